@@ -0,0 +1,100 @@
+#ifndef V2P_ALLOCATOR_H_
+#define V2P_ALLOCATOR_H_
+
+#include "v2p_export.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Memory allocator used by the library.
+//!
+//! All the allocations of the library go through an allocator:
+//!  - the global allocator (v2p_set_allocator) by default,
+//!  - the allocator of the analyzer (v2p_new_with_allocator) for everything
+//!    allocated while it processes samples: its buffers, the candidates,
+//!    the spectrums and the temporary buffers of the algorithms.
+//! The shared caches (windows, fft plans) always use the global allocator,
+//! since they outlive the analyzers.
+//!
+//! The three functions are required. They receive user_data as first
+//! argument. The structure is referenced, not copied: it must stay valid as
+//! long as memory allocated with it is alive.
+struct v2p_allocator {
+  void* (*malloc)(void* user_data, size_t size);
+  void* (*realloc)(void* user_data, void* ptr, size_t size);
+  void (*free)(void* user_data, void* ptr);
+  void* user_data;
+};
+typedef struct v2p_allocator v2p_allocator_t;
+
+//! Allocator calling malloc, realloc and free of the C library
+extern const v2p_allocator_t SYMPH_API v2p_default_allocator;
+
+//! Replace the global allocator. NULL restores v2p_default_allocator.
+//! It should be called before anything is allocated by the library
+//! (analyzers, descriptors, arrays), and not concurrently with other calls.
+//! Memory is freed by the allocator which allocated it, so set the allocator
+//! back only once this memory has been released.
+void SYMPH_API v2p_set_allocator(const v2p_allocator_t* allocator);
+//! Return the global allocator.
+const v2p_allocator_t SYMPH_API* v2p_get_allocator(void);
+
+//
+// Internal implementation
+//
+
+//! Bump allocator over a block allocated once, used for the temporary
+//! buffers of the real-time mode (see v2p_prepare).
+//! free does nothing: all the memory is given back at once by
+//! v2p_arena_reset. An allocation which doesn't fit returns NULL.
+//!
+//! An arena initialized with a null capacity measures instead: it forwards
+//! the allocations to its parent and records the capacity a bump allocator
+//! would have needed (peak).
+struct v2p_arena {
+  //! Use &arena->allocator as any other allocator
+  v2p_allocator_t allocator;
+  const v2p_allocator_t* parent;
+  char* data;
+  size_t capacity;
+  //! Bytes used since the last reset, and maximum reached
+  size_t used;
+  size_t peak;
+  //! Number of allocations which didn't fit since the last reset
+  unsigned int nb_failures;
+};
+
+//! @return 0 on success, or -1 if the block can't be allocated.
+int v2p_arena_init(struct v2p_arena* arena, const v2p_allocator_t* parent, size_t capacity);
+//! Give back all the memory allocated from the arena.
+void v2p_arena_reset(struct v2p_arena* arena);
+//! Free the block of the arena.
+void v2p_arena_release(struct v2p_arena* arena);
+
+//! Allocator used by the current thread: the one selected by
+//! v2p_allocator_enter, or the global allocator.
+const v2p_allocator_t* v2p_current_allocator(void);
+//! Use `allocator` for the allocations of the current thread until
+//! v2p_allocator_leave is called with the returned value.
+const v2p_allocator_t* v2p_allocator_enter(const v2p_allocator_t* allocator);
+void v2p_allocator_leave(const v2p_allocator_t* previous);
+
+//! Allocate with the current allocator. Same semantic as the C library.
+void* v2p_malloc(size_t size);
+void* v2p_calloc(size_t nb, size_t size);
+void* v2p_realloc(void* ptr, size_t size);
+void v2p_free(void* ptr);
+
+//! Allocate with an explicit allocator
+void* v2p_allocator_malloc(const v2p_allocator_t* allocator, size_t size);
+void* v2p_allocator_calloc(const v2p_allocator_t* allocator, size_t nb, size_t size);
+void* v2p_allocator_realloc(const v2p_allocator_t* allocator, void* ptr, size_t size);
+void v2p_allocator_free(const v2p_allocator_t* allocator, void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !V2P_ALLOCATOR_H_ */
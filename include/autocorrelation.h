@@ -7,6 +7,9 @@
 extern "C" {
 #endif
 
+// All the functions of this file are reentrant: they only read their inputs
+// and write the buffers they return (or the window_ac reference given).
+
 //! Compute autocorrelation of the frame_in window of size size_in.
 //! @return allocated string of size size_out.
 float SYMPH_API* compute_autocorrelation(float* frame_in, unsigned int size_in, unsigned int* size_out);
@@ -14,6 +17,29 @@ float SYMPH_API* compute_autocorrelation(float* frame_in, unsigned int size_in,
 //! Same as compute_autocorrelation but faster because of the abscense of normalization
 float SYMPH_API* compute_unnormalized_autocorrelation(float* frame_in, unsigned int size_in, unsigned int* size_out);
 
+//! Same as compute_unnormalized_autocorrelation, but the frame is padded
+//! with zeros up to ac_length (an even length above or equal to
+//! 2 * size_in - 1) instead of the default autocorrelation_length(size_in).
+float SYMPH_API* compute_unnormalized_autocorrelation_with_length(float* frame_in, unsigned int size_in,
+  unsigned int ac_length, unsigned int* size_out);
+
+//! Length of the zero padded buffer transformed to compute the
+//! autocorrelation of a frame of size size_in.
+//! It's the length above or equal to 2 * size_in - 1 with the cheapest
+//! transform (see fft_fast_size), so it isn't always a power of two.
+unsigned int SYMPH_API autocorrelation_length(unsigned int size_in);
+
+//! Remove the mean of frame_in, apply the window and pad with zeros,
+//! in a single pass writing into out (length floats, length >= size_in).
+void SYMPH_API compute_windowed_frame(float* out, const float* frame_in,
+  const float* window_in, unsigned int size_in, unsigned int length);
+
+//! Write scale times the power density of a realft output into out.
+//! Imaginary parts are set to 0, so out can be transformed back by realft
+//! to get an autocorrelation. out can be equal to fft.
+void SYMPH_API compute_power_density(float* out, const float* fft,
+  unsigned int length, float scale);
+
 //! Compute autocorrelation of frame_in with the window window_in.
 //! Both argument should have a size of size_in.
 //!
@@ -43,6 +69,66 @@ float SYMPH_API* compute_corrected_autocorrelation_and_fft(
   unsigned int size_in,
   unsigned int* size_out);
 
+//! Batched version of compute_corrected_autocorrelation.
+//!
+//! Compute the corrected autocorrelation of nb_frames frames at once.
+//! The frames are transformed FFT_BATCH_BLOCK by FFT_BATCH_BLOCK with
+//! realft_batch, so that the transforms run on full SIMD registers.
+//! When autocorrelation_length(size_in) isn't a power of two, the frames
+//! are transformed one by one.
+//! The frames can come from one stream or from different streams, as long
+//! as they share the same size and window.
+//!
+//! @param frames_in Array of nb_frames pointers to frames of size size_in.
+//! @param window_in Window to apply before computing autocorrelation.
+//! @param window_ac Optional reference to autocorrelation of the window
+//!                  (same semantic as in compute_corrected_autocorrelation).
+//! @param[out] size_out The size of each autocorrelation computed.
+//! @return An allocated array of nb_frames * size_out floats. The
+//!         autocorrelation of the frame k starts at index k * size_out.
+float SYMPH_API* compute_corrected_autocorrelation_batch(
+  float** frames_in,
+  unsigned int nb_frames,
+  float* window_in,
+  float** window_ac /* = NULL */,
+  unsigned int size_in,
+  unsigned int* size_out);
+
+//! Same as compute_corrected_autocorrelation_batch, without the division
+//! by the autocorrelation of the window: the unnormalized autocorrelations
+//! of the windowed frames, truncated to the lags which can be corrected.
+//! Callers dividing on the fly save a pass over the autocorrelations.
+float SYMPH_API* compute_autocorrelation_head_batch(
+  float** frames_in,
+  unsigned int nb_frames,
+  const float* window_in,
+  unsigned int size_in,
+  unsigned int* size_out);
+
+//! Time domain version of compute_corrected_autocorrelation.
+//!
+//! Only the lag 0 and the lags in [min_lag, max_lag] are computed, with
+//! dot products between the windowed frame and its shifted copy. When few
+//! lags are needed this is cheaper than the two transforms of the FFT path,
+//! and the values match the ones of compute_corrected_autocorrelation.
+//!
+//! @param window_ac Optional autocorrelation of the window as computed by
+//!                  the FFT path (unnormalized, autocorrelation_length(size_in)
+//!                  padding). If NULL, the required lags of the window
+//!                  autocorrelation are computed in the time domain too.
+//! @param[out] size_out Same size as compute_corrected_autocorrelation.
+//!                      max_lag is clamped to size_out - 1.
+//! @return An allocated array of size_out floats. The lags which are not
+//!         computed are set to 0.
+float SYMPH_API* compute_corrected_autocorrelation_direct(
+  const float* frame_in,
+  const float* window_in,
+  const float* window_ac /* = NULL */,
+  unsigned int size_in,
+  unsigned int min_lag,
+  unsigned int max_lag,
+  unsigned int* size_out);
+
 //! Compute the next power of 2 of a positive integer
 //! @param v Positive integer above or equal to 2
 unsigned int SYMPH_API next_power_of_two(unsigned int v);
@@ -0,0 +1,54 @@
+#ifndef V2P_BACKPOINTERS_H_
+#define V2P_BACKPOINTERS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Size in bytes of a page of back-pointers
+#define BACKPOINTERS_PAGE_SIZE 65536
+
+//! Back-pointers of the Viterbi path: for each timestep (row) and each of
+//! the nb_states candidates, the index of the best candidate of the
+//! previous timestep.
+//!
+//! They are packed with the narrowest width which fits nb_states (4, 8, 16
+//! or 32 bits) in pages of BACKPOINTERS_PAGE_SIZE bytes, so that long files
+//! neither store 32 bits per index nor reallocate a growing array.
+//! The memory goes through the current allocator (see allocator.h).
+struct backpointers {
+  unsigned int nb_states;
+  //! Bits per index
+  unsigned int bits;
+  //! Bytes per row
+  unsigned int row_size;
+  unsigned int rows_per_page;
+  //! Number of rows stored
+  unsigned int nb_rows;
+  //! Stretchy buffer of the pages allocated
+  unsigned char** pages;
+};
+
+//! Initialize an empty storage for indexes in [0, nb_states).
+void backpointers_init(struct backpointers* bp, unsigned int nb_states);
+//! Free the pages. The storage can be initialized again.
+void backpointers_clear(struct backpointers* bp);
+//! Allocate the pages required to store nb_rows rows.
+//! @return false on allocation failure.
+bool backpointers_reserve(struct backpointers* bp, unsigned int nb_rows);
+//! Append a row of nb_states indexes.
+//! @return false on allocation failure.
+bool backpointers_push(struct backpointers* bp, const unsigned int* row);
+//! Index of the state k of the given row
+unsigned int backpointers_get(const struct backpointers* bp, unsigned int row, unsigned int k);
+//! Memory used by the pages, in bytes.
+size_t backpointers_memory(const struct backpointers* bp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !V2P_BACKPOINTERS_H_ */
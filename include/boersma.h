@@ -2,17 +2,32 @@
 #define PDA_H_
 
 #include "v2p.h"
+#include "window_cache.h"
 #include "v2p_export.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+//! Method used by boersma to compute the autocorrelation of the frames
+enum boersma_autocorrelation_method {
+  //! Chosen by a cost model when the settings of the analyzer are applied
+  BOERSMA_AUTOCORRELATION_AUTO = 0,
+  //! Two FFTs. The spectrum is shared with the other algorithms.
+  BOERSMA_AUTOCORRELATION_FFT,
+  //! Dot products over the lags of the frequency range only
+  BOERSMA_AUTOCORRELATION_DIRECT
+};
+
 struct algorithm_descriptor_boersma;
 struct algorithm_descriptor_boersma_unvoiced;
 typedef struct algorithm_descriptor_boersma algorithm_descriptor_boersma_t;
 typedef struct algorithm_descriptor_boersma_unvoiced algorithm_descriptor_boersma_unvoiced_t;
 
+// A descriptor belongs to the analyzer it's registered into, and is used
+// from the thread of this analyzer only. The windows it references are
+// shared (read only) with the other descriptors of the same frame size.
+
 //! Allocate a boersma structure and initialize it
 //! @param frame_size You can pass 0 for default value. Default value is 2048.
 //! @param nb_candidates You can pass 0 for default value.
@@ -27,6 +42,25 @@ candidate_t SYMPH_API* generate_boersma_candidates(
   pitch_analyzer_t* s,
   algorithm_descriptor_boersma_t* ad,
   float* frame_in);
+//! Same as generate_boersma_candidates, writing the candidates in place
+//! (ad->parent.emit_candidates): the best out->size local maximums of the
+//! autocorrelation are inserted by decreasing weight, without sorting all
+//! the lags.
+void SYMPH_API emit_boersma_candidates(
+  pitch_analyzer_t* s,
+  algorithm_descriptor_boersma_t* ad,
+  float* frame_in,
+  struct candidate_slice* out);
+//! Batched version of generate_boersma_candidates.
+//! The autocorrelations of the frames are computed together with
+//! compute_corrected_autocorrelation_batch.
+//! @return Allocated array of nb_frames * ad->parent.nb_candidates_per_step
+//!         candidates, frame after frame.
+candidate_t SYMPH_API* generate_boersma_candidates_batch(
+  pitch_analyzer_t* s,
+  algorithm_descriptor_boersma_t* ad,
+  float** frames_in,
+  unsigned int nb_frames);
 //! Generate the unvoiced candidate
 //! The number of candidats is ad->parent.nb_candidates_per_step == 1
 //! @return Allocated array of length 1
@@ -34,6 +68,34 @@ candidate_t* generate_boersma_unvoiced_candidates(
     pitch_analyzer_t* s,
     algorithm_descriptor_boersma_unvoiced_t* ad,
     float* frame_in);
+//! Same as generate_boersma_unvoiced_candidates, writing the candidate
+//! in place (ad->parent.emit_candidates and emit_silence_candidates).
+void emit_boersma_unvoiced_candidates(
+    pitch_analyzer_t* s,
+    algorithm_descriptor_boersma_unvoiced_t* ad,
+    float* frame_in,
+    struct candidate_slice* out);
+//! Batched version of generate_boersma_unvoiced_candidates.
+//! @return Allocated array of nb_frames candidates
+candidate_t* generate_boersma_unvoiced_candidates_batch(
+    pitch_analyzer_t* s,
+    algorithm_descriptor_boersma_unvoiced_t* ad,
+    float** frames_in,
+    unsigned int nb_frames);
+//! Apply the settings of the analyzer (ad->parent.prepare).
+//! When ad->autocorrelation_method is BOERSMA_AUTOCORRELATION_AUTO, choose
+//! between the FFT and the direct autocorrelation from the number of lags
+//! in [sampling_rate / maximal_frequency, sampling_rate / minimal_frequency].
+void SYMPH_API boersma_prepare(pitch_analyzer_t* s, algorithm_descriptor_boersma_t* ad);
+//! Mix the settings of the descriptor into the key of the candidate cache
+//! (ad->parent.hash_settings).
+uint64_t boersma_hash_settings(algorithm_descriptor_boersma_t* ad, uint64_t hash);
+//! Same as boersma_hash_settings for the unvoiced candidate
+uint64_t boersma_unvoiced_hash_settings(algorithm_descriptor_boersma_unvoiced_t* ad, uint64_t hash);
+//! Bytes held by the descriptor and its shared window (ad->parent.memory_usage)
+size_t boersma_memory_usage(algorithm_descriptor_boersma_t* ad);
+//! Same as boersma_memory_usage for the unvoiced candidate
+size_t boersma_unvoiced_memory_usage(algorithm_descriptor_boersma_unvoiced_t* ad);
 //! Cut a frame from a stream and an index.
 //! Return NULL if more data to the stream are required,
 //! or a pointer inside the audio_buffer otherwise.
@@ -57,14 +119,21 @@ struct algorithm_descriptor_boersma {
   //! Parent algorithm descriptor (C inheritance)
   struct algorithm_descriptor parent;
 
-  //! Window used for voinced frames
+  //! Window used for voinced frames (shared, read only)
   float* voiced_window;
-  //! Autocorrelation of the voiced_window
+  //! Autocorrelation of the voiced_window (shared, read only)
   float* voiced_window_ac;
+  //! Reference to the cache entry owning voiced_window and voiced_window_ac
+  const shared_window_t* voiced_window_ref;
   //! Window used for HNR frames
   float* hnr_window;
   //! Autocorrelation of the hnr_window
   float* hnr_window_ac;
+  //! Method requested to compute the autocorrelation. Default is
+  //! BOERSMA_AUTOCORRELATION_AUTO. Call v2p_reset after changing it.
+  enum boersma_autocorrelation_method autocorrelation_method;
+  //! Method chosen by boersma_prepare: non zero for the direct autocorrelation
+  int direct_autocorrelation;
 };
 
 //! Describe the characteristics of a boersma algorithm instance
@@ -0,0 +1,89 @@
+#ifndef V2P_CANDIDATE_CACHE_H_
+#define V2P_CANDIDATE_CACHE_H_
+
+#include "v2p.h"
+#include "v2p_export.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Candidate cache
+//!
+//! The candidates of an audio file only depend on the samples, on the
+//! settings of the analyzer used by the algorithms and on the algorithms.
+//! They can be saved in a cache file and mapped back in memory, so that
+//! tuning the costs of the Viterbi decoding (octave_jump_cost,
+//! voiced_unvoiced_cost, compute_transition_cost) doesn't run the
+//! algorithms again. octave_cost is applied to the weights of the
+//! candidates: changing it changes the key.
+//!
+//! A file holds a v2p_cache_header followed by the chunks of the candidate
+//! store, as they are in memory, so that they are used from the mapping
+//! without copy. The byte order and the size of the chunks are the ones
+//! of the host which wrote it; a file from another version or byte order
+//! is a cache miss.
+
+//! Version of the file format, incremented when it or the algorithms change
+#define V2P_CACHE_VERSION 1
+//! Initial value of a v2p_hash_bytes hash
+#define V2P_HASH_INIT 14695981039346656037ULL
+
+//! Header of a cache file
+struct v2p_cache_header {
+  //! "V2PC"
+  char magic[4];
+  uint32_t version;
+  uint32_t header_size;
+  //! 0x01020304 written in the byte order of the host
+  uint32_t byte_order;
+  uint64_t key;
+  uint32_t nb_candidates_per_step;
+  uint32_t number_of_timesteps;
+  uint32_t steps_per_chunk;
+  uint32_t nb_chunks;
+  uint32_t frame_step_size;
+  float sampling_rate;
+  float frame_time_step;
+  uint32_t reserved[3];
+};
+
+//! Mix size bytes into a hash (64 bits FNV-1a)
+uint64_t SYMPH_API v2p_hash_bytes(uint64_t hash, const void* data, size_t size);
+//! Key of the candidates of the audio buffer analyzed by s: hash of the
+//! samples, of the settings of s used by the algorithms and of the
+//! registered algorithms (algorithm_descriptor::hash_settings).
+//! @return 0 if an algorithm can't be cached.
+uint64_t SYMPH_API v2p_cache_key(pitch_analyzer_t* s, const float* audio, unsigned int size);
+//! Write the candidates of s in a cache file, with the given key.
+//! The file is written under a temporary name, then renamed.
+//! @return V2P_OK or V2P_ERROR_IO.
+int SYMPH_API v2p_cache_write(pitch_analyzer_t* s, const char* path, uint64_t key);
+//! Reset s and map the candidates of a cache file written with the same
+//! key, algorithms and sampling. Afterward, s only decodes: v2p_compute_path
+//! and v2p_compute_path_parallel work on the mapped candidates, and adding
+//! samples is refused until the next v2p_reset.
+//! @return V2P_OK, V2P_ERROR_CACHE_MISS if the file doesn't exist or doesn't
+//!         match, or V2P_ERROR_OUT_OF_MEMORY.
+int SYMPH_API v2p_cache_load(pitch_analyzer_t* s, const char* path, uint64_t key);
+//! Same as v2p_run on a reset analyzer, with the candidates cached in
+//! `directory` (which must exist): on a hit the algorithms aren't run,
+//! on a miss the candidates are computed and written.
+//! @return Same as v2p_run. A failure to write the cache is ignored.
+int SYMPH_API v2p_run_cached(pitch_analyzer_t* s, float* audio, unsigned int size,
+  const char* directory);
+
+//
+// Internal implementation
+//
+
+//! Unmap the cache file used by s, if any. Called by v2p_reset.
+void v2p_cache_unmap(pitch_analyzer_t* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !V2P_CANDIDATE_CACHE_H_ */
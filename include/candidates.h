@@ -0,0 +1,86 @@
+#ifndef V2P_CANDIDATES_H_
+#define V2P_CANDIDATES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct candidate;
+
+//! Number of candidates stored in a chunk
+#define CANDIDATES_CHUNK_SIZE 4096
+
+//! Candidates of a timestep, or of an algorithm inside a timestep.
+//! The frequencies and the weights are stored in separate arrays of `size`
+//! elements. An unvoiced candidate has a null frequency.
+struct candidate_slice {
+  float* frequency;
+  float* weight;
+  //! log2 of the frequencies, 0 for unvoiced candidates.
+  //! Filled by candidates_finish_step: algorithms don't write it.
+  float* log2_frequency;
+  unsigned int size;
+};
+
+//! Candidates of all the timesteps: candidate[nb_steps][nb_per_step].
+//!
+//! They are stored by chunks of steps_per_chunk timesteps, so that the
+//! store grows without moving what is already stored. Inside a chunk, the
+//! frequencies, the weights and the log2 of the frequencies are stored in
+//! three arrays, which the Viterbi algorithm loads contiguously.
+//! The memory goes through the current allocator (see allocator.h).
+struct candidate_store {
+  unsigned int nb_per_step;
+  unsigned int steps_per_chunk;
+  //! Number of timesteps stored
+  unsigned int nb_steps;
+  //! Stretchy buffer of the chunks allocated. A chunk is a block of
+  //! 3 * steps_per_chunk * nb_per_step floats: frequencies, weights, log2.
+  float** chunks;
+  //! The chunks belong to a mapped cache file (see candidate_cache.h):
+  //! they are read only and not freed by candidates_clear.
+  bool borrowed;
+};
+
+//! Initialize an empty store of nb_per_step candidates per timestep.
+void candidates_init(struct candidate_store* store, unsigned int nb_per_step);
+//! Free the chunks (unless borrowed). The store can be initialized again.
+void candidates_clear(struct candidate_store* store);
+//! Allocate the chunks required to store nb_steps timesteps.
+//! @return false on allocation failure.
+bool candidates_reserve(struct candidate_store* store, unsigned int nb_steps);
+//! Append a timestep of unvoiced candidates with a null weight, and
+//! return its candidates in `step`, to be written by the algorithms.
+//! @return false on allocation failure.
+bool candidates_add_step(struct candidate_store* store, struct candidate_slice* step);
+//! Compute the log2 of the frequencies of the last timestep, once all the
+//! algorithms wrote their candidates.
+void candidates_finish_step(struct candidate_store* store);
+//! Candidates of the timestep t
+void candidates_step(const struct candidate_store* store, unsigned int t,
+  struct candidate_slice* step);
+//! Candidate k of the timestep t
+struct candidate candidates_get(const struct candidate_store* store, unsigned int t,
+  unsigned int k);
+//! Copy all the candidates, timestep after timestep, into `out` which
+//! holds candidates_count candidates.
+void candidates_copy(const struct candidate_store* store, struct candidate* out);
+//! Total number of candidates stored
+size_t candidates_count(const struct candidate_store* store);
+//! Memory used by the chunks, in bytes.
+size_t candidates_memory(const struct candidate_store* store);
+
+//! Sub slice of `size` candidates starting at `offset`
+void candidate_slice_sub(const struct candidate_slice* slice, unsigned int offset,
+  unsigned int size, struct candidate_slice* out);
+//! Copy an array of slice->size candidates into the slice
+void candidate_slice_assign(struct candidate_slice* slice, const struct candidate* candidates);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !V2P_CANDIDATES_H_ */
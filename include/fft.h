@@ -7,6 +7,9 @@
 extern "C" {
 #endif
 
+// All the transforms are reentrant. The sinus table used by realft and dfft
+// is filled once, under a once-guard, by the first transform.
+
 enum fft_isign {
   FFT_FORWARD = 1,
   FFT_INVERSE = -1
@@ -28,6 +31,91 @@ void SYMPH_API dfft(float data[], unsigned int nn, enum fft_isign isign);
 // For inverse fourier, coefficients should be multiplied by 2/n.
 void SYMPH_API realft(float data[], unsigned int nn, enum fft_isign isign);
 
+// Work skipped by the pruned transforms. The autocorrelation transforms
+// a frame padded with at least as many zeros as samples, and only reads
+// the first quarter of the inverse transform.
+enum fft_pruning {
+  FFT_PRUNE_NONE = 0,
+  // Forward transform: the second half of the real input is zero.
+  // The first butterfly stage becomes a copy.
+  FFT_PRUNE_ZERO_PADDED = 1,
+  // Inverse transform: only the first quarter of the real output is used,
+  // the rest is left undefined. The last two butterfly stages only compute
+  // the outputs needed.
+  FFT_PRUNE_FIRST_QUARTER = 2
+};
+
+// Same as realft, skipping the work allowed by pruning (a combination of
+// enum fft_pruning). Flags which don't apply to isign are ignored.
+void SYMPH_API realft_pruned(float data[], unsigned int nn, enum fft_isign isign, unsigned int pruning);
+
+// Number of frames transformed together by the batched routines
+// when the caller does not have a better choice (one AVX register of floats).
+#define FFT_BATCH_BLOCK 8
+
+// Batched version of dfft.
+// Transform `batch` independent complex arrays of size nn at once.
+// The arrays are interleaved across frames: the real part of the
+// k-th complex of frame b is data[2*k*batch + b] and its imaginary
+// part is data[(2*k+1)*batch + b]. The innermost loops run over
+// the frames and are contiguous in memory, so they are vectorized
+// whatever the size of the transform.
+void SYMPH_API dfft_batch(float data[], unsigned int nn, unsigned int batch, enum fft_isign isign);
+
+// Batched version of realft.
+// Transform `batch` real arrays of size nn stored interleaved across
+// frames: the i-th value of frame b is data[i*batch + b].
+// The output of each frame has the same layout as realft's one.
+void SYMPH_API realft_batch(float data[], unsigned int nn, unsigned int batch, enum fft_isign isign);
+// Batched version of realft_pruned.
+void SYMPH_API realft_batch_pruned(float data[], unsigned int nn, unsigned int batch,
+  enum fft_isign isign, unsigned int pruning);
+
+// Copy the nb_frames arrays of frames (each of size `size`) into data
+// with the layout expected by realft_batch.
+void SYMPH_API fft_batch_interleave(float* data, float** frames, unsigned int size, unsigned int nb_frames);
+// Copy back the frames from the layout used by realft_batch.
+void SYMPH_API fft_batch_deinterleave(float** frames, float* data, unsigned int size, unsigned int nb_frames);
+
+//
+// Transforms of any even size
+//
+// realft and dfft only support powers of two. Plans allow to compute real
+// transforms of any even size n: the complex transform of size n/2 is
+// computed with a mixed radix (2, 3, 4, 5) Stockham algorithm when n/2 only
+// has those prime factors, and with the Bluestein algorithm otherwise.
+//
+
+struct fft_plan;
+typedef struct fft_plan fft_plan_t;
+
+// Return the plan of real transforms of size n (n even).
+// Plans are immutable and shared through a process-wide registry
+// (protected by a mutex), so the same plan can be used by several threads.
+// Return NULL if n is odd or on allocation failure.
+const fft_plan_t SYMPH_API* fft_plan_acquire(unsigned int n);
+// Release a plan returned by fft_plan_acquire.
+void SYMPH_API fft_plan_release(const fft_plan_t* plan);
+// Size of the transforms computed by the plan.
+unsigned int SYMPH_API fft_plan_size(const fft_plan_t* plan);
+// Number of floats of the scratch buffer required by fft_plan_realft.
+unsigned int SYMPH_API fft_plan_scratch_size(const fft_plan_t* plan);
+// Same as realft, for the size of the plan.
+// scratch should hold fft_plan_scratch_size(plan) floats. It can be NULL
+// if the scratch size is 0 (power of two sizes).
+void SYMPH_API fft_plan_realft(const fft_plan_t* plan, float data[], float* scratch, enum fft_isign isign);
+// Same as fft_plan_realft. The pruning (see realft_pruned) is only applied
+// to power of two sizes, other sizes compute the full transform.
+void SYMPH_API fft_plan_realft_pruned(const fft_plan_t* plan, float data[], float* scratch,
+  enum fft_isign isign, unsigned int pruning);
+// Same as realft for any even size n.
+// Convenience function which acquires a plan and allocates the scratch
+// buffer at each call when n isn't a power of two.
+void SYMPH_API realft_any(float data[], unsigned int n, enum fft_isign isign);
+// Return the even size above or equal to n with the cheapest transform.
+// Sizes with prime factors above 5 are never returned.
+unsigned int SYMPH_API fft_fast_size(unsigned int n);
+
 // Fill window with a hann window
 void SYMPH_API compute_hann(float* window, unsigned int window_size);
 // Fill window with a hamming window
@@ -2,6 +2,7 @@
 #define PDA_MAXFREQ_H_
 
 #include "v2p.h"
+#include "window_cache.h"
 #include "v2p_export.h"
 
 #ifdef __cplusplus
@@ -12,16 +13,16 @@ struct algorithm_descriptor_maxfreq;
 typedef struct algorithm_descriptor_maxfreq algorithm_descriptor_maxfreq_t;
 
 //! Allocate a maxfreq struct and initialize it
-//! This algorithm is implemented to be run with a boersma instance.
-//! The frame_size should be the same as the boersma instance.
+//! Like boersma descriptors, it belongs to a single analyzer.
+//! When it runs with a boersma instance of the same frame_size,
+//! the spectrum of the frame is computed only once.
 algorithm_descriptor_maxfreq_t SYMPH_API* maxfreq_new(uint frame_size);
 //! Delete the Algorithm Descriptor
 void SYMPH_API maxfreq_delete(algorithm_descriptor_maxfreq_t* ad);
 
 //! Max Frequency observed in the FFT.
-//! Rely on boersma implementation which updates `s->last_fft`.
-//! Therefore, this algorithm should be added befor a boersma instance.
-//! (The insertion order is reversed to the running order)
+//! The FFT of the Hann windowed frame is requested from `s->spectrum`,
+//! so the registration order of the algorithms doesn't matter.
 //!
 //! Compute a stream of candidates.
 //! The number of candidats is in ad->parent.nb_candidates_per_step
@@ -31,10 +32,27 @@ candidate_t SYMPH_API* generate_maxfreq_candidates(
   algorithm_descriptor_maxfreq_t* ad,
   float* frame_in);
 
+//! Same as generate_maxfreq_candidates, writing the candidate in place
+//! (ad->parent.emit_candidates).
+void SYMPH_API emit_maxfreq_candidates(
+  pitch_analyzer_t*,
+  algorithm_descriptor_maxfreq_t* ad,
+  float* frame_in,
+  struct candidate_slice* out);
+
+//! Mix the settings of the descriptor into the key of the candidate cache
+//! (ad->parent.hash_settings).
+uint64_t maxfreq_hash_settings(algorithm_descriptor_maxfreq_t* ad, uint64_t hash);
+//! Bytes held by the descriptor and its shared window (ad->parent.memory_usage)
+size_t maxfreq_memory_usage(algorithm_descriptor_maxfreq_t* ad);
+
 //! Describe the characteristics of a boersma algorithm instance
 struct algorithm_descriptor_maxfreq {
     //! Parent algorithm descriptor (C inheritance)
     struct algorithm_descriptor parent;
+
+    //! Window applied befor the FFT (shared)
+    const shared_window_t* window;
 };
 
 
@@ -0,0 +1,69 @@
+#ifndef SPECTRUM_H_
+#define SPECTRUM_H_
+
+#include "window_cache.h"
+#include "v2p_export.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct spectral_context;
+typedef struct spectral_context spectral_context_t;
+
+//! Allocate an empty spectral analysis context.
+//!
+//! A context memoizes, for the current timestep, the representations of the
+//! frames computed by the algorithms: windowed spectrum, power spectrum,
+//! autocorrelation and corrected autocorrelation.
+//! Every algorithm can request the representation it needs, the first
+//! request computes it and the following ones reuse it, whatever the
+//! order in which the algorithms are registered.
+//!
+//! Representations are keyed by (frame, frame size, window). The buffers
+//! are owned by the context and reused from a timestep to the next one.
+//! A context isn't thread safe: it belongs to a single analyzer.
+spectral_context_t SYMPH_API* spectral_context_new(void);
+//! Free the context and all its buffers.
+void SYMPH_API spectral_context_delete(spectral_context_t* ctx);
+//! Bytes held by the context: its entries and their buffers.
+size_t SYMPH_API spectral_context_memory(const spectral_context_t* ctx);
+//! Invalidate all the memoized representations.
+//! Called by the pitch analyzer befor each timestep. Should be called by
+//! hand if a frame is modified in place between two requests.
+void SYMPH_API spectral_context_next_step(spectral_context_t* ctx);
+
+//! Real FFT (realft layout) of the frame, once its mean removed,
+//! the window applied and padded with window->padding zeros.
+//! @param[out] fft_size Number of floats of the returned buffer.
+//! @return A buffer owned by the context, valid until the next step.
+const float SYMPH_API* spectral_context_fft(spectral_context_t* ctx,
+  const float* frame, const shared_window_t* window, unsigned int* fft_size);
+//! Power spectrum of the windowed frame, in realft layout:
+//! the imaginary coefficients are zeros.
+//! @param[out] size Number of floats of the returned buffer.
+const float SYMPH_API* spectral_context_power_spectrum(spectral_context_t* ctx,
+  const float* frame, const shared_window_t* window, unsigned int* size);
+//! Unnormalized autocorrelation of the windowed frame.
+//! @param[out] size_out Number of lags of the returned buffer.
+const float SYMPH_API* spectral_context_autocorrelation(spectral_context_t* ctx,
+  const float* frame, const shared_window_t* window, unsigned int* size_out);
+//! First lags of the unnormalized autocorrelation of the windowed frame,
+//! the ones which can be divided by the autocorrelation of the window.
+//! Cheaper than spectral_context_autocorrelation: the inverse transform is
+//! pruned. Callers dividing by window->window_ac on the fly save the pass of
+//! spectral_context_corrected_autocorrelation.
+//! @param[out] size_out Number of lags of the returned buffer.
+const float SYMPH_API* spectral_context_autocorrelation_head(spectral_context_t* ctx,
+  const float* frame, const shared_window_t* window, unsigned int* size_out);
+//! Autocorrelation of the windowed frame divided by the autocorrelation of
+//! the window (same values as compute_corrected_autocorrelation).
+//! @param[out] size_out Number of lags of the returned buffer.
+const float SYMPH_API* spectral_context_corrected_autocorrelation(spectral_context_t* ctx,
+  const float* frame, const shared_window_t* window, unsigned int* size_out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !SPECTRUM_H_ */
@@ -0,0 +1,102 @@
+#ifndef V2P_SYNC_H_
+#define V2P_SYNC_H_
+
+// Minimal portable synchronisation primitives used internally by the library.
+//
+// v2p_mutex_t protects the process-wide registries (shared windows, fft
+// plans). v2p_once runs the initialization of immutable global tables
+// exactly once, whatever the number of threads calling it.
+// v2p_thread_t runs the workers of the parallel decoder: their routine is
+// declared with V2P_THREAD_ROUTINE and returns V2P_THREAD_RETURN.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Storage class of the variables with one instance per thread
+#if defined _MSC_VER
+  #define V2P_THREAD_LOCAL __declspec(thread)
+#elif defined __STDC_VERSION__ && __STDC_VERSION__ >= 201112L
+  #define V2P_THREAD_LOCAL _Thread_local
+#else
+  #define V2P_THREAD_LOCAL __thread
+#endif
+
+#if defined _WIN32 || defined _WIN64
+  #include <windows.h>
+
+  typedef SRWLOCK v2p_mutex_t;
+  #define V2P_MUTEX_INITIALIZER SRWLOCK_INIT
+
+  static inline void v2p_mutex_lock(v2p_mutex_t* m) { AcquireSRWLockExclusive(m); }
+  static inline void v2p_mutex_unlock(v2p_mutex_t* m) { ReleaseSRWLockExclusive(m); }
+
+  typedef INIT_ONCE v2p_once_t;
+  #define V2P_ONCE_INIT INIT_ONCE_STATIC_INIT
+
+  static BOOL CALLBACK __v2p_once_trampoline(PINIT_ONCE once, PVOID routine, PVOID* context) {
+    (void)once;
+    (void)context;
+    ((void (*)(void))routine)();
+    return TRUE;
+  }
+  static inline void v2p_once(v2p_once_t* once, void (*routine)(void)) {
+    InitOnceExecuteOnce(once, __v2p_once_trampoline, (PVOID)routine, NULL);
+  }
+
+  typedef HANDLE v2p_thread_t;
+  #define V2P_THREAD_ROUTINE(name, arg) DWORD WINAPI name(LPVOID arg)
+  #define V2P_THREAD_RETURN 0
+  typedef LPTHREAD_START_ROUTINE v2p_thread_routine_t;
+
+  //! @return 0 on success
+  static inline int v2p_thread_create(v2p_thread_t* thread, v2p_thread_routine_t routine, void* arg) {
+    *thread = CreateThread(NULL, 0, routine, arg, 0, NULL);
+    return *thread ? 0 : -1;
+  }
+  static inline void v2p_thread_join(v2p_thread_t thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+  }
+  static inline unsigned int v2p_nb_processors(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+  }
+#else
+  #include <pthread.h>
+
+  typedef pthread_mutex_t v2p_mutex_t;
+  #define V2P_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+
+  static inline void v2p_mutex_lock(v2p_mutex_t* m) { pthread_mutex_lock(m); }
+  static inline void v2p_mutex_unlock(v2p_mutex_t* m) { pthread_mutex_unlock(m); }
+
+  typedef pthread_once_t v2p_once_t;
+  #define V2P_ONCE_INIT PTHREAD_ONCE_INIT
+
+  static inline void v2p_once(v2p_once_t* once, void (*routine)(void)) { pthread_once(once, routine); }
+
+  #include <unistd.h>
+
+  typedef pthread_t v2p_thread_t;
+  #define V2P_THREAD_ROUTINE(name, arg) void* name(void* arg)
+  #define V2P_THREAD_RETURN NULL
+  typedef void* (*v2p_thread_routine_t)(void*);
+
+  //! @return 0 on success
+  static inline int v2p_thread_create(v2p_thread_t* thread, v2p_thread_routine_t routine, void* arg) {
+    return pthread_create(thread, NULL, routine, arg);
+  }
+  static inline void v2p_thread_join(v2p_thread_t thread) { pthread_join(thread, NULL); }
+  static inline unsigned int v2p_nb_processors(void) {
+    const long nb = sysconf(_SC_NPROCESSORS_ONLN);
+    return nb > 0 ? (unsigned int)nb : 1;
+  }
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !V2P_SYNC_H_ */
@@ -0,0 +1,44 @@
+#ifndef V2P_TABLES_H_
+#define V2P_TABLES_H_
+
+#include "window_cache.h"
+
+// Tables generated at build time by tools/gen_tables.c and embedded read
+// only in the library (V2P_HAS_GENERATED_TABLES). Without them, or for the
+// sizes which aren't generated, the values are computed at runtime.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Smallest and largest window sizes generated (powers of two)
+#define V2P_TABLES_MIN_SIZE 512
+#define V2P_TABLES_MAX_SIZE 8192
+
+//! A precomputed window and its autocorrelation
+struct v2p_static_window {
+  enum window_type type;
+  unsigned int size;
+  //! Padded length used for the autocorrelation (autocorrelation_length(size))
+  unsigned int ac_length;
+  const float* window;
+  //! Unnormalized autocorrelation (window_ac_size elements)
+  const float* window_ac;
+  unsigned int window_ac_size;
+};
+
+//! Return the precomputed window of the given type and size,
+//! or NULL if it wasn't generated.
+const struct v2p_static_window SYMPH_API* v2p_static_window_lookup(
+  enum window_type type, unsigned int size);
+
+#ifdef V2P_HAS_GENERATED_TABLES
+//! sin(2 pi / 2^i), used by dfft and realft
+extern const double v2p_sin_table[256];
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !V2P_TABLES_H_ */
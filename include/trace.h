@@ -0,0 +1,60 @@
+#ifndef V2P_TRACE_H_
+#define V2P_TRACE_H_
+
+#include "v2p_export.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Tracing of the pipeline
+//!
+//! When the library is built with V2P_TRACE (cmake -DV2P_TRACE=ON), it
+//! records a span for the framing, each algorithm, the FFTs of the
+//! autocorrelation, the Viterbi update and the post-processing (traceback,
+//! filters, midi conversion). Each span carries the stream_id of the
+//! analyzer and the timestep being processed.
+//! Each thread records into its own buffer, without lock. v2p_trace_dump
+//! writes all the buffers as Chrome trace events (JSON), which Perfetto
+//! (ui.perfetto.dev) and chrome://tracing display.
+//!
+//! Without V2P_TRACE the macros expand to nothing: nothing is recorded and
+//! v2p_trace_dump writes an empty trace.
+
+//! Write the spans recorded so far by all the threads in a JSON file.
+//! It must not be called while a thread of the library records spans.
+//! @return V2P_OK, or V2P_ERROR_IO if the file can't be written.
+int SYMPH_API v2p_trace_dump(const char* path);
+//! Forget the spans recorded so far. Same restriction as v2p_trace_dump.
+void SYMPH_API v2p_trace_clear(void);
+//! Number of spans recorded by all the threads
+unsigned int SYMPH_API v2p_trace_nb_spans(void);
+
+//
+// Internal implementation
+//
+
+//! Monotonic time in nanoseconds
+uint64_t v2p_trace_now(void);
+//! Stream and timestep attached to the next spans of the current thread
+void v2p_trace_context(unsigned int stream, unsigned int timestep);
+//! Record a span of the current thread from `start` to now. name is a
+//! string literal: only the pointer is stored.
+void v2p_trace_record(const char* name, uint64_t start);
+
+#ifdef V2P_TRACE
+  #define V2P_TRACE_CONTEXT(stream, timestep) v2p_trace_context(stream, timestep)
+  #define V2P_TRACE_BEGIN(span) const uint64_t __trace_##span = v2p_trace_now()
+  #define V2P_TRACE_END(span, name) v2p_trace_record(name, __trace_##span)
+#else
+  #define V2P_TRACE_CONTEXT(stream, timestep) ((void)0)
+  #define V2P_TRACE_BEGIN(span) ((void)0)
+  #define V2P_TRACE_END(span, name) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !V2P_TRACE_H_ */
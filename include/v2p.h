@@ -2,6 +2,10 @@
 #define V2P_API_H_
 
 #include "v2p_export.h"
+#include "allocator.h"
+#include "backpointers.h"
+#include "candidates.h"
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -13,9 +17,14 @@ extern "C" {
 struct algorithm_descriptor;
 struct pitch_analyzer;
 struct candidate;
+struct spectral_context;
+struct v2p_cache_mapping;
+struct viterbi_costs;
+struct v2p_memory_report;
 typedef struct algorithm_descriptor algorithm_descriptor_t;
 typedef struct pitch_analyzer pitch_analyzer_t;
 typedef struct candidate candidate_t;
+typedef struct viterbi_costs viterbi_costs_t;
 typedef unsigned int uint;
 //! Stretchy buffer float array
 //! We use them to remember that the memory was allocated by a stretchy buffer.
@@ -28,32 +37,153 @@ typedef uint* sb_uint;
 typedef candidate_t* sb_candidate;
 
 //! Type of the candidate geratore calling an algorithm implementation
+//! The candidates are released with v2p_ptr_free by the analyzer:
+//! allocate them with v2p_malloc or v2p_calloc.
 typedef candidate_t* (*algorithm_t)(struct pitch_analyzer*, struct algorithm_descriptor*, float*);
+//! Type of the candidate generator writing the candidates of a frame in
+//! place, into the slice of the current timestep reserved for the algorithm
+//! (out->size == nb_candidates_per_step). The slice is initialized with
+//! unvoiced candidates with a null weight.
+typedef void (*emitter_t)(struct pitch_analyzer*, struct algorithm_descriptor*, float*,
+  struct candidate_slice* out);
+//! Type of the candidate generator running an algorithm on several frames at once.
+//! It returns nb_frames * nb_candidates_per_step candidates, frame after frame.
+typedef candidate_t* (*batch_algorithm_t)(struct pitch_analyzer*, struct algorithm_descriptor*,
+  float** frames, unsigned int nb_frames);
 //! Type of the function cuting frames from the buffer
 typedef float* (*framer_t)(struct pitch_analyzer*, struct algorithm_descriptor*,
   float* buffer, unsigned int buffer_index);
+//! Type of the function called when the settings of the analyzer are applied
+typedef void (*preparer_t)(struct pitch_analyzer*, struct algorithm_descriptor*);
+//! Type of the function mixing the settings of a descriptor into a hash
+//! (see v2p_hash_bytes in candidate_cache.h)
+typedef uint64_t (*hasher_t)(struct algorithm_descriptor*, uint64_t hash);
+//! Type of the function returning the bytes held by a descriptor
+//! (see v2p_memory_usage)
+typedef size_t (*sizer_t)(struct algorithm_descriptor*);
 //! Type of the function used to compute the cost for a transition
 //! between two candidates.
 typedef float (*coster_t)(struct pitch_analyzer*, candidate_t *first, candidate_t *second);
 
+//! Status returned by the functions which can fail
+enum v2p_status {
+  V2P_OK = 0,
+  //! An allocation failed
+  V2P_ERROR_OUT_OF_MEMORY = -1,
+  //! Invalid argument or call sequence
+  V2P_ERROR_INVALID_ARGUMENT = -2,
+  //! Real-time mode: more samples than max_block_size given at once
+  V2P_ERROR_BLOCK_TOO_LARGE = -3,
+  //! Real-time mode: max_history timesteps are stored, the following
+  //! samples aren't analyzed until v2p_reset is called
+  V2P_ERROR_HISTORY_FULL = -4,
+  //! Real-time mode: an algorithm required more temporary memory than
+  //! measured by v2p_prepare (its candidates are replaced by unvoiced ones)
+  V2P_ERROR_SCRATCH_EXHAUSTED = -5,
+  //! A file can't be read or written
+  V2P_ERROR_IO = -6,
+  //! Candidate cache: no valid file for this audio and these settings
+  V2P_ERROR_CACHE_MISS = -7
+};
+
 //
 // Functions which can be called to use the api
 //
+// Thread safety:
+// The library has no mutable global state: the global tables are filled
+// once (v2p_once) and the shared caches (windows, fft plans) are protected
+// by mutexes. Analyzers are independent, so different threads can use
+// different analyzers concurrently without locking.
+// An analyzer, and the algorithm descriptors registered into it, must not
+// be used by two threads at the same time. A descriptor belongs to a single
+// analyzer. Functions without a pitch_analyzer_t (filters, fft,
+// autocorrelation, midi conversion) only touch their arguments and are
+// reentrant.
+//
 
 //! Allocate a sylmphonia object
 //! @param timesteps Set it to 0 for default timesteps value (10ms).
 struct pitch_analyzer SYMPH_API* v2p_new(float timesteps);
+//! Same as v2p_new, but the analyzer and everything allocated while it
+//! processes samples (buffers, candidates, spectrums, temporary buffers of
+//! the algorithms) go through `allocator` (see allocator.h).
+//! The arrays returned to the user (v2p_compute_path, filters) still use
+//! the global allocator.
+//! @param allocator NULL for the global allocator.
+struct pitch_analyzer SYMPH_API* v2p_new_with_allocator(float timesteps,
+  const v2p_allocator_t* allocator);
 //! Free memory and internal substructures
 void SYMPH_API v2p_delete(pitch_analyzer_t* s);
 //! Compute internal value for the next run. This function should be called
 //! if you changed any of the values stored into s.
 void SYMPH_API v2p_reset(pitch_analyzer_t* s);
+//! Switch the analyzer to the real-time mode and apply the settings
+//! (as v2p_reset).
+//!
+//! In this mode v2p_reset preallocates everything the analyzer needs:
+//! the audio history, the candidates and back-pointers of max_history
+//! timesteps, and a scratch arena for the temporary buffers of the
+//! algorithms, sized by running them once on a test frame. Afterward,
+//! v2p_add_samples doesn't allocate nor lock, and its work is bounded by
+//! max_block_size. The consumed samples are always discarded.
+//!
+//! The algorithms must be registered before (registering another one
+//! prepares the analyzer again), and their candidates must be allocated
+//! with v2p_malloc or v2p_calloc.
+//! @return V2P_OK, or an error if the preallocation failed.
+int SYMPH_API v2p_prepare(pitch_analyzer_t* s, unsigned int max_block_size, unsigned int max_history);
 //! Compute the pitch analyzer online with new samples
-void SYMPH_API v2p_add_samples(pitch_analyzer_t* s, const float* samples_in, unsigned int size_in);
-//! Compute the pitch analyzer on the whole audio_buffer (TODO)
-void v2p_run(pitch_analyzer_t* s, float* audio_buffer, unsigned int size);
+//! @return V2P_OK, or in real-time mode V2P_ERROR_BLOCK_TOO_LARGE
+//!         (the samples are ignored), V2P_ERROR_HISTORY_FULL or
+//!         V2P_ERROR_SCRATCH_EXHAUSTED.
+int SYMPH_API v2p_add_samples(pitch_analyzer_t* s, const float* samples_in, unsigned int size_in);
+//! Compute the pitch analyzer on a whole audio buffer.
+//! Same result as v2p_add_samples, but the frames are processed by
+//! groups of V2P_RUN_BATCH timesteps when every registered algorithm
+//! provides a generate_candidates_batch implementation.
+//! In real-time mode, the buffer is given to v2p_add_samples by blocks of
+//! max_block_size samples.
+//! @return Same as v2p_add_samples.
+int SYMPH_API v2p_run(pitch_analyzer_t* s, float* audio_buffer, unsigned int size);
 //! Compute the resulting pitch path. A 0 frequency means a silence.
 float SYMPH_API* v2p_compute_path(pitch_analyzer_t*);
+//! Fixed-lag decoding of the path while samples are added: trace back the
+//! path ending on the best candidate of the last timestep, and write the
+//! frequencies of the timesteps [first, v2p_path_len - lag) into `path`.
+//! The next samples seldom change timesteps that far from the last one
+//! (20 timesteps is usually enough), while v2p_compute_path gives the
+//! final path. It doesn't allocate, and its cost is proportional to
+//! v2p_path_len - first: call it with the first timestep not written yet.
+//! @return The number of frequencies written, 0 if there is none.
+unsigned int SYMPH_API v2p_compute_path_lagged(pitch_analyzer_t* s, unsigned int first,
+  unsigned int lag, float* path);
+//! Same as v2p_compute_path, decoding the whole path from the candidates
+//! on nb_threads threads (0 for one per processor).
+//!
+//! The timeline is split in one segment per thread. The min-plus transfer
+//! matrices of the segments are computed in parallel, combined to get the
+//! path costs at the start of each segment, then the segments are decoded
+//! and traced back in parallel. It costs nb_candidates_per_step times more
+//! operations than the sequential decoding, so it pays off with more
+//! threads than candidates per step; set offline_decoding to avoid the
+//! online decoding while the samples are added.
+//! The path costs are summed in another order than by the sequential
+//! decoding: with more than two threads, paths whose costs differ by
+//! rounding errors only may be decoded differently.
+//! @return An new allocated array, or NULL on failure.
+float SYMPH_API* v2p_compute_path_parallel(pitch_analyzer_t*, unsigned int nb_threads);
+//! Decode the candidates already computed again, with nb_settings sets of
+//! Viterbi costs, in one pass over the candidates: grid searches over the
+//! costs don't run the algorithms again.
+//! Afterward, the analyzer uses costs[0]: its costs are set, and its path
+//! costs and back-pointers are rebuilt, so that v2p_compute_path returns
+//! the first path and v2p_add_samples goes on with these costs.
+//! On failure, the analyzer is left unchanged.
+//! It allocates, so it isn't meant for the real-time mode.
+//! @return An new allocated array of nb_settings paths of v2p_path_len
+//!         frequencies, one after the other, or NULL on failure.
+float SYMPH_API* v2p_redecode(pitch_analyzer_t* s, const viterbi_costs_t* costs,
+  unsigned int nb_settings);
 //! Return the total number of samples in a computed path.
 unsigned int SYMPH_API v2p_path_len(pitch_analyzer_t*);
 //! Insert the algorithm described by algorithm_descriptor
@@ -64,9 +194,28 @@ unsigned int SYMPH_API v2p_path_len(pitch_analyzer_t*);
 //!
 //! Once an algorithm is registered, it cannot be undone.
 void SYMPH_API v2p_register_algorithm(pitch_analyzer_t*, struct algorithm_descriptor*);
+//! Range [first, last) of the audio buffer used by the frame of the
+//! algorithm ad for the timestep at audio_buffer_index.
+//! Frames are centered on the timestep, so algorithms with different
+//! frame sizes stay aligned on the same timesteps.
+void SYMPH_API v2p_frame_extent(const algorithm_descriptor_t* ad, unsigned int audio_buffer_index,
+  unsigned int* first, unsigned int* last);
+//! Number of samples at the beginning of the audio buffer which are not
+//! required anymore by any of the registered algorithms.
+unsigned int SYMPH_API v2p_releasable_samples(pitch_analyzer_t*);
+//! Fill `report` with the bytes held by the analyzer, part by part, and
+//! the largest total held so far (see struct v2p_memory_report).
+//! It doesn't allocate nor lock: it can be called from the thread of the
+//! analyzer between two calls to v2p_add_samples, even in real-time mode.
+void SYMPH_API v2p_memory_usage(pitch_analyzer_t* s, struct v2p_memory_report* report);
 //! Return the total number of candidates computed
 unsigned int SYMPH_API v2p_nb_candidates_generated(pitch_analyzer_t*);
-//! The free associated to the malloc used by the library
+//! Copy of the candidates computed, timestep after timestep
+//! (v2p_nb_candidates_generated candidates).
+//! @return An new allocated array, or NULL if there is no candidate.
+candidate_t SYMPH_API* v2p_get_candidates(pitch_analyzer_t*);
+//! The free associated to the malloc used by the library: release an array
+//! returned by the library with the global allocator (see allocator.h).
 void SYMPH_API* v2p_ptr_free(void* ptr);
 
 //! Post process the pitch path with the median of the given window size.
@@ -127,7 +276,7 @@ struct pitch_analyzer {
   float delta_t;
   //! Candidates build by running the algorithms
   //! candidate_t[number_of_timesteps][nb_candidates_per_step]
-  candidate_t* candidates;
+  struct candidate_store candidates;
   //! Total number of candidates which will be computed
   //! by the different algorithms.
   unsigned int nb_candidates_per_step;
@@ -137,6 +286,9 @@ struct pitch_analyzer {
   //! Can be used freely by the user.
   //! This field is ignored by V2p.
   void* user_data;
+  //! Identifier of the stream, attached to the spans recorded by the
+  //! traces (see trace.h). Can be used freely by the user.
+  unsigned int stream_id;
 
   //
   // Internal machinery
@@ -146,19 +298,70 @@ struct pitch_analyzer {
   sb_float audio_buffer;
   //! Index for the current online processing off the buffer
   unsigned int audio_buffer_index;
+  //! If not 0, the samples which are not required anymore by the algorithms
+  //! are removed from the audio_buffer, which then holds only the last
+  //! samples of the stream instead of the whole stream.
+  //! Can be changed at any time.
+  unsigned int discard_consumed_samples;
+  //! Number of samples removed from the beginning of the audio_buffer.
+  //! The sample audio_buffer[i] is the sample audio_buffer_offset + i of the stream.
+  unsigned int audio_buffer_offset;
+  //! Number of samples of the audio_buffer already included in global_absolute_peak
+  unsigned int audio_buffer_scanned;
+  //! If not 0, the timesteps whose frames have a peak below
+  //! silence_threshold * global_absolute_peak are not analysed:
+  //! the algorithms emit their silence candidates instead (see
+  //! algorithm_descriptor::generate_silence_candidates).
+  //! Can be changed at any time.
+  unsigned int silence_gating;
+  //! Number of timesteps skipped by the silence gate since the last reset
+  unsigned int nb_gated_frames;
+  //! If not 0, the Viterbi path isn't updated while the samples are added:
+  //! v2p_compute_path decodes it from the candidates when it's called.
+  //! Use it with v2p_compute_path_parallel on long files. Ignored by the
+  //! real-time mode. Can be changed before adding samples.
+  unsigned int offline_decoding;
+  //! Absolute peak of each hop (frame_step_size samples) of the stream.
+  //! The first value is the peak of the hop hop_peaks_offset.
+  sb_float hop_peaks;
+  unsigned int hop_peaks_offset;
   //! Size of a step inside the audio_buffer
   unsigned int frame_step_size;
   //! Amplitude maximal detected through the stream
   float global_absolute_peak;
   //! Algorithms used to generate candidates
   struct algorithm_descriptor* algorithm_descriptors;
+  //! Frames of the current timestep, one per algorithm (in the list order)
+  float** frames;
   //! List of costs through paths (viterbi)
   float* path_costs;
-  //! List of indexes through path (viterbi)
-  sb_uint path_indexes;
-  //! Last fft computed and stored by boersma algorithm (allocated)
-  float* last_fft;
-  unsigned int last_fft_size;
+  //! Costs of the paths of the timestep being added, swapped with path_costs
+  float* next_path_costs;
+  //! Back-pointers of the path (viterbi): for each timestep after the
+  //! first one, the best previous candidate of each candidate
+  struct backpointers path_indexes;
+  //! Back-pointers of the timestep being added
+  uint* next_path_indexes;
+  //! Costs of the paths through each previous candidate to the candidate
+  //! being processed (viterbi)
+  float* transition_costs;
+  //! Spectral representations of the frames of the current timestep,
+  //! shared by all the algorithms.
+  struct spectral_context* spectrum;
+  //! Allocator of all the memory owned by the analyzer
+  const v2p_allocator_t* allocator;
+  //! Real-time mode (v2p_prepare): maximal number of samples given at once
+  //! to v2p_add_samples, or 0 if the mode is disabled.
+  unsigned int max_block_size;
+  //! Real-time mode: maximal number of timesteps stored
+  unsigned int max_history;
+  //! Real-time mode: arena receiving the temporary allocations of the
+  //! algorithms, given back after each timestep
+  struct v2p_arena* scratch;
+  //! Cache file mapped by v2p_cache_load, holding the candidates
+  struct v2p_cache_mapping* cache_mapping;
+  //! Largest number of bytes held by the analyzer (see v2p_memory_usage)
+  size_t memory_peak;
 };
 
 //! An algorithm receive its configuration and the index of the next available line
@@ -174,6 +377,34 @@ struct algorithm_descriptor {
   framer_t generate_frame;
 
   struct algorithm_descriptor* next;
+
+  //! Optional function generating the candidates of several frames at once.
+  //! Can be NULL.
+  batch_algorithm_t generate_candidates_batch;
+  //! Optional function generating the candidates of a frame detected as silent
+  //! by the silence gate. It should be cheap. If NULL, unvoiced candidates
+  //! with a null weight are used.
+  algorithm_t generate_silence_candidates;
+  //! Optional function called when the descriptor is registered and at each
+  //! v2p_reset, to precompute what depends on the settings of the analyzer.
+  //! Can be NULL.
+  preparer_t prepare;
+  //! Optional function writing the candidates in place, used instead of
+  //! generate_candidates. Can be NULL.
+  emitter_t emit_candidates;
+  //! Optional function writing the candidates of a silent frame in place,
+  //! used instead of generate_silence_candidates. Can be NULL.
+  emitter_t emit_silence_candidates;
+  //! Optional function mixing into the key of the candidate cache the
+  //! identity of the algorithm and every setting which changes its
+  //! candidates. If NULL, the candidates aren't cached.
+  hasher_t hash_settings;
+  //! Name of the algorithm, used by the traces (see trace.h). Can be NULL.
+  const char* name;
+  //! Optional function returning the bytes held by the descriptor: its
+  //! structure and the buffers it references. If NULL, only the parent
+  //! structure is counted.
+  sizer_t memory_usage;
 };
 
 //! Structure containing a paire frequency/amplitude.
@@ -188,10 +419,64 @@ struct candidate {
   };
 };
 
+//! Bytes held by a part of an analyzer
+struct v2p_memory_block {
+  //! Bytes allocated
+  size_t capacity;
+  //! Bytes holding data, the rest is reserved for the following samples
+  size_t used;
+};
+
+//! Memory held by an analyzer (see v2p_memory_usage)
+struct v2p_memory_report {
+  //! The analyzer structure and its table of frames
+  struct v2p_memory_block analyzer;
+  //! Audio samples kept (audio_buffer) and peaks of their hops (hop_peaks)
+  struct v2p_memory_block audio_buffer;
+  //! Candidates of all the timesteps. The chunks mapped from a cache file
+  //! (v2p_cache_load) aren't counted: they belong to the page cache.
+  struct v2p_memory_block candidates;
+  //! Back-pointers of the Viterbi path
+  struct v2p_memory_block path_indexes;
+  //! Costs of the Viterbi paths and buffers of the Viterbi update
+  struct v2p_memory_block path_costs;
+  //! Spectrums and autocorrelations of the frames (spectral context)
+  struct v2p_memory_block spectrum;
+  //! Real-time mode: scratch arena of the algorithms. Its used bytes are
+  //! the most a timestep required.
+  struct v2p_memory_block scratch;
+  //! Registered descriptors and their windows. The windows are shared with
+  //! every descriptor of the same frame size, in any analyzer: they are
+  //! counted by each of them.
+  struct v2p_memory_block descriptors;
+  //! Sum of the parts above
+  struct v2p_memory_block total;
+  //! High-water mark: largest total capacity held since the analyzer was
+  //! created, including what v2p_reset released and the temporary buffers
+  //! of v2p_redecode.
+  size_t peak;
+};
+
+//! Costs of the Viterbi decoding, as in pitch_analyzer (see v2p_redecode)
+struct viterbi_costs {
+  coster_t compute_transition_cost;
+  float voiced_unvoiced_cost;
+  float octave_jump_cost;
+};
+
 //
 // Internal implementation
 //
 
+//! Maximal number of timesteps processed together by v2p_run.
+#define V2P_RUN_BATCH 64
+
+//! Run the emitter of an algorithm on nb_frames frames, and return their
+//! candidates, frame after frame, in an array allocated with v2p_calloc.
+//! It implements the generators returning arrays from the emitters.
+candidate_t* v2p_emit_candidates_array(pitch_analyzer_t* s, algorithm_descriptor_t* ad,
+  emitter_t emit, float** frames, unsigned int nb_frames);
+
 //! Compute Viterbi path finding algorithm O(nb_candidates^2 * path_length)
 //! Its a dynamic programic algorithm from Viterbi which allows to
 //! find the best path through candidates.
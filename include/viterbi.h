@@ -0,0 +1,43 @@
+#ifndef V2P_VITERBI_H_
+#define V2P_VITERBI_H_
+
+#include "v2p.h"
+#include "candidates.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Internal implementation of the Viterbi decoding
+//
+// The path cost of a candidate at a timestep is the minimum, over the
+// candidates of the previous timestep, of their path cost plus the
+// transition cost, minus the weight of the candidate. The first minimum is
+// kept, so the decoders agree on equal costs.
+//
+
+//! Index of the first minimum of a (length > 0)
+unsigned int fargmin(const float* a, unsigned int length);
+
+//! Cost of the paths through each candidate of `previous` to the candidate
+//! k of `current`: costs[i] = path_costs[i] + transition(i, k) - weight(k).
+//! With boersma_transition_cost, the cached log2 of the frequencies are
+//! used and the loop vectorizes.
+void viterbi_transition_costs(pitch_analyzer_t* s, const float* path_costs,
+  const struct candidate_slice* previous, const struct candidate_slice* current,
+  unsigned int k, float* costs);
+
+//! Add the timestep `current` to the paths ending at `previous`: compute
+//! the path cost of each of its candidates and the candidate of `previous`
+//! it comes from (path_indexes).
+//! costs is a buffer of previous->size floats.
+void viterbi_step(pitch_analyzer_t* s, const float* path_costs,
+  const struct candidate_slice* previous, const struct candidate_slice* current,
+  float* costs, float* next_path_costs, unsigned int* path_indexes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !V2P_VITERBI_H_ */
@@ -0,0 +1,89 @@
+#ifndef WINDOW_CACHE_H_
+#define WINDOW_CACHE_H_
+
+#include "v2p_export.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Windows which can be stored in the window cache
+enum window_type {
+  WINDOW_HANN,
+  WINDOW_HAMMING,
+  WINDOW_BLACKMAN_HARRIS
+};
+
+struct shared_window;
+typedef struct shared_window shared_window_t;
+
+//! Return a reference to the window of the given type and size, and to its
+//! autocorrelation computed with a frame padded by `padding` zeros.
+//!
+//! Windows are shared by all the callers through a process-wide registry.
+//! The first call for a key computes the window and its autocorrelation,
+//! following calls only increment a reference counter.
+//! The registry is protected by a mutex, this function can be called
+//! from any thread.
+//!
+//! @param padding Number of zeros appended to the window befor computing its
+//!                autocorrelation. Pass 0 for the padding used by
+//!                compute_corrected_autocorrelation. Otherwise size + padding
+//!                should be even and above or equal to 2 * size - 1.
+//! @return The shared window, or NULL on allocation failure or invalid padding.
+//!         The buffers are immutable and should be released with
+//!         window_cache_release.
+const shared_window_t SYMPH_API* window_cache_acquire(
+  enum window_type type, unsigned int size, unsigned int padding);
+//! Release a reference obtained with window_cache_acquire.
+//! The buffers are freed with the last reference.
+void SYMPH_API window_cache_release(const shared_window_t* w);
+//! Compute a window ahead of time (for example at startup) so that
+//! the first analyzer using it doesn't pay for its computation.
+//! The window stays in the cache until window_cache_clear is called.
+//! @return 0 on success.
+int SYMPH_API window_cache_prewarm(enum window_type type, unsigned int size, unsigned int padding);
+//! Drop the references held by window_cache_prewarm.
+void SYMPH_API window_cache_clear(void);
+//! Number of windows currently stored in the cache.
+unsigned int SYMPH_API window_cache_size(void);
+//! Bytes allocated for a window and its autocorrelation: 0 for the tables
+//! embedded in the library. Shared by all the references to the window.
+size_t SYMPH_API window_cache_memory(const shared_window_t* w);
+
+//! A window and its autocorrelation shared through the cache.
+struct shared_window {
+  //! Key of the window
+  enum window_type type;
+  unsigned int size;
+  unsigned int padding;
+
+  //! The window (size elements)
+  const float* window;
+  //! Unnormalized autocorrelation of the window (window_ac_size elements)
+  const float* window_ac;
+  unsigned int window_ac_size;
+
+  //
+  // Internal machinery (protected by the registry mutex)
+  //
+
+  //! Number of references returned by window_cache_acquire
+  unsigned int references;
+  //! True if window and window_ac point to the tables embedded in the
+  //! library (standard sizes), which are never freed
+  bool static_tables;
+  //! True if a reference is held by window_cache_prewarm
+  bool prewarmed;
+  //! Allocator of the buffers (the global allocator at creation)
+  const struct v2p_allocator* allocator;
+  struct shared_window* next;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !WINDOW_CACHE_H_ */
@@ -182,13 +182,14 @@
 #define sb_free     stb_sb_free
 #define sb_push     stb_sb_push
 #define sb_count    stb_sb_count
-#define sb_capacity stb_sb_count
+#define sb_capacity stb_sb_capacity
 #define sb_add      stb_sb_add
 #define sb_concat   stb_sb_concat
 #define sb_last     stb_sb_last
+#define sb_try_grow stb_sb_try_grow
 #endif
 
-#define stb_sb_free(a)         ((a) ? free(stb__sbraw(a)), (void*)0 : (void*)0)
+#define stb_sb_free(a)         ((a) ? v2p_allocator_free(stb__sbhdr(a)->allocator, stb__sbraw(a)), (void*)0 : (void*)0)
 #define stb_sb_reserve(a,n)    (*((void **)&(a)) = stb__sbgrowf(0, (n), sizeof(*(a))))
 #define stb_sb_push(a,v)       (stb__sbmaybegrow(a,1), (a)[stb__sbn(a)++] = (v))
 #define stb_sb_count(a)        ((a) ? stb__sbn(a) : 0)
@@ -196,42 +197,70 @@
 #define stb_sb_add(a,n)        (stb__sbmaybegrow(a,n), stb__sbn(a)+=(n), &(a)[stb__sbn(a)-(n)])
 #define stb_sb_concat(a,b,n)   (stb__sbmemcpy(stb_sb_add(a, n), (b), (n), sizeof(*(a))))
 #define stb_sb_last(a)         ((a)[stb__sbn(a)-1])
+// Make room for n more items: 1 on success, 0 if the memory can't be
+// allocated, in which case the array is left unchanged (while sb_add and
+// sb_push can't report the failure).
+#define stb_sb_try_grow(a,n)   (stb__sbneedgrow(a,(n)) ? stb__sbtrygrowf((void **)&(a), (n), sizeof(*(a))) : 1)
 
-#define stb__sbraw(a) ((unsigned int *) (a) - 2)  // Raw pointer allocated by the library
-#define stb__sbm(a)   stb__sbraw(a)[0]            // Memory allocated (capacity)
-#define stb__sbn(a)   stb__sbraw(a)[1]            // Number of items
+// The memory is allocated with the current v2p allocator (see allocator.h),
+// which is remembered in the header so that the buffer is always resized
+// and freed by the allocator which created it.
+typedef struct {
+   const v2p_allocator_t* allocator;
+   unsigned int m;
+   unsigned int n;
+} stb__sbheader;
+
+#define stb__sbhdr(a) ((stb__sbheader *) (a) - 1)  // Header stored before the items
+#define stb__sbraw(a) ((void *) stb__sbhdr(a))     // Raw pointer allocated by the library
+#define stb__sbm(a)   stb__sbhdr(a)->m             // Memory allocated (capacity)
+#define stb__sbn(a)   stb__sbhdr(a)->n             // Number of items
 
 // Tell if sb require resizing
-#define stb__sbneedgrow(a,n)  ((a)==0 || stb__sbn(a)+(n) >= stb__sbm(a))
+#define stb__sbneedgrow(a,n)  ((a)==0 || stb__sbn(a)+(n) > stb__sbm(a))
 // Resize to add n elements if required
 #define stb__sbmaybegrow(a,n) (stb__sbneedgrow(a,(n)) ? stb__sbgrow(a,n) : 0)
 // Increase the capacity to max(count + n, 2 * capacity) elements
 #define stb__sbgrow(a,n)      (*((void **)&(a)) = stb__sbgrowf((a), (n), sizeof(*(a))))
 
+#include "allocator.h"
 #include <stdlib.h>
 #include <string.h>
 
 static void* stb__sbgrowf(void* arr, unsigned int increment, unsigned int itemsize)
 {
-   int dbl_cur = arr ? 2*stb__sbm(arr) : 0;
-   int min_needed = stb_sb_count(arr) + increment;
-   int m = dbl_cur > min_needed ? dbl_cur : min_needed;
-   int *p = (int*)realloc(arr ? stb__sbraw(arr) : 0, itemsize * m + sizeof(int)*2);
+   unsigned int dbl_cur = arr ? 2*stb__sbm(arr) : 0;
+   unsigned int min_needed = stb_sb_count(arr) + increment;
+   unsigned int m = dbl_cur > min_needed ? dbl_cur : min_needed;
+   const v2p_allocator_t* allocator = arr ? stb__sbhdr(arr)->allocator : v2p_current_allocator();
+   stb__sbheader *p = (stb__sbheader *) v2p_allocator_realloc(allocator,
+      arr ? stb__sbraw(arr) : 0, (size_t)itemsize * m + sizeof(stb__sbheader));
    if (p) {
-      if (!arr)
-         p[1] = 0;
-      p[0] = m;
-      return (void*)(p+2);
+      if (!arr) {
+         p->allocator = allocator;
+         p->n = 0;
+      }
+      p->m = m;
+      return (void*)(p+1);
    } else {
       #ifdef STRETCHY_BUFFER_OUT_OF_MEMORY
       STRETCHY_BUFFER_OUT_OF_MEMORY ;
       #endif
-      return (void*)(2*sizeof(int)); // try to force a NULL pointer exception later
+      return (void*)sizeof(stb__sbheader); // try to force a NULL pointer exception later
    }
 }
 
-static inline void* stb__sbmemcpy(void* dst, void* src, unsigned int n, unsigned int itemsize) {
-  memcpy(dst, src, n * itemsize);
+static inline int stb__sbtrygrowf(void** arr, unsigned int increment, unsigned int itemsize)
+{
+   void* grown = stb__sbgrowf(*arr, increment, itemsize);
+   if (grown == (void*)sizeof(stb__sbheader))
+      return 0;
+   *arr = grown;
+   return 1;
+}
+
+static inline void* stb__sbmemcpy(void* dst, const void* src, unsigned int n, unsigned int itemsize) {
+  memcpy(dst, src, (size_t)n * itemsize);
   return dst;
 }
 
@@ -40,8 +40,8 @@ def midi_notes_to_numbers(notes):
     arr = np.zeros(max_len, dtype='int')
     for n in notes:
         position = int(round(n.position))
-        duration = int(round(n.position+n.duration))
-        arr[position:position+duration] = int(round(n.note_number))
+        end = int(round(n.position+n.duration))
+        arr[position:end] = int(round(n.note_number))
     return arr
 
 
@@ -56,7 +56,9 @@ def compute_midi_numbers_distance(notes_a, notes_b):
     assert(max_len == len(curve_a))
     assert(max_len == len(curve_b))
 
-    nb_non_zero = len([(a, b) for a, b in zip(curve_a, curve_b) if a is not 0 or b is not 0])
+    nb_non_zero = len([(a, b) for a, b in zip(curve_a, curve_b) if a != 0 or b != 0])
+    if nb_non_zero == 0:
+        return 0
     # Count the proportion of pitch mismatch for non zero numbers
     return np.sum([0 if a == b else 1 for a, b in zip(curve_a, curve_b)]) / nb_non_zero
 
@@ -73,8 +73,7 @@ def boersma_candidates(data, frame_size=2048, nb_candidates=None, timesteps=None
     handle.v2p_add_samples(s, input, len(data));
 
     # Make a copy of s->candidates
-    nb =  handle.v2p_nb_candidates_generated(s)
-    candidates = ctype_dyn2static(CandidateType, s[0].candidates, nb)
+    candidates = v2p_get_candidates(s)
 
     v2p_delete(s)
 
@@ -94,25 +93,34 @@ def maxfreq_candidates(data, frame_size=2048, nb_candidates=None, timesteps=None
     handle.v2p_add_samples(s, input, len(data));
 
     # Make a copy of s->candidates
-    nb =  handle.v2p_nb_candidates_generated(s)
-    candidates = ctype_dyn2static(CandidateType, s[0].candidates, nb)
+    candidates = v2p_get_candidates(s)
 
     v2p_delete(s)
 
     return candidates
 
 
-def boersma_path(data, frame_size=2048, nb_candidates=None, timesteps=None):
+def run_samples(s, data, cache_dir=None):
+    """Analyze the samples, with the candidates cached in cache_dir if given"""
+    input = (ctypes.c_float * len(data))(*data)
+    if cache_dir is None:
+        handle.v2p_add_samples.argtypes = [
+          ctypes.c_void_p, ctypes.POINTER(ctypes.c_float), ctypes.c_uint
+        ]
+        handle.v2p_add_samples(s, input, len(data))
+    else:
+        handle.v2p_run_cached.argtypes = [
+          ctypes.c_void_p, ctypes.POINTER(ctypes.c_float), ctypes.c_uint, ctypes.c_char_p
+        ]
+        handle.v2p_run_cached(s, input, len(data), cache_dir.encode())
+
+
+def boersma_path(data, frame_size=2048, nb_candidates=None, timesteps=None, cache_dir=None):
     # Set up the environment
     s, _ = boersma_engine(frame_size=frame_size, nb_candidates=nb_candidates, timesteps=timesteps)
 
     # Run inline algorithm
-    handle.v2p_add_samples.argtypes = [
-      ctypes.c_void_p, ctypes.POINTER(ctypes.c_float), ctypes.c_uint
-    ]
-
-    input = (ctypes.c_float * len(data))(*data)
-    handle.v2p_add_samples(s, input, len(data));
+    run_samples(s, data, cache_dir)
 
     # Make a copy of path
     handle.v2p_compute_path.argtypes = [ctypes.c_void_p]
@@ -128,17 +136,12 @@ def boersma_path(data, frame_size=2048, nb_candidates=None, timesteps=None):
     return path_copy
 
 
-def maxfreq_path(data, frame_size=2048, nb_candidates=None, timesteps=None):
+def maxfreq_path(data, frame_size=2048, nb_candidates=None, timesteps=None, cache_dir=None):
     # Set up the environment
     s, _ = maxfreq_engine(frame_size=frame_size, nb_candidates=nb_candidates, timesteps=timesteps)
 
     # Run inline algorithm
-    handle.v2p_add_samples.argtypes = [
-      ctypes.c_void_p, ctypes.POINTER(ctypes.c_float), ctypes.c_uint
-    ]
-
-    input = (ctypes.c_float * len(data))(*data)
-    handle.v2p_add_samples(s, input, len(data))
+    run_samples(s, data, cache_dir)
 
     # Make a copy of path
     handle.v2p_compute_path.argtypes = [ctypes.c_void_p]
@@ -154,17 +157,12 @@ def maxfreq_path(data, frame_size=2048, nb_candidates=None, timesteps=None):
     return path_copy
 
 
-def v2p_path(data, frame_size=2048, nb_candidates=None, timesteps=None):
+def v2p_path(data, frame_size=2048, nb_candidates=None, timesteps=None, cache_dir=None):
     # Set up the environment
     s, _ = boersma_engine(frame_size=frame_size, nb_candidates=nb_candidates, timesteps=timesteps)
 
     # Run inline algorithm
-    handle.v2p_add_samples.argtypes = [
-      ctypes.c_void_p, ctypes.POINTER(ctypes.c_float), ctypes.c_uint
-    ]
-
-    input = (ctypes.c_float * len(data))(*data)
-    handle.v2p_add_samples(s, input, len(data));
+    run_samples(s, data, cache_dir)
 
     # Make a copy of path
     handle.v2p_compute_path.argtypes = [ctypes.c_void_p]
@@ -7,6 +7,16 @@ class CandidateType(ctypes.Structure):
         ("amplitude", ctypes.c_float)
     ]
 
+# Type for the candidate store (struct candidate_store)
+class CandidateStoreType(ctypes.Structure):
+    _fields_ = [
+        ("nb_per_step", ctypes.c_uint),
+        ("steps_per_chunk", ctypes.c_uint),
+        ("nb_steps", ctypes.c_uint),
+        ("chunks", ctypes.POINTER(ctypes.POINTER(ctypes.c_float))),
+        ("borrowed", ctypes.c_bool)
+    ]
+
 class PitchAnalyzerType(ctypes.Structure):
     _fields_ = [
         ("frame_time_step", ctypes.c_float),
@@ -23,7 +33,7 @@ class PitchAnalyzerType(ctypes.Structure):
         ("minimal_note_length", ctypes.c_uint),
         ("sampling_rate", ctypes.c_float),
         ("delta_t", ctypes.c_float),
-        ("candidates", ctypes.POINTER(CandidateType)),
+        ("candidates", CandidateStoreType),
         ("nb_candidates_per_step", ctypes.c_uint),
         ("number_of_timesteps", ctypes.c_uint)
         # Remaining fields not binded
@@ -38,10 +48,80 @@ class AlgorithmDescriptorType(ctypes.Structure):
         ("next", ctypes.c_void_p)
     ]
 
+# Type for the costs of the Viterbi decoding (viterbi_costs_t)
+class ViterbiCostsType(ctypes.Structure):
+    _fields_ = [
+        ("compute_transition_cost", ctypes.c_void_p),
+        ("voiced_unvoiced_cost", ctypes.c_float),
+        ("octave_jump_cost", ctypes.c_float)
+    ]
+
+# Type for the bytes held by a part of an analyzer (struct v2p_memory_block)
+class MemoryBlockType(ctypes.Structure):
+    _fields_ = [
+        ("capacity", ctypes.c_size_t),
+        ("used", ctypes.c_size_t)
+    ]
+
+MEMORY_PARTS = [
+    "analyzer", "audio_buffer", "candidates", "path_indexes", "path_costs",
+    "spectrum", "scratch", "descriptors", "total"
+]
+
+# Type for the memory held by an analyzer (struct v2p_memory_report)
+class MemoryReportType(ctypes.Structure):
+    _fields_ = [(part, MemoryBlockType) for part in MEMORY_PARTS] + [
+        ("peak", ctypes.c_size_t)
+    ]
+
 def ptr_free(ptr):
     handle.v2p_ptr_free.argtypes = [ctypes.c_void_p]
     handle.v2p_ptr_free(ptr)
 
+def v2p_get_candidates(s):
+    """Copy of the candidates computed by s, timestep after timestep."""
+    nb = handle.v2p_nb_candidates_generated(s)
+    handle.v2p_get_candidates.argtypes = [ctypes.c_void_p]
+    handle.v2p_get_candidates.restype = ctypes.POINTER(CandidateType)
+    ptr = handle.v2p_get_candidates(s)
+    if not ptr:
+        return []
+    candidates = ctype_dyn2static(CandidateType, ptr, nb)
+    ptr_free(ptr)
+    return candidates
+
+def v2p_redecode(s, costs):
+    """Decode the candidates of s again for each (voiced_unvoiced_cost,
+    octave_jump_cost) pair of costs. Return one path per pair."""
+    settings = (ViterbiCostsType * len(costs))()
+    for setting, (voiced_unvoiced_cost, octave_jump_cost) in zip(settings, costs):
+        setting.compute_transition_cost = s[0].compute_transition_cost
+        setting.voiced_unvoiced_cost = voiced_unvoiced_cost
+        setting.octave_jump_cost = octave_jump_cost
+    handle.v2p_redecode.argtypes = [ctypes.c_void_p, ctypes.POINTER(ViterbiCostsType), ctypes.c_uint]
+    handle.v2p_redecode.restype = ctypes.POINTER(ctypes.c_float)
+    ptr = handle.v2p_redecode(s, settings, len(costs))
+    if not ptr:
+        return []
+    length = s[0].number_of_timesteps
+    paths = cfloat_dyn2static(ptr, length * len(costs))
+    ptr_free(ptr)
+    return [paths[i * length:(i + 1) * length] for i in range(len(costs))]
+
+def v2p_memory_usage(s):
+    """Bytes held by s: a (capacity, used) pair for each part (see
+    MEMORY_PARTS), and the high-water mark as "peak"."""
+    report = MemoryReportType()
+    handle.v2p_memory_usage.argtypes = [ctypes.c_void_p, ctypes.POINTER(MemoryReportType)]
+    handle.v2p_memory_usage.restype = None
+    handle.v2p_memory_usage(s, ctypes.byref(report))
+    usage = {}
+    for part in MEMORY_PARTS:
+        block = getattr(report, part)
+        usage[part] = (block.capacity, block.used)
+    usage["peak"] = report.peak
+    return usage
+
 def v2p_new(timesteps=None):
     if timesteps is None:
         timesteps = 0 # Default timesteps
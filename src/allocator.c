@@ -0,0 +1,170 @@
+#include "allocator.h"
+#include "sync.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static void* __default_malloc(void* user_data, size_t size) {
+  (void)user_data;
+  return malloc(size);
+}
+
+static void* __default_realloc(void* user_data, void* ptr, size_t size) {
+  (void)user_data;
+  return realloc(ptr, size);
+}
+
+static void __default_free(void* user_data, void* ptr) {
+  (void)user_data;
+  free(ptr);
+}
+
+const v2p_allocator_t v2p_default_allocator = {
+  __default_malloc,
+  __default_realloc,
+  __default_free,
+  NULL
+};
+
+static const v2p_allocator_t* global_allocator = &v2p_default_allocator;
+// Allocator of the analyzer currently processing samples on this thread
+static V2P_THREAD_LOCAL const v2p_allocator_t* thread_allocator = NULL;
+
+void v2p_set_allocator(const v2p_allocator_t* allocator) {
+  global_allocator = allocator ? allocator : &v2p_default_allocator;
+}
+
+const v2p_allocator_t* v2p_get_allocator(void) {
+  return global_allocator;
+}
+
+const v2p_allocator_t* v2p_current_allocator(void) {
+  return thread_allocator ? thread_allocator : global_allocator;
+}
+
+const v2p_allocator_t* v2p_allocator_enter(const v2p_allocator_t* allocator) {
+  const v2p_allocator_t* previous = thread_allocator;
+  thread_allocator = allocator;
+  return previous;
+}
+
+void v2p_allocator_leave(const v2p_allocator_t* previous) {
+  thread_allocator = previous;
+}
+
+void* v2p_allocator_malloc(const v2p_allocator_t* allocator, size_t size) {
+  return allocator->malloc(allocator->user_data, size);
+}
+
+void* v2p_allocator_calloc(const v2p_allocator_t* allocator, size_t nb, size_t size) {
+  if (size && nb > SIZE_MAX / size)
+    return NULL;
+  void* ptr = allocator->malloc(allocator->user_data, nb * size);
+  if (ptr)
+    memset(ptr, 0, nb * size);
+  return ptr;
+}
+
+void* v2p_allocator_realloc(const v2p_allocator_t* allocator, void* ptr, size_t size) {
+  return allocator->realloc(allocator->user_data, ptr, size);
+}
+
+void v2p_allocator_free(const v2p_allocator_t* allocator, void* ptr) {
+  if (ptr)
+    allocator->free(allocator->user_data, ptr);
+}
+
+void* v2p_malloc(size_t size) {
+  return v2p_allocator_malloc(v2p_current_allocator(), size);
+}
+
+void* v2p_calloc(size_t nb, size_t size) {
+  return v2p_allocator_calloc(v2p_current_allocator(), nb, size);
+}
+
+void* v2p_realloc(void* ptr, size_t size) {
+  return v2p_allocator_realloc(v2p_current_allocator(), ptr, size);
+}
+
+void v2p_free(void* ptr) {
+  v2p_allocator_free(v2p_current_allocator(), ptr);
+}
+
+//
+// Arena
+//
+
+// Each block is preceded by its size, so that realloc can copy it.
+// It keeps the blocks aligned like malloc does.
+#define ARENA_HEADER 16
+
+static size_t __arena_block_size(size_t size) {
+  return ARENA_HEADER + ((size + ARENA_HEADER - 1) & ~(size_t)(ARENA_HEADER - 1));
+}
+
+static void* __arena_malloc(void* user_data, size_t size) {
+  struct v2p_arena* arena = user_data;
+  const size_t block_size = __arena_block_size(size);
+  char* block;
+  if (arena->data) {
+    if (block_size > arena->capacity - arena->used) {
+      arena->nb_failures++;
+      return NULL;
+    }
+    block = arena->data + arena->used;
+  } else {
+    block = v2p_allocator_malloc(arena->parent, block_size);
+    if (!block)
+      return NULL;
+  }
+  arena->used += block_size;
+  if (arena->used > arena->peak)
+    arena->peak = arena->used;
+  *(size_t*)block = size;
+  return block + ARENA_HEADER;
+}
+
+static void __arena_free(void* user_data, void* ptr) {
+  struct v2p_arena* arena = user_data;
+  // Nothing to do for a bump allocator
+  if (!arena->data)
+    v2p_allocator_free(arena->parent, (char*)ptr - ARENA_HEADER);
+}
+
+static void* __arena_realloc(void* user_data, void* ptr, size_t size) {
+  void* block = __arena_malloc(user_data, size);
+  if (!block || !ptr)
+    return block;
+  const size_t old_size = *(size_t*)((char*)ptr - ARENA_HEADER);
+  memcpy(block, ptr, old_size < size ? old_size : size);
+  __arena_free(user_data, ptr);
+  return block;
+}
+
+int v2p_arena_init(struct v2p_arena* arena, const v2p_allocator_t* parent, size_t capacity) {
+  memset(arena, 0, sizeof(*arena));
+  arena->allocator.malloc = __arena_malloc;
+  arena->allocator.realloc = __arena_realloc;
+  arena->allocator.free = __arena_free;
+  arena->allocator.user_data = arena;
+  arena->parent = parent;
+  if (!capacity)
+    return 0;
+  arena->data = v2p_allocator_malloc(parent, capacity);
+  if (!arena->data)
+    return -1;
+  arena->capacity = capacity;
+  return 0;
+}
+
+void v2p_arena_reset(struct v2p_arena* arena) {
+  arena->used = 0;
+  arena->nb_failures = 0;
+}
+
+void v2p_arena_release(struct v2p_arena* arena) {
+  v2p_allocator_free(arena->parent, arena->data);
+  arena->data = NULL;
+  arena->capacity = 0;
+  v2p_arena_reset(arena);
+}
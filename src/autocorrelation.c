@@ -1,5 +1,7 @@
 #include "autocorrelation.h"
 #include "fft.h"
+#include "allocator.h"
+#include "trace.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -15,13 +17,71 @@ unsigned int SYMPH_API next_power_of_two(unsigned int v)
   return v + 1;
 }
 
-static inline float* __compute_autocorrelation(float* frame_in, unsigned int size_in,
-  unsigned int* size_out, bool normalize, float** remember_fft) {
+unsigned int autocorrelation_length(unsigned int size_in)
+{
   // Append a frame of zero to have a correlation function
   // define at least as long as the input frame (see behavior of fft).
-  unsigned int ac_length = size_in * 2;
-  ac_length = next_power_of_two(ac_length);
-  float* frame_out = malloc(sizeof(*frame_out) * ac_length);
+  // Lags up to size_in - 1 don't wrap around as soon as the length is at
+  // least 2 * size_in - 1, so the cheapest transform size above is used
+  // instead of always padding to a power of two.
+  return fft_fast_size(size_in * 2 - 1);
+}
+
+// Sum of the values. Independent partial sums allow the compiler to
+// vectorize the loop without reassociating floating point additions.
+static inline float __sum(const float* restrict a, unsigned int size) {
+  float sums[8] = {0};
+  unsigned int i = 0;
+  for (; i + 8 <= size; i += 8)
+    for (unsigned int k = 0; k < 8; k++)
+      sums[k] += a[i + k];
+  float sum = 0;
+  for (; i < size; i++)
+    sum += a[i];
+  for (unsigned int k = 0; k < 8; k++)
+    sum += sums[k];
+  return sum;
+}
+
+void compute_windowed_frame(float* restrict out, const float* restrict frame_in,
+  const float* restrict window_in, unsigned int size_in, unsigned int length) {
+  const float average = __sum(frame_in, size_in) / size_in;
+  for (unsigned int i = 0; i < size_in; i++)
+    out[i] = (frame_in[i] - average) * window_in[i];
+  memset(out + size_in, 0, sizeof(*out) * (length - size_in));
+}
+
+void compute_power_density(float* out, const float* fft,
+  unsigned int length, float scale) {
+  out[0] = scale * fft[0] * fft[0];
+  out[1] = scale * fft[1] * fft[1];
+  for (unsigned int i = 2; i < length; i += 2) {
+    const float x = fft[i];
+    const float y = fft[i + 1];
+    out[i] = scale * (x * x + y * y);
+    out[i + 1] = 0;
+  }
+}
+
+// Forward and inverse transforms of a zero padded buffer, with the pruning
+// allowed for power of two lengths.
+static inline void __forward_transform(float* data, unsigned int size_in, unsigned int ac_length) {
+  if (ac_length == next_power_of_two(ac_length) && 2 * size_in <= ac_length)
+    realft_pruned(data, ac_length, FFT_FORWARD, FFT_PRUNE_ZERO_PADDED);
+  else
+    realft_any(data, ac_length, FFT_FORWARD);
+}
+
+static inline void __inverse_transform(float* data, unsigned int ac_length, unsigned int pruning) {
+  if (ac_length == next_power_of_two(ac_length))
+    realft_pruned(data, ac_length, FFT_INVERSE, pruning);
+  else
+    realft_any(data, ac_length, FFT_INVERSE);
+}
+
+static inline float* __compute_autocorrelation_with_length(float* frame_in, unsigned int size_in,
+  unsigned int ac_length, unsigned int* size_out, bool normalize, float** remember_fft) {
+  float* frame_out = v2p_malloc(sizeof(*frame_out) * ac_length);
   if (!frame_out)
     return frame_out;
 
@@ -29,36 +89,29 @@ static inline float* __compute_autocorrelation(float* frame_in, unsigned int siz
   memset(frame_out + size_in, 0, sizeof(*frame_in) * (ac_length - size_in));
 
   // Compute the fourier transform and powerDensity
-  realft(frame_out, ac_length, FFT_FORWARD);
+  V2P_TRACE_BEGIN(forward);
+  __forward_transform(frame_out, size_in, ac_length);
+  V2P_TRACE_END(forward, "fft_forward");
 
   // Make a copy of the fft in case other algorithms require to analyze it
   if (remember_fft) {
-    (*remember_fft) = malloc(sizeof(**remember_fft) * ac_length);
+    (*remember_fft) = v2p_malloc(sizeof(**remember_fft) * ac_length);
     if (*remember_fft)
         memcpy(*remember_fft, frame_out, sizeof(*frame_out) * ac_length);
   }
 
-  // Compute the power density (squared norm of complex values)
-  frame_out[0] *= frame_out[0];
-  frame_out[1] *= frame_out[1];
-  for (size_t i = 2; i < ac_length; i += 2) {
-    const float x = frame_out[i];
-    const float y = frame_out[i + 1];
-    frame_out[i] = x * x + y * y;
-    frame_out[i + 1] = 0;
-  }
+  // Compute the power density (squared norm of complex values).
+  // The transforms are linear, so normalizing the power density
+  // normalizes the autocorrelation without an extra pass.
+  const float normalizer = normalize ? 2.0f / ac_length : 1.0f;
+  compute_power_density(frame_out, frame_out, ac_length, normalizer);
 
   // We compute the inverse fourier
   // Notice that the second half of frame_out
   // is the reverse of the first half, and therefore not required.
-  realft(frame_out, ac_length, FFT_INVERSE);
-
-  // Normalizing can be unactivated for better performances
-  if (normalize) {
-    const float normalizer = 2.0f / ac_length;
-    for (unsigned int i = 0; i < ac_length; i++)
-      frame_out[i] *= normalizer;
-  }
+  V2P_TRACE_BEGIN(inverse);
+  __inverse_transform(frame_out, ac_length, FFT_PRUNE_NONE);
+  V2P_TRACE_END(inverse, "fft_inverse");
 
   // Return autocorrelation
   // Only the first path of the function returned by IFFT is relevent.
@@ -68,6 +121,17 @@ static inline float* __compute_autocorrelation(float* frame_in, unsigned int siz
   return frame_out;
 }
 
+static inline float* __compute_autocorrelation(float* frame_in, unsigned int size_in,
+  unsigned int* size_out, bool normalize, float** remember_fft) {
+  return __compute_autocorrelation_with_length(frame_in, size_in,
+    autocorrelation_length(size_in), size_out, normalize, remember_fft);
+}
+
+float* compute_unnormalized_autocorrelation_with_length(float* frame_in, unsigned int size_in,
+  unsigned int ac_length, unsigned int* size_out) {
+  return __compute_autocorrelation_with_length(frame_in, size_in, ac_length, size_out, false, NULL);
+}
+
 float* compute_autocorrelation(float* frame_in, unsigned int size_in,
   unsigned int* size_out) {
   return __compute_autocorrelation(frame_in, size_in, size_out, true, NULL);
@@ -96,50 +160,47 @@ float SYMPH_API* __compute_corrected_autocorrelation(
   float** fft /* = NULL */,
   unsigned int size_in,
   unsigned int* size_out) {
-  // Compute average
-  float average = 0;
-  for (unsigned int i = 0; i < size_in; i++)
-    average += frame_in[i];
-  average /= size_in;
-
-  // Copy the input frame
-  const size_t chunk_size = sizeof(*frame_in) * size_in;
-  float* frame_in_cpy = malloc(chunk_size);
-  memcpy(frame_in_cpy, frame_in, chunk_size);
-
-  // Apply window
-  for (unsigned int i = 0; i < size_in; i++) {
-    const float v = frame_in_cpy[i];
-    frame_in_cpy[i] = (v - average) * window_in[i];
+  const unsigned int ac_length = autocorrelation_length(size_in);
+  float* autocorrelation = v2p_malloc(sizeof(*autocorrelation) * ac_length);
+  if (!autocorrelation)
+    return NULL;
+
+  // Mean removal, window and padding in one pass, then the transform in place
+  compute_windowed_frame(autocorrelation, frame_in, window_in, size_in, ac_length);
+  __forward_transform(autocorrelation, size_in, ac_length);
+
+  // Make a copy of the fft in case other algorithms require to analyze it
+  if (fft) {
+    *fft = v2p_malloc(sizeof(**fft) * ac_length);
+    if (*fft)
+      memcpy(*fft, autocorrelation, sizeof(*autocorrelation) * ac_length);
   }
 
-  // Compute corrected autocorrelation of the frame
-  float* autocorrelation = compute_unnormalized_autocorrelation_and_fft(
-    frame_in_cpy, size_in, size_out, fft
-  );
+  // Corrected autocorrelation isn't correct after 1/2
+  // of the window. Therefore we keep only half of it,
+  // that is a quarter of the inverse transform.
+  compute_power_density(autocorrelation, autocorrelation, ac_length, 1.f);
+  __inverse_transform(autocorrelation, ac_length, FFT_PRUNE_FIRST_QUARTER);
+  *size_out = ac_length / 4;
+
   float* window_ac_ptr;
+  unsigned int window_ac_size;
   // In case we already have the autocorrelation, retrieve it
   if (window_ac && *window_ac)
     window_ac_ptr = *window_ac;
   // otherwise compute it.
   else
     window_ac_ptr = compute_unnormalized_autocorrelation(
-      window_in, size_in, size_out
+      window_in, size_in, &window_ac_size
     );
 
-  // Corrected autocorrelation isn't correct after 1/2
-  // of the window. Therefore we keep only half of it.
-  *size_out = (*size_out) / 2;
-
   // Correct autocorrelation
   for (unsigned int i = 0; i < *size_out; i++)
     autocorrelation[i] = autocorrelation[i] / window_ac_ptr[i];
 
-  // Free frame_in copy
-  free(frame_in_cpy);
   // Free window_ac_ptr or store it in case we computed it
   if (!window_ac)
-    free(window_ac_ptr);
+    v2p_free(window_ac_ptr);
   else if (window_ac && !*window_ac)
     *window_ac = window_ac_ptr;
 
@@ -169,4 +230,183 @@ float SYMPH_API* compute_corrected_autocorrelation_and_fft(
   return __compute_corrected_autocorrelation(
     frame_in, window_in, window_ac, fft, size_in, size_out
   );
-}
\ No newline at end of file
+}
+float SYMPH_API* compute_autocorrelation_head_batch(
+  float** frames_in,
+  unsigned int nb_frames,
+  const float* window_in,
+  unsigned int size_in,
+  unsigned int* size_out)
+{
+  const unsigned int ac_length = autocorrelation_length(size_in);
+  // Same truncation than compute_corrected_autocorrelation
+  const unsigned int head_size = ac_length / 4;
+  *size_out = head_size;
+
+  // realft_batch only handles powers of two. Other lengths are
+  // transformed one frame at a time (a block of one frame isn't
+  // interleaved) with a plan.
+  const fft_plan_t* plan = NULL;
+  float* scratch = NULL;
+  unsigned int block_size = FFT_BATCH_BLOCK;
+  if (ac_length != next_power_of_two(ac_length)) {
+    block_size = 1;
+    plan = fft_plan_acquire(ac_length);
+    if (plan)
+      scratch = v2p_malloc(sizeof(*scratch) * fft_plan_scratch_size(plan));
+  }
+
+  float* autocorrelations = v2p_malloc(sizeof(*autocorrelations) * head_size * nb_frames);
+  float* block = v2p_malloc(sizeof(*block) * ac_length * block_size);
+  if (!autocorrelations || !block || (block_size == 1 && !scratch)) {
+    v2p_free(autocorrelations);
+    autocorrelations = NULL;
+    goto clean;
+  }
+
+  for (unsigned int first = 0; first < nb_frames; first += block_size) {
+    const unsigned int batch = (nb_frames - first < block_size) ?
+      nb_frames - first : block_size;
+    float** frames = frames_in + first;
+
+    // Remove the mean, apply the window and pad with zeros
+    for (unsigned int k = 0; k < batch; k++) {
+      const float average = __sum(frames[k], size_in) / size_in;
+      for (unsigned int i = 0; i < size_in; i++)
+        block[(size_t)i * batch + k] = (frames[k][i] - average) * window_in[i];
+    }
+    memset(block + (size_t)size_in * batch, 0,
+      sizeof(*block) * (ac_length - size_in) * batch);
+
+    if (plan)
+      fft_plan_realft(plan, block, scratch, FFT_FORWARD);
+    else
+      realft_batch_pruned(block, ac_length, batch, FFT_FORWARD, FFT_PRUNE_ZERO_PADDED);
+
+    // Power density of each frame
+    for (unsigned int k = 0; k < 2 * batch; k++)
+      block[k] *= block[k];
+    for (size_t i = 2; i < ac_length; i += 2) {
+      float* restrict re = block + i * batch;
+      float* restrict im = block + (i + 1) * batch;
+      for (unsigned int k = 0; k < batch; k++) {
+        re[k] = re[k] * re[k] + im[k] * im[k];
+        im[k] = 0;
+      }
+    }
+
+    // Only the first quarter of the autocorrelation is kept
+    if (plan)
+      fft_plan_realft(plan, block, scratch, FFT_INVERSE);
+    else
+      realft_batch_pruned(block, ac_length, batch, FFT_INVERSE, FFT_PRUNE_FIRST_QUARTER);
+
+    for (unsigned int k = 0; k < batch; k++) {
+      float* out = autocorrelations + (size_t)(first + k) * head_size;
+      for (unsigned int i = 0; i < head_size; i++)
+        out[i] = block[(size_t)i * batch + k];
+    }
+  }
+
+clean:
+  v2p_free(block);
+  v2p_free(scratch);
+  fft_plan_release(plan);
+  return autocorrelations;
+}
+
+float SYMPH_API* compute_corrected_autocorrelation_batch(
+  float** frames_in,
+  unsigned int nb_frames,
+  float* window_in,
+  float** window_ac /* = NULL */,
+  unsigned int size_in,
+  unsigned int* size_out)
+{
+  float* autocorrelations = compute_autocorrelation_head_batch(
+    frames_in, nb_frames, window_in, size_in, size_out);
+  if (!autocorrelations)
+    return NULL;
+
+  // Retrieve or compute the autocorrelation of the window
+  float* window_ac_ptr;
+  unsigned int window_ac_size;
+  if (window_ac && *window_ac)
+    window_ac_ptr = *window_ac;
+  else
+    window_ac_ptr = compute_unnormalized_autocorrelation(
+      window_in, size_in, &window_ac_size
+    );
+
+  // Correct with the autocorrelation of the window
+  for (unsigned int k = 0; k < nb_frames; k++) {
+    float* out = autocorrelations + (size_t)k * (*size_out);
+    for (unsigned int i = 0; i < *size_out; i++)
+      out[i] /= window_ac_ptr[i];
+  }
+
+  if (!window_ac)
+    v2p_free(window_ac_ptr);
+  else if (!*window_ac)
+    *window_ac = window_ac_ptr;
+
+  return autocorrelations;
+}
+
+// Dot product of a and b. Independent partial sums allow the compiler to
+// vectorize the loop without reassociating floating point additions.
+static inline float __dot(const float* restrict a, const float* restrict b, unsigned int size) {
+  float sums[8] = {0};
+  unsigned int i = 0;
+  for (; i + 8 <= size; i += 8)
+    for (unsigned int k = 0; k < 8; k++)
+      sums[k] += a[i + k] * b[i + k];
+  float sum = 0;
+  for (; i < size; i++)
+    sum += a[i] * b[i];
+  for (unsigned int k = 0; k < 8; k++)
+    sum += sums[k];
+  return sum;
+}
+
+float SYMPH_API* compute_corrected_autocorrelation_direct(
+  const float* frame_in,
+  const float* window_in,
+  const float* window_ac /* = NULL */,
+  unsigned int size_in,
+  unsigned int min_lag,
+  unsigned int max_lag,
+  unsigned int* size_out)
+{
+  const unsigned int ac_length = autocorrelation_length(size_in);
+  *size_out = ac_length / 4;
+  if (max_lag >= *size_out)
+    max_lag = *size_out - 1;
+
+  float* autocorrelation = v2p_calloc(*size_out, sizeof(*autocorrelation));
+  float* windowed = v2p_malloc(sizeof(*windowed) * size_in);
+  if (!autocorrelation || !windowed) {
+    v2p_free(windowed);
+    v2p_free(autocorrelation);
+    return NULL;
+  }
+
+  // Remove the mean and apply the window, like the FFT path
+  compute_windowed_frame(windowed, frame_in, window_in, size_in, size_in);
+
+  // The unnormalized inverse transform of the FFT path is ac_length / 2
+  // times the autocorrelation. The scale cancels when both autocorrelations
+  // are computed here.
+  const float scale = window_ac ? ac_length / 2.f : 1.f;
+  // Lag 0, then [min_lag, max_lag]
+  for (unsigned int lag = 0; lag <= max_lag; lag = (lag == 0 && min_lag > 1) ? min_lag : lag + 1) {
+    const float ac = __dot(windowed, windowed + lag, size_in - lag);
+    const float w_ac = window_ac ?
+      window_ac[lag] :
+      __dot(window_in, window_in + lag, size_in - lag);
+    autocorrelation[lag] = scale * ac / w_ac;
+  }
+
+  v2p_free(windowed);
+  return autocorrelation;
+}
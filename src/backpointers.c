@@ -0,0 +1,97 @@
+#include "backpointers.h"
+#include "allocator.h"
+#include "stretchy_buffer.h"
+#include <string.h>
+
+void backpointers_init(struct backpointers* bp, unsigned int nb_states) {
+  memset(bp, 0, sizeof(*bp));
+  bp->nb_states = nb_states;
+  // Largest index is nb_states - 1
+  if (nb_states <= 1u << 4)
+    bp->bits = 4;
+  else if (nb_states <= 1u << 8)
+    bp->bits = 8;
+  else if (nb_states <= 1u << 16)
+    bp->bits = 16;
+  else
+    bp->bits = 32;
+  bp->row_size = (nb_states * bp->bits + 7) / 8;
+  if (!bp->row_size)
+    bp->row_size = 1;
+  bp->rows_per_page = BACKPOINTERS_PAGE_SIZE / bp->row_size;
+  if (!bp->rows_per_page)
+    bp->rows_per_page = 1;
+}
+
+void backpointers_clear(struct backpointers* bp) {
+  for (unsigned int i = 0; i < sb_count(bp->pages); i++)
+    v2p_free(bp->pages[i]);
+  bp->pages = sb_free(bp->pages);
+  bp->nb_rows = 0;
+}
+
+bool backpointers_reserve(struct backpointers* bp, unsigned int nb_rows) {
+  const unsigned int nb_pages = (nb_rows + bp->rows_per_page - 1) / bp->rows_per_page;
+  while (sb_count(bp->pages) < nb_pages) {
+    unsigned char* page = v2p_malloc((size_t)bp->rows_per_page * bp->row_size);
+    if (!page)
+      return false;
+    sb_push(bp->pages, page);
+  }
+  return true;
+}
+
+// Address of a row, in an allocated page
+static inline unsigned char* __row(const struct backpointers* bp, unsigned int row) {
+  return bp->pages[row / bp->rows_per_page] + (size_t)(row % bp->rows_per_page) * bp->row_size;
+}
+
+bool backpointers_push(struct backpointers* bp, const unsigned int* values) {
+  if (!backpointers_reserve(bp, bp->nb_rows + 1))
+    return false;
+  unsigned char* row = __row(bp, bp->nb_rows);
+  const unsigned int n = bp->nb_states;
+  switch (bp->bits) {
+    case 4:
+      memset(row, 0, bp->row_size);
+      for (unsigned int k = 0; k < n; k++)
+        row[k >> 1] |= (unsigned char)(values[k] << ((k & 1) * 4));
+      break;
+    case 8:
+      for (unsigned int k = 0; k < n; k++)
+        row[k] = (unsigned char)values[k];
+      break;
+    case 16:
+      for (unsigned int k = 0; k < n; k++) {
+        row[2 * k] = (unsigned char)values[k];
+        row[2 * k + 1] = (unsigned char)(values[k] >> 8);
+      }
+      break;
+    default:
+      memcpy(row, values, sizeof(*values) * n);
+      break;
+  }
+  bp->nb_rows++;
+  return true;
+}
+
+unsigned int backpointers_get(const struct backpointers* bp, unsigned int r, unsigned int k) {
+  const unsigned char* row = __row(bp, r);
+  switch (bp->bits) {
+    case 4:
+      return (row[k >> 1] >> ((k & 1) * 4)) & 0xf;
+    case 8:
+      return row[k];
+    case 16:
+      return row[2 * k] | (unsigned int)row[2 * k + 1] << 8;
+    default: {
+      unsigned int value;
+      memcpy(&value, row + sizeof(value) * k, sizeof(value));
+      return value;
+    }
+  }
+}
+
+size_t backpointers_memory(const struct backpointers* bp) {
+  return (size_t)sb_count(bp->pages) * bp->rows_per_page * bp->row_size;
+}
@@ -3,7 +3,11 @@
 #include "autocorrelation.h"
 #include "fft.h"
 #include "boersma.h"
+#include "window_cache.h"
+#include "spectrum.h"
 #include "stretchy_buffer.h"
+#include "allocator.h"
+#include "candidate_cache.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -11,6 +15,10 @@
 
 #define log2(x) (log(x) / log(2))
 
+// Number of floats processed at once by the direct autocorrelation
+// dot products, used by the cost model.
+#define BOERSMA_DIRECT_SIMD_WIDTH 4
+
 
 algorithm_descriptor_boersma_t* boersma_init(
   algorithm_descriptor_boersma_t* ad, uint frame_size, uint nb_candidates) {
@@ -25,28 +33,37 @@ algorithm_descriptor_boersma_t* boersma_init(
   ad->parent.frame_size = frame_size;
   ad->parent.nb_candidates_per_step = nb_candidates;
   ad->parent.generate_candidates = (algorithm_t)generate_boersma_candidates;
+  ad->parent.emit_candidates = (emitter_t)emit_boersma_candidates;
   ad->parent.generate_frame = (framer_t)generate_frame_boersma;
+  ad->parent.generate_candidates_batch = (batch_algorithm_t)generate_boersma_candidates_batch;
+  ad->parent.prepare = (preparer_t)boersma_prepare;
+  ad->parent.hash_settings = (hasher_t)boersma_hash_settings;
+  ad->parent.memory_usage = (sizer_t)boersma_memory_usage;
+  ad->parent.name = "boersma";
+  ad->autocorrelation_method = BOERSMA_AUTOCORRELATION_AUTO;
 
   ad->voiced_window = 0;
   ad->voiced_window_ac = 0;
   ad->hnr_window = 0;
   ad->hnr_window_ac = 0;
 
-  ad->voiced_window = malloc(sizeof(*ad->voiced_window) * ad->parent.frame_size);
-  compute_hann(ad->voiced_window, ad->parent.frame_size);
+  // The window and its autocorrelation are shared by all the instances
+  ad->voiced_window_ref = window_cache_acquire(WINDOW_HANN, ad->parent.frame_size, 0);
+  if (!ad->voiced_window_ref)
+    return NULL;
+  ad->voiced_window = (float*)ad->voiced_window_ref->window;
+  ad->voiced_window_ac = (float*)ad->voiced_window_ref->window_ac;
 
   return ad;
 }
 
 void boersma_delete(algorithm_descriptor_boersma_t* b) {
-    free(b->voiced_window);
-    if(b->voiced_window_ac)
-      b->voiced_window_ac = (free(b->voiced_window_ac), NULL);
-    free(b);
+    window_cache_release(b->voiced_window_ref);
+    v2p_free(b);
 }
 
 void boersma_unvoiced_delete(algorithm_descriptor_boersma_unvoiced_t* ad) {
-    free(ad);
+    v2p_free(ad);
 }
 
 algorithm_descriptor_boersma_unvoiced_t* boersma_unvoiced_init(
@@ -61,21 +78,33 @@ algorithm_descriptor_boersma_unvoiced_t* boersma_unvoiced_init(
     ad->parent.nb_candidates_per_step = 1;
     ad->parent.generate_candidates = (algorithm_t)generate_boersma_unvoiced_candidates;
     ad->parent.generate_frame = (framer_t)generate_frame_boersma;
+    ad->parent.generate_candidates_batch = (batch_algorithm_t)generate_boersma_unvoiced_candidates_batch;
+    // The unvoiced candidate is cheap: it's computed for silent frames too
+    ad->parent.generate_silence_candidates = (algorithm_t)generate_boersma_unvoiced_candidates;
+    ad->parent.emit_candidates = (emitter_t)emit_boersma_unvoiced_candidates;
+    ad->parent.emit_silence_candidates = (emitter_t)emit_boersma_unvoiced_candidates;
+    ad->parent.hash_settings = (hasher_t)boersma_unvoiced_hash_settings;
+    ad->parent.memory_usage = (sizer_t)boersma_unvoiced_memory_usage;
+    ad->parent.name = "boersma_unvoiced";
 
     return ad;
 }
 
 algorithm_descriptor_boersma_t* boersma_new(uint frame_size, uint nb_candidates) {
-    void* ptr = calloc(1, sizeof(struct algorithm_descriptor_boersma));
+    void* ptr = v2p_calloc(1, sizeof(struct algorithm_descriptor_boersma));
 
     if(!ptr)
       return NULL;
 
-    return boersma_init(ptr, frame_size, nb_candidates);
+    if (!boersma_init(ptr, frame_size, nb_candidates)) {
+      v2p_free(ptr);
+      return NULL;
+    }
+    return ptr;
 }
 
 algorithm_descriptor_boersma_unvoiced_t* boersma_unvoiced_new(uint frame_size) {
-    void* ptr = calloc(1, sizeof(struct algorithm_descriptor_boersma_unvoiced));
+    void* ptr = v2p_calloc(1, sizeof(struct algorithm_descriptor_boersma_unvoiced));
 
     if(!ptr)
       return NULL;
@@ -108,32 +137,66 @@ static double __tau(double x) {
   return 1.0 / 4.0 * log(3*x2 + 6*x + 1) - sqrt(6) / 24 * log((x + 1 - sqrt(2 / 3)) / (x + 1 + sqrt(2 / 3)));
 }
 
-candidate_t* generate_boersma_unvoiced_candidates(
+void emit_boersma_unvoiced_candidates(
   struct pitch_analyzer* s,
   struct algorithm_descriptor_boersma_unvoiced* ad,
-  float* frame_in) {
-  // Alloc a new candidates (only one is used. others are just zeros)
-  candidate_t* candidates = calloc(ad->parent.nb_candidates_per_step, sizeof(*candidates));
-
+  float* frame_in,
+  struct candidate_slice* out) {
+  // Only the first candidate is used. others are just zeros.
   // Its frequency is 0
-  candidates->frequency = 0;
+  out->frequency[0] = 0;
   // Its strength is function of the loc/glob peak
   const float numerator = fabs_max_arr(frame_in, ad->parent.frame_size) / s->global_absolute_peak;
   const float denominator = s->silence_threshold / (1.f + s->voicing_threshold);
   const float quotient = numerator / denominator;
-  candidates->weight = s->voicing_threshold + (float)fmax(0.f, 2.f - quotient);
+  out->weight[0] = s->voicing_threshold + (float)fmax(0.f, 2.f - quotient);
+}
 
-  return candidates;
+candidate_t* generate_boersma_unvoiced_candidates(
+  struct pitch_analyzer* s,
+  struct algorithm_descriptor_boersma_unvoiced* ad,
+  float* frame_in) {
+  return generate_boersma_unvoiced_candidates_batch(s, ad, &frame_in, 1);
+}
+
+candidate_t* generate_boersma_unvoiced_candidates_batch(
+  struct pitch_analyzer* s,
+  struct algorithm_descriptor_boersma_unvoiced* ad,
+  float** frames_in,
+  unsigned int nb_frames) {
+  return v2p_emit_candidates_array(s, (algorithm_descriptor_t*)ad,
+    (emitter_t)emit_boersma_unvoiced_candidates, frames_in, nb_frames);
+}
+
+uint64_t boersma_hash_settings(algorithm_descriptor_boersma_t* ad, uint64_t hash) {
+  // The autocorrelation methods differ by rounding errors
+  const unsigned int settings[] = {
+    ad->parent.frame_size, ad->parent.nb_candidates_per_step, ad->direct_autocorrelation != 0
+  };
+  hash = v2p_hash_bytes(hash, "boersma", 7);
+  return v2p_hash_bytes(hash, settings, sizeof(settings));
+}
+
+uint64_t boersma_unvoiced_hash_settings(algorithm_descriptor_boersma_unvoiced_t* ad, uint64_t hash) {
+  const unsigned int settings[] = { ad->parent.frame_size, ad->parent.nb_candidates_per_step };
+  hash = v2p_hash_bytes(hash, "boersma_unvoiced", 16);
+  return v2p_hash_bytes(hash, settings, sizeof(settings));
+}
+
+size_t boersma_memory_usage(algorithm_descriptor_boersma_t* ad) {
+  return sizeof(*ad) + window_cache_memory(ad->voiced_window_ref);
+}
+
+size_t boersma_unvoiced_memory_usage(algorithm_descriptor_boersma_unvoiced_t* ad) {
+  return sizeof(*ad);
 }
 
 // Interpolate with quadratic equation
-static float __quadratic_method(uint k, float* X) {
+// yl, yc, yr are the values at k - 1, k and k + 1.
+static float __quadratic_method(uint k, double yl, double yc, double yr) {
     const float xl = (float)(k - 1);
     const float xc = (float)(k);
     const float xr = (float)(k + 1);
-    const double yl = X[k - 1];
-    const double yc = X[k];
-    const double yr = X[k + 1];
     const double d2 = 2 * ((yr - yc) - (yl - yc) / (xl - xc)) / 2.0;
     const double d1 = (yr - yc) / (xr - xc) - 0.5 * d2 * (xr - xc);
 
@@ -149,56 +212,219 @@ static float __quadratic_method(uint k, float* X) {
     return xe;
 }
 
-candidate_t* generate_boersma_candidates(
+// Range of lags [*first, *last] which can produce a candidate in
+// [minimal_frequency, maximal_frequency]. The interpolated lag of a local
+// maximum is at most half a lag away, so a margin of 2 lags is enough.
+static void __boersma_lag_range(struct pitch_analyzer* s, unsigned int size_out,
+  unsigned int* first, unsigned int* last) {
+  const double min_lag = floor(s->sampling_rate / s->maximal_frequency) - 2;
+  const double max_lag = ceil(s->sampling_rate / s->minimal_frequency) + 2;
+  *first = (min_lag < 1) ? 1 : (unsigned int)min_lag;
+  *last = (size_out < 2 || max_lag < size_out - 2) ?
+    (unsigned int)max_lag : size_out - 2;
+}
+
+void boersma_prepare(pitch_analyzer_t* s, algorithm_descriptor_boersma_t* ad) {
+  switch (ad->autocorrelation_method) {
+    case BOERSMA_AUTOCORRELATION_FFT:
+      ad->direct_autocorrelation = 0;
+      return;
+    case BOERSMA_AUTOCORRELATION_DIRECT:
+      ad->direct_autocorrelation = 1;
+      return;
+    case BOERSMA_AUTOCORRELATION_AUTO:
+    default:
+      break;
+  }
+
+  // The direct method computes a dot product of frame_size products per
+  // lag, the FFT method two transforms of ac_length values.
+  const unsigned int frame_size = ad->parent.frame_size;
+  const unsigned int ac_length = autocorrelation_length(frame_size);
+  unsigned int first, last;
+  __boersma_lag_range(s, ac_length / 4, &first, &last);
+  const double nb_lags = (last >= first) ? last - first + 4 : 1;
+  const double direct_cost = nb_lags * frame_size / BOERSMA_DIRECT_SIMD_WIDTH;
+  const double fft_cost = 3.0 * ac_length * log2(ac_length);
+  ad->direct_autocorrelation = direct_cost < fft_cost;
+}
+
+// Value of the corrected autocorrelation at lag i.
+// window_ac is NULL when the autocorrelation is already corrected.
+static inline float __corrected(const float* autocorrelation,
+  const float* window_ac, unsigned int i) {
+  return window_ac ? autocorrelation[i] / window_ac[i] : autocorrelation[i];
+}
+
+// Insert a candidate into the out->size best ones of out, sorted by
+// decreasing weight. nb_kept is the number of candidates already kept.
+// A candidate is inserted after the ones of the same weight.
+static void __boersma_insert_candidate(struct candidate_slice* out, unsigned int* nb_kept,
+  float frequency, float weight) {
+  if (*nb_kept == out->size && (!out->size || weight <= out->weight[out->size - 1]))
+    return;
+  unsigned int j = (*nb_kept < out->size) ? (*nb_kept)++ : out->size - 1;
+  for (; j > 0 && out->weight[j - 1] < weight; j--) {
+    out->frequency[j] = out->frequency[j - 1];
+    out->weight[j] = out->weight[j - 1];
+  }
+  out->frequency[j] = frequency;
+  out->weight[j] = weight;
+}
+
+// Pick the candidates from the local maximums of a corrected autocorrelation.
+// The division by the autocorrelation of the window is done on the fly
+// for the lags of the frequency range only.
+// The best out->size candidates are written into out by decreasing weight.
+// Each of the size_out lags without candidate counts as an unvoiced
+// candidate with a null weight.
+static void __boersma_pick_candidates(
   struct pitch_analyzer* s,
   struct algorithm_descriptor_boersma* ad,
-  float* frame_in) {
-  // Lag values sorted by amplitude of the autocorrelation function
-  unsigned int size_out;
-  // Free last fft if required
-  if (s->last_fft)
-    free(s->last_fft);
-  float* autocorrelation = compute_corrected_autocorrelation_and_fft(
-    frame_in, ad->voiced_window, &ad->voiced_window_ac, &s->last_fft,
-    ad->parent.frame_size, &size_out);
-   // This value is dependent of the implementation autocorrelation's implementation.
-   // It would be nice to have a better design when the fft is shared between algorithms
-   // instead of retrieving it.
-   s->last_fft_size = size_out * 4;
-
-  // Candidates considered
-  unsigned int nb_candidates = (ad->parent.nb_candidates_per_step > size_out) ?
-    ad->parent.nb_candidates_per_step : size_out;
-  candidate_t* candidates = calloc(nb_candidates, sizeof(*candidates));
-  for (unsigned int ds = 1; ds + 1 < size_out; ds++) {
-    const float v = autocorrelation[ds];
+  const float* autocorrelation,
+  const float* window_ac,
+  unsigned int size_out,
+  struct candidate_slice* out) {
+  // Lags outside of this range are filtered by frequency anyway
+  unsigned int first, last;
+  __boersma_lag_range(s, size_out, &first, &last);
+  if (first > last)
+    return;
+  // Candidates kept in out, and candidates found
+  unsigned int nb_kept = 0;
+  unsigned int nb_found = 0;
+  const float origin = __corrected(autocorrelation, window_ac, 0);
+  float previous = __corrected(autocorrelation, window_ac, first - 1);
+  float v = __corrected(autocorrelation, window_ac, first);
+  for (unsigned int ds = first; ds <= last; ds++) {
+    const float next = __corrected(autocorrelation, window_ac, ds + 1);
 
     //! Filter by local maximum
-    if (v >= autocorrelation[ds - 1] && v >= autocorrelation[ds + 1]) {
+    if (v >= previous && v >= next) {
       // Interpolate lag of maximal value
-      float ds_new = __quadratic_method(ds, autocorrelation);
+      float ds_new = __quadratic_method(ds, previous, v, next);
       // Todo : Also interpolate the amplitude and use it
 
-      candidates[ds].frequency = 1.f / (ds_new * s->delta_t);
-      candidates[ds].amplitude = autocorrelation[ds] / autocorrelation[0];
+      candidate_t candidate;
+      candidate.frequency = 1.f / (ds_new * s->delta_t);
+      candidate.amplitude = v / origin;
       // Compute the weigth of the candidate
-      __boersma_compute_weigth(s, ad, ds, candidates + ds);
+      __boersma_compute_weigth(s, ad, ds, &candidate);
+
+      //! Filter by frequency
+      const float freq = candidate.frequency;
+      if (freq >= s->minimal_frequency && freq <= s->maximal_frequency) {
+        __boersma_insert_candidate(out, &nb_kept, candidate.frequency, candidate.weight);
+        nb_found++;
+      }
     }
+    previous = v;
+    v = next;
+  }
 
-    //! Filter by frequency
-    const float freq = candidates[ds].frequency;
-    if (freq < s->minimal_frequency || freq > s->maximal_frequency) {
-      candidates[ds].frequency = 0;
-      candidates[ds].amplitude = 0;
+  // The unvoiced candidates of the other lags come before the negative weights
+  unsigned int nb_positive = 0;
+  while (nb_positive < nb_kept && out->weight[nb_positive] >= 0)
+    nb_positive++;
+  const unsigned int nb_unvoiced = _min(size_out - nb_found, out->size - nb_positive);
+  for (unsigned int j = nb_kept; j-- > nb_positive;)
+    if (j + nb_unvoiced < out->size) {
+      out->frequency[j + nb_unvoiced] = out->frequency[j];
+      out->weight[j + nb_unvoiced] = out->weight[j];
     }
+  for (unsigned int j = nb_positive; j < nb_positive + nb_unvoiced; j++) {
+    out->frequency[j] = 0;
+    out->weight[j] = 0;
   }
-  // Sort by decreasing amplitude
-  qsort(candidates, size_out, sizeof(*candidates), dsc_candidates_amplitude);
+}
 
-  // Free autocorrelation
-  free(autocorrelation);
+// Candidates of a frame from its direct autocorrelation
+static void __boersma_direct_candidates(
+  struct pitch_analyzer* s,
+  struct algorithm_descriptor_boersma* ad,
+  const float* frame_in,
+  struct candidate_slice* out) {
+  const unsigned int frame_size = ad->parent.frame_size;
+  unsigned int size_out = autocorrelation_length(frame_size) / 4;
+  unsigned int first, last;
+  __boersma_lag_range(s, size_out, &first, &last);
+  // Neighbours of the range are needed to detect the local maximums
+  float* autocorrelation = compute_corrected_autocorrelation_direct(
+    frame_in, ad->voiced_window, ad->voiced_window_ac, frame_size,
+    first - 1, last + 1, &size_out);
+  if (!autocorrelation)
+    return;
+
+  __boersma_pick_candidates(s, ad, autocorrelation, NULL, size_out, out);
+  v2p_free(autocorrelation);
+}
+
+void emit_boersma_candidates(
+  struct pitch_analyzer* s,
+  struct algorithm_descriptor_boersma* ad,
+  float* frame_in,
+  struct candidate_slice* out) {
+  // Lag values sorted by amplitude of the autocorrelation function
+  unsigned int size_out;
+  if (ad->direct_autocorrelation) {
+    __boersma_direct_candidates(s, ad, frame_in, out);
+    return;
+  }
+  // The spectrum of the frame is shared with the other algorithms
+  const float* autocorrelation = spectral_context_autocorrelation_head(
+    s->spectrum, frame_in, ad->voiced_window_ref, &size_out);
+  if (!autocorrelation)
+    return;
 
   // Store the candidates
+  __boersma_pick_candidates(s, ad, autocorrelation, ad->voiced_window_ac, size_out, out);
+}
+
+candidate_t* generate_boersma_candidates(
+  struct pitch_analyzer* s,
+  struct algorithm_descriptor_boersma* ad,
+  float* frame_in) {
+  return v2p_emit_candidates_array(s, (algorithm_descriptor_t*)ad,
+    (emitter_t)emit_boersma_candidates, &frame_in, 1);
+}
+
+candidate_t* generate_boersma_candidates_batch(
+  struct pitch_analyzer* s,
+  struct algorithm_descriptor_boersma* ad,
+  float** frames_in,
+  unsigned int nb_frames) {
+  const unsigned int nb_candidates = ad->parent.nb_candidates_per_step;
+  // Dot products don't gain anything from batching
+  if (ad->direct_autocorrelation)
+    return v2p_emit_candidates_array(s, (algorithm_descriptor_t*)ad,
+      (emitter_t)emit_boersma_candidates, frames_in, nb_frames);
+
+  unsigned int size_out;
+  float* autocorrelations = compute_autocorrelation_head_batch(
+    frames_in, nb_frames, ad->voiced_window, ad->parent.frame_size, &size_out);
+  candidate_t* candidates = v2p_calloc((size_t)nb_frames * nb_candidates, sizeof(*candidates));
+  // Candidates of a frame
+  float* buffer = v2p_malloc(sizeof(*buffer) * (2 * nb_candidates + 1));
+  if (!autocorrelations || !candidates || !buffer) {
+    v2p_free(autocorrelations);
+    v2p_free(candidates);
+    v2p_free(buffer);
+    return NULL;
+  }
+
+  struct candidate_slice slice = { buffer, buffer + nb_candidates, NULL, nb_candidates };
+  for (unsigned int k = 0; k < nb_frames; k++) {
+    memset(buffer, 0, sizeof(*buffer) * 2 * nb_candidates);
+    __boersma_pick_candidates(s, ad, autocorrelations + (size_t)k * size_out,
+      ad->voiced_window_ac, size_out, &slice);
+    for (unsigned int i = 0; i < nb_candidates; i++) {
+      candidates[(size_t)k * nb_candidates + i].frequency = slice.frequency[i];
+      candidates[(size_t)k * nb_candidates + i].weight = slice.weight[i];
+    }
+  }
+
+  v2p_free(buffer);
+  v2p_free(autocorrelations);
   return candidates;
 }
 
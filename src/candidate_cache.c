@@ -0,0 +1,299 @@
+#if !defined _WIN32 && !defined _WIN64
+  #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "candidate_cache.h"
+#include "v2p.h"
+#include "candidates.h"
+#include "allocator.h"
+#include "stretchy_buffer.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined _WIN32 || defined _WIN64
+  #include <windows.h>
+  #include <process.h>
+  #define __getpid _getpid
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #define __getpid getpid
+#endif
+
+#define V2P_CACHE_MAGIC "V2PC"
+#define V2P_CACHE_BYTE_ORDER 0x01020304u
+
+// Read only mapping of a whole file
+struct v2p_cache_mapping {
+  const unsigned char* data;
+  size_t size;
+#if defined _WIN32 || defined _WIN64
+  HANDLE file;
+  HANDLE map;
+#endif
+};
+
+uint64_t v2p_hash_bytes(uint64_t hash, const void* data, size_t size) {
+  const unsigned char* bytes = data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+#define __hash_value(hash, value) v2p_hash_bytes(hash, &(value), sizeof(value))
+
+uint64_t v2p_cache_key(pitch_analyzer_t* s, const float* audio, unsigned int size) {
+  const uint32_t version = V2P_CACHE_VERSION;
+  uint64_t hash = __hash_value(V2P_HASH_INIT, version);
+  hash = v2p_hash_bytes(hash, audio, sizeof(*audio) * size);
+
+  // Settings used while the candidates are computed
+  hash = __hash_value(hash, s->frame_time_step);
+  hash = __hash_value(hash, s->minimal_frequency);
+  hash = __hash_value(hash, s->maximal_frequency);
+  hash = __hash_value(hash, s->initial_absolute_peak_coeff);
+  hash = __hash_value(hash, s->octave_cost);
+  hash = __hash_value(hash, s->silence_threshold);
+  hash = __hash_value(hash, s->voicing_threshold);
+  hash = __hash_value(hash, s->zero_padding);
+  hash = __hash_value(hash, s->sampling_rate);
+  hash = __hash_value(hash, s->silence_gating);
+
+  for (algorithm_descriptor_t* ad = s->algorithm_descriptors; ad; ad = ad->next) {
+    if (!ad->hash_settings)
+      return 0;
+    hash = ad->hash_settings(ad, hash);
+  }
+  // 0 means "not cachable"
+  return hash ? hash : 1;
+}
+
+// Write count floats of an array of length floats, padded with zeros
+static bool __write_floats(FILE* file, const float* array, size_t count, size_t length) {
+  static const float zeros[256] = {0};
+  if (count && fwrite(array, sizeof(*array), count, file) != count)
+    return false;
+  for (size_t i = count; i < length; ) {
+    const size_t n = (length - i < 256) ? length - i : 256;
+    if (fwrite(zeros, sizeof(*zeros), n, file) != n)
+      return false;
+    i += n;
+  }
+  return true;
+}
+
+int v2p_cache_write(pitch_analyzer_t* s, const char* path, uint64_t key) {
+  const struct candidate_store* store = &s->candidates;
+  const unsigned int nb_timesteps = s->number_of_timesteps;
+  if (store->nb_steps < nb_timesteps)
+    return V2P_ERROR_INVALID_ARGUMENT;
+
+  struct v2p_cache_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, V2P_CACHE_MAGIC, 4);
+  header.version = V2P_CACHE_VERSION;
+  header.header_size = sizeof(header);
+  header.byte_order = V2P_CACHE_BYTE_ORDER;
+  header.key = key;
+  header.nb_candidates_per_step = store->nb_per_step;
+  header.number_of_timesteps = nb_timesteps;
+  header.steps_per_chunk = store->steps_per_chunk;
+  header.nb_chunks = (nb_timesteps + store->steps_per_chunk - 1) / store->steps_per_chunk;
+  header.frame_step_size = s->frame_step_size;
+  header.sampling_rate = s->sampling_rate;
+  header.frame_time_step = s->frame_time_step;
+
+  // Write under a temporary name, so that a reader never maps a partial file
+  const size_t path_length = strlen(path);
+  char* tmp_path = v2p_malloc(path_length + 32);
+  if (!tmp_path)
+    return V2P_ERROR_OUT_OF_MEMORY;
+  sprintf(tmp_path, "%s.%u.tmp", path, (unsigned int)__getpid());
+  FILE* file = fopen(tmp_path, "wb");
+  if (!file) {
+    v2p_free(tmp_path);
+    return V2P_ERROR_IO;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  const size_t chunk_length = (size_t)store->steps_per_chunk * store->nb_per_step;
+  struct candidate_slice step;
+  for (unsigned int i = 0; ok && i < header.nb_chunks; i++) {
+    const unsigned int first = i * store->steps_per_chunk;
+    const unsigned int nb_steps = (nb_timesteps - first < store->steps_per_chunk) ?
+      nb_timesteps - first : store->steps_per_chunk;
+    const size_t count = (size_t)nb_steps * store->nb_per_step;
+    candidates_step(store, first, &step);
+    ok = __write_floats(file, step.frequency, count, chunk_length) &&
+      __write_floats(file, step.weight, count, chunk_length) &&
+      __write_floats(file, step.log2_frequency, count, chunk_length);
+  }
+  ok = (fclose(file) == 0) && ok;
+  if (ok) {
+    // rename doesn't replace an existing file on Windows
+    remove(path);
+    ok = rename(tmp_path, path) == 0;
+  }
+  if (!ok)
+    remove(tmp_path);
+  v2p_free(tmp_path);
+  return ok ? V2P_OK : V2P_ERROR_IO;
+}
+
+// Map a whole file, read only. Return NULL if it can't be mapped.
+static struct v2p_cache_mapping* __map_file(const char* path) {
+  struct v2p_cache_mapping* mapping = v2p_calloc(1, sizeof(*mapping));
+  if (!mapping)
+    return NULL;
+#if defined _WIN32 || defined _WIN64
+  mapping->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+    NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  LARGE_INTEGER size;
+  if (mapping->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(mapping->file, &size) ||
+      !size.QuadPart) {
+    if (mapping->file != INVALID_HANDLE_VALUE)
+      CloseHandle(mapping->file);
+    v2p_free(mapping);
+    return NULL;
+  }
+  mapping->size = (size_t)size.QuadPart;
+  mapping->map = CreateFileMappingA(mapping->file, NULL, PAGE_READONLY, 0, 0, NULL);
+  mapping->data = mapping->map ? MapViewOfFile(mapping->map, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (!mapping->data) {
+    if (mapping->map)
+      CloseHandle(mapping->map);
+    CloseHandle(mapping->file);
+    v2p_free(mapping);
+    return NULL;
+  }
+#else
+  const int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+    if (fd >= 0)
+      close(fd);
+    v2p_free(mapping);
+    return NULL;
+  }
+  mapping->size = (size_t)st.st_size;
+  void* data = mmap(NULL, mapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid once the file is closed
+  close(fd);
+  if (data == MAP_FAILED) {
+    v2p_free(mapping);
+    return NULL;
+  }
+  mapping->data = data;
+#endif
+  return mapping;
+}
+
+static void __unmap_file(struct v2p_cache_mapping* mapping) {
+#if defined _WIN32 || defined _WIN64
+  UnmapViewOfFile(mapping->data);
+  CloseHandle(mapping->map);
+  CloseHandle(mapping->file);
+#else
+  munmap((void*)mapping->data, mapping->size);
+#endif
+  v2p_free(mapping);
+}
+
+void v2p_cache_unmap(pitch_analyzer_t* s) {
+  if (!s->cache_mapping)
+    return;
+  __unmap_file(s->cache_mapping);
+  s->cache_mapping = NULL;
+}
+
+// Tell if a mapped file holds the candidates expected by s
+static bool __header_matches(pitch_analyzer_t* s, const struct v2p_cache_mapping* mapping,
+  uint64_t key) {
+  struct v2p_cache_header header;
+  if (mapping->size < sizeof(header))
+    return false;
+  memcpy(&header, mapping->data, sizeof(header));
+  if (memcmp(header.magic, V2P_CACHE_MAGIC, 4) != 0 ||
+      header.version != V2P_CACHE_VERSION ||
+      header.header_size != sizeof(header) ||
+      header.byte_order != V2P_CACHE_BYTE_ORDER ||
+      header.key != key ||
+      header.nb_candidates_per_step != s->nb_candidates_per_step ||
+      header.frame_step_size != s->frame_step_size ||
+      header.sampling_rate != s->sampling_rate ||
+      header.frame_time_step != s->frame_time_step ||
+      !header.steps_per_chunk ||
+      (uint64_t)header.nb_chunks * header.steps_per_chunk < header.number_of_timesteps)
+    return false;
+  const uint64_t chunk_size = (uint64_t)3 * header.steps_per_chunk *
+    header.nb_candidates_per_step * sizeof(float);
+  return mapping->size == sizeof(header) + header.nb_chunks * chunk_size;
+}
+
+int v2p_cache_load(pitch_analyzer_t* s, const char* path, uint64_t key) {
+  v2p_reset(s);
+  if (!key)
+    return V2P_ERROR_CACHE_MISS;
+
+  int status = V2P_OK;
+  const v2p_allocator_t* previous = v2p_allocator_enter(s->allocator);
+  struct v2p_cache_mapping* mapping = __map_file(path);
+  if (!mapping || !__header_matches(s, mapping, key)) {
+    if (mapping)
+      __unmap_file(mapping);
+    v2p_allocator_leave(previous);
+    return V2P_ERROR_CACHE_MISS;
+  }
+
+  struct v2p_cache_header header;
+  memcpy(&header, mapping->data, sizeof(header));
+  struct candidate_store* store = &s->candidates;
+  candidates_clear(store);
+  candidates_init(store, header.nb_candidates_per_step);
+  store->steps_per_chunk = header.steps_per_chunk;
+  store->borrowed = true;
+  const size_t chunk_size = (size_t)3 * header.steps_per_chunk * header.nb_candidates_per_step *
+    sizeof(float);
+  sb_reserve(store->chunks, header.nb_chunks);
+  if (sb_capacity(store->chunks) < header.nb_chunks) {
+    candidates_clear(store);
+    __unmap_file(mapping);
+    status = V2P_ERROR_OUT_OF_MEMORY;
+  }
+  else {
+    // The chunks are used from the mapping: they are never written
+    for (unsigned int i = 0; i < header.nb_chunks; i++)
+      sb_push(store->chunks, (float*)(mapping->data + sizeof(header) + i * chunk_size));
+    store->nb_steps = header.number_of_timesteps;
+    s->number_of_timesteps = header.number_of_timesteps;
+    s->cache_mapping = mapping;
+  }
+  v2p_allocator_leave(previous);
+  return status;
+}
+
+int v2p_run_cached(pitch_analyzer_t* s, float* audio, unsigned int size, const char* directory) {
+  v2p_reset(s);
+  const uint64_t key = v2p_cache_key(s, audio, size);
+  if (!key)
+    return v2p_run(s, audio, size);
+
+  char* path = v2p_malloc(strlen(directory) + 32);
+  if (!path)
+    return V2P_ERROR_OUT_OF_MEMORY;
+  sprintf(path, "%s/%016llx.v2pc", directory, (unsigned long long)key);
+
+  // Hit: straight to the decoding
+  int status = v2p_cache_load(s, path, key);
+  if (status == V2P_ERROR_CACHE_MISS) {
+    status = v2p_run(s, audio, size);
+    if (status == V2P_OK)
+      v2p_cache_write(s, path, key);
+  }
+  v2p_free(path);
+  return status;
+}
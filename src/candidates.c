@@ -0,0 +1,113 @@
+#include "candidates.h"
+#include "v2p.h"
+#include "allocator.h"
+#include "stretchy_buffer.h"
+#include <string.h>
+#include <math.h>
+
+void candidates_init(struct candidate_store* store, unsigned int nb_per_step) {
+  memset(store, 0, sizeof(*store));
+  store->nb_per_step = nb_per_step;
+  store->steps_per_chunk = nb_per_step ? CANDIDATES_CHUNK_SIZE / nb_per_step : 1;
+  if (!store->steps_per_chunk)
+    store->steps_per_chunk = 1;
+}
+
+void candidates_clear(struct candidate_store* store) {
+  if (!store->borrowed)
+    for (unsigned int i = 0; i < sb_count(store->chunks); i++)
+      v2p_free(store->chunks[i]);
+  store->chunks = sb_free(store->chunks);
+  store->nb_steps = 0;
+  store->borrowed = false;
+}
+
+// Number of candidates of each array of a chunk
+static inline size_t __chunk_length(const struct candidate_store* store) {
+  return (size_t)store->steps_per_chunk * store->nb_per_step;
+}
+
+bool candidates_reserve(struct candidate_store* store, unsigned int nb_steps) {
+  const unsigned int nb_chunks = (nb_steps + store->steps_per_chunk - 1) / store->steps_per_chunk;
+  while (sb_count(store->chunks) < nb_chunks) {
+    float* chunk = v2p_malloc(sizeof(*chunk) * 3 * (__chunk_length(store) ? __chunk_length(store) : 1));
+    if (!chunk)
+      return false;
+    sb_push(store->chunks, chunk);
+  }
+  return true;
+}
+
+void candidates_step(const struct candidate_store* store, unsigned int t,
+  struct candidate_slice* step) {
+  float* chunk = store->chunks[t / store->steps_per_chunk];
+  const size_t offset = (size_t)(t % store->steps_per_chunk) * store->nb_per_step;
+  step->frequency = chunk + offset;
+  step->weight = chunk + __chunk_length(store) + offset;
+  step->log2_frequency = chunk + 2 * __chunk_length(store) + offset;
+  step->size = store->nb_per_step;
+}
+
+bool candidates_add_step(struct candidate_store* store, struct candidate_slice* step) {
+  if (!candidates_reserve(store, store->nb_steps + 1))
+    return false;
+  candidates_step(store, store->nb_steps, step);
+  memset(step->frequency, 0, sizeof(float) * step->size);
+  memset(step->weight, 0, sizeof(float) * step->size);
+  memset(step->log2_frequency, 0, sizeof(float) * step->size);
+  store->nb_steps++;
+  return true;
+}
+
+void candidates_finish_step(struct candidate_store* store) {
+  if (!store->nb_steps)
+    return;
+  struct candidate_slice step;
+  candidates_step(store, store->nb_steps - 1, &step);
+  for (unsigned int k = 0; k < step.size; k++)
+    step.log2_frequency[k] = (step.frequency[k] > 0) ? log2f(step.frequency[k]) : 0;
+}
+
+candidate_t candidates_get(const struct candidate_store* store, unsigned int t, unsigned int k) {
+  struct candidate_slice step;
+  candidates_step(store, t, &step);
+  candidate_t candidate;
+  candidate.frequency = step.frequency[k];
+  candidate.weight = step.weight[k];
+  return candidate;
+}
+
+void candidates_copy(const struct candidate_store* store, candidate_t* out) {
+  struct candidate_slice step;
+  for (unsigned int t = 0; t < store->nb_steps; t++) {
+    candidates_step(store, t, &step);
+    for (unsigned int k = 0; k < step.size; k++) {
+      out->frequency = step.frequency[k];
+      out->weight = step.weight[k];
+      out++;
+    }
+  }
+}
+
+size_t candidates_count(const struct candidate_store* store) {
+  return (size_t)store->nb_steps * store->nb_per_step;
+}
+
+size_t candidates_memory(const struct candidate_store* store) {
+  return (size_t)sb_count(store->chunks) * 3 * __chunk_length(store) * sizeof(float);
+}
+
+void candidate_slice_sub(const struct candidate_slice* slice, unsigned int offset,
+  unsigned int size, struct candidate_slice* out) {
+  out->frequency = slice->frequency + offset;
+  out->weight = slice->weight + offset;
+  out->log2_frequency = slice->log2_frequency + offset;
+  out->size = size;
+}
+
+void candidate_slice_assign(struct candidate_slice* slice, const candidate_t* candidates) {
+  for (unsigned int k = 0; k < slice->size; k++) {
+    slice->frequency[k] = candidates[k].frequency;
+    slice->weight[k] = candidates[k].weight;
+  }
+}
@@ -3,13 +3,20 @@
 #include "v2p.h"
 #include "stdlib.h"
 #include "stdbool.h"
+#include "sync.h"
+#include "tables.h"
+#include "string.h"
 
 #define SWAP(a,b) tempr=(a); (a)=(b); (b)=tempr
 
-// Hash table used to precompute cosinus and sinus tables
+// Table of sin(2 pi / 2^i).
 #define SINCOS_TAB_SIZE 256
-static double sin_table[SINCOS_TAB_SIZE];
-static double cos_table[SINCOS_TAB_SIZE];
+
+// Use the tables generated at build time when they are available, except
+// when building the generator itself.
+#if defined(V2P_HAS_GENERATED_TABLES) && !defined(V2P_GENERATING_TABLES)
+  #define V2P_USE_STATIC_TABLES
+#endif
 
 uint log2ui(uint n) {
   uint log = 0;
@@ -17,23 +24,31 @@ uint log2ui(uint n) {
   return log;
 }
 
-void __precompute_sincos() {
+#ifdef V2P_USE_STATIC_TABLES
+// Embedded read only in the library
+#define sin_table v2p_sin_table
+
+static inline
+void initialize_sincos_tables() {
+}
+#else
+// Written once by initialize_sincos_tables and read only afterward.
+static double sin_table[SINCOS_TAB_SIZE];
+static v2p_once_t sincos_once = V2P_ONCE_INIT;
+
+static void __precompute_sincos(void) {
   const double theta = 2 * M_PI;
-  for (uint i = 0; i < SINCOS_TAB_SIZE; i++) {
+  for (uint i = 0; i < SINCOS_TAB_SIZE; i++)
     sin_table[i] = sin(theta / pow(2., i));
-    cos_table[i] = cos(theta / pow(2., i));
-  }
 }
 
+// Thread safe: the table is filled by the first caller, the others wait
+// for it to be ready.
 static inline
 void initialize_sincos_tables() {
-  static bool initialized = false;
-  if (!initialized) {
-    __precompute_sincos();
-    initialized = true;
-  }
+  v2p_once(&sincos_once, __precompute_sincos);
 }
-
+#endif
 
 //
 // See the book:
@@ -47,7 +62,7 @@ void initialize_sincos_tables() {
 // data is a complex array of length nn or, equivalently, a real array
 // of length 2*nn.
 // nn MUST be an integer power of 2 (this is not checked for!).
-void dfft(float data[], unsigned int nn, int isign) {
+static void __dfft(float data[], unsigned int nn, int isign, unsigned int pruning) {
   initialize_sincos_tables();
   unsigned int n, mmax, m, j, istep, i;
   double wtemp, wr, wpr, wpi, wi;
@@ -72,9 +87,24 @@ void dfft(float data[], unsigned int nn, int isign) {
   // Here  begins  the  Danielson-Lanczos  section  of  the  routine.
   mmax = 2;
   uint theta_index = 1;
+  if ((pruning & FFT_PRUNE_ZERO_PADDED) && nn >= 4) {
+    // After the bit reversal the odd complex are zero, so the first
+    // stage (where w = 1) copies the even complex onto them.
+    for (i = 1; i <= n; i += 4) {
+      data[i + 1] = data[i - 1];
+      data[i + 2] = data[i];
+    }
+    mmax = 4;
+    theta_index++;
+  }
+  const bool first_quarter = (pruning & FFT_PRUNE_FIRST_QUARTER) && nn >= 4;
   while (n > mmax) {
     // Outer loop executed log2(nn) times.
     istep = mmax << 1;
+    // When only the first quarter of the output is needed, the last two
+    // stages only compute the sums, and the last one only up to n / 4.
+    const bool sums_only = first_quarter && istep >= (n >> 1);
+    const unsigned int m_end = (first_quarter && istep == n) ? (n >> 2) : mmax;
     // Initialize the trigonometric recurrence.
     //The angle considered is theta = isign * (6.28318530717959 / mmax)
     wtemp = sin_table[theta_index + 1]; // abs(sin(theta / 2))
@@ -82,6 +112,21 @@ void dfft(float data[], unsigned int nn, int isign) {
     wpi = isign * sin_table[theta_index]; // sin(theta)
     wr = 1.0;
     wi = 0.0;
+    if (sums_only) {
+      for (m = 1; m < m_end; m += 2) {
+        for (i = m; i <= n; i += istep) {
+          j = i + mmax;
+          data[i - 1] += (float)(wr * data[j - 1] - wi * data[j]);
+          data[i] += (float)(wr * data[j] + wi * data[j - 1]);
+        }
+        wtemp = wr;
+        wr += wr * wpr - wi * wpi;
+        wi += wi * wpr + wtemp * wpi;
+      }
+      mmax = istep;
+      theta_index++;
+      continue;
+    }
     for (m = 1; m < mmax; m += 2) { // Here are the two nested inner loops.
       for (i = m; i <= n; i += istep) {
         j = i + mmax;
@@ -103,6 +148,10 @@ void dfft(float data[], unsigned int nn, int isign) {
   }
 }
 
+void dfft(float data[], unsigned int nn, int isign) {
+  __dfft(data, nn, isign, FFT_PRUNE_NONE);
+}
+
 // Calculates the Fourier transform of a set of n real-valued data points.
 // Replaces this data (whichis stored in array data[0..n-1]) by the positive
 // frequency half of its complex Fourier transform.
@@ -123,7 +172,7 @@ void dfft(float data[], unsigned int nn, int isign) {
 // data[1022] --- real component of transform point 511
 // data[1023] --- imaginary component of transform point 511
 //
-void realft(float data[], unsigned int n, int isign) {
+static void __realft(float data[], unsigned int n, int isign, unsigned int pruning) {
   initialize_sincos_tables();
   unsigned int i, i1, i2, i3, i4, np1;
   float c1 = 0.5, c2, h1r, h1i, h2r, h2i;
@@ -135,7 +184,7 @@ void realft(float data[], unsigned int n, int isign) {
   if (isign == 1) {
     // The forward transform is here.
     c2 = -0.5;
-    dfft(data, n >> 1, 1);
+    __dfft(data, n >> 1, 1, pruning);
   } else {
     // Otherwise set up for an inverse trans-form.
     c2 = 0.5;
@@ -177,11 +226,222 @@ void realft(float data[], unsigned int n, int isign) {
     data[0] = c1 * ((h1r = data[0]) + data[1]);
     data[1] = c1 * (h1r - data[1]);
     // This is the inverse transform for the case isign = -1.
-    dfft(data, n >> 1, -1);
+    __dfft(data, n >> 1, -1, pruning);
+  }
+}
+
+void realft(float data[], unsigned int n, int isign) {
+  __realft(data, n, isign, FFT_PRUNE_NONE);
+}
+
+void realft_pruned(float data[], unsigned int n, int isign, unsigned int pruning) {
+  // Forward transforms can only skip work on their input,
+  // inverse transforms on their output.
+  pruning &= (isign == FFT_FORWARD) ? FFT_PRUNE_ZERO_PADDED : FFT_PRUNE_FIRST_QUARTER;
+  __realft(data, n, isign, pruning);
+}
+
+//
+// Batched transforms
+//
+// Same algorithms as dfft and realft, but each scalar operation is replaced
+// by a loop over the `batch` interleaved frames. Twiddle factors are shared
+// by all the frames, so they are computed once and broadcasted.
+//
+
+// Row r of a batched array (r-th float of every frames)
+#define ROW(data, r, batch) ((data) + (size_t)(r) * (batch))
+
+static inline
+void __swap_rows(float* restrict a, float* restrict b, unsigned int batch) {
+  for (unsigned int k = 0; k < batch; k++) {
+    const float tmp = a[k];
+    a[k] = b[k];
+    b[k] = tmp;
+  }
+}
+
+static void __dfft_batch(float data[], unsigned int nn, unsigned int batch, int isign, unsigned int pruning) {
+  initialize_sincos_tables();
+  unsigned int n, mmax, m, j, istep, i, k;
+  double wtemp, wr, wpr, wpi, wi;
+  n = nn << 1;
+  j = 1;
+
+  // Bit-reversal section, applied to whole rows.
+  for (i = 1; i < n; i += 2) {
+    if (j > i) {
+      __swap_rows(ROW(data, j - 1, batch), ROW(data, i - 1, batch), batch);
+      __swap_rows(ROW(data, j, batch), ROW(data, i, batch), batch);
+    }
+    m = nn;
+    while (m >= 2 && j > m) {
+      j -= m;
+      m >>= 1;
+    }
+    j += m;
+  }
+  // Danielson-Lanczos section.
+  mmax = 2;
+  uint theta_index = 1;
+  if ((pruning & FFT_PRUNE_ZERO_PADDED) && nn >= 4) {
+    // First stage on zero odd complex: a copy (see dfft)
+    for (i = 1; i <= n; i += 4) {
+      memcpy(ROW(data, i + 1, batch), ROW(data, i - 1, batch), sizeof(*data) * batch);
+      memcpy(ROW(data, i + 2, batch), ROW(data, i, batch), sizeof(*data) * batch);
+    }
+    mmax = 4;
+    theta_index++;
+  }
+  const bool first_quarter = (pruning & FFT_PRUNE_FIRST_QUARTER) && nn >= 4;
+  while (n > mmax) {
+    istep = mmax << 1;
+    const bool sums_only = first_quarter && istep >= (n >> 1);
+    const unsigned int m_end = (first_quarter && istep == n) ? (n >> 2) : mmax;
+    wtemp = sin_table[theta_index + 1];
+    wpr = -2.0 * wtemp * wtemp;
+    wpi = isign * sin_table[theta_index];
+    wr = 1.0;
+    wi = 0.0;
+    for (m = 1; m < m_end; m += 2) {
+      const float fwr = (float)wr;
+      const float fwi = (float)wi;
+      for (i = m; i <= n; i += istep) {
+        j = i + mmax;
+        float* restrict xr = ROW(data, i - 1, batch);
+        float* restrict xi = ROW(data, i, batch);
+        float* restrict yr = ROW(data, j - 1, batch);
+        float* restrict yi = ROW(data, j, batch);
+        if (sums_only) {
+          for (k = 0; k < batch; k++) {
+            xr[k] += fwr * yr[k] - fwi * yi[k];
+            xi[k] += fwr * yi[k] + fwi * yr[k];
+          }
+          continue;
+        }
+        for (k = 0; k < batch; k++) {
+          const float tempr = fwr * yr[k] - fwi * yi[k];
+          const float tempi = fwr * yi[k] + fwi * yr[k];
+          yr[k] = xr[k] - tempr;
+          yi[k] = xi[k] - tempi;
+          xr[k] += tempr;
+          xi[k] += tempi;
+        }
+      }
+      wtemp = wr;
+      wr += wr * wpr - wi * wpi;
+      wi += wi * wpr + wtemp * wpi;
+    }
+    mmax = istep;
+    theta_index++;
+  }
+}
+
+void dfft_batch(float data[], unsigned int nn, unsigned int batch, int isign) {
+  __dfft_batch(data, nn, batch, isign, FFT_PRUNE_NONE);
+}
+
+static void __realft_batch(float data[], unsigned int n, unsigned int batch, int isign, unsigned int pruning) {
+  initialize_sincos_tables();
+  unsigned int i, i1, i2, i3, i4, np1, k;
+  float c1 = 0.5, c2;
+  double wr, wi, wpr, wpi, wtemp;
+  uint theta_index = log2ui(n);
+  if (isign == 1) {
+    c2 = -0.5;
+    __dfft_batch(data, n >> 1, batch, 1, pruning);
+  } else {
+    c2 = 0.5;
+    isign = -1;
+  }
+  wtemp = isign * sin_table[theta_index + 1];
+  wpr = -2.0 * wtemp * wtemp;
+  wpi = isign * sin_table[theta_index];
+  wr = 1.0 + wpr;
+  wi = wpi;
+  np1 = n + 1;
+  for (i = 1; i < (n >> 2); i++) {
+    i1 = i + i;
+    i2 = 1 + i1;
+    i3 = np1 - i2;
+    i4 = 1 + i3;
+    float* restrict d1 = ROW(data, i1, batch);
+    float* restrict d2 = ROW(data, i2, batch);
+    float* restrict d3 = ROW(data, i3, batch);
+    float* restrict d4 = ROW(data, i4, batch);
+    const float fwr = (float)wr;
+    const float fwi = (float)wi;
+    for (k = 0; k < batch; k++) {
+      const float h1r = c1 * (d1[k] + d3[k]);
+      const float h1i = c1 * (d2[k] - d4[k]);
+      const float h2r = -c2 * (d2[k] + d4[k]);
+      const float h2i = c2 * (d1[k] - d3[k]);
+      d1[k] = h1r + fwr * h2r - fwi * h2i;
+      d2[k] = h1i + fwr * h2i + fwi * h2r;
+      d3[k] = h1r - fwr * h2r + fwi * h2i;
+      d4[k] = -h1i + fwr * h2i + fwi * h2r;
+    }
+    wr = (wtemp = wr) * wpr - wi * wpi + wr;
+    wi = wi * wpr + wtemp * wpi + wi;
+  }
+  float* restrict d0 = ROW(data, 0, batch);
+  float* restrict d1 = ROW(data, 1, batch);
+  if (isign == 1) {
+    for (k = 0; k < batch; k++) {
+      const float h1r = d0[k];
+      d0[k] = h1r + d1[k];
+      d1[k] = h1r - d1[k];
+    }
+  } else {
+    for (k = 0; k < batch; k++) {
+      const float h1r = d0[k];
+      d0[k] = c1 * (h1r + d1[k]);
+      d1[k] = c1 * (h1r - d1[k]);
+    }
+    __dfft_batch(data, n >> 1, batch, -1, pruning);
+  }
+}
+
+void realft_batch(float data[], unsigned int n, unsigned int batch, int isign) {
+  __realft_batch(data, n, batch, isign, FFT_PRUNE_NONE);
+}
+
+void realft_batch_pruned(float data[], unsigned int n, unsigned int batch, int isign, unsigned int pruning) {
+  pruning &= (isign == FFT_FORWARD) ? FFT_PRUNE_ZERO_PADDED : FFT_PRUNE_FIRST_QUARTER;
+  __realft_batch(data, n, batch, isign, pruning);
+}
+
+void fft_batch_interleave(float* data, float** frames, unsigned int size, unsigned int nb_frames) {
+  for (unsigned int i = 0; i < size; i++)
+    for (unsigned int k = 0; k < nb_frames; k++)
+      data[(size_t)i * nb_frames + k] = frames[k][i];
+}
+
+void fft_batch_deinterleave(float** frames, float* data, unsigned int size, unsigned int nb_frames) {
+  for (unsigned int i = 0; i < size; i++)
+    for (unsigned int k = 0; k < nb_frames; k++)
+      frames[k][i] = data[(size_t)i * nb_frames + k];
+}
+
+// Copy the window from the generated tables if available
+static bool __copy_static_window(float* window, enum window_type type, unsigned int window_size) {
+#ifdef V2P_USE_STATIC_TABLES
+  const struct v2p_static_window* w = v2p_static_window_lookup(type, window_size);
+  if (w) {
+    memcpy(window, w->window, sizeof(*window) * window_size);
+    return true;
   }
+#else
+  (void)window;
+  (void)type;
+  (void)window_size;
+#endif
+  return false;
 }
 
 void compute_hann(float* window, unsigned int window_size) {
+  if (__copy_static_window(window, WINDOW_HANN, window_size))
+    return;
   for (unsigned int i = 0; i < window_size; i++) {
     double v = sin(M_PI * i / (window_size-1));
     window[i] = (float)(v * v);
@@ -201,6 +461,8 @@ void compute_hamming(float* window, unsigned int window_size) {
 void compute_blackman_harris(float* window, unsigned int window_size) {
   // List of all coefficients:
   // https://sci-hub.tw/10.1109/icassp.2001.940309
+  if (__copy_static_window(window, WINDOW_BLACKMAN_HARRIS, window_size))
+    return;
   const unsigned int N = window_size;
   for (unsigned int n = 0; n < window_size; n++) {
     double value = 0.f;
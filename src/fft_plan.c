@@ -0,0 +1,491 @@
+#include "fft.h"
+#include "tools.h"
+#include "sync.h"
+#include "allocator.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+//
+// Real transforms of any even size.
+//
+// The real transform of size n is computed from the complex transform of
+// size m = n / 2 exactly like realft does. The complex transform uses:
+//  - dfft when m is a power of two,
+//  - a mixed radix Stockham algorithm when m = 2^a 3^b 5^c,
+//  - the Bluestein algorithm (a convolution computed with power of two
+//    transforms) otherwise.
+// All transforms use the same sign convention as dfft:
+// forward is sum_j x_j exp(+2 i pi j k / m).
+//
+
+#define FFT_PLAN_MAX_FACTORS 32
+
+enum fft_plan_kind {
+  FFT_PLAN_POWER_OF_TWO,
+  FFT_PLAN_MIXED_RADIX,
+  FFT_PLAN_BLUESTEIN
+};
+
+struct fft_plan {
+  unsigned int n;
+  unsigned int m;
+  enum fft_plan_kind kind;
+  unsigned int scratch_size;
+
+  // Mixed radix: radix of each pass, and for each pass the twiddles
+  // exp(+2 i pi r k / (Ns R)) stored as (re, im) for k < Ns, 0 < r < R.
+  unsigned int nb_factors;
+  unsigned int factors[FFT_PLAN_MAX_FACTORS];
+  float* twiddles;
+
+  // Bluestein: chirp exp(+i pi j^2 / m) for j < m, and the forward
+  // transform of the conjugated chirp wrapped on conv_size points.
+  unsigned int conv_size;
+  float* chirp;
+  float* chirp_fft;
+
+  // Registry
+  unsigned int references;
+  const v2p_allocator_t* allocator;
+  struct fft_plan* next;
+};
+
+static struct fft_plan* registry = NULL;
+static v2p_mutex_t registry_mutex = V2P_MUTEX_INITIALIZER;
+
+static bool __is_power_of_two(unsigned int v) {
+  return v && !(v & (v - 1));
+}
+
+// Factorize m with radices 4, 2, 3 and 5.
+// Return false if m has another prime factor.
+static bool __factorize(unsigned int m, unsigned int* factors, unsigned int* nb_factors) {
+  static const unsigned int radices[] = {4, 2, 3, 5};
+  unsigned int nb = 0;
+  for (unsigned int i = 0; i < sizeof(radices) / sizeof(radices[0]); i++)
+    while (m % radices[i] == 0 && m > 1 && nb < FFT_PLAN_MAX_FACTORS) {
+      factors[nb++] = radices[i];
+      m /= radices[i];
+    }
+  *nb_factors = nb;
+  return m == 1;
+}
+
+static bool __init_mixed_radix(struct fft_plan* p) {
+  unsigned int nb_twiddles = 0;
+  unsigned int ns = 1;
+  for (unsigned int f = 0; f < p->nb_factors; f++) {
+    nb_twiddles += ns * (p->factors[f] - 1);
+    ns *= p->factors[f];
+  }
+  p->twiddles = v2p_malloc(sizeof(*p->twiddles) * 2 * (nb_twiddles ? nb_twiddles : 1));
+  if (!p->twiddles)
+    return false;
+
+  float* tw = p->twiddles;
+  ns = 1;
+  for (unsigned int f = 0; f < p->nb_factors; f++) {
+    const unsigned int radix = p->factors[f];
+    for (unsigned int k = 0; k < ns; k++)
+      for (unsigned int r = 1; r < radix; r++) {
+        const double angle = 2 * M_PI * (double)(r * k) / (double)(ns * radix);
+        *tw++ = (float)cos(angle);
+        *tw++ = (float)sin(angle);
+      }
+    ns *= radix;
+  }
+  p->scratch_size = 2 * p->m;
+  return true;
+}
+
+static bool __init_bluestein(struct fft_plan* p) {
+  const unsigned int m = p->m;
+  unsigned int conv_size = 1;
+  while (conv_size < 2 * m - 1)
+    conv_size <<= 1;
+  p->conv_size = conv_size;
+  p->chirp = v2p_malloc(sizeof(*p->chirp) * 2 * m);
+  p->chirp_fft = v2p_calloc(2 * conv_size, sizeof(*p->chirp_fft));
+  if (!p->chirp || !p->chirp_fft)
+    return false;
+
+  for (unsigned int j = 0; j < m; j++) {
+    // j^2 modulo 2m keeps the angle accurate for large j
+    const unsigned long long j2 = ((unsigned long long)j * j) % (2ull * m);
+    const double angle = M_PI * (double)j2 / (double)m;
+    p->chirp[2 * j] = (float)cos(angle);
+    p->chirp[2 * j + 1] = (float)sin(angle);
+  }
+  // Conjugated chirp, wrapped around for the negative indices
+  float* b = p->chirp_fft;
+  b[0] = p->chirp[0];
+  b[1] = -p->chirp[1];
+  for (unsigned int j = 1; j < m; j++) {
+    b[2 * j] = b[2 * (conv_size - j)] = p->chirp[2 * j];
+    b[2 * j + 1] = b[2 * (conv_size - j) + 1] = -p->chirp[2 * j + 1];
+  }
+  dfft(b, conv_size, FFT_FORWARD);
+  p->scratch_size = 2 * conv_size;
+  return true;
+}
+
+static void __plan_delete(struct fft_plan* p) {
+  if (!p)
+    return;
+  v2p_allocator_free(p->allocator, p->twiddles);
+  v2p_allocator_free(p->allocator, p->chirp);
+  v2p_allocator_free(p->allocator, p->chirp_fft);
+  v2p_allocator_free(p->allocator, p);
+}
+
+static struct fft_plan* __plan_new(unsigned int n) {
+  struct fft_plan* p = v2p_calloc(1, sizeof(*p));
+  if (!p)
+    return NULL;
+  p->allocator = v2p_current_allocator();
+  p->n = n;
+  p->m = n >> 1;
+
+  bool ok = true;
+  if (__is_power_of_two(p->m))
+    p->kind = FFT_PLAN_POWER_OF_TWO;
+  else if (__factorize(p->m, p->factors, &p->nb_factors)) {
+    p->kind = FFT_PLAN_MIXED_RADIX;
+    ok = __init_mixed_radix(p);
+  } else {
+    p->kind = FFT_PLAN_BLUESTEIN;
+    ok = __init_bluestein(p);
+  }
+  if (!ok) {
+    __plan_delete(p);
+    return NULL;
+  }
+  return p;
+}
+
+const fft_plan_t* fft_plan_acquire(unsigned int n) {
+  if (n < 2 || n & 1)
+    return NULL;
+
+  v2p_mutex_lock(&registry_mutex);
+  struct fft_plan* p = registry;
+  while (p && p->n != n)
+    p = p->next;
+  if (!p) {
+    // Plans outlive the analyzers: use the global allocator
+    const v2p_allocator_t* previous = v2p_allocator_enter(v2p_get_allocator());
+    p = __plan_new(n);
+    v2p_allocator_leave(previous);
+    if (p) {
+      p->next = registry;
+      registry = p;
+    }
+  }
+  if (p)
+    p->references++;
+  v2p_mutex_unlock(&registry_mutex);
+  return p;
+}
+
+void fft_plan_release(const fft_plan_t* cp) {
+  if (!cp)
+    return;
+  struct fft_plan* p = (struct fft_plan*)cp;
+  v2p_mutex_lock(&registry_mutex);
+  if (--p->references == 0) {
+    struct fft_plan** it = &registry;
+    while (*it && *it != p)
+      it = &(*it)->next;
+    if (*it)
+      *it = p->next;
+    __plan_delete(p);
+  }
+  v2p_mutex_unlock(&registry_mutex);
+}
+
+unsigned int fft_plan_size(const fft_plan_t* plan) {
+  return plan->n;
+}
+
+unsigned int fft_plan_scratch_size(const fft_plan_t* plan) {
+  return plan->scratch_size;
+}
+
+//
+// Complex transforms
+//
+
+// DFT of the `radix` complex values of v (in place), with sign isign.
+static inline void __small_dft(float* v, unsigned int radix, int isign) {
+  // cos and sin of 2 pi t / 5 and 2 pi t / 3
+  static const float cos5[] = {1.f, 0.30901699437494745f, -0.8090169943749475f, -0.8090169943749475f, 0.30901699437494745f};
+  static const float sin5[] = {0.f, 0.9510565162951535f, 0.5877852522924731f, -0.5877852522924731f, -0.9510565162951535f};
+  static const float cos3[] = {1.f, -0.5f, -0.5f};
+  static const float sin3[] = {0.f, 0.8660254037844386f, -0.8660254037844386f};
+
+  switch (radix) {
+    case 2: {
+      const float ar = v[0], ai = v[1];
+      v[0] = ar + v[2];
+      v[1] = ai + v[3];
+      v[2] = ar - v[2];
+      v[3] = ai - v[3];
+      break;
+    }
+    case 4: {
+      // (s i) is exp(+2 i pi / 4) for the forward transform
+      const float s = (float)isign;
+      const float t0r = v[0] + v[4], t0i = v[1] + v[5];
+      const float t1r = v[0] - v[4], t1i = v[1] - v[5];
+      const float t2r = v[2] + v[6], t2i = v[3] + v[7];
+      const float t3r = s * (v[7] - v[3]), t3i = s * (v[2] - v[6]);
+      v[0] = t0r + t2r;
+      v[1] = t0i + t2i;
+      v[2] = t1r + t3r;
+      v[3] = t1i + t3i;
+      v[4] = t0r - t2r;
+      v[5] = t0i - t2i;
+      v[6] = t1r - t3r;
+      v[7] = t1i - t3i;
+      break;
+    }
+    case 3:
+    case 5: {
+      const float* c = radix == 3 ? cos3 : cos5;
+      const float* sn = radix == 3 ? sin3 : sin5;
+      float out[10];
+      for (unsigned int q = 0; q < radix; q++) {
+        float re = 0, im = 0;
+        for (unsigned int r = 0; r < radix; r++) {
+          const unsigned int t = (r * q) % radix;
+          const float wr = c[t], wi = isign * sn[t];
+          re += v[2 * r] * wr - v[2 * r + 1] * wi;
+          im += v[2 * r] * wi + v[2 * r + 1] * wr;
+        }
+        out[2 * q] = re;
+        out[2 * q + 1] = im;
+      }
+      memcpy(v, out, sizeof(*v) * 2 * radix);
+      break;
+    }
+  }
+}
+
+// Stockham autosort transform: each pass reads src and writes dst,
+// so no bit reversal is needed.
+static void __mixed_radix(const struct fft_plan* p, float* data, float* scratch, int isign) {
+  const unsigned int m = p->m;
+  float* src = data;
+  float* dst = scratch;
+  const float* tw = p->twiddles;
+  unsigned int ns = 1;
+
+  for (unsigned int f = 0; f < p->nb_factors; f++) {
+    const unsigned int radix = p->factors[f];
+    const unsigned int stride = m / radix;
+    for (unsigned int j = 0; j < stride; j++) {
+      const unsigned int k = j % ns;
+      const float* w = tw + 2 * k * (radix - 1);
+      float v[10];
+      v[0] = src[2 * j];
+      v[1] = src[2 * j + 1];
+      for (unsigned int r = 1; r < radix; r++) {
+        const float xr = src[2 * (j + r * stride)];
+        const float xi = src[2 * (j + r * stride) + 1];
+        const float wr = w[2 * (r - 1)];
+        const float wi = isign * w[2 * (r - 1) + 1];
+        v[2 * r] = xr * wr - xi * wi;
+        v[2 * r + 1] = xr * wi + xi * wr;
+      }
+      __small_dft(v, radix, isign);
+      const unsigned int idx = (j / ns) * ns * radix + k;
+      for (unsigned int r = 0; r < radix; r++) {
+        dst[2 * (idx + r * ns)] = v[2 * r];
+        dst[2 * (idx + r * ns) + 1] = v[2 * r + 1];
+      }
+    }
+    tw += 2 * ns * (radix - 1);
+    ns *= radix;
+    float* tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+  if (src != data)
+    memcpy(data, src, sizeof(*data) * 2 * m);
+}
+
+// Bluestein transform: X_k = c_k sum_j (x_j c_j) conj(c_{k-j})
+// with c_j = exp(+i pi j^2 / m). The inverse transform is computed
+// by conjugating the input and the output of the forward one.
+static void __bluestein(const struct fft_plan* p, float* data, float* scratch, int isign) {
+  const unsigned int m = p->m;
+  const unsigned int conv_size = p->conv_size;
+  const float* c = p->chirp;
+  const float s = (float)isign;
+
+  for (unsigned int j = 0; j < m; j++) {
+    const float xr = data[2 * j], xi = s * data[2 * j + 1];
+    scratch[2 * j] = xr * c[2 * j] - xi * c[2 * j + 1];
+    scratch[2 * j + 1] = xr * c[2 * j + 1] + xi * c[2 * j];
+  }
+  memset(scratch + 2 * m, 0, sizeof(*scratch) * 2 * (conv_size - m));
+
+  dfft(scratch, conv_size, FFT_FORWARD);
+  const float* b = p->chirp_fft;
+  for (unsigned int k = 0; k < conv_size; k++) {
+    const float ar = scratch[2 * k], ai = scratch[2 * k + 1];
+    scratch[2 * k] = ar * b[2 * k] - ai * b[2 * k + 1];
+    scratch[2 * k + 1] = ar * b[2 * k + 1] + ai * b[2 * k];
+  }
+  dfft(scratch, conv_size, FFT_INVERSE);
+
+  const float scale = 1.f / conv_size;
+  for (unsigned int k = 0; k < m; k++) {
+    const float yr = scratch[2 * k] * scale, yi = scratch[2 * k + 1] * scale;
+    data[2 * k] = yr * c[2 * k] - yi * c[2 * k + 1];
+    data[2 * k + 1] = s * (yr * c[2 * k + 1] + yi * c[2 * k]);
+  }
+}
+
+static void __complex_fft(const struct fft_plan* p, float* data, float* scratch, int isign) {
+  switch (p->kind) {
+    case FFT_PLAN_POWER_OF_TWO:
+      dfft(data, p->m, isign);
+      break;
+    case FFT_PLAN_MIXED_RADIX:
+      __mixed_radix(p, data, scratch, isign);
+      break;
+    case FFT_PLAN_BLUESTEIN:
+      __bluestein(p, data, scratch, isign);
+      break;
+  }
+}
+
+// Same as realft, with the complex transform of the plan and a loop
+// which also handles an odd number m of complex points.
+void fft_plan_realft_pruned(const fft_plan_t* plan, float data[], float* scratch,
+  enum fft_isign isign, unsigned int pruning) {
+  const unsigned int n = plan->n;
+  if (__is_power_of_two(n)) {
+    realft_pruned(data, n, isign, pruning);
+    return;
+  }
+
+  const unsigned int m = plan->m;
+  const float c1 = 0.5f;
+  float c2, h1r, h1i, h2r, h2i;
+  double wr, wi, wpr, wpi, wtemp;
+  double theta = 2 * M_PI / (double)n;
+  if (isign == FFT_FORWARD) {
+    c2 = -0.5f;
+    __complex_fft(plan, data, scratch, FFT_FORWARD);
+  } else {
+    c2 = 0.5f;
+    theta = -theta;
+  }
+  wtemp = sin(0.5 * theta);
+  wpr = -2.0 * wtemp * wtemp;
+  wpi = sin(theta);
+  wr = 1.0 + wpr;
+  wi = wpi;
+  for (unsigned int i = 1; 2 * i < m; i++) {
+    const unsigned int i1 = 2 * i;
+    const unsigned int i2 = i1 + 1;
+    const unsigned int i3 = n - i1;
+    const unsigned int i4 = i3 + 1;
+    h1r = c1 * (data[i1] + data[i3]);
+    h1i = c1 * (data[i2] - data[i4]);
+    h2r = -c2 * (data[i2] + data[i4]);
+    h2i = c2 * (data[i1] - data[i3]);
+    data[i1] = (float)(h1r + wr * h2r - wi * h2i);
+    data[i2] = (float)(h1i + wr * h2i + wi * h2r);
+    data[i3] = (float)(h1r - wr * h2r + wi * h2i);
+    data[i4] = (float)(-h1i + wr * h2i + wi * h2r);
+    wr = (wtemp = wr) * wpr - wi * wpi + wr;
+    wi = wi * wpr + wtemp * wpi + wi;
+  }
+  if (isign == FFT_FORWARD) {
+    data[0] = (h1r = data[0]) + data[1];
+    data[1] = h1r - data[1];
+  } else {
+    data[0] = c1 * ((h1r = data[0]) + data[1]);
+    data[1] = c1 * (h1r - data[1]);
+    __complex_fft(plan, data, scratch, FFT_INVERSE);
+  }
+}
+
+void fft_plan_realft(const fft_plan_t* plan, float data[], float* scratch, enum fft_isign isign) {
+  fft_plan_realft_pruned(plan, data, scratch, isign, FFT_PRUNE_NONE);
+}
+
+void realft_any(float data[], unsigned int n, enum fft_isign isign) {
+  if (__is_power_of_two(n)) {
+    realft(data, n, isign);
+    return;
+  }
+  const fft_plan_t* plan = fft_plan_acquire(n);
+  if (!plan)
+    return;
+  float* scratch = v2p_malloc(sizeof(*scratch) * plan->scratch_size);
+  if (scratch)
+    fft_plan_realft(plan, data, scratch, isign);
+  v2p_free(scratch);
+  fft_plan_release(plan);
+}
+
+//
+// Size selection
+//
+
+// Rough number of operations of the real transform of size n
+// (n even, n / 2 = 2^a 3^b 5^c). A radix-R pass costs about R / 2
+// butterflies per point, and the Stockham passes of the mixed radix
+// algorithm are a bit slower than dfft's in place passes.
+static double __fft_cost(unsigned int n) {
+  const unsigned int m = n >> 1;
+  unsigned int factors[FFT_PLAN_MAX_FACTORS];
+  unsigned int nb_factors;
+  if (__is_power_of_two(m)) {
+    unsigned int stages = 0;
+    while (m >> (stages + 1))
+      stages++;
+    return m * (stages + 1.0);
+  }
+  __factorize(m, factors, &nb_factors);
+  double cost_per_point = 0;
+  for (unsigned int f = 0; f < nb_factors; f++)
+    switch (factors[f]) {
+      case 4: cost_per_point += 1.5; break;
+      case 2: cost_per_point += 1.0; break;
+      case 3: cost_per_point += 2.0; break;
+      case 5: cost_per_point += 3.0; break;
+    }
+  return m * (1.3 * cost_per_point + 1.0);
+}
+
+static bool __is_smooth(unsigned int v) {
+  while (v % 2 == 0) v /= 2;
+  while (v % 3 == 0) v /= 3;
+  while (v % 5 == 0) v /= 5;
+  return v == 1;
+}
+
+unsigned int fft_fast_size(unsigned int n) {
+  unsigned int power = 2;
+  while (power < n)
+    power <<= 1;
+
+  unsigned int best = power;
+  double best_cost = __fft_cost(power);
+  for (unsigned int v = n + (n & 1); v < power; v += 2) {
+    if (!__is_smooth(v))
+      continue;
+    const double cost = __fft_cost(v);
+    if (cost < best_cost) {
+      best = v;
+      best_cost = cost;
+    }
+  }
+  return best;
+}
@@ -2,7 +2,11 @@
 #include "tools.h"
 #include "maxfreq.h"
 #include "boersma.h"
+#include "spectrum.h"
+#include "window_cache.h"
 #include "fft.h"
+#include "allocator.h"
+#include "candidate_cache.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -20,26 +24,51 @@ algorithm_descriptor_maxfreq_t* maxfreq_init(
     ad->parent.frame_size = frame_size;
     ad->parent.nb_candidates_per_step = 1;
     ad->parent.generate_candidates = (algorithm_t)generate_maxfreq_candidates;
+    ad->parent.emit_candidates = (emitter_t)emit_maxfreq_candidates;
+    ad->parent.hash_settings = (hasher_t)maxfreq_hash_settings;
+    ad->parent.memory_usage = (sizer_t)maxfreq_memory_usage;
+    ad->parent.name = "maxfreq";
     ad->parent.generate_frame = (framer_t)generate_frame_boersma;
 
+    // Same window as boersma, so that the spectrum is computed once
+    // when both algorithms are registered.
+    ad->window = window_cache_acquire(WINDOW_HANN, frame_size, 0);
+    if (!ad->window)
+      return NULL;
+
     return ad;
 }
 
 algorithm_descriptor_maxfreq_t* maxfreq_new(uint frame_size) {
-    void* ptr = calloc(1, sizeof(struct algorithm_descriptor_maxfreq));
+    void* ptr = v2p_calloc(1, sizeof(struct algorithm_descriptor_maxfreq));
 
     if(!ptr)
       return NULL;
 
-    return maxfreq_init(ptr, frame_size);
+    if (!maxfreq_init(ptr, frame_size)) {
+      v2p_free(ptr);
+      return NULL;
+    }
+    return ptr;
 }
 
 void maxfreq_delete(algorithm_descriptor_maxfreq_t* ad) {
-    free(ad);
+    window_cache_release(ad->window);
+    v2p_free(ad);
+}
+
+uint64_t maxfreq_hash_settings(algorithm_descriptor_maxfreq_t* ad, uint64_t hash) {
+  const unsigned int settings[] = { ad->parent.frame_size, ad->parent.nb_candidates_per_step };
+  hash = v2p_hash_bytes(hash, "maxfreq", 7);
+  return v2p_hash_bytes(hash, settings, sizeof(settings));
+}
+
+size_t maxfreq_memory_usage(algorithm_descriptor_maxfreq_t* ad) {
+  return sizeof(*ad) + window_cache_memory(ad->window);
 }
 
 //! Compute argument of maximal norm
-static unsigned int fft_argmax_max_sum(float* array, unsigned int length, float* out_max, float* out_sum) {
+static unsigned int fft_argmax_max_sum(const float* array, unsigned int length, float* out_max, float* out_sum) {
   float max = log2(1 + fabs(array[0])); // real value
   float sum = log2(1 + fabs(array[0]));
   unsigned int idx = 0;
@@ -73,32 +102,48 @@ void __maxfreq_compute_weigth(struct pitch_analyzer* s,
   candidate->weight = r_max - s->octave_cost * log_coef;
 }
 
-candidate_t* generate_maxfreq_candidates(
+void emit_maxfreq_candidates(
   pitch_analyzer_t* s,
   algorithm_descriptor_maxfreq_t* ad,
-  float* frame_in) {
-  // Alloc a new candidates (only one is used. others are just zeros)
-  candidate_t* candidates = calloc(ad->parent.nb_candidates_per_step, sizeof(*candidates));
+  float* frame_in,
+  struct candidate_slice* out) {
+  // Only the first candidate is used. others are just zeros.
+  candidate_t candidate;
+
+  // The spectrum of the frame is shared with the other algorithms
+  unsigned int fft_size;
+  const float* fft = spectral_context_fft(s->spectrum, frame_in, ad->window, &fft_size);
+  if (!fft)
+    return;
 
   // Get index of maximal value
   // Remember coord 0 and 1 are real value of first and last real coefficients
   float max, sum;
-  uint argmax = fft_argmax_max_sum(s->last_fft, s->last_fft_size, &max, &sum);
-  float mean = sum / (s->last_fft_size / 2);
+  uint argmax = fft_argmax_max_sum(fft, fft_size, &max, &sum);
+  float mean = sum / (fft_size / 2);
   // Convert index to frequency (see http://wiki.analytica.com/index.php?title=FFT)
   const float delta_t = 1.f / s->sampling_rate;
-  const float delta_f = 1.f / (delta_t * s->last_fft_size);
-  candidates->frequency = argmax * delta_f;
-  candidates->amplitude = 1.f - (mean / max); // max/max - mean/max
+  const float delta_f = 1.f / (delta_t * fft_size);
+  candidate.frequency = argmax * delta_f;
+  candidate.amplitude = 1.f - (mean / max); // max/max - mean/max
   // The variation of amplitudes are skewed beetween 0.95 and 0.999, so we skew it
   // with a power... (Pure WTF Heuristic)
-  candidates->amplitude = pow(candidates->amplitude, 2);
-  __maxfreq_compute_weigth(s, candidates);
+  candidate.amplitude = pow(candidate.amplitude, 2);
+  __maxfreq_compute_weigth(s, &candidate);
 
-  if (candidates->frequency > 2500 || candidates->frequency < 880) {
-    candidates->frequency = 0;
-    candidates->weight = 0;
+  if (candidate.frequency > 2500 || candidate.frequency < 880) {
+    candidate.frequency = 0;
+    candidate.weight = 0;
    }
 
-  return candidates;
+  out->frequency[0] = candidate.frequency;
+  out->weight[0] = candidate.weight;
+}
+
+candidate_t* generate_maxfreq_candidates(
+  pitch_analyzer_t* s,
+  algorithm_descriptor_maxfreq_t* ad,
+  float* frame_in) {
+  return v2p_emit_candidates_array(s, (algorithm_descriptor_t*)ad,
+    (emitter_t)emit_maxfreq_candidates, &frame_in, 1);
 }
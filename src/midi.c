@@ -2,6 +2,8 @@
 #include "midi.h"
 #include "tools.h"
 #include "stretchy_buffer.h"
+#include "allocator.h"
+#include "trace.h"
 #include <stdio.h>
 #include <math.h>
 #include <stdbool.h>
@@ -29,11 +31,13 @@ double midi_number_to_frequency(double number) {
 }
 
 float SYMPH_API* pitch_to_midi_numbers(float* pitch, uint length) {
-  float* numbers = malloc(sizeof(*numbers) * length);
+  V2P_TRACE_BEGIN(numbers);
+  float* numbers = v2p_malloc(sizeof(*numbers) * length);
 
   for (uint i = 0; i < length; i++)
     numbers[i] = __inline__frequency_to_midi_number(pitch[i]);
 
+  V2P_TRACE_END(numbers, "midi_numbers");
   return numbers;
 }
 
@@ -60,7 +64,7 @@ static float __min_max_diff(float* window, uint window_length) {
 // Contain the class index of each sample from signal
 uint* notes_segmentation_heuristic(float* numbers, uint length) {
   // Create result array initialized to a unique class.
-  uint* segment_array = calloc(length, sizeof(*segment_array));
+  uint* segment_array = v2p_calloc(length, sizeof(*segment_array));
   if (!segment_array)
     return NULL;
 
@@ -130,7 +134,7 @@ midi_note_data_t* merge_overlapping_notes(const midi_note_data_t* midi_array, ui
   if (length < 1)
     return NULL;
   // New array
-  midi_note_data_t* notes = malloc(sizeof(*notes) * sb_count(midi_array));
+  midi_note_data_t* notes = v2p_malloc(sizeof(*notes) * sb_count(midi_array));
 
   const uint minimal_note_length = 6;
   uint i = 1;
@@ -235,6 +239,7 @@ midi_note_data_t SYMPH_API* midi_numbers_to_notes(float* midi_numbers, uint leng
   if (length < 1)
     return NULL;
 
+  V2P_TRACE_BEGIN(notes);
   sb_note midi_array = NULL;
 
   // Segmentation
@@ -261,11 +266,12 @@ midi_note_data_t SYMPH_API* midi_numbers_to_notes(float* midi_numbers, uint leng
   add_note_from_segment_using_buckets(&midi_array, note_start, &midi_numbers[note_start], length - note_start);
 
   // Clean memory
-  free(segment_array);
+  v2p_free(segment_array);
 
   // Merge overlapping notes into a single one
   midi_note_data_t* midi = merge_overlapping_notes(midi_array, sb_count(midi_array), nb_notes);
   sb_free(midi_array);
 
+  V2P_TRACE_END(notes, "midi_notes");
   return midi;
 }
@@ -0,0 +1,283 @@
+#include "spectrum.h"
+#include "fft.h"
+#include "autocorrelation.h"
+#include "allocator.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// Representations of a frame memoized by the context
+enum spectral_flags {
+  SPECTRUM_FFT = 1,
+  SPECTRUM_POWER = 2,
+  SPECTRUM_AUTOCORRELATION = 4,
+  SPECTRUM_CORRECTED_AUTOCORRELATION = 8,
+  // First quarter of the autocorrelation only (pruned inverse transform)
+  SPECTRUM_AUTOCORRELATION_HEAD = 16
+};
+
+struct spectral_entry {
+  // Key
+  const float* frame;
+  const shared_window_t* window;
+  // Timestep of the memoized values
+  unsigned int generation;
+  // Representations already computed (enum spectral_flags)
+  unsigned int flags;
+
+  // Transform of window->size + window->padding floats
+  const fft_plan_t* plan;
+  float* scratch;
+
+  // Buffers of window->size + window->padding floats
+  float* fft;
+  float* power;
+  float* autocorrelation;
+  float* corrected_autocorrelation;
+
+  struct spectral_entry* next;
+};
+
+struct spectral_context {
+  // Allocator of the entries (the one current at creation). The buffers
+  // are created on first use, possibly while the analyzer routes the
+  // temporary allocations to a scratch arena: they must not go there.
+  const v2p_allocator_t* allocator;
+  // Current timestep
+  unsigned int generation;
+  // Entries, reused from a timestep to the next
+  struct spectral_entry* entries;
+};
+
+spectral_context_t* spectral_context_new(void) {
+  struct spectral_context* ctx = v2p_calloc(1, sizeof(*ctx));
+  if (ctx) {
+    ctx->allocator = v2p_current_allocator();
+    ctx->generation = 1;
+  }
+  return ctx;
+}
+
+void spectral_context_delete(spectral_context_t* ctx) {
+  if (!ctx)
+    return;
+  struct spectral_entry* e = ctx->entries;
+  while (e) {
+    struct spectral_entry* next = e->next;
+    v2p_allocator_free(ctx->allocator, e->fft);
+    v2p_allocator_free(ctx->allocator, e->power);
+    v2p_allocator_free(ctx->allocator, e->autocorrelation);
+    v2p_allocator_free(ctx->allocator, e->corrected_autocorrelation);
+    v2p_allocator_free(ctx->allocator, e->scratch);
+    fft_plan_release(e->plan);
+    v2p_allocator_free(ctx->allocator, e);
+    e = next;
+  }
+  v2p_allocator_free(ctx->allocator, ctx);
+}
+
+void spectral_context_next_step(spectral_context_t* ctx) {
+  ctx->generation++;
+}
+
+static inline unsigned int __fft_size(const shared_window_t* window) {
+  return window->size + window->padding;
+}
+
+size_t spectral_context_memory(const spectral_context_t* ctx) {
+  if (!ctx)
+    return 0;
+  size_t memory = sizeof(*ctx);
+  for (const struct spectral_entry* e = ctx->entries; e; e = e->next) {
+    const size_t buffer_size = sizeof(float) * __fft_size(e->window);
+    memory += sizeof(*e);
+    if (e->scratch)
+      memory += sizeof(float) * fft_plan_scratch_size(e->plan);
+    memory += buffer_size * ((e->fft != NULL) + (e->power != NULL) + (e->autocorrelation != NULL));
+    // A quarter only (see __compute_corrected_autocorrelation)
+    if (e->corrected_autocorrelation)
+      memory += sizeof(float) * (__fft_size(e->window) / 4);
+  }
+  return memory;
+}
+
+// Find the entry of the frame for the current step.
+// Reuse the buffers of an outdated entry sharing the same window if possible.
+static struct spectral_entry* __lookup(struct spectral_context* ctx,
+  const float* frame, const shared_window_t* window) {
+  struct spectral_entry* outdated = NULL;
+  for (struct spectral_entry* e = ctx->entries; e; e = e->next) {
+    if (e->window != window)
+      continue;
+    if (e->generation == ctx->generation && e->frame == frame)
+      return e;
+    if (e->generation != ctx->generation)
+      outdated = e;
+  }
+
+  if (!outdated) {
+    outdated = v2p_allocator_calloc(ctx->allocator, 1, sizeof(*outdated));
+    if (!outdated)
+      return NULL;
+    outdated->plan = fft_plan_acquire(__fft_size(window));
+    const unsigned int scratch_size = outdated->plan ? fft_plan_scratch_size(outdated->plan) : 0;
+    if (scratch_size)
+      outdated->scratch = v2p_allocator_malloc(ctx->allocator,
+        sizeof(*outdated->scratch) * scratch_size);
+    if (!outdated->plan || (scratch_size && !outdated->scratch)) {
+      fft_plan_release(outdated->plan);
+      v2p_allocator_free(ctx->allocator, outdated);
+      return NULL;
+    }
+    outdated->window = window;
+    outdated->next = ctx->entries;
+    ctx->entries = outdated;
+  }
+  outdated->frame = frame;
+  outdated->generation = ctx->generation;
+  outdated->flags = 0;
+  return outdated;
+}
+
+// Allocate a buffer of the entry the first time it's used
+static bool __reserve(struct spectral_context* ctx, float** buffer, unsigned int size) {
+  if (!*buffer)
+    *buffer = v2p_allocator_malloc(ctx->allocator, sizeof(**buffer) * size);
+  return *buffer != NULL;
+}
+
+static struct spectral_entry* __compute_fft(struct spectral_context* ctx,
+  const float* frame, const shared_window_t* window) {
+  struct spectral_entry* e = __lookup(ctx, frame, window);
+  if (!e || (e->flags & SPECTRUM_FFT))
+    return e;
+
+  const unsigned int size = window->size;
+  const unsigned int fft_size = __fft_size(window);
+  if (!__reserve(ctx, &e->fft, fft_size))
+    return NULL;
+
+  // Remove the mean, apply the window and pad in a single pass
+  compute_windowed_frame(e->fft, frame, window->window, size, fft_size);
+
+  // The second half is usually padding
+  const unsigned int pruning = (2 * size <= fft_size) ? FFT_PRUNE_ZERO_PADDED : FFT_PRUNE_NONE;
+  V2P_TRACE_BEGIN(forward);
+  fft_plan_realft_pruned(e->plan, e->fft, e->scratch, FFT_FORWARD, pruning);
+  V2P_TRACE_END(forward, "fft_forward");
+  e->flags |= SPECTRUM_FFT;
+  return e;
+}
+
+static struct spectral_entry* __compute_power(struct spectral_context* ctx,
+  const float* frame, const shared_window_t* window) {
+  struct spectral_entry* e = __compute_fft(ctx, frame, window);
+  if (!e || (e->flags & SPECTRUM_POWER))
+    return e;
+
+  const unsigned int fft_size = __fft_size(window);
+  if (!__reserve(ctx, &e->power, fft_size))
+    return NULL;
+  compute_power_density(e->power, e->fft, fft_size, 1.f);
+  e->flags |= SPECTRUM_POWER;
+  return e;
+}
+
+// Write the power density into the autocorrelation buffer,
+// without computing it twice
+static void __autocorrelation_power(struct spectral_entry* e, unsigned int fft_size) {
+  if (e->flags & SPECTRUM_POWER)
+    memcpy(e->autocorrelation, e->power, sizeof(*e->power) * fft_size);
+  else
+    compute_power_density(e->autocorrelation, e->fft, fft_size, 1.f);
+}
+
+static struct spectral_entry* __compute_autocorrelation(struct spectral_context* ctx,
+  const float* frame, const shared_window_t* window) {
+  struct spectral_entry* e = __compute_fft(ctx, frame, window);
+  if (!e || (e->flags & SPECTRUM_AUTOCORRELATION))
+    return e;
+
+  const unsigned int fft_size = __fft_size(window);
+  if (!__reserve(ctx, &e->autocorrelation, fft_size))
+    return NULL;
+  __autocorrelation_power(e, fft_size);
+  V2P_TRACE_BEGIN(inverse);
+  fft_plan_realft(e->plan, e->autocorrelation, e->scratch, FFT_INVERSE);
+  V2P_TRACE_END(inverse, "fft_inverse");
+  e->flags |= SPECTRUM_AUTOCORRELATION | SPECTRUM_AUTOCORRELATION_HEAD;
+  return e;
+}
+
+static struct spectral_entry* __compute_autocorrelation_head(struct spectral_context* ctx,
+  const float* frame, const shared_window_t* window) {
+  struct spectral_entry* e = __compute_fft(ctx, frame, window);
+  if (!e || (e->flags & SPECTRUM_AUTOCORRELATION_HEAD))
+    return e;
+
+  // Only the first quarter of the inverse transform is computed
+  const unsigned int fft_size = __fft_size(window);
+  if (!__reserve(ctx, &e->autocorrelation, fft_size))
+    return NULL;
+  __autocorrelation_power(e, fft_size);
+  V2P_TRACE_BEGIN(inverse);
+  fft_plan_realft_pruned(e->plan, e->autocorrelation, e->scratch,
+    FFT_INVERSE, FFT_PRUNE_FIRST_QUARTER);
+  V2P_TRACE_END(inverse, "fft_inverse");
+  e->flags |= SPECTRUM_AUTOCORRELATION_HEAD;
+  return e;
+}
+
+static struct spectral_entry* __compute_corrected_autocorrelation(struct spectral_context* ctx,
+  const float* frame, const shared_window_t* window) {
+  struct spectral_entry* e = __compute_autocorrelation_head(ctx, frame, window);
+  if (!e || (e->flags & SPECTRUM_CORRECTED_AUTOCORRELATION))
+    return e;
+
+  // Corrected autocorrelation isn't correct after 1/2
+  // of the window. Therefore we keep only half of it.
+  const unsigned int size_out = __fft_size(window) / 4;
+  if (!__reserve(ctx, &e->corrected_autocorrelation, size_out))
+    return NULL;
+  for (unsigned int i = 0; i < size_out; i++)
+    e->corrected_autocorrelation[i] = e->autocorrelation[i] / window->window_ac[i];
+  e->flags |= SPECTRUM_CORRECTED_AUTOCORRELATION;
+  return e;
+}
+
+const float* spectral_context_fft(spectral_context_t* ctx,
+  const float* frame, const shared_window_t* window, unsigned int* fft_size) {
+  struct spectral_entry* e = __compute_fft(ctx, frame, window);
+  *fft_size = __fft_size(window);
+  return e ? e->fft : NULL;
+}
+
+const float* spectral_context_power_spectrum(spectral_context_t* ctx,
+  const float* frame, const shared_window_t* window, unsigned int* size) {
+  struct spectral_entry* e = __compute_power(ctx, frame, window);
+  *size = __fft_size(window);
+  return e ? e->power : NULL;
+}
+
+const float* spectral_context_autocorrelation(spectral_context_t* ctx,
+  const float* frame, const shared_window_t* window, unsigned int* size_out) {
+  struct spectral_entry* e = __compute_autocorrelation(ctx, frame, window);
+  // The autocorrelation is symetrical: ac(x) = ac(fft_size - x).
+  *size_out = __fft_size(window) / 2;
+  return e ? e->autocorrelation : NULL;
+}
+
+const float* spectral_context_autocorrelation_head(spectral_context_t* ctx,
+  const float* frame, const shared_window_t* window, unsigned int* size_out) {
+  struct spectral_entry* e = __compute_autocorrelation_head(ctx, frame, window);
+  *size_out = __fft_size(window) / 4;
+  return e ? e->autocorrelation : NULL;
+}
+
+const float* spectral_context_corrected_autocorrelation(spectral_context_t* ctx,
+  const float* frame, const shared_window_t* window, unsigned int* size_out) {
+  struct spectral_entry* e = __compute_corrected_autocorrelation(ctx, frame, window);
+  *size_out = __fft_size(window) / 4;
+  return e ? e->corrected_autocorrelation : NULL;
+}
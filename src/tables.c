@@ -0,0 +1,23 @@
+#include "tables.h"
+#include <stddef.h>
+
+#ifdef V2P_HAS_GENERATED_TABLES
+// Defines v2p_sin_table and v2p_static_windows
+#include "v2p_generated_tables.inc"
+
+const struct v2p_static_window* v2p_static_window_lookup(enum window_type type, unsigned int size) {
+  // Sizes are powers of two: skip the lookup for the others
+  if (size < V2P_TABLES_MIN_SIZE || size > V2P_TABLES_MAX_SIZE || (size & (size - 1)))
+    return NULL;
+  for (size_t i = 0; i < sizeof(v2p_static_windows) / sizeof(v2p_static_windows[0]); i++)
+    if (v2p_static_windows[i].type == type && v2p_static_windows[i].size == size)
+      return v2p_static_windows + i;
+  return NULL;
+}
+#else
+const struct v2p_static_window* v2p_static_window_lookup(enum window_type type, unsigned int size) {
+  (void)type;
+  (void)size;
+  return NULL;
+}
+#endif
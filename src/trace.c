@@ -0,0 +1,158 @@
+#if !defined _WIN32 && !defined _WIN64
+  #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "trace.h"
+#include "v2p.h"
+#include "allocator.h"
+#include "sync.h"
+#include <stdio.h>
+#include <string.h>
+
+#if !defined _WIN32 && !defined _WIN64
+  #include <time.h>
+#endif
+
+//! Number of spans of a block of a thread buffer
+#define V2P_TRACE_BLOCK_SIZE 4096
+
+struct trace_span {
+  const char* name;
+  unsigned int stream;
+  unsigned int timestep;
+  uint64_t start;
+  uint64_t duration;
+};
+
+struct trace_block {
+  struct trace_span spans[V2P_TRACE_BLOCK_SIZE];
+  unsigned int count;
+  struct trace_block* next;
+};
+
+// Spans of a thread. Only this thread appends to it; the buffers stay
+// registered once the thread ended, so that they can be dumped.
+struct trace_buffer {
+  unsigned int thread_index;
+  struct trace_block* first;
+  struct trace_block* last;
+  struct trace_buffer* next;
+};
+
+// Registry of the buffers, locked when a thread records its first span
+static v2p_mutex_t __registry_lock = V2P_MUTEX_INITIALIZER;
+static struct trace_buffer* __buffers = NULL;
+static unsigned int __nb_buffers = 0;
+
+static V2P_THREAD_LOCAL struct trace_buffer* __thread_buffer = NULL;
+static V2P_THREAD_LOCAL unsigned int __thread_stream = 0;
+static V2P_THREAD_LOCAL unsigned int __thread_timestep = 0;
+
+uint64_t v2p_trace_now(void) {
+#if defined _WIN32 || defined _WIN64
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (uint64_t)((double)counter.QuadPart * 1e9 / frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void v2p_trace_context(unsigned int stream, unsigned int timestep) {
+  __thread_stream = stream;
+  __thread_timestep = timestep;
+}
+
+// The trace outlives the analyzers: it uses the global allocator
+static struct trace_buffer* __register_thread(void) {
+  struct trace_buffer* buffer = v2p_allocator_malloc(v2p_get_allocator(), sizeof(*buffer));
+  if (!buffer)
+    return NULL;
+  memset(buffer, 0, sizeof(*buffer));
+  v2p_mutex_lock(&__registry_lock);
+  buffer->thread_index = ++__nb_buffers;
+  buffer->next = __buffers;
+  __buffers = buffer;
+  v2p_mutex_unlock(&__registry_lock);
+  return buffer;
+}
+
+void v2p_trace_record(const char* name, uint64_t start) {
+  const uint64_t end = v2p_trace_now();
+  if (!__thread_buffer && !(__thread_buffer = __register_thread()))
+    return;
+  struct trace_buffer* buffer = __thread_buffer;
+  if (!buffer->last || buffer->last->count == V2P_TRACE_BLOCK_SIZE) {
+    struct trace_block* block = v2p_allocator_malloc(v2p_get_allocator(), sizeof(*block));
+    // The span is lost
+    if (!block)
+      return;
+    block->count = 0;
+    block->next = NULL;
+    if (buffer->last)
+      buffer->last->next = block;
+    else
+      buffer->first = block;
+    buffer->last = block;
+  }
+  struct trace_span* span = &buffer->last->spans[buffer->last->count++];
+  span->name = name;
+  span->stream = __thread_stream;
+  span->timestep = __thread_timestep;
+  span->start = start;
+  span->duration = end - start;
+}
+
+unsigned int v2p_trace_nb_spans(void) {
+  unsigned int nb = 0;
+  v2p_mutex_lock(&__registry_lock);
+  for (struct trace_buffer* buffer = __buffers; buffer; buffer = buffer->next)
+    for (struct trace_block* block = buffer->first; block; block = block->next)
+      nb += block->count;
+  v2p_mutex_unlock(&__registry_lock);
+  return nb;
+}
+
+void v2p_trace_clear(void) {
+  v2p_mutex_lock(&__registry_lock);
+  for (struct trace_buffer* buffer = __buffers; buffer; buffer = buffer->next) {
+    for (struct trace_block* block = buffer->first; block;) {
+      struct trace_block* next = block->next;
+      v2p_allocator_free(v2p_get_allocator(), block);
+      block = next;
+    }
+    buffer->first = buffer->last = NULL;
+  }
+  v2p_mutex_unlock(&__registry_lock);
+}
+
+int v2p_trace_dump(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file)
+    return V2P_ERROR_IO;
+
+  // Complete events ("X"), with timestamps in microseconds
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  const char* separator = "\n";
+  v2p_mutex_lock(&__registry_lock);
+  for (struct trace_buffer* buffer = __buffers; buffer; buffer = buffer->next) {
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+      "\"args\":{\"name\":\"v2p thread %u\"}}", separator, buffer->thread_index,
+      buffer->thread_index);
+    separator = ",\n";
+    for (struct trace_block* block = buffer->first; block; block = block->next)
+      for (unsigned int i = 0; i < block->count; i++) {
+        const struct trace_span* span = &block->spans[i];
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"v2p\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+          "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"stream\":%u,\"timestep\":%u}}",
+          span->name, buffer->thread_index, span->start / 1000., span->duration / 1000.,
+          span->stream, span->timestep);
+      }
+  }
+  v2p_mutex_unlock(&__registry_lock);
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0 ? V2P_OK : V2P_ERROR_IO;
+}
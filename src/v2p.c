@@ -1,12 +1,20 @@
 #include "v2p.h"
 #include "tools.h"
 #include "boersma.h"
+#include "spectrum.h"
 #include "stretchy_buffer.h"
+#include "backpointers.h"
+#include "candidates.h"
+#include "viterbi.h"
+#include "candidate_cache.h"
+#include "allocator.h"
+#include "trace.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <math.h>
 #include <stdio.h>
+#include <limits.h>
 
 void v2p_init(pitch_analyzer_t* s, float timesteps) {
   // Set everything to 0
@@ -33,217 +41,954 @@ void v2p_init(pitch_analyzer_t* s, float timesteps) {
   s->sampling_rate = 48000;
 
   // Allocated resources
+  s->allocator = v2p_current_allocator();
   s->audio_buffer = NULL;
   s->algorithm_descriptors = NULL;
   s->compute_transition_cost = (coster_t)boersma_transition_cost;
   s->path_costs = NULL;
+  s->next_path_costs = NULL;
+  s->spectrum = spectral_context_new();
 
   v2p_reset(s);
 }
 
 pitch_analyzer_t* v2p_new(float timesteps) {
+  return v2p_new_with_allocator(timesteps, NULL);
+}
+
+pitch_analyzer_t* v2p_new_with_allocator(float timesteps, const v2p_allocator_t* allocator) {
   pitch_analyzer_t *s;
 
-  s = calloc(1, sizeof(pitch_analyzer_t));
-  v2p_init(s, timesteps);
+  if (!allocator)
+    allocator = v2p_get_allocator();
+  const v2p_allocator_t* previous = v2p_allocator_enter(allocator);
+  s = v2p_calloc(1, sizeof(pitch_analyzer_t));
+  if (s)
+    v2p_init(s, timesteps);
+  v2p_allocator_leave(previous);
 
   return s;
 }
 
+// Free the viterbi buffers and the scratch arena
+static void __free_path_costs(pitch_analyzer_t* s) {
+  s->path_costs = (v2p_free(s->path_costs), NULL);
+  s->next_path_costs = (v2p_free(s->next_path_costs), NULL);
+  s->next_path_indexes = (v2p_free(s->next_path_indexes), NULL);
+  s->transition_costs = (v2p_free(s->transition_costs), NULL);
+  backpointers_clear(&s->path_indexes);
+}
+
+static void __free_scratch(pitch_analyzer_t* s) {
+  if (!s->scratch)
+    return;
+  v2p_arena_release(s->scratch);
+  s->scratch = (v2p_free(s->scratch), NULL);
+}
+
 void SYMPH_API v2p_delete(pitch_analyzer_t* s) {
-  s->candidates = sb_free(s->candidates);
+  const v2p_allocator_t* previous = v2p_allocator_enter(s->allocator);
+  candidates_clear(&s->candidates);
+  v2p_cache_unmap(s);
   s->audio_buffer = sb_free(s->audio_buffer);
-  s->path_indexes = sb_free(s->path_indexes);
-  if(s->path_costs)
-    s->path_costs = (free(s->path_costs), NULL);
-  if (s->last_fft)
-    s->last_fft = (free(s->last_fft), NULL);
-  free(s);
+  __free_path_costs(s);
+  __free_scratch(s);
+  s->frames = sb_free(s->frames);
+  s->hop_peaks = sb_free(s->hop_peaks);
+  spectral_context_delete(s->spectrum);
+  v2p_free(s);
+  v2p_allocator_leave(previous);
 }
 
-void v2p_reset(pitch_analyzer_t* s) {
+// Allocate the costs of the paths (viterbi) if it's not done yet
+static bool __reserve_path_costs(pitch_analyzer_t* s) {
+  if (s->path_costs)
+    return true;
+  s->path_costs = v2p_malloc(s->nb_candidates_per_step * sizeof(float));
+  s->next_path_costs = v2p_malloc(s->nb_candidates_per_step * sizeof(float));
+  s->next_path_indexes = v2p_malloc(s->nb_candidates_per_step * sizeof(uint));
+  s->transition_costs = v2p_malloc(s->nb_candidates_per_step * sizeof(float));
+  backpointers_init(&s->path_indexes, s->nb_candidates_per_step);
+  if (!s->path_costs || !s->next_path_costs || !s->next_path_indexes ||
+      !s->transition_costs) {
+    __free_path_costs(s);
+    return false;
+  }
+  return true;
+}
+
+// Largest frame of the registered algorithms
+static unsigned int __max_frame_size(pitch_analyzer_t* s) {
+  unsigned int max_frame_size = 0;
+  for (algorithm_descriptor_t* ad = s->algorithm_descriptors; ad; ad = ad->next)
+    max_frame_size = _max(max_frame_size, ad->frame_size);
+  return max_frame_size;
+}
+
+// Copy the candidates of a legacy generator into the slice, and free them.
+// The slice stays unvoiced if candidates is NULL.
+static void __assign_candidates(struct candidate_slice* out, candidate_t* candidates) {
+  if (!candidates)
+    return;
+  candidate_slice_assign(out, candidates);
+  v2p_ptr_free(candidates);
+}
+
+// Write the candidates of an algorithm into its slice of the timestep,
+// in place when the algorithm provides an emitter.
+static void __generate_candidates(pitch_analyzer_t* s, algorithm_descriptor_t* ad,
+  float* frame, bool silent, struct candidate_slice* out) {
+  if (!silent) {
+    if (ad->emit_candidates)
+      ad->emit_candidates(s, ad, frame, out);
+    else
+      __assign_candidates(out, ad->generate_candidates(s, ad, frame));
+  }
+  // Without a silence generator, the candidates stay unvoiced
+  else if (ad->emit_silence_candidates)
+    ad->emit_silence_candidates(s, ad, frame, out);
+  else if (ad->generate_silence_candidates)
+    __assign_candidates(out, ad->generate_silence_candidates(s, ad, frame));
+}
+
+candidate_t* v2p_emit_candidates_array(pitch_analyzer_t* s, algorithm_descriptor_t* ad,
+  emitter_t emit, float** frames, unsigned int nb_frames) {
+  const unsigned int nb_candidates = ad->nb_candidates_per_step;
+  candidate_t* candidates = v2p_calloc((size_t)nb_frames * nb_candidates + 1, sizeof(*candidates));
+  // Slice of a frame
+  float* buffer = v2p_malloc(sizeof(*buffer) * (2 * nb_candidates + 1));
+  if (!candidates || !buffer) {
+    v2p_free(buffer);
+    v2p_free(candidates);
+    return NULL;
+  }
+  struct candidate_slice slice = { buffer, buffer + nb_candidates, NULL, nb_candidates };
+  for (unsigned int i = 0; i < nb_frames; i++) {
+    memset(buffer, 0, sizeof(*buffer) * 2 * nb_candidates);
+    emit(s, ad, frames[i], &slice);
+    for (unsigned int k = 0; k < nb_candidates; k++) {
+      candidates[i * nb_candidates + k].frequency = slice.frequency[k];
+      candidates[i * nb_candidates + k].weight = slice.weight[k];
+    }
+  }
+  v2p_free(buffer);
+  return candidates;
+}
+
+// Size the scratch arena by running the algorithms once on a test frame
+// (a noisy sinusoid) with a measuring arena.
+// The spectrums are allocated by this first run too.
+static int __prepare_scratch(pitch_analyzer_t* s) {
+  __free_scratch(s);
+  const unsigned int frame_size = __max_frame_size(s);
+  float* frame = v2p_malloc(sizeof(*frame) * (frame_size ? frame_size : 1));
+  if (!frame)
+    return V2P_ERROR_OUT_OF_MEMORY;
+  unsigned int seed = 1;
+  for (unsigned int i = 0; i < frame_size; i++) {
+    seed = seed * 1103515245u + 12345u;
+    const float noise = (float)(seed >> 16 & 0x7fff) / 0x7fff - 0.5f;
+    frame[i] = (float)sin(i * 220 * 2 * M_PI / s->sampling_rate) + 0.1f * noise;
+  }
+
+  // Timestep receiving the candidates of the test frame
+  struct candidate_store store;
+  struct candidate_slice step, slice;
+  candidates_init(&store, s->nb_candidates_per_step);
+  if (!candidates_add_step(&store, &step)) {
+    v2p_free(frame);
+    return V2P_ERROR_OUT_OF_MEMORY;
+  }
+
+  struct v2p_arena measure;
+  v2p_arena_init(&measure, s->allocator, 0);
+  const v2p_allocator_t* previous = v2p_allocator_enter(&measure.allocator);
+  spectral_context_next_step(s->spectrum);
+  unsigned int offset = 0;
+  for (algorithm_descriptor_t* ad = s->algorithm_descriptors; ad; ad = ad->next) {
+    candidate_slice_sub(&step, offset, ad->nb_candidates_per_step, &slice);
+    __generate_candidates(s, ad, frame, false, &slice);
+    __generate_candidates(s, ad, frame, true, &slice);
+    offset += ad->nb_candidates_per_step;
+  }
+  spectral_context_next_step(s->spectrum);
+  v2p_allocator_leave(previous);
+  candidates_clear(&store);
+  v2p_free(frame);
+
+  // Margin for the allocations depending on the content of the frames
+  const size_t capacity = measure.peak + measure.peak / 4 + 1024;
+  v2p_arena_release(&measure);
+  s->scratch = v2p_malloc(sizeof(*s->scratch));
+  if (!s->scratch)
+    return V2P_ERROR_OUT_OF_MEMORY;
+  if (v2p_arena_init(s->scratch, s->allocator, capacity)) {
+    s->scratch = (v2p_free(s->scratch), NULL);
+    return V2P_ERROR_OUT_OF_MEMORY;
+  }
+  return V2P_OK;
+}
+
+// Preallocate the buffers of the real-time mode
+static int __preallocate(pitch_analyzer_t* s) {
+  const unsigned int hop = _max(s->frame_step_size, 1);
+  // Once the samples are discarded, the buffer holds at most the samples
+  // of a frame and of a step which aren't analyzed yet, and a new block.
+  const unsigned int audio_capacity = s->zero_padding + __max_frame_size(s) +
+    hop + s->max_block_size + 1;
+  sb_reserve(s->audio_buffer, audio_capacity);
+  sb_reserve(s->hop_peaks, audio_capacity / hop + 2);
+  if (sb_capacity(s->audio_buffer) < audio_capacity ||
+      sb_capacity(s->hop_peaks) < audio_capacity / hop + 2 ||
+      !candidates_reserve(&s->candidates, s->max_history) ||
+      !__reserve_path_costs(s) ||
+      !backpointers_reserve(&s->path_indexes, s->max_history))
+    return V2P_ERROR_OUT_OF_MEMORY;
+  return __prepare_scratch(s);
+}
+
+static inline void __add_block(struct v2p_memory_block* block, size_t capacity, size_t used) {
+  block->capacity += capacity;
+  block->used += used;
+}
+
+// Bytes held by the analyzer, part by part
+static void __measure_memory(pitch_analyzer_t* s, struct v2p_memory_report* report) {
+  memset(report, 0, sizeof(*report));
+  __add_block(&report->analyzer, sizeof(*s) + sizeof(*s->frames) * sb_capacity(s->frames),
+    sizeof(*s) + sizeof(*s->frames) * sb_count(s->frames));
+  __add_block(&report->audio_buffer, sizeof(*s->audio_buffer) * sb_capacity(s->audio_buffer),
+    sizeof(*s->audio_buffer) * sb_count(s->audio_buffer));
+  __add_block(&report->audio_buffer, sizeof(*s->hop_peaks) * sb_capacity(s->hop_peaks),
+    sizeof(*s->hop_peaks) * sb_count(s->hop_peaks));
+
+  const struct candidate_store* store = &s->candidates;
+  __add_block(&report->candidates, sizeof(*store->chunks) * sb_capacity(store->chunks),
+    sizeof(*store->chunks) * sb_count(store->chunks));
+  if (!store->borrowed)
+    // Frequencies, weights and log2 of the frequencies
+    __add_block(&report->candidates, candidates_memory(store),
+      3 * sizeof(float) * candidates_count(store));
+
+  const struct backpointers* bp = &s->path_indexes;
+  __add_block(&report->path_indexes, sizeof(*bp->pages) * sb_capacity(bp->pages),
+    sizeof(*bp->pages) * sb_count(bp->pages));
+  __add_block(&report->path_indexes, backpointers_memory(bp), (size_t)bp->nb_rows * bp->row_size);
+
+  if (s->path_costs) {
+    // path_costs, next_path_costs, transition_costs and next_path_indexes
+    const size_t size = s->nb_candidates_per_step * (3 * sizeof(float) + sizeof(uint));
+    __add_block(&report->path_costs, size, size);
+  }
+
+  const size_t spectrum_size = spectral_context_memory(s->spectrum);
+  __add_block(&report->spectrum, spectrum_size, spectrum_size);
+
+  if (s->scratch)
+    __add_block(&report->scratch, sizeof(*s->scratch) + s->scratch->capacity,
+      sizeof(*s->scratch) + s->scratch->peak);
+
+  for (algorithm_descriptor_t* ad = s->algorithm_descriptors; ad; ad = ad->next) {
+    const size_t size = ad->memory_usage ? ad->memory_usage(ad) : sizeof(*ad);
+    __add_block(&report->descriptors, size, size);
+  }
+
+  const struct v2p_memory_block* parts[] = {
+    &report->analyzer, &report->audio_buffer, &report->candidates, &report->path_indexes,
+    &report->path_costs, &report->spectrum, &report->scratch, &report->descriptors
+  };
+  for (unsigned int i = 0; i < sizeof(parts) / sizeof(*parts); i++)
+    __add_block(&report->total, parts[i]->capacity, parts[i]->used);
+}
+
+// Update the high-water mark with what the analyzer holds, plus `extra`
+// temporary bytes
+static void __record_memory_peak(pitch_analyzer_t* s, size_t extra) {
+  struct v2p_memory_report report;
+  __measure_memory(s, &report);
+  s->memory_peak = _max(s->memory_peak, report.total.capacity + extra);
+}
+
+// Same as v2p_reset, returning the status of the preallocation
+static int __reset(pitch_analyzer_t* s) {
+  int status = V2P_OK;
+  // What is released below
+  __record_memory_peak(s, 0);
+  const v2p_allocator_t* previous = v2p_allocator_enter(s->allocator);
   // Some computed values
   s->delta_t = 1.f / s->sampling_rate;
   // Size of a step
   s->frame_step_size = (int)(s->frame_time_step * s->sampling_rate);
 
   // Remove produced data
-  s->candidates = sb_free(s->candidates);
+  candidates_clear(&s->candidates);
+  candidates_init(&s->candidates, s->nb_candidates_per_step);
+  v2p_cache_unmap(s);
   s->audio_buffer = sb_free(s->audio_buffer);
   s->number_of_timesteps = 0;
   s->audio_buffer_index = 0;
-  s->path_indexes = sb_free(s->path_indexes);
-  if(s->path_costs)
-    s->path_costs = (free(s->path_costs), NULL);
+  s->audio_buffer_offset = 0;
+  s->audio_buffer_scanned = 0;
+  s->global_absolute_peak = 0;
+  s->hop_peaks = sb_free(s->hop_peaks);
+  s->hop_peaks_offset = 0;
+  s->nb_gated_frames = 0;
+  __free_path_costs(s);
+  __free_scratch(s);
+
+  // Settings may have changed
+  for (algorithm_descriptor_t* ad = s->algorithm_descriptors; ad; ad = ad->next)
+    if (ad->prepare)
+      ad->prepare(s, ad);
+
+  if (s->max_block_size) {
+    s->discard_consumed_samples = 1;
+    status = __preallocate(s);
+  }
+
   // Add padding
   for (uint i = 0; i < s->zero_padding; i++)
     sb_push(s->audio_buffer, 0);
   s->audio_buffer_index = s->zero_padding;
+  v2p_allocator_leave(previous);
+  return status;
 }
 
-// Assert length > 0
-unsigned int fargmin(float* a, uint length) {
-  float min = a[0];
-  unsigned int arg = 0;
-  for (unsigned int i = 0; i < length; i++)
-    if (a[i] < min) {
-      min = a[i];
-      arg = i;
-    }
-  return arg;
+void v2p_reset(pitch_analyzer_t* s) {
+  __reset(s);
 }
 
-void update_viterbi_path(pitch_analyzer_t* s) {
-  // Last candidates:
-  candidate_t* candidates = s->candidates + sb_count(s->candidates) - s->nb_candidates_per_step;
-  candidate_t* old_candidates = s->candidates + sb_count(s->candidates) - 2 * s->nb_candidates_per_step;
+int v2p_prepare(pitch_analyzer_t* s, unsigned int max_block_size, unsigned int max_history) {
+  if (!max_block_size || !max_history || !s->algorithm_descriptors)
+    return V2P_ERROR_INVALID_ARGUMENT;
+  s->max_block_size = max_block_size;
+  s->max_history = max_history;
+  return __reset(s);
+}
+
+// Add the timestep t of the candidates to the viterbi path
+static void __viterbi_step(pitch_analyzer_t* s, unsigned int t) {
+  // Buffers allocated once (or preallocated by the real-time mode)
+  if (!__reserve_path_costs(s))
+    return;
+
+  struct candidate_slice candidates, old_candidates;
+  candidates_step(&s->candidates, t, &candidates);
 
   // We require at least two timesteps to access old_condidates
-  if (s->number_of_timesteps <= 1) {
-    if (s->path_costs) // we should never enter this if
-      free(s->path_costs);
-	// First allocation of path_costs
-    // and corresponding path_indexes
-	s->path_costs = malloc(s->nb_candidates_per_step * sizeof(float));
-    s->path_indexes = sb_free(s->path_indexes);
-    sb_reserve(s->path_indexes, s->nb_candidates_per_step);
-    for (uint i = 0; i < s->nb_candidates_per_step; i++) {
-      (s->path_costs)[i] = -candidates[i].weight;
-      (s->path_indexes)[i] = i;
-    }
+  if (s->number_of_timesteps <= 1 || t == 0) {
+    for (uint i = 0; i < s->nb_candidates_per_step; i++)
+      (s->path_costs)[i] = -candidates.weight[i];
     return;
   }
+  candidates_step(&s->candidates, t - 1, &old_candidates);
 
-  // Allocate the local version of path_costs and path_indexes
-  float* new_path_costs = calloc(s->nb_candidates_per_step, sizeof(float));
-  uint* new_path_indexes = calloc(s->nb_candidates_per_step, sizeof(uint));
-  // For each candidate
-  for (uint candidate_idx = 0; candidate_idx < s->nb_candidates_per_step; candidate_idx++) {
-    // new frequency
-  	candidate_t* cdt2 = &candidates[candidate_idx];
-
-    sb_float scores = NULL;
-    // For each path (0 is unvoiced)
-    for (uint path_idx = 0; path_idx < s->nb_candidates_per_step; path_idx++) {
-      // previous frequency already in path
-  		candidate_t* cdt1 = &old_candidates[path_idx];
-
-      // Compute the score and add it to the array
-      const float new_cost = s->path_costs[path_idx] +
-        s->compute_transition_cost(s, cdt1, cdt2) +
-        -candidates[candidate_idx].weight;
-      sb_push(scores, new_cost);
-    }
+  viterbi_step(s, s->path_costs, &old_candidates, &candidates,
+    s->transition_costs, s->next_path_costs, s->next_path_indexes);
+  symp_swap(s->path_costs, s->next_path_costs);
+  backpointers_push(&s->path_indexes, s->next_path_indexes);
+}
 
-    const uint arg_min = fargmin(scores, sb_count(scores));
-    new_path_costs[candidate_idx] = scores[arg_min];
-    new_path_indexes[candidate_idx] = arg_min;
-    sb_free(scores);
-  }
+void update_viterbi_path(pitch_analyzer_t* s) {
+  // The path is decoded when it's requested
+  if (s->offline_decoding && !s->max_block_size)
+    return;
+  if (s->candidates.nb_steps)
+    __viterbi_step(s, s->candidates.nb_steps - 1);
+}
 
-  symp_swap(s->path_costs, new_path_costs);
-  sb_concat(s->path_indexes, new_path_indexes, s->nb_candidates_per_step);
-  free(new_path_costs);
-  free(new_path_indexes);
+// Decode the whole path from the candidates (offline decoding)
+static void __decode(pitch_analyzer_t* s) {
+  if (!s->number_of_timesteps || !s->candidates.nb_steps)
+    return;
+  const v2p_allocator_t* previous = v2p_allocator_enter(s->allocator);
+  if (__reserve_path_costs(s)) {
+    backpointers_clear(&s->path_indexes);
+    backpointers_init(&s->path_indexes, s->nb_candidates_per_step);
+    for (unsigned int t = 0; t < s->number_of_timesteps && t < s->candidates.nb_steps; t++)
+      __viterbi_step(s, t);
+  }
+  v2p_allocator_leave(previous);
 }
 
-//! Called when the audio buffer of a pitch_analyzer changed.
-void v2p_audio_buffer_changed(pitch_analyzer_t* s) {
+// Update the global absolute peak with the samples added to the audio buffer.
+// Return false if there is not enough data yet.
+static bool __update_global_absolute_peak(pitch_analyzer_t* s) {
   // Wait for at least some data
-  if (sb_count(s->audio_buffer) < 1024)
-      return;
+  if (sb_count(s->audio_buffer) + s->audio_buffer_offset < 1024)
+      return false;
 
   // Initialize global_absolute_peak the first time with initial_absolute_peak_coeff* the maximum of the first frame
-  if (s->global_absolute_peak <= 0) {
+  if (s->global_absolute_peak <= 0 && s->audio_buffer_offset == 0) {
     const unsigned int length = _min(sb_count(s->audio_buffer), s->zero_padding + 1024);
     s->global_absolute_peak =
       fabs_max_arr(s->audio_buffer, length) * s->initial_absolute_peak_coeff;
   }
-  // Update global Absolute Peak
-  const float loc_abs_peak = fabs_max_arr(s->audio_buffer, sb_count(s->audio_buffer));
-  s->global_absolute_peak = _max(loc_abs_peak, s->global_absolute_peak);
+  // Update global Absolute Peak with the samples not scanned yet,
+  // and the peak of each hop of the stream.
+  const unsigned int hop = _max(s->frame_step_size, 1);
+  const unsigned int count = sb_count(s->audio_buffer);
+  unsigned int i = s->audio_buffer_scanned;
+  while (i < count) {
+    const unsigned int block = (s->audio_buffer_offset + i) / hop;
+    const unsigned int block_end = (block + 1) * hop - s->audio_buffer_offset;
+    const unsigned int end = _min(count, block_end);
+    const float loc_abs_peak = fabs_max_arr(s->audio_buffer + i, end - i);
+    s->global_absolute_peak = _max(loc_abs_peak, s->global_absolute_peak);
+
+    while (s->hop_peaks_offset + sb_count(s->hop_peaks) <= block)
+      sb_push(s->hop_peaks, 0);
+    float* hop_peak = &s->hop_peaks[block - s->hop_peaks_offset];
+    *hop_peak = _max(*hop_peak, loc_abs_peak);
+    i = end;
+  }
+  s->audio_buffer_scanned = count;
+  return true;
+}
+
+void v2p_frame_extent(const algorithm_descriptor_t* ad, unsigned int audio_buffer_index,
+  unsigned int* first, unsigned int* last) {
+  // Frames are centered on audio_buffer_index, except at the
+  // beginning of the stream where they start at 0.
+  const unsigned int left_half_frame_size = ad->frame_size / 2;
+  *first = (audio_buffer_index > left_half_frame_size) ?
+    audio_buffer_index - left_half_frame_size : 0;
+  *last = *first + ad->frame_size;
+}
+
+// Cut the frames of all the algorithms for the timestep at audio_buffer_index.
+// The list of algorithms is walked once, and each framer is called once.
+// Return false if more data is required by one of the algorithms.
+static bool __schedule_frames(pitch_analyzer_t* s, unsigned int audio_buffer_index, float** frames) {
+  const unsigned int count = sb_count(s->audio_buffer);
+  unsigned int first, last;
+  unsigned int algorithm_idx = 0;
+  for (struct algorithm_descriptor* ad = s->algorithm_descriptors; ad; ad = ad->next) {
+    v2p_frame_extent(ad, audio_buffer_index, &first, &last);
+    if (last > count)
+      return false;
+    float* frame = ad->generate_frame(s, ad, s->audio_buffer, audio_buffer_index);
+    if (!frame)
+      return false;
+    if (frames)
+      frames[algorithm_idx] = frame;
+    algorithm_idx++;
+  }
+  return true;
+}
+
+unsigned int v2p_releasable_samples(pitch_analyzer_t* s) {
+  // Earliest sample required by the next timestep
+  unsigned int releasable = _min(s->audio_buffer_index, sb_count(s->audio_buffer));
+  unsigned int first, last;
+  for (struct algorithm_descriptor* ad = s->algorithm_descriptors; ad; ad = ad->next) {
+    v2p_frame_extent(ad, s->audio_buffer_index, &first, &last);
+    releasable = _min(releasable, first);
+  }
+  return releasable;
+}
+
+// Remove the samples which won't be used anymore from the audio buffer.
+static void __release_consumed_samples(pitch_analyzer_t* s) {
+  if (!s->discard_consumed_samples)
+    return;
+  const unsigned int releasable = v2p_releasable_samples(s);
+  const unsigned int count = sb_count(s->audio_buffer);
+  // Amortize the memmove: release only when it's at least half the buffer.
+  // The real-time mode releases at once to keep the buffer bounded.
+  if (!releasable || (!s->max_block_size && releasable < count / 2))
+    return;
+
+  memmove(s->audio_buffer, s->audio_buffer + releasable,
+    sizeof(*s->audio_buffer) * (count - releasable));
+  stb__sbn(s->audio_buffer) -= releasable;
+  s->audio_buffer_index -= releasable;
+  s->audio_buffer_scanned -= releasable;
+  s->audio_buffer_offset += releasable;
+
+  // Forget the peaks of the hops entirely released
+  const unsigned int hop = _max(s->frame_step_size, 1);
+  const unsigned int first_block = s->audio_buffer_offset / hop;
+  const unsigned int nb_blocks = _min(first_block - s->hop_peaks_offset, sb_count(s->hop_peaks));
+  if (nb_blocks) {
+    memmove(s->hop_peaks, s->hop_peaks + nb_blocks,
+      sizeof(*s->hop_peaks) * (sb_count(s->hop_peaks) - nb_blocks));
+    stb__sbn(s->hop_peaks) -= nb_blocks;
+    s->hop_peaks_offset += nb_blocks;
+  }
+}
+
+// Tell if the frames of the timestep at audio_buffer_index are clearly silent.
+// The peak of the frames is bounded by the peaks of the hops they overlap,
+// which are computed once when the samples are added.
+static bool __is_silent(pitch_analyzer_t* s, unsigned int audio_buffer_index) {
+  if (!s->silence_gating || !s->algorithm_descriptors)
+    return false;
+
+  // Samples used by all the frames of the timestep
+  unsigned int first = UINT_MAX, last = 0;
+  unsigned int ad_first, ad_last;
+  for (struct algorithm_descriptor* ad = s->algorithm_descriptors; ad; ad = ad->next) {
+    v2p_frame_extent(ad, audio_buffer_index, &ad_first, &ad_last);
+    first = _min(first, ad_first);
+    last = _max(last, ad_last);
+  }
+
+  const unsigned int hop = _max(s->frame_step_size, 1);
+  const unsigned int first_block = (s->audio_buffer_offset + first) / hop - s->hop_peaks_offset;
+  const unsigned int last_block = (s->audio_buffer_offset + last - 1) / hop - s->hop_peaks_offset;
+  float peak = 0;
+  for (unsigned int b = first_block; b <= last_block && b < sb_count(s->hop_peaks); b++)
+    peak = _max(peak, s->hop_peaks[b]);
+
+  return peak == 0 || peak < s->silence_threshold * s->global_absolute_peak;
+}
+
+// Route the temporary allocations of the algorithms to the scratch arena
+// of the real-time mode.
+static const v2p_allocator_t* __enter_scratch(pitch_analyzer_t* s) {
+  return s->scratch ? v2p_allocator_enter(&s->scratch->allocator) : NULL;
+}
+
+// Give the memory of the timestep back to the scratch arena
+static int __leave_scratch(pitch_analyzer_t* s, const v2p_allocator_t* previous) {
+  if (!s->scratch)
+    return V2P_OK;
+  v2p_allocator_leave(previous);
+  const int status = s->scratch->nb_failures ? V2P_ERROR_SCRATCH_EXHAUSTED : V2P_OK;
+  v2p_arena_reset(s->scratch);
+  return status;
+}
+
+// Tell if the history of the real-time mode is full
+static bool __history_full(pitch_analyzer_t* s) {
+  return s->max_block_size && s->number_of_timesteps >= s->max_history;
+}
+
+//! Called when the audio buffer of a pitch_analyzer changed.
+int v2p_audio_buffer_changed(pitch_analyzer_t* s) {
+  int status = V2P_OK;
+  if (!__update_global_absolute_peak(s))
+    return status;
 
   // While something remind in the buffer
   while(s->audio_buffer_index < sb_count(s->audio_buffer)) {
-    // Check if all algorithm can compute a new frame for current index
-    bool data_available = true;
-    struct algorithm_descriptor* ad = s->algorithm_descriptors;
-    while(data_available && ad) {
-      data_available = data_available && ad->generate_frame(
-        s, ad, s->audio_buffer, s->audio_buffer_index);
-      ad = ad->next;
+    if (__history_full(s)) {
+      status = V2P_ERROR_HISTORY_FULL;
+      break;
     }
-    if (!data_available)
+    // Cut the frames of all the algorithms
+    V2P_TRACE_CONTEXT(s->stream_id, s->number_of_timesteps);
+    V2P_TRACE_BEGIN(framing);
+    const bool scheduled = __schedule_frames(s, s->audio_buffer_index, s->frames);
+    V2P_TRACE_END(framing, "framing");
+    if (!scheduled)
+      break;
+
+    // Forget the spectrums of the previous frames
+    spectral_context_next_step(s->spectrum);
+
+    // Skip the analysis of silent frames
+    const bool silent = __is_silent(s, s->audio_buffer_index);
+
+    // Candidates of the new timestep
+    struct candidate_slice step, slice;
+    if (!candidates_add_step(&s->candidates, &step)) {
+      status = V2P_ERROR_OUT_OF_MEMORY;
       break;
+    }
+    if (silent)
+      s->nb_gated_frames++;
 
-    // Run all the algorithm on their frame
-    ad = s->algorithm_descriptors;
-    while (ad) {
-      // Generate frame
-      float* frame = ad->generate_frame(
-        s, ad, s->audio_buffer, s->audio_buffer_index);
-      // Generate candidates
-		candidate_t* candidates =
-			ad->generate_candidates(s, ad, frame);
-      // Add the candidates to the candidate buffer
-      sb_concat(s->candidates, candidates, ad->nb_candidates_per_step);
-      // Clean memory and go to the next algorithm
-      v2p_ptr_free(candidates);
-      ad = ad->next;
+    // Run all the algorithm on their frame, each one writing its
+    // candidates into its part of the timestep
+    const v2p_allocator_t* previous = __enter_scratch(s);
+    unsigned int algorithm_idx = 0;
+    unsigned int offset = 0;
+    for (struct algorithm_descriptor* ad = s->algorithm_descriptors; ad; ad = ad->next) {
+      candidate_slice_sub(&step, offset, ad->nb_candidates_per_step, &slice);
+      V2P_TRACE_BEGIN(algorithm);
+      __generate_candidates(s, ad, s->frames[algorithm_idx++], silent, &slice);
+      V2P_TRACE_END(algorithm, ad->name ? ad->name : "algorithm");
+      offset += ad->nb_candidates_per_step;
     }
+    const int scratch_status = __leave_scratch(s, previous);
+    if (scratch_status != V2P_OK)
+      status = scratch_status;
+    candidates_finish_step(&s->candidates);
 
     // Go to the next collection of frames.
     s->audio_buffer_index += s->frame_step_size;
     s->number_of_timesteps++;
 
     //! Construct the coeffecients used to build the path through candidates
+    V2P_TRACE_BEGIN(viterbi);
     update_viterbi_path(s);
+    V2P_TRACE_END(viterbi, "viterbi");
+  }
+
+  __release_consumed_samples(s);
+  return status;
+}
+
+// Tell if every registered algorithm can process frames by batch
+static bool __batch_available(pitch_analyzer_t* s) {
+  for (struct algorithm_descriptor* ad = s->algorithm_descriptors; ad; ad = ad->next)
+    if (!ad->generate_candidates_batch)
+      return false;
+  return true;
+}
+
+// Same as v2p_audio_buffer_changed, but each algorithm receives the frames
+// of up to V2P_RUN_BATCH timesteps at once.
+static int __audio_buffer_changed_batch(pitch_analyzer_t* s) {
+  int status = V2P_OK;
+  if (!__update_global_absolute_peak(s))
+    return status;
+
+  const unsigned int nb_algorithms = sb_count(s->frames);
+  // Frames of each timestep, timestep after timestep
+  float** step_frames = v2p_malloc(sizeof(*step_frames) * V2P_RUN_BATCH * (nb_algorithms + 1));
+  // Frames of an algorithm for all the non silent timesteps
+  float* frames[V2P_RUN_BATCH];
+  // Rank of the timestep among the non silent ones, or -1 if silent
+  int rank[V2P_RUN_BATCH];
+  // Candidates generated by each algorithm (in the list order)
+  candidate_t** batch_candidates = NULL;
+  if (!step_frames)
+    return V2P_ERROR_OUT_OF_MEMORY;
+
+  while (status == V2P_OK) {
+    // Schedule the timesteps for which all the frames are available
+    V2P_TRACE_CONTEXT(s->stream_id, s->number_of_timesteps);
+    V2P_TRACE_BEGIN(framing);
+    unsigned int nb_steps = 0;
+    while (nb_steps < V2P_RUN_BATCH) {
+      const unsigned int index = s->audio_buffer_index + nb_steps * s->frame_step_size;
+      if (index >= sb_count(s->audio_buffer) ||
+          !__schedule_frames(s, index, step_frames + nb_steps * nb_algorithms))
+        break;
+      nb_steps++;
+    }
+    V2P_TRACE_END(framing, "framing");
+    if (!nb_steps)
+      break;
+
+    // Skip the analysis of silent frames
+    unsigned int nb_voiced_steps = 0;
+    for (unsigned int i = 0; i < nb_steps; i++) {
+      const unsigned int index = s->audio_buffer_index + i * s->frame_step_size;
+      if (__is_silent(s, index)) {
+        rank[i] = -1;
+        s->nb_gated_frames++;
+      }
+      else
+        rank[i] = nb_voiced_steps++;
+    }
+
+    // Run each algorithm on all its frames
+    unsigned int algorithm_idx = 0;
+    for (struct algorithm_descriptor* ad = s->algorithm_descriptors; ad; ad = ad->next) {
+      for (unsigned int i = 0; i < nb_steps; i++)
+        if (rank[i] >= 0)
+          frames[rank[i]] = step_frames[i * nb_algorithms + algorithm_idx];
+      V2P_TRACE_BEGIN(algorithm);
+      sb_push(batch_candidates, nb_voiced_steps ?
+        ad->generate_candidates_batch(s, ad, frames, nb_voiced_steps) : NULL);
+      V2P_TRACE_END(algorithm, ad->name ? ad->name : "algorithm");
+      if (nb_voiced_steps && !sb_last(batch_candidates))
+        status = V2P_ERROR_OUT_OF_MEMORY;
+      algorithm_idx++;
+    }
+
+    // Store the candidates timestep after timestep
+    for (unsigned int i = 0; status == V2P_OK && i < nb_steps; i++) {
+      struct candidate_slice step, slice;
+      if (!candidates_add_step(&s->candidates, &step)) {
+        status = V2P_ERROR_OUT_OF_MEMORY;
+        break;
+      }
+      unsigned int algorithm_idx = 0;
+      unsigned int offset = 0;
+      for (struct algorithm_descriptor* ad = s->algorithm_descriptors; ad; ad = ad->next) {
+        candidate_slice_sub(&step, offset, ad->nb_candidates_per_step, &slice);
+        if (rank[i] < 0)
+          __generate_candidates(s, ad, step_frames[i * nb_algorithms + algorithm_idx], true, &slice);
+        else
+          candidate_slice_assign(&slice,
+            batch_candidates[algorithm_idx] + rank[i] * ad->nb_candidates_per_step);
+        offset += ad->nb_candidates_per_step;
+        algorithm_idx++;
+      }
+      candidates_finish_step(&s->candidates);
+      s->audio_buffer_index += s->frame_step_size;
+      V2P_TRACE_CONTEXT(s->stream_id, s->number_of_timesteps);
+      s->number_of_timesteps++;
+      V2P_TRACE_BEGIN(viterbi);
+      update_viterbi_path(s);
+      V2P_TRACE_END(viterbi, "viterbi");
+    }
+
+    // Clean memory
+    for (unsigned int i = 0; i < sb_count(batch_candidates); i++)
+      v2p_ptr_free(batch_candidates[i]);
+    stb__sbn(batch_candidates) = 0;
   }
+  sb_free(batch_candidates);
+  v2p_free(step_frames);
+
+  __release_consumed_samples(s);
+  return status;
 }
 
-void v2p_add_samples(pitch_analyzer_t* s,
+int v2p_add_samples(pitch_analyzer_t* s,
   const float* samples_in, unsigned int size_in) {
+    // The candidates of a cache file are read only
+    if (s->cache_mapping)
+      return V2P_ERROR_INVALID_ARGUMENT;
+    // The real-time mode never grows the audio buffer
+    if (s->max_block_size) {
+      if (size_in > s->max_block_size)
+        return V2P_ERROR_BLOCK_TOO_LARGE;
+      // Only when the samples stopped being analyzed
+      if (sb_count(s->audio_buffer) + size_in > sb_capacity(s->audio_buffer))
+        return V2P_ERROR_HISTORY_FULL;
+    }
+
+    const v2p_allocator_t* previous = v2p_allocator_enter(s->allocator);
     // Reserve more memory
+    if (!sb_try_grow(s->audio_buffer, size_in)) {
+      v2p_allocator_leave(previous);
+      return V2P_ERROR_OUT_OF_MEMORY;
+    }
     sb_concat(s->audio_buffer, samples_in, size_in);
 
     // Actualise inline computation of the pitch
-    v2p_audio_buffer_changed(s);
+    const int status = v2p_audio_buffer_changed(s);
+    v2p_allocator_leave(previous);
+    __record_memory_peak(s, 0);
+    return status;
+}
+
+int v2p_run(pitch_analyzer_t* s, float* audio_buffer, unsigned int size) {
+  if (s->cache_mapping)
+    return V2P_ERROR_INVALID_ARGUMENT;
+  if (s->max_block_size) {
+    for (unsigned int i = 0; i < size; i += s->max_block_size) {
+      const int status = v2p_add_samples(s, audio_buffer + i, _min(size - i, s->max_block_size));
+      if (status != V2P_OK)
+        return status;
+    }
+    return V2P_OK;
+  }
+  if (!__batch_available(s))
+    return v2p_add_samples(s, audio_buffer, size);
+
+  const v2p_allocator_t* previous = v2p_allocator_enter(s->allocator);
+  int status = V2P_ERROR_OUT_OF_MEMORY;
+  if (sb_try_grow(s->audio_buffer, size)) {
+    sb_concat(s->audio_buffer, audio_buffer, size);
+    status = __audio_buffer_changed_batch(s);
+  }
+  v2p_allocator_leave(previous);
+  __record_memory_peak(s, 0);
+  return status;
 }
 
 void v2p_register_algorithm(pitch_analyzer_t* s,
   struct algorithm_descriptor* ad) {
+  const v2p_allocator_t* previous = v2p_allocator_enter(s->allocator);
   ad->next = s->algorithm_descriptors;
   s->algorithm_descriptors = ad;
   s->nb_candidates_per_step += ad->nb_candidates_per_step;
+  // One more frame per timestep
+  sb_push(s->frames, NULL);
+  if (!s->candidates.nb_steps) {
+    candidates_clear(&s->candidates);
+    candidates_init(&s->candidates, s->nb_candidates_per_step);
+  }
+  if (ad->prepare)
+    ad->prepare(s, ad);
+  v2p_allocator_leave(previous);
+  // The preallocated buffers depend on the algorithms
+  if (s->max_block_size)
+    __reset(s);
 }
 
 unsigned int v2p_nb_candidates_generated(pitch_analyzer_t*s) {
-  return sb_count(s->candidates);
+  return (unsigned int)candidates_count(&s->candidates);
+}
+
+candidate_t* v2p_get_candidates(pitch_analyzer_t* s) {
+  const size_t count = candidates_count(&s->candidates);
+  if (!count)
+    return NULL;
+  candidate_t* candidates = v2p_malloc(count * sizeof(*candidates));
+  if (candidates)
+    candidates_copy(&s->candidates, candidates);
+  return candidates;
+}
+
+void v2p_memory_usage(pitch_analyzer_t* s, struct v2p_memory_report* report) {
+  __measure_memory(s, report);
+  s->memory_peak = _max(s->memory_peak, report->total.capacity);
+  report->peak = s->memory_peak;
+}
+
+// Write the frequencies of the path ending at the minimal path cost
+static void __traceback(pitch_analyzer_t* s, const float* path_costs,
+  const struct backpointers* path_indexes, float* path) {
+  unsigned int best_candidate = fargmin(path_costs, s->nb_candidates_per_step);
+  for (uint i = s->number_of_timesteps - 1; i > 0; i--) {
+    path[i] = candidates_get(&s->candidates, i, best_candidate).frequency;
+    best_candidate = backpointers_get(path_indexes, i - 1, best_candidate);
+  }
+  path[0] = candidates_get(&s->candidates, 0, best_candidate).frequency;
 }
 
 float* v2p_compute_path(pitch_analyzer_t* s) {
-  if (!s->path_costs || !s->nb_candidates_per_step)
+  // The path wasn't updated while the candidates were added
+  // (offline decoding, candidates loaded from a cache)
+  if (!s->path_costs || s->path_indexes.nb_rows + 1 < s->number_of_timesteps)
+    __decode(s);
+  if (!s->path_costs || !s->nb_candidates_per_step || !s->number_of_timesteps)
+    return NULL;
+  // A back-pointer for each timestep after the first one
+  if (s->path_indexes.nb_rows + 1 < s->number_of_timesteps ||
+      s->candidates.nb_steps < s->number_of_timesteps)
     return NULL;
 
   float* frequency_history =
-    malloc(s->number_of_timesteps * sizeof(*frequency_history));
+    v2p_malloc(s->number_of_timesteps * sizeof(*frequency_history));
+  if (!frequency_history)
+    return NULL;
 
+  V2P_TRACE_BEGIN(traceback);
+  __traceback(s, s->path_costs, &s->path_indexes, frequency_history);
+  V2P_TRACE_END(traceback, "traceback");
+  return frequency_history;
+}
+
+unsigned int v2p_compute_path_lagged(pitch_analyzer_t* s, unsigned int first,
+  unsigned int lag, float* path) {
+  if (!s->path_costs || s->path_indexes.nb_rows + 1 < s->number_of_timesteps)
+    __decode(s);
+  const unsigned int nb_timesteps = s->number_of_timesteps;
+  if (!s->path_costs || !s->nb_candidates_per_step || nb_timesteps <= lag ||
+      nb_timesteps - lag <= first)
+    return 0;
+  if (s->path_indexes.nb_rows + 1 < nb_timesteps || s->candidates.nb_steps < nb_timesteps)
+    return 0;
+
+  V2P_TRACE_BEGIN(traceback);
+  // Back to the last timestep written
+  const unsigned int end = nb_timesteps - lag;
   unsigned int best_candidate = fargmin(s->path_costs, s->nb_candidates_per_step);
+  for (uint i = nb_timesteps - 1; i >= end; i--)
+    best_candidate = backpointers_get(&s->path_indexes, i - 1, best_candidate);
+  for (uint i = end - 1; i > first; i--) {
+    path[i - first] = candidates_get(&s->candidates, i, best_candidate).frequency;
+    best_candidate = backpointers_get(&s->path_indexes, i - 1, best_candidate);
+  }
+  path[0] = candidates_get(&s->candidates, first, best_candidate).frequency;
+  V2P_TRACE_END(traceback, "traceback");
+  return end - first;
+}
 
-  for (uint i = s->number_of_timesteps - 1; i > 0; i--) {
-      const uint candidates_idx = i * s->nb_candidates_per_step;
-      frequency_history[i] = s->candidates[candidates_idx + best_candidate].frequency;
+static void __set_costs(pitch_analyzer_t* s, const viterbi_costs_t* costs) {
+  s->compute_transition_cost = costs->compute_transition_cost;
+  s->voiced_unvoiced_cost = costs->voiced_unvoiced_cost;
+  s->octave_jump_cost = costs->octave_jump_cost;
+}
+
+// Paths decoded by v2p_redecode with one of the settings
+struct redecoding {
+  float* path_costs;
+  float* next_path_costs;
+  struct backpointers path_indexes;
+};
+
+float* v2p_redecode(pitch_analyzer_t* s, const viterbi_costs_t* costs, unsigned int nb_settings) {
+  const unsigned int nb_candidates = s->nb_candidates_per_step;
+  const unsigned int nb_timesteps = s->number_of_timesteps;
+  if (!nb_settings || !nb_candidates || !nb_timesteps || s->candidates.nb_steps < nb_timesteps)
+    return NULL;
+  float* paths = v2p_malloc(sizeof(*paths) * nb_timesteps * nb_settings);
+  if (!paths)
+    return NULL;
 
-      const uint path_idx = (i - 1) * s->nb_candidates_per_step;
-      best_candidate = s->path_indexes[path_idx + best_candidate];
+  // Everything is reserved before the analyzer is changed: on failure, it
+  // keeps its back-pointers and its costs.
+  const v2p_allocator_t* previous = v2p_allocator_enter(s->allocator);
+  const bool had_path_costs = s->path_costs != NULL;
+  struct redecoding* decodings = v2p_calloc(nb_settings, sizeof(*decodings));
+  float* block = v2p_malloc(sizeof(*block) * 2 * nb_candidates * nb_settings);
+  bool ok = decodings && block && __reserve_path_costs(s);
+  for (unsigned int j = 0; ok && j < nb_settings; j++) {
+    struct redecoding* d = &decodings[j];
+    d->path_costs = block + 2 * j * nb_candidates;
+    d->next_path_costs = d->path_costs + nb_candidates;
+    backpointers_init(&d->path_indexes, nb_candidates);
+    ok = backpointers_reserve(&d->path_indexes, nb_timesteps - 1);
   }
-  frequency_history[0] = s->candidates[best_candidate].frequency;
 
-  return frequency_history;
+  if (ok) {
+    struct candidate_slice candidates, old_candidates;
+    candidates_step(&s->candidates, 0, &candidates);
+    for (unsigned int j = 0; j < nb_settings; j++)
+      for (unsigned int k = 0; k < nb_candidates; k++)
+        decodings[j].path_costs[k] = -candidates.weight[k];
+
+    // Each timestep is loaded once for all the settings
+    for (unsigned int t = 1; t < nb_timesteps; t++) {
+      old_candidates = candidates;
+      candidates_step(&s->candidates, t, &candidates);
+      for (unsigned int j = 0; j < nb_settings; j++) {
+        struct redecoding* d = &decodings[j];
+        __set_costs(s, &costs[j]);
+        viterbi_step(s, d->path_costs, &old_candidates, &candidates,
+          s->transition_costs, d->next_path_costs, s->next_path_indexes);
+        symp_swap(d->path_costs, d->next_path_costs);
+        backpointers_push(&d->path_indexes, s->next_path_indexes);
+      }
+    }
+
+    for (unsigned int j = 0; j < nb_settings; j++)
+      __traceback(s, decodings[j].path_costs, &decodings[j].path_indexes,
+        paths + (size_t)j * nb_timesteps);
+
+    // The back-pointers of all the settings are held with the previous ones
+    size_t temporary_size = sizeof(*decodings) * nb_settings +
+      sizeof(*block) * 2 * nb_candidates * nb_settings;
+    for (unsigned int j = 0; j < nb_settings; j++)
+      temporary_size += backpointers_memory(&decodings[j].path_indexes);
+    __record_memory_peak(s, temporary_size);
+
+    // The analyzer goes on with the first settings
+    memcpy(s->path_costs, decodings[0].path_costs, sizeof(float) * nb_candidates);
+    backpointers_clear(&s->path_indexes);
+    s->path_indexes = decodings[0].path_indexes;
+    backpointers_init(&decodings[0].path_indexes, nb_candidates);
+    __set_costs(s, &costs[0]);
+  } else if (!had_path_costs) {
+    __free_path_costs(s);
+  }
+
+  for (unsigned int j = 0; decodings && j < nb_settings; j++)
+    backpointers_clear(&decodings[j].path_indexes);
+  v2p_free(decodings);
+  v2p_free(block);
+  v2p_allocator_leave(previous);
+
+  if (!ok)
+    paths = (v2p_free(paths), NULL);
+  return paths;
 }
 
 void* v2p_ptr_free(void* ptr) {
-  free(ptr);
+  // The arrays returned to the user are allocated with the global
+  // allocator, the candidates freed by the analyzer with its allocator.
+  v2p_free(ptr);
   return NULL;
 }
 
@@ -269,10 +1014,11 @@ static float __get_median(float* window, uint window_size) {
 }
 
 float* median_filter(float* input, uint length, uint window_size) {
-  float *window = calloc(sizeof(*window), window_size);
+  V2P_TRACE_BEGIN(filter);
+  float *window = v2p_calloc(sizeof(*window), window_size);
   if (!window)
     return NULL;
-  float *out = malloc(sizeof(*out) * length);
+  float *out = v2p_malloc(sizeof(*out) * length);
   if (!out)
     return NULL;
 
@@ -298,12 +1044,14 @@ float* median_filter(float* input, uint length, uint window_size) {
   for (; i < length; i++)
     out[i] = input[i];
 
-  free(window);
+  v2p_free(window);
+  V2P_TRACE_END(filter, "median_filter");
   return out;
 }
 
 float* mean_filter(float* input, uint length, uint window_size) {
-  float *out = malloc(sizeof(*out) * length);
+  V2P_TRACE_BEGIN(filter);
+  float *out = v2p_malloc(sizeof(*out) * length);
   if (!out)
     return NULL;
 
@@ -327,6 +1075,7 @@ float* mean_filter(float* input, uint length, uint window_size) {
     if (input[i] == 0)
       out[i] = 0;
   }
+  V2P_TRACE_END(filter, "mean_filter");
   return out;
 }
 
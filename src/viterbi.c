@@ -0,0 +1,335 @@
+#include "viterbi.h"
+#include "v2p.h"
+#include "boersma.h"
+#include "candidates.h"
+#include "backpointers.h"
+#include "allocator.h"
+#include "sync.h"
+#include "tools.h"
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+unsigned int fargmin(const float* a, unsigned int length) {
+  float min = a[0];
+  unsigned int arg = 0;
+  for (unsigned int i = 0; i < length; i++)
+    if (a[i] < min) {
+      min = a[i];
+      arg = i;
+    }
+  return arg;
+}
+
+// viterbi_transition_costs with boersma_transition_cost. The log2 of the
+// frequencies are cached by the candidate store, and the loops have no
+// call so that they vectorize.
+static void __boersma_transition_costs(pitch_analyzer_t* s, const float* restrict path_costs,
+  const struct candidate_slice* previous, const struct candidate_slice* current,
+  unsigned int k, float* restrict costs) {
+  const float* restrict frequency = previous->frequency;
+  const float* restrict log2_frequency = previous->log2_frequency;
+  const float weight = current->weight[k];
+  const float voiced_unvoiced_cost = s->voiced_unvoiced_cost;
+  const unsigned int n = previous->size;
+
+  if (current->frequency[k] != 0) {
+    const float log2_k = current->log2_frequency[k];
+    const float octave_jump_cost = s->octave_jump_cost;
+    for (unsigned int i = 0; i < n; i++)
+      costs[i] = path_costs[i] + (frequency[i] != 0 ?
+        octave_jump_cost * fabsf(log2_frequency[i] - log2_k) : voiced_unvoiced_cost) - weight;
+  }
+  else
+    for (unsigned int i = 0; i < n; i++)
+      costs[i] = path_costs[i] + (frequency[i] != 0 ? voiced_unvoiced_cost : 0) - weight;
+}
+
+void viterbi_transition_costs(pitch_analyzer_t* s, const float* path_costs,
+  const struct candidate_slice* previous, const struct candidate_slice* current,
+  unsigned int k, float* costs) {
+  if (s->compute_transition_cost == (coster_t)boersma_transition_cost) {
+    __boersma_transition_costs(s, path_costs, previous, current, k, costs);
+    return;
+  }
+
+  // Any other cost function receives candidates
+  candidate_t cdt1, cdt2;
+  cdt2.frequency = current->frequency[k];
+  cdt2.weight = current->weight[k];
+  for (unsigned int i = 0; i < previous->size; i++) {
+    cdt1.frequency = previous->frequency[i];
+    cdt1.weight = previous->weight[i];
+    costs[i] = path_costs[i] + s->compute_transition_cost(s, &cdt1, &cdt2) - cdt2.weight;
+  }
+}
+
+void viterbi_step(pitch_analyzer_t* s, const float* path_costs,
+  const struct candidate_slice* previous, const struct candidate_slice* current,
+  float* costs, float* next_path_costs, unsigned int* path_indexes) {
+  for (unsigned int k = 0; k < current->size; k++) {
+    viterbi_transition_costs(s, path_costs, previous, current, k, costs);
+    // For each path (0 is unvoiced), keep the first one of minimal score
+    const unsigned int arg_min = fargmin(costs, previous->size);
+    next_path_costs[k] = costs[arg_min];
+    path_indexes[k] = arg_min;
+  }
+}
+
+//
+// Parallel decoding
+//
+// The timeline is split in segments, one per worker. A step of the Viterbi
+// algorithm is a min-plus product of the path costs by the transition
+// matrix of the timestep, so each segment is summarized by the min-plus
+// product of its matrices (transfer), computed in parallel. The path costs
+// at the start of each segment follow from the transfers; then each worker
+// decodes its segment from them, and traces its part of the path back.
+//
+
+// Timesteps [first, last) decoded by a worker. Their transitions start
+// from the timestep first - 1.
+struct viterbi_segment {
+  unsigned int first;
+  unsigned int last;
+  //! Min-plus transfer matrix: transfer[i * K + j] is the cost of the best
+  //! path from the candidate i of the timestep first - 1 to the candidate j
+  //! of the timestep last - 1
+  float* transfer;
+  //! Path costs at the timesteps first - 1 and last - 1
+  float* start;
+  float* end;
+  //! For each candidate of the timestep last - 1, the candidate of the
+  //! timestep first - 1 its best path comes from
+  unsigned int* origin;
+  //! Back-pointers of the timesteps of the segment
+  struct backpointers path_indexes;
+  //! Candidate of the decoded path at the timestep last - 1
+  unsigned int end_state;
+  // Buffers of the forward pass
+  float* costs;
+  float* next_path_costs;
+  unsigned int* next_origin;
+  unsigned int* step_indexes;
+  // Allocated blocks, since the forward pass swaps the buffers
+  float* float_block;
+  unsigned int* index_block;
+};
+
+enum viterbi_phase {
+  //! Decode the first segment, compute the transfer of the others
+  VITERBI_TRANSFER,
+  //! Decode the other segments
+  VITERBI_FORWARD,
+  //! Trace the path back in each segment
+  VITERBI_TRACEBACK
+};
+
+struct viterbi_worker {
+  pitch_analyzer_t* s;
+  struct viterbi_segment* segment;
+  unsigned int index;
+  unsigned int nb_segments;
+  enum viterbi_phase phase;
+  float* path;
+};
+
+// Compute the path costs of the segment from its start, with the
+// back-pointers of each timestep and the origin of the paths.
+static void __segment_forward(pitch_analyzer_t* s, struct viterbi_segment* seg) {
+  const unsigned int nb_candidates = s->nb_candidates_per_step;
+  struct candidate_slice previous, current;
+  memcpy(seg->end, seg->start, sizeof(*seg->end) * nb_candidates);
+  for (unsigned int k = 0; k < nb_candidates; k++)
+    seg->origin[k] = k;
+
+  for (unsigned int t = seg->first; t < seg->last; t++) {
+    candidates_step(&s->candidates, t - 1, &previous);
+    candidates_step(&s->candidates, t, &current);
+    viterbi_step(s, seg->end, &previous, &current, seg->costs,
+      seg->next_path_costs, seg->step_indexes);
+    for (unsigned int k = 0; k < nb_candidates; k++)
+      seg->next_origin[k] = seg->origin[seg->step_indexes[k]];
+    symp_swap(seg->end, seg->next_path_costs);
+    symp_swap(seg->origin, seg->next_origin);
+    // The pages are reserved: it doesn't allocate
+    backpointers_push(&seg->path_indexes, seg->step_indexes);
+  }
+}
+
+// Compute the transfer matrix of the segment: the forward pass from each
+// candidate of the timestep first - 1 alone.
+static void __segment_transfer(pitch_analyzer_t* s, struct viterbi_segment* seg) {
+  const unsigned int nb_candidates = s->nb_candidates_per_step;
+  struct candidate_slice previous, current;
+  for (unsigned int i = 0; i < nb_candidates; i++) {
+    float* row = seg->transfer + (size_t)i * nb_candidates;
+    for (unsigned int k = 0; k < nb_candidates; k++)
+      row[k] = (k == i) ? 0 : INFINITY;
+    for (unsigned int t = seg->first; t < seg->last; t++) {
+      candidates_step(&s->candidates, t - 1, &previous);
+      candidates_step(&s->candidates, t, &current);
+      viterbi_step(s, row, &previous, &current, seg->costs,
+        seg->next_path_costs, seg->step_indexes);
+      memcpy(row, seg->next_path_costs, sizeof(*row) * nb_candidates);
+    }
+  }
+}
+
+// Write the frequencies of the path in the segment, ending at end_state
+static void __segment_traceback(pitch_analyzer_t* s, struct viterbi_segment* seg, float* path) {
+  unsigned int state = seg->end_state;
+  for (unsigned int t = seg->last; t-- > seg->first;) {
+    path[t] = candidates_get(&s->candidates, t, state).frequency;
+    state = backpointers_get(&seg->path_indexes, t - seg->first, state);
+  }
+}
+
+static V2P_THREAD_ROUTINE(__viterbi_worker, arg) {
+  struct viterbi_worker* worker = arg;
+  switch (worker->phase) {
+    case VITERBI_TRANSFER:
+      // The start of the first segment is known. The transfer of the last
+      // one isn't required.
+      if (worker->index == 0)
+        __segment_forward(worker->s, worker->segment);
+      else if (worker->index + 1 < worker->nb_segments)
+        __segment_transfer(worker->s, worker->segment);
+      break;
+    case VITERBI_FORWARD:
+      if (worker->index > 0)
+        __segment_forward(worker->s, worker->segment);
+      break;
+    case VITERBI_TRACEBACK:
+      __segment_traceback(worker->s, worker->segment, worker->path);
+      break;
+  }
+  return V2P_THREAD_RETURN;
+}
+
+// Run a phase on all the segments: the first one on the calling thread,
+// the others on threads. A worker whose thread can't be created runs on
+// the calling thread.
+static void __run_phase(struct viterbi_worker* workers, v2p_thread_t* threads,
+  unsigned int nb_workers, enum viterbi_phase phase) {
+  bool* started = (bool*)(threads + nb_workers);
+  for (unsigned int i = 0; i < nb_workers; i++)
+    workers[i].phase = phase;
+  for (unsigned int i = 1; i < nb_workers; i++)
+    started[i] = v2p_thread_create(&threads[i], __viterbi_worker, &workers[i]) == 0;
+  __viterbi_worker(&workers[0]);
+  for (unsigned int i = 1; i < nb_workers; i++) {
+    if (started[i])
+      v2p_thread_join(threads[i]);
+    else
+      __viterbi_worker(&workers[i]);
+  }
+}
+
+// Allocate the buffers of a segment
+static bool __segment_init(struct viterbi_segment* seg, unsigned int nb_candidates,
+  unsigned int first, unsigned int last) {
+  const size_t n = nb_candidates;
+  seg->first = first;
+  seg->last = last;
+  seg->float_block = v2p_malloc(sizeof(float) * (n * n + 5 * n));
+  seg->index_block = v2p_malloc(sizeof(unsigned int) * 3 * n);
+  backpointers_init(&seg->path_indexes, nb_candidates);
+  if (!seg->float_block || !seg->index_block ||
+      !backpointers_reserve(&seg->path_indexes, last - first))
+    return false;
+  seg->transfer = seg->float_block;
+  seg->origin = seg->index_block;
+  seg->start = seg->transfer + n * n;
+  seg->end = seg->start + n;
+  seg->costs = seg->end + n;
+  seg->next_path_costs = seg->costs + n;
+  seg->next_origin = seg->origin + n;
+  seg->step_indexes = seg->next_origin + n;
+  return true;
+}
+
+static void __segment_delete(struct viterbi_segment* seg) {
+  v2p_free(seg->float_block);
+  v2p_free(seg->index_block);
+  backpointers_clear(&seg->path_indexes);
+}
+
+float* v2p_compute_path_parallel(pitch_analyzer_t* s, unsigned int nb_threads) {
+  const unsigned int nb_candidates = s->nb_candidates_per_step;
+  const unsigned int nb_timesteps = s->number_of_timesteps;
+  if (!nb_candidates || !nb_timesteps || s->candidates.nb_steps < nb_timesteps)
+    return NULL;
+  if (!nb_threads)
+    nb_threads = v2p_nb_processors();
+  // One segment per worker, of one timestep at least
+  const unsigned int nb_segments = _max(_min(nb_threads, nb_timesteps - 1), 1);
+
+  float* path = v2p_malloc(sizeof(*path) * nb_timesteps);
+  if (!path)
+    return NULL;
+
+  const v2p_allocator_t* previous = v2p_allocator_enter(s->allocator);
+  struct viterbi_segment* segments = v2p_calloc(nb_segments, sizeof(*segments));
+  struct viterbi_worker* workers = v2p_calloc(nb_segments, sizeof(*workers));
+  v2p_thread_t* threads = v2p_malloc((sizeof(*threads) + sizeof(bool)) * nb_segments);
+  bool ok = segments && workers && threads;
+  for (unsigned int i = 0; ok && i < nb_segments; i++) {
+    const unsigned int first = 1 + (unsigned int)((unsigned long long)(nb_timesteps - 1) * i / nb_segments);
+    const unsigned int last = 1 + (unsigned int)((unsigned long long)(nb_timesteps - 1) * (i + 1) / nb_segments);
+    ok = __segment_init(&segments[i], nb_candidates, first, last);
+    workers[i].s = s;
+    workers[i].segment = &segments[i];
+    workers[i].index = i;
+    workers[i].nb_segments = nb_segments;
+    workers[i].path = path;
+  }
+
+  if (ok) {
+    // The paths start at the first timestep
+    struct candidate_slice step;
+    candidates_step(&s->candidates, 0, &step);
+    for (unsigned int k = 0; k < nb_candidates; k++)
+      segments[0].start[k] = -step.weight[k];
+
+    __run_phase(workers, threads, nb_segments, VITERBI_TRANSFER);
+
+    // Path costs at the start of each segment (min-plus prefix)
+    for (unsigned int i = 1; i < nb_segments; i++) {
+      const struct viterbi_segment* prev = &segments[i - 1];
+      if (i == 1) {
+        memcpy(segments[1].start, prev->end, sizeof(float) * nb_candidates);
+        continue;
+      }
+      for (unsigned int k = 0; k < nb_candidates; k++) {
+        float min = INFINITY;
+        for (unsigned int j = 0; j < nb_candidates; j++)
+          min = fminf(min, prev->start[j] + prev->transfer[(size_t)j * nb_candidates + k]);
+        segments[i].start[k] = min;
+      }
+    }
+
+    __run_phase(workers, threads, nb_segments, VITERBI_FORWARD);
+
+    // Candidate of the path at the end of each segment
+    unsigned int state = fargmin(segments[nb_segments - 1].end, nb_candidates);
+    for (unsigned int i = nb_segments; i-- > 0;) {
+      segments[i].end_state = state;
+      state = segments[i].origin[state];
+    }
+    path[0] = candidates_get(&s->candidates, 0, state).frequency;
+
+    __run_phase(workers, threads, nb_segments, VITERBI_TRACEBACK);
+  }
+
+  for (unsigned int i = 0; segments && i < nb_segments; i++)
+    __segment_delete(&segments[i]);
+  v2p_free(segments);
+  v2p_free(workers);
+  v2p_free(threads);
+  v2p_allocator_leave(previous);
+
+  if (!ok)
+    path = (v2p_free(path), NULL);
+  return path;
+}
@@ -0,0 +1,175 @@
+#include "window_cache.h"
+#include "autocorrelation.h"
+#include "fft.h"
+#include "sync.h"
+#include "tables.h"
+#include "allocator.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+// Registry of the shared windows. It's a short linked list:
+// a process rarely uses more than a few window sizes.
+static struct shared_window* registry = NULL;
+static v2p_mutex_t registry_mutex = V2P_MUTEX_INITIALIZER;
+
+// Allocate a new entry and compute its buffers
+static struct shared_window* __window_new(
+  enum window_type type, unsigned int size, unsigned int padding) {
+  struct shared_window* w = v2p_calloc(1, sizeof(*w));
+  if (!w)
+    return NULL;
+  w->allocator = v2p_current_allocator();
+
+  // Standard sizes are embedded in the library: nothing to compute
+  const struct v2p_static_window* sw = v2p_static_window_lookup(type, size);
+  if (sw && sw->ac_length == size + padding) {
+    w->type = type;
+    w->size = size;
+    w->padding = padding;
+    w->window = sw->window;
+    w->window_ac = sw->window_ac;
+    w->window_ac_size = sw->window_ac_size;
+    w->static_tables = true;
+    return w;
+  }
+
+  float* window = v2p_malloc(sizeof(*window) * size);
+  if (!window)
+    goto error;
+
+  switch (type) {
+    case WINDOW_HAMMING:
+      compute_hamming(window, size);
+      break;
+    case WINDOW_BLACKMAN_HARRIS:
+      compute_blackman_harris(window, size);
+      break;
+    case WINDOW_HANN:
+    default:
+      compute_hann(window, size);
+      break;
+  }
+
+  unsigned int window_ac_size;
+  float* window_ac = compute_unnormalized_autocorrelation_with_length(
+    window, size, size + padding, &window_ac_size);
+  if (!window_ac)
+    goto error;
+
+  w->type = type;
+  w->size = size;
+  w->padding = padding;
+  w->window = window;
+  w->window_ac = window_ac;
+  w->window_ac_size = window_ac_size;
+  return w;
+
+error:
+  v2p_free(window);
+  v2p_free(w);
+  return NULL;
+}
+
+static void __window_delete(struct shared_window* w) {
+  if (!w->static_tables) {
+    v2p_allocator_free(w->allocator, (float*)w->window);
+    v2p_allocator_free(w->allocator, (float*)w->window_ac);
+  }
+  v2p_allocator_free(w->allocator, w);
+}
+
+// Unlink and free w if nobody reference it anymore.
+// The registry mutex should be locked.
+static void __window_maybe_delete(struct shared_window* w) {
+  if (w->references || w->prewarmed)
+    return;
+  struct shared_window** it = &registry;
+  while (*it && *it != w)
+    it = &(*it)->next;
+  if (*it)
+    *it = w->next;
+  __window_delete(w);
+}
+
+// Find or create the entry for the given key.
+// The registry mutex should be locked.
+static struct shared_window* __window_lookup(
+  enum window_type type, unsigned int size, unsigned int padding) {
+  if (!size)
+    return NULL;
+  if (padding == 0)
+    padding = autocorrelation_length(size) - size;
+  // Any even length without wrap around of the lags is supported
+  if ((size + padding) & 1 || size + padding < 2 * size - 1)
+    return NULL;
+
+  for (struct shared_window* w = registry; w; w = w->next)
+    if (w->type == type && w->size == size && w->padding == padding)
+      return w;
+
+  // The cache outlives the analyzers: use the global allocator
+  const v2p_allocator_t* previous = v2p_allocator_enter(v2p_get_allocator());
+  struct shared_window* w = __window_new(type, size, padding);
+  v2p_allocator_leave(previous);
+  if (w) {
+    w->next = registry;
+    registry = w;
+  }
+  return w;
+}
+
+const shared_window_t* window_cache_acquire(
+  enum window_type type, unsigned int size, unsigned int padding) {
+  v2p_mutex_lock(&registry_mutex);
+  struct shared_window* w = __window_lookup(type, size, padding);
+  if (w)
+    w->references++;
+  v2p_mutex_unlock(&registry_mutex);
+  return w;
+}
+
+void window_cache_release(const shared_window_t* cw) {
+  if (!cw)
+    return;
+  struct shared_window* w = (struct shared_window*)cw;
+  v2p_mutex_lock(&registry_mutex);
+  w->references--;
+  __window_maybe_delete(w);
+  v2p_mutex_unlock(&registry_mutex);
+}
+
+int window_cache_prewarm(enum window_type type, unsigned int size, unsigned int padding) {
+  v2p_mutex_lock(&registry_mutex);
+  struct shared_window* w = __window_lookup(type, size, padding);
+  if (w)
+    w->prewarmed = true;
+  v2p_mutex_unlock(&registry_mutex);
+  return w ? 0 : -1;
+}
+
+void window_cache_clear(void) {
+  v2p_mutex_lock(&registry_mutex);
+  struct shared_window* w = registry;
+  while (w) {
+    struct shared_window* next = w->next;
+    w->prewarmed = false;
+    __window_maybe_delete(w);
+    w = next;
+  }
+  v2p_mutex_unlock(&registry_mutex);
+}
+
+unsigned int window_cache_size(void) {
+  unsigned int size = 0;
+  v2p_mutex_lock(&registry_mutex);
+  for (struct shared_window* w = registry; w; w = w->next)
+    size++;
+  v2p_mutex_unlock(&registry_mutex);
+  return size;
+}
+
+size_t window_cache_memory(const shared_window_t* w) {
+  if (!w || w->static_tables)
+    return 0;
+  return sizeof(*w) + sizeof(float) * (w->size + w->window_ac_size);
+}
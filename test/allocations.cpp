@@ -0,0 +1,76 @@
+#include "lib/TestHarness.hpp"
+#include "lib/AllocationTracker.hpp"
+#include "lib/TestAnalyzer.hpp"
+#include "v2p.h"
+
+// Several seconds of a sung phrase, analyzed with maxfreq too
+static TestAnalyzerSettings __phrase(double duration) {
+  TestAnalyzerSettings settings;
+  settings.maxfreq = true;
+  settings.signal = phraseSignal;
+  settings.duration = duration;
+  return settings;
+}
+
+// The trace records its spans into blocks allocated along the run
+static bool __tracked() {
+#ifdef V2P_TRACE
+  return false;
+#else
+  return AllocationTracker::available();
+#endif
+}
+
+// Feed the analyzer by blocks of 10ms, tracking the allocations after
+// the first second. Return the number of timesteps tracked.
+static unsigned int __stream(TestAnalyzer& a, unsigned int block_size, const char* name) {
+  const std::vector<float>& buffer = a.signal;
+  // Warm-up: the shared caches, the spectrums and the first buffers
+  unsigned int i = 0;
+  for (; i < 48000; i += block_size)
+    v2p_add_samples(a.s, &buffer[i], block_size);
+  const unsigned int first_timestep = a.s->number_of_timesteps;
+
+  AllocationTracker::start();
+  for (; i + block_size <= buffer.size(); i += block_size) {
+    v2p_add_samples(a.s, &buffer[i], block_size);
+    if (a.s->number_of_timesteps % 100 == 0)
+      AllocationTracker::sample(a.s->number_of_timesteps);
+  }
+  AllocationTracker::stop();
+  AllocationTracker::report(name);
+  return a.s->number_of_timesteps - first_timestep;
+}
+
+TEST (Allocations, streaming_allocations_per_frame_are_bounded)
+{
+  TestAnalyzer a(__phrase(12));
+  a.s->discard_consumed_samples = 1;
+  v2p_reset(a.s);
+
+  const unsigned int nb_frames = __stream(a, 480, "Allocations, streaming");
+  CHECK(nb_frames > 1000);
+  if (__tracked()) {
+    const AllocationTracker::Counters counters = AllocationTracker::counters();
+    // Only the amortized growth of the candidates and of the back-pointers
+    CHECK(counters.allocations + counters.reallocations <= nb_frames / 100);
+    // What is kept of each timestep
+    const unsigned int nb_candidates = a.s->nb_candidates_per_step;
+    const long long bytes_per_frame = nb_candidates * (3 * sizeof(float) + sizeof(unsigned int));
+    CHECK(counters.bytesInUse <= 4 * bytes_per_frame * nb_frames);
+  }
+}
+
+TEST (Allocations, realtime_streaming_never_allocates)
+{
+  TestAnalyzer a(__phrase(6));
+  CHECK_LONGS_EQUAL(V2P_OK, v2p_prepare(a.s, 480, 1000));
+
+  const unsigned int nb_frames = __stream(a, 480, "Allocations, real-time");
+  CHECK(nb_frames > 400);
+  if (__tracked()) {
+    // Not even by the C library or the shared caches
+    const AllocationTracker::Counters counters = AllocationTracker::counters();
+    CHECK_LONGS_EQUAL(0, counters.allocations + counters.reallocations + counters.frees);
+  }
+}
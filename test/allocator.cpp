@@ -0,0 +1,227 @@
+#include "lib/TestHarness.hpp"
+#include "lib/TestAnalyzer.hpp"
+#include "allocator.h"
+#include "v2p.h"
+#include "boersma.h"
+#include "maxfreq.h"
+#include "window_cache.h"
+#include "backpointers.h"
+#include "stretchy_buffer.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+// Allocator keeping track of the memory it gives, with the size of each
+// block stored in front of it. It refuses the blocks whose size is in
+// [fail_from, fail_to], unless fail_from is 0.
+struct counting_allocator {
+  v2p_allocator_t allocator;
+  size_t nb_allocations;
+  size_t allocated;
+  size_t peak;
+  size_t fail_from;
+  size_t fail_to;
+};
+
+#define COUNTING_HEADER 16
+
+static void* __counting_realloc(void* user_data, void* ptr, size_t size) {
+  counting_allocator* c = (counting_allocator*)user_data;
+  size_t old_size = 0;
+  char* raw = NULL;
+  if (ptr) {
+    raw = (char*)ptr - COUNTING_HEADER;
+    old_size = *(size_t*)raw;
+  }
+  if (c->fail_from && size >= c->fail_from && size <= c->fail_to)
+    return NULL;
+  raw = (char*)realloc(raw, size + COUNTING_HEADER);
+  if (!raw)
+    return NULL;
+  *(size_t*)raw = size;
+  c->nb_allocations++;
+  c->allocated += size - old_size;
+  if (c->allocated > c->peak)
+    c->peak = c->allocated;
+  return raw + COUNTING_HEADER;
+}
+
+static void* __counting_malloc(void* user_data, size_t size) {
+  return __counting_realloc(user_data, NULL, size);
+}
+
+static void __counting_free(void* user_data, void* ptr) {
+  counting_allocator* c = (counting_allocator*)user_data;
+  char* raw = (char*)ptr - COUNTING_HEADER;
+  c->allocated -= *(size_t*)raw;
+  free(raw);
+}
+
+static void __counting_init(counting_allocator* c) {
+  c->allocator.malloc = __counting_malloc;
+  c->allocator.realloc = __counting_realloc;
+  c->allocator.free = __counting_free;
+  c->allocator.user_data = c;
+  c->nb_allocations = 0;
+  c->allocated = 0;
+  c->peak = 0;
+  c->fail_from = 0;
+  c->fail_to = 0;
+}
+
+// Analysis of a tone through a counting allocator
+static TestAnalyzerSettings __tone(const counting_allocator& c, unsigned int frame_size,
+  double duration) {
+  TestAnalyzerSettings settings;
+  settings.frameSize = frame_size;
+  settings.signal = toneSignal;
+  settings.duration = duration;
+  settings.allocator = &c.allocator;
+  return settings;
+}
+
+TEST (Allocator, analyzer_memory_goes_through_its_allocator)
+{
+  counting_allocator streams[2];
+  __counting_init(&streams[0]);
+  __counting_init(&streams[1]);
+  {
+    // Descriptors are allocated with the global allocator
+    TestAnalyzer online(__tone(streams[0], 1500, 1)), batch(__tone(streams[1], 1500, 1));
+    CHECK(online.s->allocator == &streams[0].allocator);
+    CHECK(batch.s->allocator == &streams[1].allocator);
+    CHECK(streams[0].nb_allocations > 0);
+
+    // Online and batch processing
+    online.stream((unsigned int)online.signal.size());
+    batch.run();
+    for (unsigned int k = 0; k < 2; k++) {
+      CHECK(v2p_path_len(k ? batch.s : online.s) > 0);
+      // At least the candidates and the audio buffer
+      CHECK(streams[k].allocated >= sizeof(float) * online.signal.size());
+      CHECK(streams[k].peak >= streams[k].allocated);
+    }
+
+    // The path is returned to the user with the global allocator
+    const size_t allocated = streams[0].allocated;
+    CHECK(!online.path().empty());
+    CHECK_LONGS_EQUAL(allocated, streams[0].allocated);
+  }
+
+  // Everything is given back
+  for (unsigned int k = 0; k < 2; k++)
+    CHECK_LONGS_EQUAL(0, streams[k].allocated);
+}
+
+TEST (Allocator, failed_allocations_stop_the_batch_analysis)
+{
+  // The audio buffer, the buffers of the batches (the largest blocks), and
+  // the chunks of candidates can't be allocated
+  for (unsigned int k = 0; k < 3; k++) {
+    counting_allocator c;
+    __counting_init(&c);
+    {
+      TestAnalyzer a(__tone(c, 2048, 0.2));
+      const size_t size = sizeof(float) * a.signal.size();
+      const size_t chunk_size = 3 * sizeof(float) * a.s->candidates.steps_per_chunk *
+        a.s->nb_candidates_per_step;
+      c.fail_from = k == 0 ? size : k == 1 ? 2 * size : chunk_size;
+      c.fail_to = k == 2 ? chunk_size : (size_t)-1;
+
+      CHECK_LONGS_EQUAL(V2P_ERROR_OUT_OF_MEMORY, a.run());
+      CHECK_LONGS_EQUAL(0, v2p_path_len(a.s));
+
+      // Once the memory is available again
+      c.fail_from = 0;
+      v2p_reset(a.s);
+      CHECK_LONGS_EQUAL(V2P_OK, a.run());
+      CHECK(v2p_path_len(a.s) > 0);
+    }
+    CHECK_LONGS_EQUAL(0, c.allocated);
+  }
+}
+
+TEST (Allocator, failed_redecoding_leaves_the_analyzer_unchanged)
+{
+  counting_allocator c;
+  __counting_init(&c);
+  {
+    TestAnalyzer a(__tone(c, 2048, 0.2));
+    pitch_analyzer_t* s = a.s;
+    a.run();
+    const std::vector<float> path = a.path();
+    CHECK(!path.empty());
+    const unsigned int nb_rows = s->path_indexes.nb_rows;
+    const float voiced_unvoiced_cost = s->voiced_unvoiced_cost;
+    const size_t allocated = c.allocated;
+
+    // The pages of back-pointers can't be allocated
+    viterbi_costs_t costs[2];
+    for (unsigned int j = 0; j < 2; j++) {
+      costs[j].compute_transition_cost = s->compute_transition_cost;
+      costs[j].voiced_unvoiced_cost = s->voiced_unvoiced_cost * (j + 2);
+      costs[j].octave_jump_cost = s->octave_jump_cost * (j + 2);
+    }
+    c.fail_from = BACKPOINTERS_PAGE_SIZE / 2;
+    c.fail_to = BACKPOINTERS_PAGE_SIZE;
+    CHECK(v2p_redecode(s, costs, 2) == NULL);
+    c.fail_from = 0;
+
+    // Neither the back-pointers nor the costs changed
+    CHECK_LONGS_EQUAL(nb_rows, s->path_indexes.nb_rows);
+    CHECK_DOUBLES_EQUAL(voiced_unvoiced_cost, s->voiced_unvoiced_cost);
+    CHECK_LONGS_EQUAL(allocated, c.allocated);
+    CHECK(path == a.path());
+  }
+  CHECK_LONGS_EQUAL(0, c.allocated);
+}
+
+TEST (Allocator, global_allocator_is_used_by_default)
+{
+  counting_allocator global;
+  __counting_init(&global);
+  v2p_set_allocator(&global.allocator);
+  CHECK(v2p_get_allocator() == &global.allocator);
+
+  pitch_analyzer_t* s = v2p_new(0);
+  algorithm_descriptor_maxfreq_t* ad = maxfreq_new(1024);
+  v2p_register_algorithm(s, (algorithm_descriptor_t*)ad);
+  std::vector<float> buffer(16000, 0.5f);
+  v2p_add_samples(s, &buffer[0], (unsigned int)buffer.size());
+  CHECK(global.allocated > 0);
+
+  float* filtered = median_filter(&buffer[0], (unsigned int)buffer.size(), 5);
+  CHECK(filtered != NULL);
+  v2p_ptr_free(filtered);
+
+  v2p_delete(s);
+  maxfreq_delete(ad);
+  window_cache_clear();
+  CHECK_LONGS_EQUAL(0, global.allocated);
+
+  v2p_set_allocator(NULL);
+  CHECK(v2p_get_allocator() == &v2p_default_allocator);
+}
+
+TEST (Allocator, stretchy_buffers_remember_their_allocator)
+{
+  counting_allocator c;
+  __counting_init(&c);
+
+  // Created inside the scope of an allocator, freed outside
+  const v2p_allocator_t* previous = v2p_allocator_enter(&c.allocator);
+  sb_float values = NULL;
+  sb_push(values, 1.f);
+  v2p_allocator_leave(previous);
+  CHECK(c.allocated > 0);
+
+  for (unsigned int i = 0; i < 100; i++)
+    sb_push(values, (float)i);
+  CHECK_LONGS_EQUAL(101, sb_count(values));
+  CHECK(sb_capacity(values) >= sb_count(values));
+  CHECK(c.allocated >= sizeof(float) * 101);
+
+  sb_free(values);
+  CHECK_LONGS_EQUAL(0, c.allocated);
+}
@@ -6,6 +6,7 @@
 #include <vector>
 #include <algorithm>
 #include <cstdlib>
+#include <cmath>
 
 TEST (FFT, Next_power_of_two)
 {
@@ -102,3 +103,97 @@ TEST (FFT, Corrected_autocorrelation_of_dirac_is_dirac)
   // Free allocated memory
   v2p_ptr_free(out);
 }
+
+TEST (FFT, Corrected_autocorrelation_batch_match_single_frame)
+{
+  const unsigned int size = 512;
+  // More than one block, and a partial last block
+  const unsigned int nb_frames = FFT_BATCH_BLOCK + 3;
+  std::vector<float> window(size);
+  compute_hann(&window[0], size);
+
+  std::vector<std::vector<float>> frames(nb_frames, std::vector<float>(size));
+  std::vector<float*> frame_ptrs(nb_frames);
+  for (unsigned int k = 0; k < nb_frames; k++) {
+    for (unsigned int i = 0; i < size; i++)
+      frames[k][i] = (float)sin(i * (k + 1) * 0.05) + (float)rand() / RAND_MAX * 0.1f;
+    frame_ptrs[k] = &frames[k][0];
+  }
+
+  unsigned int batch_size;
+  float* window_ac = NULL;
+  float* batch = compute_corrected_autocorrelation_batch(
+    &frame_ptrs[0], nb_frames, &window[0], &window_ac, size, &batch_size);
+  CHECK(window_ac != NULL);
+
+  for (unsigned int k = 0; k < nb_frames; k++) {
+    unsigned int new_size;
+    float* out = compute_corrected_autocorrelation(&frames[k][0], &window[0], &window_ac, size, &new_size);
+    CHECK_LONGS_EQUAL(new_size, batch_size);
+    for (unsigned int i = 0; i < new_size; i++)
+      CHECK(fabs(out[i] - batch[k * batch_size + i]) < 1e-3 * (1 + fabs(out[i])));
+    v2p_ptr_free(out);
+  }
+
+  v2p_ptr_free(batch);
+  v2p_ptr_free(window_ac);
+}
+
+TEST (FFT, Autocorrelation_with_mixed_radix_length_match_direct_sum)
+{
+  // 2 * 2100 - 1 pads to 4320 = 2^5 3^3 5 instead of 8192
+  const unsigned int size = 2100;
+  const unsigned int ac_length = autocorrelation_length(size);
+  CHECK(ac_length >= 2 * size - 1);
+  CHECK(ac_length < next_power_of_two(2 * size));
+
+  std::vector<float> frame(size);
+  for (unsigned int i = 0; i < size; i++)
+    frame[i] = (float)sin(i * 0.03) + (float)rand() / RAND_MAX * 0.1f;
+
+  unsigned int size_out;
+  float* ac = compute_autocorrelation(&frame[0], size, &size_out);
+  CHECK_LONGS_EQUAL(ac_length / 2, size_out);
+  for (unsigned int lag = 0; lag < size; lag += 7) {
+    double expected = 0;
+    for (unsigned int i = 0; i + lag < size; i++)
+      expected += frame[i] * frame[i + lag];
+    CHECK(fabs(ac[lag] - expected) < 1e-3 * (1 + fabs(expected)));
+  }
+  v2p_ptr_free(ac);
+}
+
+TEST (FFT, Direct_corrected_autocorrelation_match_fft)
+{
+  const unsigned int size = 600;
+  std::vector<float> window(size);
+  compute_hann(&window[0], size);
+  std::vector<float> frame(size);
+  for (unsigned int i = 0; i < size; i++)
+    frame[i] = (float)sin(i * 0.2) + (float)rand() / RAND_MAX * 0.1f;
+
+  unsigned int fft_size;
+  float* window_ac = NULL;
+  float* fft_ac = compute_corrected_autocorrelation(&frame[0], &window[0], &window_ac, size, &fft_size);
+
+  // With the window autocorrelation of the FFT path, or computed directly
+  const float* window_acs[] = {window_ac, NULL};
+  for (const float* w_ac : window_acs) {
+    unsigned int direct_size;
+    float* direct_ac = compute_corrected_autocorrelation_direct(
+      &frame[0], &window[0], w_ac, size, 20, 200, &direct_size);
+    CHECK_LONGS_EQUAL(fft_size, direct_size);
+    CHECK(fabs(fft_ac[0] - direct_ac[0]) < 1e-3 * fabs(fft_ac[0]));
+    for (unsigned int lag = 1; lag < direct_size; lag++) {
+      if (lag < 20 || lag > 200) {
+        CHECK_DOUBLES_EQUAL(0, direct_ac[lag]);
+      } else {
+        CHECK(fabs(fft_ac[lag] - direct_ac[lag]) < 1e-3 * (1 + fabs(fft_ac[0])));
+      }
+    }
+    v2p_ptr_free(direct_ac);
+  }
+
+  v2p_ptr_free(fft_ac);
+  v2p_ptr_free(window_ac);
+}
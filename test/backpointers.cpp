@@ -0,0 +1,66 @@
+#include "lib/TestHarness.hpp"
+#include "backpointers.h"
+
+#include <vector>
+#include <cstdlib>
+
+TEST (Backpointers, narrowest_width_is_used)
+{
+  const unsigned int nb_states[] = {1, 3, 16, 17, 256, 257, 65536, 65537};
+  const unsigned int bits[] = {4, 4, 4, 8, 8, 16, 16, 32};
+  for (unsigned int i = 0; i < 8; i++) {
+    struct backpointers bp;
+    backpointers_init(&bp, nb_states[i]);
+    CHECK_LONGS_EQUAL(bits[i], bp.bits);
+    CHECK_LONGS_EQUAL((nb_states[i] * bits[i] + 7) / 8, bp.row_size);
+    CHECK(bp.rows_per_page >= 1);
+    backpointers_clear(&bp);
+  }
+}
+
+TEST (Backpointers, rows_are_read_back_across_pages)
+{
+  const unsigned int nb_states[] = {3, 16, 40, 300, 70000};
+  for (unsigned int i = 0; i < 5; i++) {
+    const unsigned int n = nb_states[i];
+    struct backpointers bp;
+    backpointers_init(&bp, n);
+    // At least three pages
+    const unsigned int nb_rows = 2 * bp.rows_per_page + 3;
+
+    std::vector<unsigned int> values((size_t)nb_rows * n);
+    for (size_t j = 0; j < values.size(); j++)
+      values[j] = rand() % n;
+    for (unsigned int r = 0; r < nb_rows; r++)
+      CHECK(backpointers_push(&bp, &values[(size_t)r * n]));
+    CHECK_LONGS_EQUAL(nb_rows, bp.nb_rows);
+    const size_t nb_pages = (nb_rows + bp.rows_per_page - 1) / bp.rows_per_page;
+    CHECK_LONGS_EQUAL(nb_pages * bp.rows_per_page * bp.row_size, backpointers_memory(&bp));
+
+    bool same = true;
+    for (unsigned int r = 0; r < nb_rows; r++)
+      for (unsigned int k = 0; k < n; k++)
+        same = same && backpointers_get(&bp, r, k) == values[(size_t)r * n + k];
+    CHECK(same);
+    backpointers_clear(&bp);
+    CHECK_LONGS_EQUAL(0, backpointers_memory(&bp));
+  }
+}
+
+TEST (Backpointers, reserved_pages_are_reused)
+{
+  struct backpointers bp;
+  backpointers_init(&bp, 5);
+  CHECK(backpointers_reserve(&bp, 100000));
+  const size_t memory = backpointers_memory(&bp);
+  // 3 bytes per row instead of 20 with 32 bits indexes
+  CHECK(memory >= 100000 * 3);
+  CHECK(memory < 100000 * 3 + BACKPOINTERS_PAGE_SIZE);
+
+  const unsigned int row[5] = {4, 3, 2, 1, 0};
+  for (unsigned int r = 0; r < 100000; r++)
+    backpointers_push(&bp, row);
+  CHECK_LONGS_EQUAL(memory, backpointers_memory(&bp));
+  CHECK_LONGS_EQUAL(2, backpointers_get(&bp, 99999, 2));
+  backpointers_clear(&bp);
+}
@@ -1,4 +1,5 @@
 #include "lib/TestHarness.hpp"
+#include "lib/TestAnalyzer.hpp"
 #include "boersma.h"
 #include "v2p.h"
 #include "tools.h"
@@ -114,7 +115,7 @@ TEST (Boersma, v2p_scenario_boersma)
     // Check we have nb_candidates_per_step * number_of_frames candidates.
     const unsigned int number_of_frames = s->audio_buffer_index / s->frame_step_size;
     CHECK_LONGS_EQUAL(s->nb_candidates_per_step * number_of_frames,
-      sb_count(s->candidates));
+      v2p_nb_candidates_generated(s));
 
     // Compute paths and check its value
     float* path = v2p_compute_path(s);
@@ -127,6 +128,114 @@ TEST (Boersma, v2p_scenario_boersma)
     boersma_unvoiced_delete(adu);
 }
 
+TEST (Boersma, v2p_run_match_v2p_add_samples)
+{
+  // One second of glissando, frame by frame and by batch
+  TestAnalyzer online, batch;
+  online.stream((unsigned int)online.signal.size());
+  batch.run();
+
+  CHECK(online.s->number_of_timesteps > V2P_RUN_BATCH);
+  CHECK_LONGS_EQUAL(online.s->number_of_timesteps, batch.s->number_of_timesteps);
+  CHECK_LONGS_EQUAL(v2p_nb_candidates_generated(online.s), v2p_nb_candidates_generated(batch.s));
+
+  const std::vector<float> path = online.path();
+  const std::vector<float> path_batch = batch.path();
+  CHECK_LONGS_EQUAL(path.size(), path_batch.size());
+  for (uint i = 0; i < path.size() && i < path_batch.size(); i++)
+    CHECK(fabs(path[i] - path_batch[i]) < 0.1);
+}
+
+TEST (Boersma, direct_autocorrelation_match_fft)
+{
+  // One second of glissando at 16kHz
+  TestAnalyzerSettings settings;
+  settings.frameSize = 1024;
+  settings.samplingRate = 16000;
+  TestAnalyzer direct(settings), fft(settings);
+  direct.s->minimal_frequency = 100;
+  fft.s->minimal_frequency = 100;
+  v2p_reset(direct.s);
+  v2p_reset(fft.s);
+  // Few lags in [16000 / 800, 16000 / 100]: the cost model picks dot products
+  CHECK(fft.adb->direct_autocorrelation);
+  fft.adb->autocorrelation_method = BOERSMA_AUTOCORRELATION_FFT;
+  v2p_reset(fft.s);
+  CHECK(!fft.adb->direct_autocorrelation);
+
+  fft.stream((unsigned int)fft.signal.size());
+  direct.stream((unsigned int)direct.signal.size());
+
+  pitch_analyzer_t* s[2] = {fft.s, direct.s};
+  CHECK(s[0]->number_of_timesteps > 0);
+  CHECK_LONGS_EQUAL(s[0]->number_of_timesteps, s[1]->number_of_timesteps);
+  CHECK_LONGS_EQUAL(v2p_nb_candidates_generated(s[0]), v2p_nb_candidates_generated(s[1]));
+  for (unsigned int i = 0; i < s[0]->number_of_timesteps; i++)
+    for (unsigned int k = 0; k < s[0]->nb_candidates_per_step; k++) {
+      const candidate_t a = candidates_get(&s[0]->candidates, i, k);
+      const candidate_t b = candidates_get(&s[1]->candidates, i, k);
+      CHECK(fabs(a.frequency - b.frequency) < 1e-2 * (1 + a.frequency));
+      CHECK(fabs(a.weight - b.weight) < 1e-3);
+    }
+}
+
+TEST (Boersma, default_settings_use_the_fft_autocorrelation)
+{
+  struct pitch_analyzer* s = v2p_new(0);
+  struct algorithm_descriptor_boersma* adb = boersma_new(2048, 0);
+  v2p_register_algorithm(s, (algorithm_descriptor*)adb);
+  // 48kHz with lags up to 48000 / 20: two transforms are cheaper
+  CHECK(!adb->direct_autocorrelation);
+  v2p_delete(s);
+  boersma_delete(adb);
+}
+
+// Quiet noise, then a sinusoid at 150Hz, then quiet noise
+static std::vector<float> __noise_and_sinusoid(unsigned int nb_samples, float sampling_rate) {
+  std::vector<float> buffer(nb_samples);
+  srand(3);
+  for (unsigned int i = 0; i < nb_samples; i++) {
+    buffer[i] = ((float)rand() / RAND_MAX - 0.5f) * 0.002f;
+    if (i > nb_samples / 3 && i < 2 * nb_samples / 3)
+      buffer[i] = (float)sin(i * 150 * 2 * M_PI / sampling_rate);
+  }
+  return buffer;
+}
+
+TEST (Boersma, silence_gating_skips_quiet_frames)
+{
+  // Same analysis with and without silence gate, online and by batch
+  TestAnalyzerSettings settings;
+  settings.signal = __noise_and_sinusoid;
+  settings.duration = 2;
+  TestAnalyzer online(settings), gated(settings), batch(settings);
+  gated.s->silence_gating = 1;
+  batch.s->silence_gating = 1;
+
+  online.stream(4800);
+  gated.stream(4800);
+  batch.run();
+
+  // About 2/3 of the frames are silent. Online, the gate only knows the
+  // peak of the samples received so far: the leading noise isn't gated.
+  CHECK_LONGS_EQUAL(0, online.s->nb_gated_frames);
+  CHECK(gated.s->nb_gated_frames > gated.s->number_of_timesteps / 4);
+  CHECK(batch.s->nb_gated_frames > batch.s->number_of_timesteps / 2);
+
+  // Same number of candidates and same path
+  CHECK_LONGS_EQUAL(v2p_nb_candidates_generated(online.s), v2p_nb_candidates_generated(gated.s));
+  CHECK_LONGS_EQUAL(v2p_nb_candidates_generated(online.s), v2p_nb_candidates_generated(batch.s));
+  const std::vector<float> path = online.path();
+  const std::vector<float> path_gated = gated.path();
+  const std::vector<float> path_batch = batch.path();
+  CHECK_LONGS_EQUAL(path.size(), path_gated.size());
+  CHECK_LONGS_EQUAL(path.size(), path_batch.size());
+  for (uint i = 0; i < path.size() && i < path_gated.size() && i < path_batch.size(); i++) {
+    CHECK_DOUBLES_EQUAL(path[i], path_gated[i]);
+    CHECK(fabs(path_gated[i] - path_batch[i]) < 0.1);
+  }
+}
+
 TEST(Boersma, transition_cost) {
   // We have our different candidates:
   candidate_t a, b, z;
@@ -0,0 +1,143 @@
+#include "lib/TestHarness.hpp"
+#include "lib/TestAnalyzer.hpp"
+#include "v2p.h"
+#include "candidate_cache.h"
+
+#include <vector>
+#include <cmath>
+#include <cstdio>
+
+// Vibrato analyzed at 16kHz
+static TestAnalyzerSettings __vibrato(double duration) {
+  TestAnalyzerSettings settings;
+  settings.frameSize = 1024;
+  settings.samplingRate = 16000;
+  settings.nbCandidates = 4;
+  settings.signal = vibratoSignal;
+  settings.duration = duration;
+  return settings;
+}
+
+static bool __same_path(float* a, float* b, unsigned int length) {
+  bool same = a && b;
+  for (unsigned int i = 0; same && i < length; i++)
+    same = a[i] == b[i];
+  return same;
+}
+
+TEST (CandidateCache, key_depends_on_the_audio_and_the_candidate_settings)
+{
+  TestAnalyzer a(__vibrato(0.5));
+  pitch_analyzer_t* s = a.s;
+  std::vector<float>& buffer = a.signal;
+
+  const uint64_t key = v2p_cache_key(s, &buffer[0], (unsigned int)buffer.size());
+  CHECK(key != 0);
+  CHECK(key == v2p_cache_key(s, &buffer[0], (unsigned int)buffer.size()));
+  CHECK(key != v2p_cache_key(s, &buffer[0], (unsigned int)buffer.size() - 1));
+  buffer[100] += 0.01f;
+  CHECK(key != v2p_cache_key(s, &buffer[0], (unsigned int)buffer.size()));
+  buffer[100] -= 0.01f;
+
+  // The decoding costs don't change the candidates
+  s->octave_jump_cost *= 2;
+  s->voiced_unvoiced_cost *= 2;
+  CHECK(key == v2p_cache_key(s, &buffer[0], (unsigned int)buffer.size()));
+  // The octave cost is applied to the weights
+  s->octave_cost *= 2;
+  CHECK(key != v2p_cache_key(s, &buffer[0], (unsigned int)buffer.size()));
+  s->octave_cost /= 2;
+  a.adb->direct_autocorrelation = !a.adb->direct_autocorrelation;
+  CHECK(key != v2p_cache_key(s, &buffer[0], (unsigned int)buffer.size()));
+  a.adb->direct_autocorrelation = !a.adb->direct_autocorrelation;
+
+  // An algorithm without hash_settings can't be cached
+  a.adu->parent.hash_settings = NULL;
+  CHECK_LONGS_EQUAL(0, v2p_cache_key(s, &buffer[0], (unsigned int)buffer.size()));
+
+}
+
+TEST (CandidateCache, loaded_candidates_give_the_same_path)
+{
+  TestAnalyzer a(__vibrato(2));
+  pitch_analyzer_t* s = a.s;
+  std::vector<float>& buffer = a.signal;
+  const char* path = "candidate_cache_test.v2pc";
+  remove(path);
+
+  const uint64_t key = v2p_cache_key(s, &buffer[0], (unsigned int)buffer.size());
+  CHECK_LONGS_EQUAL(V2P_ERROR_CACHE_MISS, v2p_cache_load(s, path, key));
+  CHECK_LONGS_EQUAL(V2P_OK, a.run());
+  const unsigned int length = v2p_path_len(s);
+  CHECK(length > 50);
+  float* expected = v2p_compute_path(s);
+  CHECK_LONGS_EQUAL(V2P_OK, v2p_cache_write(s, path, key));
+
+  CHECK_LONGS_EQUAL(V2P_ERROR_CACHE_MISS, v2p_cache_load(s, path, key + 1));
+  CHECK_LONGS_EQUAL(V2P_OK, v2p_cache_load(s, path, key));
+  CHECK(s->cache_mapping != NULL);
+  CHECK(s->candidates.borrowed);
+  CHECK_LONGS_EQUAL(length, v2p_path_len(s));
+  float* path_loaded = v2p_compute_path(s);
+  CHECK(__same_path(expected, path_loaded, length));
+  float* path_parallel = v2p_compute_path_parallel(s, 2);
+  CHECK(__same_path(expected, path_parallel, length));
+  // A loaded analyzer only decodes
+  CHECK_LONGS_EQUAL(V2P_ERROR_INVALID_ARGUMENT, v2p_add_samples(s, &buffer[0], 1024));
+  v2p_reset(s);
+  CHECK(s->cache_mapping == NULL);
+  CHECK_LONGS_EQUAL(V2P_OK, v2p_add_samples(s, &buffer[0], 1024));
+
+  // A truncated file is a miss
+  FILE* file = fopen(path, "r+b");
+  CHECK(file != NULL);
+  fseek(file, 0, SEEK_END);
+  const long size = ftell(file);
+  fclose(file);
+  std::vector<char> content(size);
+  file = fopen(path, "rb");
+  CHECK_LONGS_EQUAL(size, fread(&content[0], 1, size, file));
+  fclose(file);
+  file = fopen(path, "wb");
+  fwrite(&content[0], 1, size - 4, file);
+  fclose(file);
+  CHECK_LONGS_EQUAL(V2P_ERROR_CACHE_MISS, v2p_cache_load(s, path, key));
+  CHECK(s->cache_mapping == NULL);
+
+  v2p_ptr_free(expected);
+  v2p_ptr_free(path_loaded);
+  v2p_ptr_free(path_parallel);
+  remove(path);
+}
+
+TEST (CandidateCache, run_cached_writes_then_maps_the_file)
+{
+  TestAnalyzer a(__vibrato(1));
+  pitch_analyzer_t* s = a.s;
+  std::vector<float>& buffer = a.signal;
+  char path[64];
+  sprintf(path, "./%016llx.v2pc",
+    (unsigned long long)v2p_cache_key(s, &buffer[0], (unsigned int)buffer.size()));
+  remove(path);
+
+  // Miss: the candidates are computed, then written
+  CHECK_LONGS_EQUAL(V2P_OK, v2p_run_cached(s, &buffer[0], (unsigned int)buffer.size(), "."));
+  CHECK(s->cache_mapping == NULL);
+  const unsigned int length = v2p_path_len(s);
+  float* expected = v2p_compute_path(s);
+  FILE* file = fopen(path, "rb");
+  CHECK(file != NULL);
+  if (file)
+    fclose(file);
+
+  // Hit: the file is mapped
+  CHECK_LONGS_EQUAL(V2P_OK, v2p_run_cached(s, &buffer[0], (unsigned int)buffer.size(), "."));
+  CHECK(s->cache_mapping != NULL);
+  CHECK_LONGS_EQUAL(length, v2p_path_len(s));
+  float* path_cached = v2p_compute_path(s);
+  CHECK(__same_path(expected, path_cached, length));
+
+  v2p_ptr_free(expected);
+  v2p_ptr_free(path_cached);
+  remove(path);
+}
@@ -0,0 +1,125 @@
+#include "lib/TestHarness.hpp"
+#include "candidates.h"
+#include "boersma.h"
+#include "v2p.h"
+
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+TEST (Candidates, steps_are_read_back_across_chunks)
+{
+  const unsigned int nb_per_step[] = {1, 4, 5000};
+  for (unsigned int i = 0; i < 3; i++) {
+    const unsigned int n = nb_per_step[i];
+    struct candidate_store store;
+    candidates_init(&store, n);
+    CHECK(store.steps_per_chunk >= 1);
+    // At least three chunks
+    const unsigned int nb_steps = 2 * store.steps_per_chunk + 3;
+
+    std::vector<candidate_t> candidates((size_t)nb_steps * n);
+    for (size_t j = 0; j < candidates.size(); j++) {
+      candidates[j].frequency = (j % 3) ? (float)(rand() % 1000) : 0;
+      candidates[j].weight = (float)(rand() % 1000) / 1000;
+    }
+    struct candidate_slice step;
+    for (unsigned int t = 0; t < nb_steps; t++) {
+      CHECK(candidates_add_step(&store, &step));
+      CHECK_LONGS_EQUAL(n, step.size);
+      candidate_slice_assign(&step, &candidates[(size_t)t * n]);
+      candidates_finish_step(&store);
+    }
+    CHECK_LONGS_EQUAL(nb_steps, store.nb_steps);
+    CHECK_LONGS_EQUAL(candidates.size(), candidates_count(&store));
+    const size_t nb_chunks = (nb_steps + store.steps_per_chunk - 1) / store.steps_per_chunk;
+    CHECK_LONGS_EQUAL(nb_chunks * 3 * store.steps_per_chunk * n * sizeof(float),
+      candidates_memory(&store));
+
+    // Same candidates, and the log2 of the frequencies are cached
+    bool same = true;
+    for (unsigned int t = 0; t < nb_steps; t++) {
+      candidates_step(&store, t, &step);
+      for (unsigned int k = 0; k < n; k++) {
+        const candidate_t& c = candidates[(size_t)t * n + k];
+        const float log2_frequency = c.frequency > 0 ? log2f(c.frequency) : 0;
+        same = same && step.frequency[k] == c.frequency && step.weight[k] == c.weight &&
+          step.log2_frequency[k] == log2_frequency;
+      }
+    }
+    CHECK(same);
+    std::vector<candidate_t> copy(candidates.size());
+    candidates_copy(&store, &copy[0]);
+    for (size_t j = 0; j < copy.size(); j++)
+      same = same && copy[j].frequency == candidates[j].frequency &&
+        copy[j].weight == candidates[j].weight;
+    CHECK(same);
+    candidates_clear(&store);
+    CHECK_LONGS_EQUAL(0, candidates_memory(&store));
+  }
+}
+
+TEST (Candidates, new_steps_are_unvoiced)
+{
+  struct candidate_store store;
+  struct candidate_slice step, slice;
+  candidates_init(&store, 6);
+  CHECK(candidates_reserve(&store, 2));
+  CHECK_LONGS_EQUAL(0, store.nb_steps);
+
+  CHECK(candidates_add_step(&store, &step));
+  for (unsigned int k = 0; k < step.size; k++) {
+    step.frequency[k] = 100.f * (k + 1);
+    step.weight[k] = 1;
+  }
+  CHECK(candidates_add_step(&store, &step));
+  bool unvoiced = true;
+  for (unsigned int k = 0; k < step.size; k++)
+    unvoiced = unvoiced && step.frequency[k] == 0 && step.weight[k] == 0;
+  CHECK(unvoiced);
+
+  // An algorithm writes into its part of the timestep only
+  candidate_slice_sub(&step, 2, 3, &slice);
+  CHECK_LONGS_EQUAL(3, slice.size);
+  slice.frequency[0] = 440;
+  slice.weight[2] = 0.5f;
+  CHECK_DOUBLES_EQUAL(440, candidates_get(&store, 1, 2).frequency);
+  CHECK_DOUBLES_EQUAL(0.5, candidates_get(&store, 1, 4).weight);
+  CHECK_DOUBLES_EQUAL(300, candidates_get(&store, 0, 2).frequency);
+  candidates_clear(&store);
+}
+
+TEST (Candidates, emitted_candidates_are_sorted_by_weight)
+{
+  const unsigned int frame_size = 1024;
+  struct pitch_analyzer* s = v2p_new(0);
+  s->sampling_rate = 16000;
+  struct algorithm_descriptor_boersma* adb = boersma_new(frame_size, 6);
+  v2p_register_algorithm(s, (algorithm_descriptor*)adb);
+  v2p_reset(s);
+
+  // Sum of two sinusoids: several local maximums
+  std::vector<float> frame(frame_size);
+  for (unsigned int i = 0; i < frame_size; i++)
+    frame[i] = (float)(sin(i * 180 * 2 * M_PI / s->sampling_rate) +
+      0.5 * sin(i * 290 * 2 * M_PI / s->sampling_rate));
+
+  std::vector<float> frequency(6), weight(6);
+  struct candidate_slice slice = { &frequency[0], &weight[0], NULL, 6 };
+  emit_boersma_candidates(s, adb, &frame[0], &slice);
+  CHECK(frequency[0] > 0);
+  for (unsigned int k = 1; k < 6; k++)
+    CHECK(weight[k - 1] >= weight[k]);
+
+  // The generator returns the same candidates
+  float* frame_in = &frame[0];
+  candidate_t* candidates = generate_boersma_candidates(s, adb, frame_in);
+  for (unsigned int k = 0; k < 6; k++) {
+    CHECK_DOUBLES_EQUAL(frequency[k], candidates[k].frequency);
+    CHECK_DOUBLES_EQUAL(weight[k], candidates[k].weight);
+  }
+  v2p_ptr_free(candidates);
+
+  v2p_delete(s);
+  boersma_delete(adb);
+}
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <cmath>
 
 TEST (FFT, FFT_of_zero_vector_is_zero)
 {
@@ -124,3 +125,144 @@ TEST (FFT, BlackmanHarris_Window)
   CHECK_DOUBLES_EQUAL(0, window[0]);
   CHECK_DOUBLES_EQUAL(0, window[window.size() - 1]);
 }
+
+TEST (FFT, REALFT_BATCH_match_REALFT)
+{
+  const unsigned int size = 1024;
+  const unsigned int batch = 5;
+  std::vector<std::vector<float>> frames(batch, std::vector<float>(size));
+  std::vector<float*> frame_ptrs(batch);
+
+  for (unsigned int k = 0; k < batch; k++) {
+    std::generate(frames[k].begin(), frames[k].end(),
+      []() { return (float)rand()/(float)(RAND_MAX / 10.0f) - 5.0f; }
+    );
+    frame_ptrs[k] = &frames[k][0];
+  }
+
+  // Transform all the frames at once
+  std::vector<float> data(size * batch);
+  fft_batch_interleave(&data[0], &frame_ptrs[0], size, batch);
+  realft_batch(&data[0], size, batch, FFT_FORWARD);
+
+  // Compare with the transform of each frame
+  for (unsigned int k = 0; k < batch; k++) {
+    std::vector<float> expected(frames[k]);
+    realft(&expected[0], size, FFT_FORWARD);
+    for (unsigned int i = 0; i < size; i++)
+      CHECK(fabs(expected[i] - data[i * batch + k]) < 1e-3 * (1 + fabs(expected[i])));
+  }
+
+  // Inverse transform is still the identity
+  realft_batch(&data[0], size, batch, FFT_INVERSE);
+  std::vector<std::vector<float>> inverse(batch, std::vector<float>(size));
+  std::vector<float*> inverse_ptrs(batch);
+  for (unsigned int k = 0; k < batch; k++)
+    inverse_ptrs[k] = &inverse[k][0];
+  fft_batch_deinterleave(&inverse_ptrs[0], &data[0], size, batch);
+  for (unsigned int k = 0; k < batch; k++)
+    for (unsigned int i = 0; i < size; i++)
+      CHECK_DOUBLES_EQUAL(frames[k][i], inverse[k][i] * 2 / size);
+}
+
+TEST (FFT, FFT_PLAN_match_direct_DFT)
+{
+  // Powers of two, mixed radix (2, 3, 4, 5) and Bluestein sizes,
+  // with even and odd numbers of complex points
+  const unsigned int sizes[] = {64, 90, 96, 120, 30, 154, 194, 4320};
+  for (unsigned int n : sizes) {
+    std::vector<float> data(n);
+    std::generate(data.begin(), data.end(),
+      []() { return (float)rand() / RAND_MAX - 0.5f; }
+    );
+    auto original_data(data);
+
+    const fft_plan_t* plan = fft_plan_acquire(n);
+    CHECK(plan != NULL);
+    CHECK_LONGS_EQUAL(n, fft_plan_size(plan));
+    std::vector<float> scratch(fft_plan_scratch_size(plan) + 1);
+    fft_plan_realft(plan, &data[0], &scratch[0], FFT_FORWARD);
+
+    // Same convention as realft: sum_j x_j exp(+2 i pi j k / n)
+    for (unsigned int k = 0; k <= n / 2; k++) {
+      double re = 0, im = 0;
+      for (unsigned int j = 0; j < n; j++) {
+        const double angle = 2 * M_PI * (double)((unsigned long long)j * k % n) / n;
+        re += original_data[j] * cos(angle);
+        im += original_data[j] * sin(angle);
+      }
+      if (k == 0) {
+        CHECK(fabs(data[0] - re) < 1e-3);
+      } else if (k == n / 2) {
+        CHECK(fabs(data[1] - re) < 1e-3);
+      } else {
+        CHECK(fabs(data[2 * k] - re) < 1e-3);
+        CHECK(fabs(data[2 * k + 1] - im) < 1e-3);
+      }
+    }
+
+    // The inverse transform is scaled by n / 2, like realft
+    fft_plan_realft(plan, &data[0], &scratch[0], FFT_INVERSE);
+    for (unsigned int i = 0; i < n; i++)
+      CHECK(fabs(original_data[i] - data[i] * 2 / n) < 1e-4);
+
+    fft_plan_release(plan);
+  }
+}
+
+TEST (FFT, FFT_fast_size_is_smooth_and_even)
+{
+  CHECK(fft_plan_acquire(31) == NULL);
+  // Powers of two are kept
+  CHECK_LONGS_EQUAL(4096, fft_fast_size(4095));
+  for (unsigned int n = 3; n < 5000; n += 37) {
+    unsigned int v = fft_fast_size(n);
+    CHECK(v >= n);
+    CHECK(v % 2 == 0);
+    while (v % 2 == 0) v /= 2;
+    while (v % 3 == 0) v /= 3;
+    while (v % 5 == 0) v /= 5;
+    CHECK_LONGS_EQUAL(1, v);
+  }
+  // Never above the next power of two
+  CHECK(fft_fast_size(4199) < 8192);
+}
+
+TEST (FFT, REALFT_PRUNED_match_REALFT)
+{
+  for (unsigned int n = 8; n <= 4096; n *= 2) {
+    const unsigned int batch = 3;
+    std::vector<float> data(n, 0);
+    // Zero padded input
+    for (unsigned int i = 0; i < n / 2; i++)
+      data[i] = (float)rand() / RAND_MAX - 0.5f;
+
+    auto expected(data);
+    realft(&expected[0], n, FFT_FORWARD);
+    auto pruned(data);
+    realft_pruned(&pruned[0], n, FFT_FORWARD, FFT_PRUNE_ZERO_PADDED);
+    for (unsigned int i = 0; i < n; i++)
+      CHECK(fabs(expected[i] - pruned[i]) < 1e-4);
+
+    // Same input for every frame of the batch
+    std::vector<float> batched(n * batch);
+    for (unsigned int i = 0; i < n; i++)
+      for (unsigned int k = 0; k < batch; k++)
+        batched[i * batch + k] = data[i];
+    realft_batch_pruned(&batched[0], n, batch, FFT_FORWARD, FFT_PRUNE_ZERO_PADDED);
+    for (unsigned int i = 0; i < n; i++)
+      for (unsigned int k = 0; k < batch; k++)
+        CHECK(fabs(expected[i] - batched[i * batch + k]) < 1e-4);
+
+    // Only the first quarter of the inverse is computed
+    auto inverse(expected);
+    realft(&inverse[0], n, FFT_INVERSE);
+    realft_pruned(&pruned[0], n, FFT_INVERSE, FFT_PRUNE_FIRST_QUARTER);
+    realft_batch_pruned(&batched[0], n, batch, FFT_INVERSE, FFT_PRUNE_FIRST_QUARTER);
+    for (unsigned int i = 0; i < n / 4; i++) {
+      CHECK(fabs(inverse[i] - pruned[i]) < 1e-3);
+      for (unsigned int k = 0; k < batch; k++)
+        CHECK(fabs(inverse[i] - batched[i * batch + k]) < 1e-3);
+    }
+  }
+}
@@ -0,0 +1,151 @@
+#include "AllocationTracker.hpp"
+
+#include <iostream>
+
+#if defined __has_feature
+	#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || \
+		__has_feature(memory_sanitizer)
+		#define TRACKER_SANITIZED
+	#endif
+#endif
+#if defined __SANITIZE_ADDRESS__ || defined __SANITIZE_THREAD__
+	#define TRACKER_SANITIZED
+#endif
+
+#if defined __GLIBC__ && !defined TRACKER_SANITIZED
+	#define TRACKER_INTERPOSED
+#endif
+
+// Counters of the tracked thread. Only this thread updates them, while
+// the others are left alone.
+static thread_local bool trackedThread = false;
+static AllocationTracker::Counters trackedCounters;
+
+#ifdef TRACKER_INTERPOSED
+
+#include <malloc.h>
+
+extern "C" {
+void* __libc_malloc (size_t size);
+void* __libc_calloc (size_t nb, size_t size);
+void* __libc_realloc (void* ptr, size_t size);
+void __libc_free (void* ptr);
+}
+
+static void countAllocation (void* ptr)
+{
+	trackedCounters.bytesInUse += malloc_usable_size (ptr);
+	if (trackedCounters.bytesInUse > trackedCounters.peakBytesInUse)
+		trackedCounters.peakBytesInUse = trackedCounters.bytesInUse;
+}
+
+extern "C" {
+
+void* malloc (size_t size)
+{
+	void* ptr = __libc_malloc (size);
+	if (trackedThread && ptr) {
+		trackedCounters.allocations++;
+		countAllocation (ptr);
+	}
+	return ptr;
+}
+
+void* calloc (size_t nb, size_t size)
+{
+	void* ptr = __libc_calloc (nb, size);
+	if (trackedThread && ptr) {
+		trackedCounters.allocations++;
+		countAllocation (ptr);
+	}
+	return ptr;
+}
+
+void* realloc (void* ptr, size_t size)
+{
+	if (!trackedThread)
+		return __libc_realloc (ptr, size);
+	const size_t oldSize = ptr ? malloc_usable_size (ptr) : 0;
+	void* newPtr = __libc_realloc (ptr, size);
+	if (newPtr || !size) {
+		trackedCounters.reallocations++;
+		trackedCounters.bytesInUse -= oldSize;
+		if (newPtr)
+			countAllocation (newPtr);
+	}
+	return newPtr;
+}
+
+void free (void* ptr)
+{
+	if (trackedThread && ptr) {
+		trackedCounters.frees++;
+		trackedCounters.bytesInUse -= malloc_usable_size (ptr);
+	}
+	__libc_free (ptr);
+}
+
+}
+
+#endif
+
+bool AllocationTracker::available ()
+{
+#ifdef TRACKER_INTERPOSED
+	return true;
+#else
+	return false;
+#endif
+}
+
+std::vector<AllocationTracker::Sample>& AllocationTracker::timeline ()
+{
+	static std::vector<Sample> samples;
+	return samples;
+}
+
+void AllocationTracker::start ()
+{
+	timeline ().clear ();
+	// Grown before the tracking starts
+	timeline ().reserve (1024);
+	trackedCounters = Counters ();
+	trackedThread = true;
+}
+
+AllocationTracker::Counters AllocationTracker::stop ()
+{
+	trackedThread = false;
+	return trackedCounters;
+}
+
+AllocationTracker::Counters AllocationTracker::counters ()
+{
+	return trackedCounters;
+}
+
+void AllocationTracker::sample (unsigned long position)
+{
+	// The timeline itself isn't counted
+	const bool tracked = trackedThread;
+	trackedThread = false;
+	Sample sample = { position, trackedCounters.bytesInUse };
+	timeline ().push_back (sample);
+	trackedThread = tracked;
+}
+
+void AllocationTracker::report (const std::string& name)
+{
+	const bool tracked = trackedThread;
+	trackedThread = false;
+	std::cerr << name << ": " << trackedCounters.allocations << " allocations, "
+		<< trackedCounters.reallocations << " reallocations, " << trackedCounters.frees
+		<< " frees, peak " << trackedCounters.peakBytesInUse << " bytes" << std::endl;
+	if (!timeline ().empty ()) {
+		std::cerr << "  bytes in use:";
+		for (size_t i = 0; i < timeline ().size (); i++)
+			std::cerr << " " << timeline ()[i].position << ":" << timeline ()[i].bytesInUse;
+		std::cerr << std::endl;
+	}
+	trackedThread = tracked;
+}
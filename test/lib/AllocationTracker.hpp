@@ -0,0 +1,51 @@
+#ifndef ALLOCATIONTRACKER_H
+#define ALLOCATIONTRACKER_H
+
+// AllocationTracker counts the calls to malloc, calloc, realloc and free
+// made by the thread which started it, whatever calls them (the library
+// allocators, the C++ runtime...). The test executable interposes these
+// functions; it's only available with glibc and without sanitizers, which
+// interpose them too: tests check available() and skip their assertions
+// otherwise.
+//
+// Tests can record the bytes in use along a run (sample) and print this
+// timeline with the counters (report).
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class AllocationTracker
+{
+public:
+	struct Counters
+	{
+		unsigned long allocations;
+		unsigned long reallocations;
+		unsigned long frees;
+		// Bytes of the blocks allocated and not freed since start
+		long long bytesInUse;
+		long long peakBytesInUse;
+	};
+
+	static bool available ();
+	// Reset the counters and the timeline, and track the current thread
+	static void start ();
+	static Counters stop ();
+	static Counters counters ();
+
+	// Record the bytes in use at a position of the run (a timestep...)
+	static void sample (unsigned long position);
+	// Print the counters and the timeline on stderr
+	static void report (const std::string& name);
+
+private:
+	struct Sample
+	{
+		unsigned long position;
+		long long bytesInUse;
+	};
+	static std::vector<Sample>& timeline ();
+};
+
+#endif
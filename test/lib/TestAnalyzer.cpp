@@ -0,0 +1,104 @@
+#include "TestAnalyzer.hpp"
+
+#include <cmath>
+
+std::vector<float> toneSignal (unsigned int nbSamples, float samplingRate)
+{
+	std::vector<float> buffer (nbSamples);
+	for (unsigned int i = 0; i < nbSamples; i++)
+		buffer[i] = (float)sin (2 * M_PI * 220 * i / samplingRate);
+	return buffer;
+}
+
+std::vector<float> glissandoSignal (unsigned int nbSamples, float samplingRate)
+{
+	std::vector<float> buffer (nbSamples);
+	double phase = 0;
+	for (unsigned int i = 0; i < nbSamples; i++) {
+		phase += (150 + 150. * i / nbSamples) * 2 * M_PI / samplingRate;
+		buffer[i] = (float)sin (phase);
+	}
+	return buffer;
+}
+
+std::vector<float> vibratoSignal (unsigned int nbSamples, float samplingRate)
+{
+	std::vector<float> buffer (nbSamples);
+	double phase = 0;
+	for (unsigned int i = 0; i < nbSamples; i++) {
+		phase += (220 + 20 * sin (2 * M_PI * 4 * i / samplingRate)) * 2 * M_PI / samplingRate;
+		buffer[i] = (float)sin (phase);
+	}
+	return buffer;
+}
+
+std::vector<float> phraseSignal (unsigned int nbSamples, float samplingRate)
+{
+	std::vector<float> buffer (nbSamples);
+	double phase = 0;
+	for (unsigned int i = 0; i < nbSamples; i++) {
+		const double t = i / (double)samplingRate;
+		phase += (196 + 60 * sin (2 * M_PI * 0.7 * t)) * 2 * M_PI / samplingRate;
+		const bool pause = fmod (t, 1.5) > 1.3;
+		buffer[i] = pause ? 0.f : (float)(0.6 * sin (phase) + 0.2 * sin (2 * phase));
+	}
+	return buffer;
+}
+
+TestAnalyzerSettings::TestAnalyzerSettings ()
+	: frameSize (2048), samplingRate (48000), nbCandidates (0), maxfreq (false),
+	signal (glissandoSignal), duration (1), allocator (NULL)
+{
+}
+
+TestAnalyzer::TestAnalyzer (const TestAnalyzerSettings& settings)
+	: s (v2p_new_with_allocator (0, settings.allocator)),
+	adb (boersma_new (settings.frameSize, settings.nbCandidates)),
+	adu (boersma_unvoiced_new (settings.frameSize)),
+	adm (settings.maxfreq ? maxfreq_new (settings.frameSize) : NULL),
+	signal (settings.signal ((unsigned int)(settings.duration * settings.samplingRate),
+		settings.samplingRate))
+{
+	s->sampling_rate = settings.samplingRate;
+	v2p_register_algorithm (s, (algorithm_descriptor_t*)adb);
+	v2p_register_algorithm (s, (algorithm_descriptor_t*)adu);
+	if (adm)
+		v2p_register_algorithm (s, (algorithm_descriptor_t*)adm);
+	v2p_reset (s);
+}
+
+TestAnalyzer::~TestAnalyzer ()
+{
+	v2p_delete (s);
+	boersma_delete (adb);
+	boersma_unvoiced_delete (adu);
+	if (adm)
+		maxfreq_delete (adm);
+}
+
+int TestAnalyzer::run ()
+{
+	return v2p_run (s, &signal[0], (unsigned int)signal.size ());
+}
+
+int TestAnalyzer::stream (unsigned int blockSize)
+{
+	for (unsigned int i = 0; i < signal.size (); i += blockSize) {
+		const unsigned int size = i + blockSize <= signal.size () ?
+			blockSize : (unsigned int)signal.size () - i;
+		const int status = v2p_add_samples (s, &signal[i], size);
+		if (status != V2P_OK)
+			return status;
+	}
+	return V2P_OK;
+}
+
+std::vector<float> TestAnalyzer::path ()
+{
+	std::vector<float> result;
+	float* path = v2p_compute_path (s);
+	if (path)
+		result.assign (path, path + v2p_path_len (s));
+	v2p_ptr_free (path);
+	return result;
+}
@@ -0,0 +1,73 @@
+#ifndef TESTANALYZER_H
+#define TESTANALYZER_H
+
+// TestAnalyzer is the analyzer most tests run: boersma and
+// boersma_unvoiced, and maxfreq if requested, on frames of frameSize
+// samples, with duration seconds of a synthetic signal to analyze. It's
+// reset once configured, and deleted with its algorithms at the end of
+// the scope. Tests changing the settings of the analyzer after its
+// construction reset it again.
+
+#include "v2p.h"
+#include "boersma.h"
+#include "maxfreq.h"
+
+#include <vector>
+
+// Generator of nbSamples samples of a signal sampled at samplingRate. The
+// analyzers of a test compare their results: generators are deterministic.
+typedef std::vector<float> (*TestSignal) (unsigned int nbSamples, float samplingRate);
+
+// Sinusoid at 220Hz
+std::vector<float> toneSignal (unsigned int nbSamples, float samplingRate);
+// Glissando from 150Hz to 300Hz
+std::vector<float> glissandoSignal (unsigned int nbSamples, float samplingRate);
+// 220Hz with a vibrato of 20Hz at 4Hz
+std::vector<float> vibratoSignal (unsigned int nbSamples, float samplingRate);
+// Sung phrase: a glide around 196Hz with harmonics, and pauses
+std::vector<float> phraseSignal (unsigned int nbSamples, float samplingRate);
+
+struct TestAnalyzerSettings
+{
+	unsigned int frameSize;
+	float samplingRate;
+	// Candidates of boersma per frame, 0 for its default
+	unsigned int nbCandidates;
+	bool maxfreq;
+	TestSignal signal;
+	// Seconds of signal
+	double duration;
+	// Allocator of the analyzer, NULL for the global one
+	const v2p_allocator_t* allocator;
+
+	// Frames of 2048 samples at 48kHz, one second of glissando
+	TestAnalyzerSettings ();
+};
+
+class TestAnalyzer
+{
+public:
+	explicit TestAnalyzer (const TestAnalyzerSettings& settings = TestAnalyzerSettings ());
+	~TestAnalyzer ();
+
+	// Analyze the whole signal with v2p_run, or by blocks of blockSize
+	// samples with v2p_add_samples.
+	// Return the status of the first call which failed, V2P_OK otherwise.
+	int run ();
+	int stream (unsigned int blockSize);
+	// Path computed by v2p_compute_path, empty if there is none
+	std::vector<float> path ();
+
+	pitch_analyzer_t* s;
+	algorithm_descriptor_boersma_t* adb;
+	algorithm_descriptor_boersma_unvoiced_t* adu;
+	// NULL without maxfreq
+	algorithm_descriptor_maxfreq_t* adm;
+	std::vector<float> signal;
+
+private:
+	TestAnalyzer (const TestAnalyzer&);
+	TestAnalyzer& operator= (const TestAnalyzer&);
+};
+
+#endif
@@ -49,3 +49,24 @@ TEST (Maxfreq, generate_maxfreq_candidates_should_return_frequency_from_sin)
   boersma_delete(b);
   maxfreq_delete(f);
 }
+
+TEST (Maxfreq, generate_maxfreq_candidates_does_not_require_boersma)
+{
+  unsigned int frame_size = 2048;
+  std::vector<float> frame_in(frame_size);
+
+  struct pitch_analyzer *s = v2p_new(0);
+  struct algorithm_descriptor_maxfreq *f = maxfreq_new(frame_size);
+
+  for(unsigned int i = 0; i < frame_size; i++)
+    frame_in[i] = (float)sin(i * 1200 * 2 * M_PI / s->sampling_rate);
+
+  // Maxfreq alone
+  candidate_t* candidates = generate_maxfreq_candidates(s, f, &frame_in[0]);
+  CHECK(candidates[0].amplitude > 0);
+  CHECK(fabs(1200 - candidates[0].frequency) < 10);
+
+  v2p_ptr_free(candidates);
+  v2p_delete(s);
+  maxfreq_delete(f);
+}
@@ -0,0 +1,101 @@
+#include "lib/TestHarness.hpp"
+#include "spectrum.h"
+#include "window_cache.h"
+#include "autocorrelation.h"
+#include "v2p.h"
+
+#include <vector>
+#include <cstdlib>
+
+TEST (Spectrum, corrected_autocorrelation_match_compute_corrected_autocorrelation)
+{
+  const unsigned int size = 1024;
+  std::vector<float> frame(size);
+  for (unsigned int i = 0; i < size; i++)
+    frame[i] = (float)sin(i * 0.07) + (float)rand() / RAND_MAX * 0.1f;
+
+  spectral_context_t* ctx = spectral_context_new();
+  const shared_window_t* w = window_cache_acquire(WINDOW_HANN, size, 0);
+
+  unsigned int expected_size, size_out;
+  float* expected = compute_corrected_autocorrelation(
+    &frame[0], (float*)w->window, NULL, size, &expected_size);
+  const float* ac = spectral_context_corrected_autocorrelation(ctx, &frame[0], w, &size_out);
+
+  CHECK_LONGS_EQUAL(expected_size, size_out);
+  for (unsigned int i = 0; i < size_out; i++)
+    CHECK(fabs(expected[i] - ac[i]) < 1e-3 * (1 + fabs(expected[i])));
+
+  v2p_ptr_free(expected);
+  window_cache_release(w);
+  spectral_context_delete(ctx);
+}
+
+TEST (Spectrum, representations_are_memoized_per_step)
+{
+  const unsigned int size = 512;
+  std::vector<float> frame(size), other_frame(size);
+  for (unsigned int i = 0; i < size; i++) {
+    frame[i] = (float)sin(i * 0.1);
+    other_frame[i] = (float)sin(i * 0.2);
+  }
+
+  spectral_context_t* ctx = spectral_context_new();
+  const shared_window_t* w = window_cache_acquire(WINDOW_HANN, size, 0);
+
+  unsigned int fft_size, power_size;
+  const float* fft = spectral_context_fft(ctx, &frame[0], w, &fft_size);
+  const float first_value = fft[2];
+  CHECK_LONGS_EQUAL(autocorrelation_length(size), fft_size);
+
+  // Same frame, same buffer
+  CHECK(fft == spectral_context_fft(ctx, &frame[0], w, &fft_size));
+  // Another frame has its own buffer during the step
+  const float* other_fft = spectral_context_fft(ctx, &other_frame[0], w, &fft_size);
+  CHECK(fft != other_fft);
+  CHECK(fft[2] == first_value);
+
+  // Power spectrum is computed from the memoized fft
+  const float* power = spectral_context_power_spectrum(ctx, &frame[0], w, &power_size);
+  CHECK_LONGS_EQUAL(fft_size, power_size);
+  for (unsigned int i = 2; i < power_size; i += 2) {
+    CHECK_DOUBLES_EQUAL(fft[i] * fft[i] + fft[i + 1] * fft[i + 1], power[i]);
+    CHECK_DOUBLES_EQUAL(0, power[i + 1]);
+  }
+
+  // Buffers are reused at the next step
+  spectral_context_next_step(ctx);
+  const float* next_fft = spectral_context_fft(ctx, &other_frame[0], w, &fft_size);
+  CHECK(next_fft == fft || next_fft == other_fft);
+
+  window_cache_release(w);
+  spectral_context_delete(ctx);
+}
+
+TEST (Spectrum, autocorrelation_head_divided_by_window_ac_is_corrected)
+{
+  const unsigned int size = 2048;
+  std::vector<float> frame(size);
+  for (unsigned int i = 0; i < size; i++)
+    frame[i] = (float)sin(i * 0.11) + (float)rand() / RAND_MAX * 0.1f;
+
+  spectral_context_t* ctx = spectral_context_new();
+  const shared_window_t* w = window_cache_acquire(WINDOW_HANN, size, 0);
+
+  unsigned int head_size, corrected_size, ac_size;
+  const float* head = spectral_context_autocorrelation_head(ctx, &frame[0], w, &head_size);
+  const float* corrected = spectral_context_corrected_autocorrelation(ctx, &frame[0], w, &corrected_size);
+  CHECK_LONGS_EQUAL(corrected_size, head_size);
+  for (unsigned int i = 0; i < head_size; i++)
+    CHECK(fabs(head[i] / w->window_ac[i] - corrected[i]) < 1e-3 * (1 + fabs(corrected[i])));
+
+  // The full autocorrelation is still available, and starts with the head
+  std::vector<float> head_copy(head, head + head_size);
+  const float* ac = spectral_context_autocorrelation(ctx, &frame[0], w, &ac_size);
+  CHECK_LONGS_EQUAL(2 * head_size, ac_size);
+  for (unsigned int i = 0; i < head_size; i++)
+    CHECK(fabs(head_copy[i] - ac[i]) < 1e-3 * (1 + fabs(ac[i])));
+
+  window_cache_release(w);
+  spectral_context_delete(ctx);
+}
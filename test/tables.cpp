@@ -0,0 +1,81 @@
+#include "lib/TestHarness.hpp"
+#include "tables.h"
+#include "window_cache.h"
+#include "autocorrelation.h"
+#include "fft.h"
+#include "v2p.h"
+
+#include <cmath>
+#include <vector>
+
+#ifdef V2P_HAS_GENERATED_TABLES
+
+TEST (Tables, static_windows_match_runtime_computation)
+{
+  const enum window_type types[] = {WINDOW_HANN, WINDOW_BLACKMAN_HARRIS};
+  for (unsigned int t = 0; t < 2; t++)
+    for (unsigned int size = V2P_TABLES_MIN_SIZE; size <= V2P_TABLES_MAX_SIZE; size *= 2) {
+      const struct v2p_static_window* w = v2p_static_window_lookup(types[t], size);
+      CHECK(w != NULL);
+      CHECK_LONGS_EQUAL(size, w->size);
+      CHECK_LONGS_EQUAL(autocorrelation_length(size), w->ac_length);
+      CHECK_LONGS_EQUAL(w->ac_length / 2, w->window_ac_size);
+
+      // The window is the textbook formula
+      if (types[t] == WINDOW_HANN) {
+        for (unsigned int i = 0; i < size; i++) {
+          const double v = sin(M_PI * i / (size - 1));
+          CHECK_DOUBLES_EQUAL((float)(v * v), w->window[i]);
+        }
+      }
+
+      // The autocorrelation is the one computed at runtime from the window
+      std::vector<float> window(w->window, w->window + size);
+      unsigned int ac_size;
+      float* ac = compute_unnormalized_autocorrelation_with_length(
+        &window[0], size, w->ac_length, &ac_size);
+      CHECK_LONGS_EQUAL(w->window_ac_size, ac_size);
+      for (unsigned int i = 0; i < ac_size; i++)
+        CHECK(fabs(ac[i] - w->window_ac[i]) < 1e-4 * (1 + fabs(ac[i])));
+      v2p_ptr_free(ac);
+    }
+}
+
+TEST (Tables, window_cache_shares_the_static_windows)
+{
+  const unsigned int size = 2048;
+  const struct v2p_static_window* sw = v2p_static_window_lookup(WINDOW_HANN, size);
+  CHECK(sw != NULL);
+
+  const shared_window_t* w = window_cache_acquire(WINDOW_HANN, size, 0);
+  CHECK(w != NULL);
+  CHECK(w->static_tables);
+  CHECK(w->window == sw->window);
+  CHECK(w->window_ac == sw->window_ac);
+  CHECK_LONGS_EQUAL(sw->window_ac_size, w->window_ac_size);
+  window_cache_release(w);
+
+  // Another padding can't use the embedded autocorrelation
+  w = window_cache_acquire(WINDOW_HANN, size, 2 * size + 2);
+  CHECK(w != NULL);
+  CHECK(!w->static_tables);
+  CHECK(w->window != sw->window);
+  for (unsigned int i = 0; i < size; i++)
+    CHECK_DOUBLES_EQUAL(sw->window[i], w->window[i]);
+  window_cache_release(w);
+}
+
+#endif
+
+TEST (Tables, other_sizes_and_windows_fall_back_to_runtime)
+{
+  CHECK(v2p_static_window_lookup(WINDOW_HANN, 1000) == NULL);
+  CHECK(v2p_static_window_lookup(WINDOW_HANN, 256) == NULL);
+  CHECK(v2p_static_window_lookup(WINDOW_HANN, 16384) == NULL);
+  CHECK(v2p_static_window_lookup(WINDOW_HAMMING, 2048) == NULL);
+
+  const shared_window_t* w = window_cache_acquire(WINDOW_HANN, 1000, 0);
+  CHECK(w != NULL);
+  CHECK(!w->static_tables);
+  window_cache_release(w);
+}
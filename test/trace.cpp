@@ -0,0 +1,66 @@
+#include "lib/TestHarness.hpp"
+#include "lib/TestAnalyzer.hpp"
+#include "v2p.h"
+#include "trace.h"
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdio>
+
+static std::string __read_file(const char* path) {
+  std::string content;
+  FILE* file = fopen(path, "rb");
+  if (!file)
+    return content;
+  char buffer[4096];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    content.append(buffer, size);
+  fclose(file);
+  return content;
+}
+
+TEST (Trace, spans_of_the_pipeline_are_dumped)
+{
+  TestAnalyzerSettings settings;
+  settings.frameSize = 1024;
+  settings.samplingRate = 16000;
+  settings.nbCandidates = 4;
+  settings.signal = toneSignal;
+
+  v2p_trace_clear();
+  TestAnalyzer a(settings);
+  pitch_analyzer_t* s = a.s;
+  s->stream_id = 7;
+  // The FFTs are traced
+  a.adb->autocorrelation_method = BOERSMA_AUTOCORRELATION_FFT;
+  v2p_reset(s);
+  a.stream((unsigned int)a.signal.size());
+  float* pitch = v2p_compute_path(s);
+  v2p_ptr_free(median_filter(pitch, v2p_path_len(s), 3));
+  v2p_ptr_free(pitch);
+
+  const char* path = "trace_test.json";
+  CHECK_LONGS_EQUAL(V2P_OK, v2p_trace_dump(path));
+  const std::string trace = __read_file(path);
+  CHECK(trace.find("\"traceEvents\":[") != std::string::npos);
+  CHECK(trace.find("]}") != std::string::npos);
+#ifdef V2P_TRACE
+  // A span for each stage of each timestep, at least
+  CHECK(v2p_trace_nb_spans() > 4 * v2p_path_len(s));
+  const char* names[] = {
+    "framing", "boersma", "boersma_unvoiced", "fft_forward", "fft_inverse", "viterbi",
+    "traceback", "median_filter"
+  };
+  for (unsigned int i = 0; i < sizeof(names) / sizeof(*names); i++)
+    CHECK(trace.find(std::string("\"name\":\"") + names[i] + "\"") != std::string::npos);
+  CHECK(trace.find("\"stream\":7,\"timestep\":10}") != std::string::npos);
+#else
+  CHECK_LONGS_EQUAL(0, v2p_trace_nb_spans());
+#endif
+
+  v2p_trace_clear();
+  CHECK_LONGS_EQUAL(0, v2p_trace_nb_spans());
+  remove(path);
+}
@@ -1,4 +1,5 @@
 #include "lib/TestHarness.hpp"
+#include "lib/TestAnalyzer.hpp"
 #include "v2p.h"
 #include "tools.h"
 #include "stretchy_buffer.h"
@@ -7,6 +8,10 @@
 #include "midi.h"
 
 #include <vector>
+#include <algorithm>
+#include <thread>
+#include <cmath>
+#include <cstring>
 
 TEST (SYMP, v2p_scenario_feed_audio_buffer)
 {
@@ -39,6 +44,71 @@ TEST (SYMP, v2p_scenario_feed_audio_buffer)
     v2p_delete(s);
 }
 
+// Count the calls to the framer
+static unsigned int __nb_framer_calls = 0;
+static float* __counting_framer(pitch_analyzer_t* s, algorithm_descriptor_t* ad,
+  float* buffer, unsigned int index) {
+  __nb_framer_calls++;
+  return generate_frame_boersma(s, (algorithm_descriptor_boersma_t*)ad, buffer, index);
+}
+
+TEST (SYMP, v2p_scheduler_mixed_frame_sizes_and_discard)
+{
+  std::vector<float> buffer(48000 * 2); //2s of audio
+
+  // Two analyzers with a bass (4096) and a treble (1024) detector.
+  // The second one discards the samples it doesn't need anymore.
+  pitch_analyzer_t* s[2];
+  algorithm_descriptor_boersma_t* bass[2];
+  algorithm_descriptor_boersma_t* treble[2];
+  for (int k = 0; k < 2; k++) {
+    s[k] = v2p_new(0);
+    bass[k] = boersma_new(4096, 0);
+    treble[k] = boersma_new(1024, 0);
+    bass[k]->parent.generate_frame = __counting_framer;
+    v2p_register_algorithm(s[k], (algorithm_descriptor*)bass[k]);
+    v2p_register_algorithm(s[k], (algorithm_descriptor*)treble[k]);
+  }
+  s[1]->discard_consumed_samples = 1;
+
+  for(unsigned int i = 0; i < buffer.size(); i++)
+    buffer[i] = (float)sin(i * 150 * 2 * M_PI / s[0]->sampling_rate);
+
+  const unsigned int chunk_size = 480;
+  unsigned int max_buffer_size = 0;
+  __nb_framer_calls = 0;
+  for (unsigned int i = 0; i + chunk_size <= buffer.size(); i += chunk_size) {
+    for (int k = 0; k < 2; k++)
+      v2p_add_samples(s[k], &buffer[i], chunk_size);
+    max_buffer_size = std::max(max_buffer_size, (unsigned int)sb_count(s[1]->audio_buffer));
+  }
+
+  // Each framer is called once per timestep
+  CHECK_LONGS_EQUAL(s[0]->number_of_timesteps + s[1]->number_of_timesteps, __nb_framer_calls);
+
+  // Same analysis with and without discarding samples
+  CHECK_LONGS_EQUAL(s[0]->number_of_timesteps, s[1]->number_of_timesteps);
+  float* p0 = v2p_compute_path(s[0]);
+  float* p1 = v2p_compute_path(s[1]);
+  for (unsigned int i = 0; i < s[0]->number_of_timesteps; i++)
+    CHECK_DOUBLES_EQUAL(p0[i], p1[i]);
+  CHECK_DOUBLES_EQUAL(s[0]->global_absolute_peak, s[1]->global_absolute_peak);
+
+  // Only the end of the stream is kept
+  CHECK(s[1]->audio_buffer_offset > 0);
+  CHECK(max_buffer_size < 3 * 4096);
+  CHECK_LONGS_EQUAL(sb_count(s[0]->audio_buffer),
+    sb_count(s[1]->audio_buffer) + s[1]->audio_buffer_offset);
+
+  v2p_ptr_free(p0);
+  v2p_ptr_free(p1);
+  for (int k = 0; k < 2; k++) {
+    v2p_delete(s[k]);
+    boersma_delete(bass[k]);
+    boersma_delete(treble[k]);
+  }
+}
+
 static float
 __fake_transition_cost(struct pitch_analyzer*, candidate_t* first, candidate_t* second) {
   const float diff = (float)fabs(first->frequency - second->frequency);
@@ -47,12 +117,265 @@ __fake_transition_cost(struct pitch_analyzer*, candidate_t* first, candidate_t*
   return 1000.f;
 }
 
+// Append a timestep of candidates, as the algorithms would
+static bool __add_step(struct pitch_analyzer* s, const std::vector<candidate_t>& candidates) {
+  struct candidate_slice step;
+  if (!candidates_add_step(&s->candidates, &step))
+    return false;
+  candidate_slice_assign(&step, &candidates[0]);
+  candidates_finish_step(&s->candidates);
+  return true;
+}
+
+// Half a second of glissando analyzed with boersma and maxfreq
+static TestAnalyzerSettings __glissando(unsigned int frame_size) {
+  TestAnalyzerSettings settings;
+  settings.frameSize = frame_size;
+  settings.maxfreq = true;
+  settings.duration = 0.5;
+  return settings;
+}
+
+// Pitch path of the glissando, analyzed by batch or by blocks of 10ms
+static std::vector<float> __analyze_glissando(unsigned int frame_size, bool batch) {
+  TestAnalyzer a(__glissando(frame_size));
+  if (batch)
+    a.run();
+  else
+    a.stream(480);
+  return a.path();
+}
+
+TEST (SYMP, concurrent_analyzers_match_serial_runs)
+{
+  // Frame sizes sharing or not their windows and fft plans
+  // (1000 and 1500 use mixed radix transforms)
+  const unsigned int frame_sizes[] = {1000, 1500, 2048, 2048};
+  const unsigned int nb_configs = sizeof(frame_sizes) / sizeof(frame_sizes[0]);
+
+  std::vector<std::vector<float>> expected(2 * nb_configs);
+  for (unsigned int k = 0; k < 2 * nb_configs; k++)
+    expected[k] = __analyze_glissando(frame_sizes[k % nb_configs], k >= nb_configs);
+
+  // The shared caches are created and destroyed concurrently at each round
+  for (int round = 0; round < 3; round++) {
+    std::vector<std::vector<float>> results(2 * nb_configs);
+    std::vector<std::thread> threads;
+    for (unsigned int k = 0; k < 2 * nb_configs; k++)
+      threads.emplace_back([&results, &frame_sizes, k, nb_configs]() {
+        results[k] = __analyze_glissando(frame_sizes[k % nb_configs], k >= nb_configs);
+      });
+    for (auto& t : threads)
+      t.join();
+
+    for (unsigned int k = 0; k < 2 * nb_configs; k++) {
+      CHECK(!expected[k].empty());
+      CHECK_LONGS_EQUAL(expected[k].size(), results[k].size());
+      CHECK(expected[k] == results[k]);
+    }
+  }
+}
+
+// Allocator counting the allocations
+static void* __counted_malloc(void* user_data, size_t size) {
+  (*(unsigned int*)user_data)++;
+  return malloc(size);
+}
+static void* __counted_realloc(void* user_data, void* ptr, size_t size) {
+  (*(unsigned int*)user_data)++;
+  return realloc(ptr, size);
+}
+static void __counted_free(void* user_data, void* ptr) {
+  (void)user_data;
+  free(ptr);
+}
+
+TEST (SYMP, realtime_mode_doesnt_allocate_after_prepare)
+{
+  const unsigned int frame_size = 1500;
+  const unsigned int block_size = 480;
+  unsigned int nb_analyzer_allocations = 0;
+  unsigned int nb_global_allocations = 0;
+  const v2p_allocator_t analyzer_allocator = {
+    __counted_malloc, __counted_realloc, __counted_free, &nb_analyzer_allocations};
+  const v2p_allocator_t global_allocator = {
+    __counted_malloc, __counted_realloc, __counted_free, &nb_global_allocations};
+
+  TestAnalyzerSettings settings = __glissando(frame_size);
+  settings.allocator = &analyzer_allocator;
+  TestAnalyzer a(settings);
+  pitch_analyzer_t* s = a.s;
+  std::vector<float>& buffer = a.signal;
+  CHECK_LONGS_EQUAL(V2P_ERROR_INVALID_ARGUMENT, v2p_prepare(s, 0, 100));
+  CHECK_LONGS_EQUAL(V2P_OK, v2p_prepare(s, block_size, 100));
+  CHECK(s->discard_consumed_samples);
+
+  // Nothing is allocated by the analyzer nor by the shared caches
+  nb_analyzer_allocations = 0;
+  v2p_set_allocator(&global_allocator);
+  CHECK_LONGS_EQUAL(V2P_OK, a.stream(block_size));
+  v2p_set_allocator(NULL);
+  CHECK_LONGS_EQUAL(0, nb_analyzer_allocations);
+  CHECK_LONGS_EQUAL(0, nb_global_allocations);
+  CHECK(sb_count(s->audio_buffer) <= sb_capacity(s->audio_buffer));
+
+  // Same path as the default mode
+  const std::vector<float> expected = __analyze_glissando(frame_size, false);
+  const std::vector<float> path = a.path();
+  CHECK_LONGS_EQUAL(expected.size(), path.size());
+  for (unsigned int i = 0; i < expected.size() && i < path.size(); i++)
+    CHECK_DOUBLES_EQUAL(expected[i], path[i]);
+
+  // Limits are reported instead of reallocating
+  CHECK_LONGS_EQUAL(V2P_ERROR_BLOCK_TOO_LARGE, v2p_add_samples(s, &buffer[0], block_size + 1));
+  CHECK_LONGS_EQUAL(V2P_OK, v2p_prepare(s, block_size, 10));
+  CHECK_LONGS_EQUAL(V2P_ERROR_HISTORY_FULL, a.stream(block_size));
+  CHECK_LONGS_EQUAL(10, v2p_path_len(s));
+  CHECK_LONGS_EQUAL(V2P_ERROR_HISTORY_FULL, v2p_run(s, &buffer[0], block_size));
+}
+
+// Allocator keeping the number of bytes in use (user_data), with the size
+// of each block stored before it
+static void* __sized_malloc(void* user_data, size_t size) {
+  size_t* block = (size_t*)malloc(size + 16);
+  if (!block)
+    return NULL;
+  *block = size;
+  *(size_t*)user_data += size;
+  return (char*)block + 16;
+}
+static void __sized_free(void* user_data, void* ptr) {
+  if (!ptr)
+    return;
+  size_t* block = (size_t*)((char*)ptr - 16);
+  *(size_t*)user_data -= *block;
+  free(block);
+}
+static void* __sized_realloc(void* user_data, void* ptr, size_t size) {
+  void* new_ptr = __sized_malloc(user_data, size);
+  if (new_ptr && ptr) {
+    const size_t old_size = *(size_t*)((char*)ptr - 16);
+    memcpy(new_ptr, ptr, std::min(old_size, size));
+    __sized_free(user_data, ptr);
+  }
+  return new_ptr;
+}
+
+// Sum of the parts of a report
+static bool __report_sums_up(const v2p_memory_report& r) {
+  const v2p_memory_block* parts[] = {
+    &r.analyzer, &r.audio_buffer, &r.candidates, &r.path_indexes, &r.path_costs, &r.spectrum,
+    &r.scratch, &r.descriptors
+  };
+  size_t capacity = 0, used = 0;
+  for (unsigned int i = 0; i < sizeof(parts) / sizeof(*parts); i++) {
+    if (parts[i]->used > parts[i]->capacity)
+      return false;
+    capacity += parts[i]->capacity;
+    used += parts[i]->used;
+  }
+  return capacity == r.total.capacity && used == r.total.used && r.peak >= r.total.capacity;
+}
+
+TEST (SYMP, lagged_path_follows_the_stream)
+{
+  TestAnalyzerSettings settings;
+  settings.duration = 0.5;
+  TestAnalyzer a(settings);
+  pitch_analyzer_t* s = a.s;
+  std::vector<float>& buffer = a.signal;
+
+  // The settled timesteps are written once, block after block
+  const unsigned int lag = 20;
+  std::vector<float> lagged(buffer.size());
+  unsigned int nb_written = 0;
+  CHECK_LONGS_EQUAL(0, v2p_compute_path_lagged(s, 0, lag, &lagged[0]));
+  for (unsigned int i = 0; i < buffer.size(); i += 480) {
+    v2p_add_samples(s, &buffer[i], 480);
+    nb_written += v2p_compute_path_lagged(s, nb_written, lag, &lagged[nb_written]);
+  }
+  CHECK_LONGS_EQUAL(v2p_path_len(s) - lag, nb_written);
+  CHECK_LONGS_EQUAL(0, v2p_compute_path_lagged(s, nb_written, lag, &lagged[0]));
+
+  // Without lag, it's the path of v2p_compute_path
+  float* path = v2p_compute_path(s);
+  std::vector<float> tail(v2p_path_len(s));
+  CHECK_LONGS_EQUAL(tail.size() - 10, v2p_compute_path_lagged(s, 10, 0, &tail[0]));
+  unsigned int nb_settled = 0;
+  for (unsigned int i = 0; i < nb_written; i++)
+    nb_settled += lagged[i] == path[i];
+  for (unsigned int i = 10; i < tail.size(); i++)
+    CHECK_DOUBLES_EQUAL(path[i], tail[i - 10]);
+  CHECK(nb_settled >= nb_written * 95 / 100);
+  v2p_ptr_free(path);
+}
+
+TEST (SYMP, memory_usage_reports_the_bytes_held)
+{
+  const unsigned int frame_size = 1500;
+  size_t bytes_in_use = 0;
+  const v2p_allocator_t allocator = {__sized_malloc, __sized_realloc, __sized_free, &bytes_in_use};
+  TestAnalyzerSettings settings;
+  settings.frameSize = frame_size;
+  settings.maxfreq = true;
+  settings.signal = toneSignal;
+  settings.allocator = &allocator;
+  {
+    TestAnalyzer a(settings);
+    pitch_analyzer_t* s = a.s;
+
+    v2p_memory_report report;
+    v2p_memory_usage(s, &report);
+    CHECK(__report_sums_up(report));
+    CHECK_LONGS_EQUAL(0, report.candidates.capacity);
+    // The windows of this size aren't embedded in the library
+    CHECK(report.descriptors.capacity > 2 * frame_size * sizeof(float));
+
+    a.stream((unsigned int)a.signal.size());
+    v2p_memory_usage(s, &report);
+    CHECK(__report_sums_up(report));
+    CHECK_LONGS_EQUAL(sizeof(float) * sb_count(s->audio_buffer) +
+      sizeof(float) * sb_count(s->hop_peaks), report.audio_buffer.used);
+    CHECK(report.candidates.used >= 3 * sizeof(float) * v2p_nb_candidates_generated(s));
+    CHECK(report.path_indexes.used > 0);
+    CHECK(report.path_costs.used > 0);
+    CHECK(report.spectrum.used > 0);
+    CHECK_LONGS_EQUAL(0, report.scratch.capacity);
+    // Everything allocated through the allocator of the analyzer is counted:
+    // only the headers of the stretchy buffers are not
+    const size_t owned = report.total.capacity - report.descriptors.capacity;
+    CHECK(bytes_in_use >= owned);
+    CHECK(bytes_in_use <= owned + 256);
+
+    // The high-water mark remembers what the reset released
+    const size_t held = report.total.capacity;
+    v2p_reset(s);
+    v2p_memory_usage(s, &report);
+    CHECK(__report_sums_up(report));
+    CHECK(report.total.capacity < held);
+    CHECK(report.peak >= held);
+
+    // Real-time mode: everything is preallocated
+    CHECK_LONGS_EQUAL(V2P_OK, v2p_prepare(s, 480, 200));
+    v2p_memory_usage(s, &report);
+    const size_t prepared = report.total.capacity;
+    CHECK(report.scratch.capacity > 0);
+    CHECK(report.candidates.capacity >= 200 * 3 * sizeof(float) * s->nb_candidates_per_step);
+    a.stream(480);
+    v2p_memory_usage(s, &report);
+    CHECK(__report_sums_up(report));
+    CHECK_LONGS_EQUAL(prepared, report.total.capacity);
+  }
+  CHECK_LONGS_EQUAL(0, bytes_in_use);
+}
+
 TEST(SYMP, viterbi_path_cost_on_obvious_candidates)
 {
   // Initialize structure and algorithm
   struct pitch_analyzer* s = v2p_new(0.f);
   s->compute_transition_cost = __fake_transition_cost;
   s->nb_candidates_per_step = 3;
+  candidates_init(&s->candidates, s->nb_candidates_per_step);
 
   // Input audio and settings
   std::vector<candidate_t> path(s->nb_candidates_per_step, {0, 1.f});
@@ -63,7 +386,7 @@ TEST(SYMP, viterbi_path_cost_on_obvious_candidates)
   path[2].frequency = 300;
 
   // Run algorithm by hand
-  sb_concat(s->candidates, &path[0], s->nb_candidates_per_step);
+  CHECK(__add_step(s, path));
   s->number_of_timesteps++;
   update_viterbi_path(s);
 
@@ -80,7 +403,7 @@ TEST(SYMP, viterbi_path_cost_on_obvious_candidates)
   path[2].frequency = 105;
 
   // Run algorithm by hand
-  sb_concat(s->candidates, &path[0], s->nb_candidates_per_step);
+  CHECK(__add_step(s, path));
   s->number_of_timesteps++;
   update_viterbi_path(s);
 
@@ -97,7 +420,7 @@ TEST(SYMP, viterbi_path_cost_on_obvious_candidates)
   path[2].frequency = 110;
 
   // Run algorithm by hand
-  sb_concat(s->candidates, &path[0], s->nb_candidates_per_step);
+  CHECK(__add_step(s, path));
   s->number_of_timesteps++;
   update_viterbi_path(s);
 
@@ -0,0 +1,165 @@
+#include "lib/TestHarness.hpp"
+#include "lib/TestAnalyzer.hpp"
+#include "v2p.h"
+#include "viterbi.h"
+
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+// Noisy vibrato with a pause every second
+static std::vector<float> __noisy_vibrato(unsigned int nb_samples, float sampling_rate) {
+  std::vector<float> buffer(nb_samples);
+  double phase = 0;
+  srand(42);
+  for (unsigned int i = 0; i < nb_samples; i++) {
+    const double t = i / (double)sampling_rate;
+    phase += (220 + 30 * sin(2 * M_PI * 5 * t)) * 2 * M_PI / sampling_rate;
+    const float noise = (float)(rand() % 1000) / 1000 - 0.5f;
+    const bool pause = fmod(t, 1.) > 0.8;
+    buffer[i] = (pause ? 0.f : (float)sin(phase)) + 0.05f * noise;
+  }
+  return buffer;
+}
+
+// Noisy octave jumps and pauses
+static std::vector<float> __octave_jumps(unsigned int nb_samples, float sampling_rate) {
+  std::vector<float> buffer(nb_samples);
+  double phase = 0;
+  srand(7);
+  for (unsigned int i = 0; i < nb_samples; i++) {
+    const double t = i / (double)sampling_rate;
+    const double frequency = (fmod(t, 0.5) < 0.25) ? 200 : 400;
+    phase += frequency * 2 * M_PI / sampling_rate;
+    const bool pause = fmod(t, 0.7) > 0.6;
+    buffer[i] = (pause ? 0.f : (float)sin(phase)) + 0.1f * ((float)(rand() % 1000) / 1000 - 0.5f);
+  }
+  return buffer;
+}
+
+// Analysis at 16kHz with 6 candidates per frame
+static TestAnalyzerSettings __settings(TestSignal signal, double duration) {
+  TestAnalyzerSettings settings;
+  settings.frameSize = 1024;
+  settings.samplingRate = 16000;
+  settings.nbCandidates = 6;
+  settings.signal = signal;
+  settings.duration = duration;
+  return settings;
+}
+
+TEST (Viterbi, parallel_decoding_matches_sequential)
+{
+  TestAnalyzer online(__settings(__noisy_vibrato, 3));
+  TestAnalyzer offline(__settings(__noisy_vibrato, 3));
+  offline.s->offline_decoding = 1;
+  online.run();
+  offline.run();
+  // Nothing decoded while the samples were added
+  CHECK_LONGS_EQUAL(0, offline.s->path_indexes.nb_rows);
+
+  const unsigned int length = v2p_path_len(online.s);
+  CHECK(length > 100);
+  CHECK_LONGS_EQUAL(length, v2p_path_len(offline.s));
+  const std::vector<float> path = online.path();
+  CHECK(path == offline.path());
+
+  const unsigned int nb_threads[] = {1, 2, 3, 5, 8, 0};
+  for (unsigned int k = 0; k < 6; k++) {
+    float* path_parallel = v2p_compute_path_parallel(offline.s, nb_threads[k]);
+    CHECK(path_parallel != NULL);
+    bool same = true;
+    for (unsigned int i = 0; path_parallel && i < length; i++)
+      same = same && path[i] == path_parallel[i];
+    CHECK(same);
+    v2p_ptr_free(path_parallel);
+  }
+}
+
+TEST (Viterbi, parallel_decoding_of_few_timesteps)
+{
+  // More threads than timesteps
+  const float frequencies[4][3] = {
+    {0, 200, 400}, {0, 205, 390}, {0, 800, 210}, {0, 0, 215}
+  };
+  // Online, then offline decoding (from a single timestep)
+  for (unsigned int offline = 0; offline < 2; offline++) {
+    pitch_analyzer_t* s = v2p_new(0);
+    s->nb_candidates_per_step = 3;
+    s->offline_decoding = offline;
+    candidates_init(&s->candidates, s->nb_candidates_per_step);
+    CHECK(v2p_compute_path_parallel(s, 4) == NULL);
+    CHECK(v2p_compute_path(s) == NULL);
+
+    for (unsigned int t = 0; t < 4; t++) {
+      struct candidate_slice step;
+      CHECK(candidates_add_step(&s->candidates, &step));
+      for (unsigned int k = 0; k < 3; k++) {
+        step.frequency[k] = frequencies[t][k];
+        step.weight[k] = frequencies[t][k] ? 0.5f : 0.3f;
+      }
+      candidates_finish_step(&s->candidates);
+      s->number_of_timesteps++;
+      update_viterbi_path(s);
+
+      float* path = v2p_compute_path(s);
+      float* path_parallel = v2p_compute_path_parallel(s, 8);
+      CHECK(path != NULL);
+      CHECK(path_parallel != NULL);
+      for (unsigned int i = 0; path && path_parallel && i <= t; i++)
+        CHECK_DOUBLES_EQUAL(path[i], path_parallel[i]);
+      if (path)
+        CHECK_DOUBLES_EQUAL(200, path[0]);
+      v2p_ptr_free(path);
+      v2p_ptr_free(path_parallel);
+    }
+    v2p_delete(s);
+  }
+}
+
+TEST (Viterbi, redecoding_matches_an_analysis_with_the_same_costs)
+{
+  TestAnalyzer a(__settings(__octave_jumps, 2));
+  pitch_analyzer_t* s = a.s;
+  a.run();
+  const unsigned int length = v2p_path_len(s);
+  const std::vector<float> path = a.path();
+
+  viterbi_costs_t costs[3];
+  const float factors[3] = {4, 1, 0.25f};
+  for (unsigned int j = 0; j < 3; j++) {
+    costs[j].compute_transition_cost = s->compute_transition_cost;
+    costs[j].voiced_unvoiced_cost = s->voiced_unvoiced_cost * factors[j];
+    costs[j].octave_jump_cost = s->octave_jump_cost * factors[j];
+  }
+  float* paths = v2p_redecode(s, costs, 3);
+  CHECK(paths != NULL);
+  // The second setting is the default one
+  bool same = true;
+  for (unsigned int i = 0; paths && i < length; i++)
+    same = same && paths[length + i] == path[i];
+  CHECK(same);
+  // The costs change the path
+  bool differ = false;
+  for (unsigned int i = 0; paths && i < length; i++)
+    differ = differ || paths[i] != paths[2 * length + i];
+  CHECK(differ);
+
+  // Each path is the one of an analysis with the same costs
+  for (unsigned int j = 0; paths && j < 3; j += 2) {
+    TestAnalyzer a_j(__settings(__octave_jumps, 2));
+    a_j.s->voiced_unvoiced_cost = costs[j].voiced_unvoiced_cost;
+    a_j.s->octave_jump_cost = costs[j].octave_jump_cost;
+    a_j.run();
+    const std::vector<float> path_j = a_j.path();
+    CHECK_LONGS_EQUAL(length, path_j.size());
+    CHECK(std::equal(path_j.begin(), path_j.end(), paths + j * length));
+  }
+
+  // The analyzer goes on with the first setting
+  CHECK_DOUBLES_EQUAL(costs[0].octave_jump_cost, s->octave_jump_cost);
+  const std::vector<float> path_after = a.path();
+  CHECK(paths && std::equal(path_after.begin(), path_after.end(), paths));
+  v2p_ptr_free(paths);
+}
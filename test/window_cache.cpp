@@ -0,0 +1,74 @@
+#include "lib/TestHarness.hpp"
+#include "window_cache.h"
+#include "autocorrelation.h"
+#include "boersma.h"
+#include "fft.h"
+
+#include <vector>
+
+TEST (WindowCache, windows_are_shared_and_reference_counted)
+{
+  const unsigned int size = 1000;
+  const unsigned int nb_windows = window_cache_size();
+
+  const shared_window_t* a = window_cache_acquire(WINDOW_HANN, size, 0);
+  const shared_window_t* b = window_cache_acquire(WINDOW_HANN, size, 0);
+  const shared_window_t* c = window_cache_acquire(WINDOW_BLACKMAN_HARRIS, size, 0);
+
+  // Same key, same buffers
+  CHECK(a != NULL);
+  CHECK(a == b);
+  CHECK(a->window == b->window);
+  CHECK(a != c);
+  CHECK_LONGS_EQUAL(nb_windows + 2, window_cache_size());
+
+  // Default padding is the one of the autocorrelation
+  CHECK_LONGS_EQUAL(autocorrelation_length(size), a->size + a->padding);
+
+  // Content of the window and of its autocorrelation
+  std::vector<float> window(size);
+  compute_hann(&window[0], size);
+  unsigned int ac_size;
+  float* ac = compute_unnormalized_autocorrelation(&window[0], size, &ac_size);
+  CHECK_LONGS_EQUAL(ac_size, a->window_ac_size);
+  for (unsigned int i = 0; i < size; i++)
+    CHECK_DOUBLES_EQUAL(window[i], a->window[i]);
+  for (unsigned int i = 0; i < ac_size; i++)
+    CHECK(fabs(ac[i] - a->window_ac[i]) < 1e-3 * (1 + fabs(ac[i])));
+  v2p_ptr_free(ac);
+
+  // Released with the last reference
+  window_cache_release(a);
+  CHECK_LONGS_EQUAL(nb_windows + 2, window_cache_size());
+  window_cache_release(b);
+  window_cache_release(c);
+  CHECK_LONGS_EQUAL(nb_windows, window_cache_size());
+}
+
+TEST (WindowCache, invalid_padding_is_rejected)
+{
+  CHECK(window_cache_acquire(WINDOW_HANN, 1000, 10) == NULL);
+  CHECK(window_cache_acquire(WINDOW_HANN, 0, 0) == NULL);
+}
+
+TEST (WindowCache, prewarm_keeps_window_alive)
+{
+  const unsigned int size = 1500;
+  const unsigned int nb_windows = window_cache_size();
+
+  CHECK_LONGS_EQUAL(0, window_cache_prewarm(WINDOW_HANN, size, 0));
+  CHECK_LONGS_EQUAL(nb_windows + 1, window_cache_size());
+
+  // Boersma instances reuse the prewarmed window
+  algorithm_descriptor_boersma_t* b1 = boersma_new(size, 0);
+  algorithm_descriptor_boersma_t* b2 = boersma_new(size, 0);
+  CHECK(b1->voiced_window == b2->voiced_window);
+  CHECK(b1->voiced_window_ac == b2->voiced_window_ac);
+  CHECK_LONGS_EQUAL(nb_windows + 1, window_cache_size());
+  boersma_delete(b1);
+  boersma_delete(b2);
+
+  CHECK_LONGS_EQUAL(nb_windows + 1, window_cache_size());
+  window_cache_clear();
+  CHECK_LONGS_EQUAL(nb_windows, window_cache_size());
+}
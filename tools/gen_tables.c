@@ -0,0 +1,87 @@
+// Generate the tables embedded in the library (see include/tables.h).
+//
+// Usage: v2p-gentables output_file
+//
+// It's linked with the transforms of the library compiled with
+// V2P_GENERATING_TABLES, so the values are computed by the exact same code
+// as the runtime fallback, and printed with enough digits to be read back
+// bit for bit.
+
+#include "fft.h"
+#include "autocorrelation.h"
+#include "tables.h"
+#include "tools.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static void __print_array(FILE* f, const char* type, const char* name,
+  const float* values, unsigned int size) {
+  fprintf(f, "static const %s %s[%u] = {\n", type, name, size);
+  for (unsigned int i = 0; i < size; i++)
+    fprintf(f, "%s%.9g%s", (i % 6) ? " " : "  ", values[i],
+      (i + 1 == size) ? "\n" : ((i % 6 == 5) ? ",\n" : ","));
+  fprintf(f, "};\n\n");
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s output_file\n", argv[0]);
+    return 1;
+  }
+  FILE* f = fopen(argv[1], "w");
+  if (!f) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  fprintf(f, "// Generated by tools/gen_tables.c. Do not edit.\n\n");
+
+  // Same expression as the runtime computation in src/fft.c
+  fprintf(f, "const double v2p_sin_table[256] = {\n");
+  for (unsigned int i = 0; i < 256; i++)
+    fprintf(f, "  %.17g%s\n", sin(2 * M_PI / pow(2., i)), (i == 255) ? "" : ",");
+  fprintf(f, "};\n\n");
+
+  static const struct {
+    enum window_type type;
+    const char* name;
+    const char* enum_name;
+    void (*compute)(float*, unsigned int);
+  } windows[] = {
+    {WINDOW_HANN, "hann", "WINDOW_HANN", compute_hann},
+    {WINDOW_BLACKMAN_HARRIS, "blackman_harris", "WINDOW_BLACKMAN_HARRIS", compute_blackman_harris},
+  };
+  const unsigned int nb_windows = sizeof(windows) / sizeof(windows[0]);
+
+  for (unsigned int w = 0; w < nb_windows; w++)
+    for (unsigned int size = V2P_TABLES_MIN_SIZE; size <= V2P_TABLES_MAX_SIZE; size *= 2) {
+      float* window = malloc(sizeof(*window) * size);
+      if (!window)
+        return 1;
+      windows[w].compute(window, size);
+      unsigned int ac_size;
+      float* ac = compute_unnormalized_autocorrelation_with_length(
+        window, size, autocorrelation_length(size), &ac_size);
+      if (!ac)
+        return 1;
+
+      char name[64];
+      snprintf(name, sizeof(name), "v2p_%s_%u", windows[w].name, size);
+      __print_array(f, "float", name, window, size);
+      snprintf(name, sizeof(name), "v2p_%s_%u_ac", windows[w].name, size);
+      __print_array(f, "float", name, ac, ac_size);
+      free(ac);
+      free(window);
+    }
+
+  fprintf(f, "static const struct v2p_static_window v2p_static_windows[] = {\n");
+  for (unsigned int w = 0; w < nb_windows; w++)
+    for (unsigned int size = V2P_TABLES_MIN_SIZE; size <= V2P_TABLES_MAX_SIZE; size *= 2)
+      fprintf(f, "  {%s, %u, %u, v2p_%s_%u, v2p_%s_%u_ac, %u},\n",
+        windows[w].enum_name, size, autocorrelation_length(size),
+        windows[w].name, size, windows[w].name, size, autocorrelation_length(size) / 2);
+  fprintf(f, "};\n");
+
+  return fclose(f) ? 1 : 0;
+}
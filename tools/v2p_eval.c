@@ -0,0 +1,760 @@
+// Evaluate the accuracy and the speed of the pitch analysis on a corpus.
+//
+// Usage: v2p-eval [-j threads] [-v] [-t trace.json] [-c config]... directory
+//
+// The directory is walked recursively for pairs of name.wav / name.mns
+// files, as python/v2p-test/accuracy.py does: the .mns ground truth holds a
+// note per line ("midi_number : start_seconds : end_seconds"). The files are
+// processed in parallel, each worker running every configuration on the
+// files it takes. For each configuration, it reports the note accuracy
+// metrics of accuracy.py, the real-time factor (analysis time per second of
+// audio, on one thread) and the peak memory of an analyzer.
+//
+// A configuration is "name:key=value,key=value...", with the keys:
+//   algorithm             maxfreq (maxfreq + boersma, as accuracy.py) or boersma
+//   frame_size            frame size of the algorithms (2048)
+//   candidates            voiced candidates of boersma (4)
+//   sampling_rate         the audio is resampled at this rate (48000)
+//   median                window of the median filter of the midi numbers (3)
+//   octave_cost, octave_jump_cost, voiced_unvoiced_cost, silence_threshold,
+//   voicing_threshold     settings of the analyzer (library defaults)
+// Without -c, the maxfreq and boersma configurations are evaluated.
+//
+// With a library built with V2P_TRACE, -t writes the spans of the analyses
+// as Chrome trace events; the stream of a span is the index of its file.
+
+#if !defined _WIN32 && !defined _WIN64
+  #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "v2p.h"
+#include "boersma.h"
+#include "maxfreq.h"
+#include "midi.h"
+#include "tools.h"
+#include "allocator.h"
+#include "sync.h"
+#include "stretchy_buffer.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined _WIN32 || defined _WIN64
+  #include <psapi.h>
+#else
+  #include <dirent.h>
+  #include <sys/stat.h>
+  #include <sys/resource.h>
+  #include <time.h>
+#endif
+
+#define EVAL_MAX_CONFIGS 32
+
+//
+// Configurations
+//
+
+struct eval_config {
+  char name[64];
+  bool boersma_only;
+  unsigned int frame_size;
+  unsigned int nb_candidates;
+  float sampling_rate;
+  unsigned int median_window;
+  // Settings of the analyzer, NAN to keep the default value
+  float octave_cost;
+  float octave_jump_cost;
+  float voiced_unvoiced_cost;
+  float silence_threshold;
+  float voicing_threshold;
+};
+
+static void __config_init(struct eval_config* config, const char* name) {
+  memset(config, 0, sizeof(*config));
+  snprintf(config->name, sizeof(config->name), "%s", name);
+  config->boersma_only = strcmp(name, "boersma") == 0;
+  config->frame_size = 2048;
+  config->nb_candidates = 4;
+  config->sampling_rate = 48000;
+  config->median_window = 3;
+  config->octave_cost = config->octave_jump_cost = config->voiced_unvoiced_cost = NAN;
+  config->silence_threshold = config->voicing_threshold = NAN;
+}
+
+// Parse "name:key=value,...". Return false on an unknown key or value.
+static bool __config_parse(struct eval_config* config, const char* text) {
+  const char* colon = strchr(text, ':');
+  char name[64];
+  snprintf(name, sizeof(name), "%.*s", colon ? (int)(colon - text) : (int)strlen(text), text);
+  __config_init(config, name);
+  if (!colon)
+    return true;
+
+  char settings[512];
+  snprintf(settings, sizeof(settings), "%s", colon + 1);
+  for (char* key = strtok(settings, ","); key; key = strtok(NULL, ",")) {
+    char* value = strchr(key, '=');
+    if (!value)
+      return false;
+    *value++ = 0;
+    const float number = (float)atof(value);
+    if (strcmp(key, "algorithm") == 0) {
+      if (strcmp(value, "boersma") && strcmp(value, "maxfreq"))
+        return false;
+      config->boersma_only = strcmp(value, "boersma") == 0;
+    }
+    else if (strcmp(key, "frame_size") == 0 && number >= 64)
+      config->frame_size = (unsigned int)number;
+    else if (strcmp(key, "candidates") == 0 && number >= 1)
+      config->nb_candidates = (unsigned int)number;
+    else if (strcmp(key, "sampling_rate") == 0 && number > 0)
+      config->sampling_rate = number;
+    else if (strcmp(key, "median") == 0 && number >= 1)
+      config->median_window = (unsigned int)number;
+    else if (strcmp(key, "octave_cost") == 0)
+      config->octave_cost = number;
+    else if (strcmp(key, "octave_jump_cost") == 0)
+      config->octave_jump_cost = number;
+    else if (strcmp(key, "voiced_unvoiced_cost") == 0)
+      config->voiced_unvoiced_cost = number;
+    else if (strcmp(key, "silence_threshold") == 0)
+      config->silence_threshold = number;
+    else if (strcmp(key, "voicing_threshold") == 0)
+      config->voicing_threshold = number;
+    else
+      return false;
+  }
+  return true;
+}
+
+//
+// Memory and time measures
+//
+
+// Allocator counting the bytes allocated by an analyzer. The size of each
+// block is stored before it.
+struct counting_allocator {
+  v2p_allocator_t allocator;
+  size_t used;
+  size_t peak;
+};
+
+#define COUNTING_HEADER 16
+
+static void* __counting_malloc(void* user_data, size_t size) {
+  struct counting_allocator* counter = user_data;
+  char* block = malloc(size + COUNTING_HEADER);
+  if (!block)
+    return NULL;
+  memcpy(block, &size, sizeof(size));
+  counter->used += size;
+  if (counter->used > counter->peak)
+    counter->peak = counter->used;
+  return block + COUNTING_HEADER;
+}
+
+static void __counting_free(void* user_data, void* ptr) {
+  struct counting_allocator* counter = user_data;
+  if (!ptr)
+    return;
+  char* block = (char*)ptr - COUNTING_HEADER;
+  size_t size;
+  memcpy(&size, block, sizeof(size));
+  counter->used -= size;
+  free(block);
+}
+
+static void* __counting_realloc(void* user_data, void* ptr, size_t size) {
+  if (!ptr)
+    return __counting_malloc(user_data, size);
+  struct counting_allocator* counter = user_data;
+  char* block = (char*)ptr - COUNTING_HEADER;
+  size_t old_size;
+  memcpy(&old_size, block, sizeof(old_size));
+  block = realloc(block, size + COUNTING_HEADER);
+  if (!block)
+    return NULL;
+  memcpy(block, &size, sizeof(size));
+  counter->used += size - old_size;
+  if (counter->used > counter->peak)
+    counter->peak = counter->used;
+  return block + COUNTING_HEADER;
+}
+
+static void __counting_init(struct counting_allocator* counter) {
+  memset(counter, 0, sizeof(*counter));
+  counter->allocator.malloc = __counting_malloc;
+  counter->allocator.realloc = __counting_realloc;
+  counter->allocator.free = __counting_free;
+  counter->allocator.user_data = counter;
+}
+
+// Monotonic time in seconds
+static double __now(void) {
+#if defined _WIN32 || defined _WIN64
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (double)counter.QuadPart / frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Peak resident memory of the process, in bytes
+static size_t __peak_rss(void) {
+#if defined _WIN32 || defined _WIN64
+  PROCESS_MEMORY_COUNTERS counters;
+  GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  #if defined __APPLE__
+    return (size_t)usage.ru_maxrss;
+  #else
+    return (size_t)usage.ru_maxrss * 1024;
+  #endif
+#endif
+}
+
+//
+// Audio and ground truth
+//
+
+static uint32_t __read_le(const unsigned char* bytes, unsigned int size) {
+  uint32_t value = 0;
+  for (unsigned int i = size; i-- > 0;)
+    value = (value << 8) | bytes[i];
+  return value;
+}
+
+// Load the first channel of a PCM (8, 16, 24, 32 bits) or float (32, 64 bits)
+// wav file, scaled in [-1, 1]. Return a stretchy buffer, or NULL on failure
+// (a sampling rate of 0 is one).
+static float* __wav_load(const char* path, float* sampling_rate) {
+  *sampling_rate = 0;
+  FILE* file = fopen(path, "rb");
+  if (!file)
+    return NULL;
+  unsigned char header[12], chunk[8], format[40];
+  unsigned int audio_format = 0, nb_channels = 0, bits = 0;
+  float* samples = NULL;
+  bool ok = fread(header, 1, 12, file) == 12 && !memcmp(header, "RIFF", 4) &&
+    !memcmp(header + 8, "WAVE", 4);
+
+  while (ok && fread(chunk, 1, 8, file) == 8) {
+    const uint32_t size = __read_le(chunk + 4, 4);
+    if (!memcmp(chunk, "fmt ", 4)) {
+      ok = size >= 16 && fread(format, 1, size < 40 ? size : 40, file) == (size < 40 ? size : 40);
+      if (size > 40)
+        fseek(file, size - 40, SEEK_CUR);
+      audio_format = __read_le(format, 2);
+      nb_channels = __read_le(format + 2, 2);
+      *sampling_rate = (float)__read_le(format + 4, 4);
+      ok = ok && *sampling_rate > 0;
+      bits = __read_le(format + 14, 2);
+      // WAVE_FORMAT_EXTENSIBLE: the format is the start of the sub format
+      if (audio_format == 0xFFFE && size >= 26)
+        audio_format = __read_le(format + 24, 2);
+    }
+    else if (!memcmp(chunk, "data", 4) && nb_channels && bits) {
+      const unsigned int sample_size = bits / 8;
+      const unsigned int frame_size = sample_size * nb_channels;
+      const bool is_float = audio_format == 3;
+      if ((audio_format != 1 && !is_float) || !sample_size || sample_size > 8 ||
+          (is_float && sample_size != 4 && sample_size != 8)) {
+        ok = false;
+        break;
+      }
+      unsigned char* data = malloc(size ? size : 1);
+      ok = data && fread(data, 1, size, file) == size;
+      const unsigned int nb_frames = ok ? size / frame_size : 0;
+      if (ok)
+        sb_reserve(samples, nb_frames);
+      for (unsigned int i = 0; ok && i < nb_frames; i++) {
+        const unsigned char* bytes = data + (size_t)i * frame_size;
+        float sample;
+        if (is_float && sample_size == 4) {
+          memcpy(&sample, bytes, 4);
+        }
+        else if (is_float) {
+          double value;
+          memcpy(&value, bytes, 8);
+          sample = (float)value;
+        }
+        else if (sample_size == 1)
+          sample = (bytes[0] - 128) / 128.f;
+        else {
+          // Sign extension of the most significant bytes
+          const uint32_t raw = __read_le(bytes + (sample_size > 4 ? sample_size - 4 : 0),
+            sample_size > 4 ? 4 : sample_size);
+          const unsigned int shift = 32 - 8 * (sample_size > 4 ? 4 : sample_size);
+          sample = (float)((int32_t)(raw << shift) / 2147483648.);
+        }
+        sb_push(samples, sample);
+      }
+      free(data);
+      break;
+    }
+    else
+      fseek(file, size + (size & 1), SEEK_CUR);
+  }
+  fclose(file);
+  if (!ok || !samples)
+    samples = sb_free(samples);
+  return samples;
+}
+
+// Resample with a windowed sinc (Blackman, 16 zero crossings), low-passed
+// at the lowest Nyquist frequency. Return a stretchy buffer.
+static float* __resample(const float* input, unsigned int length, float rate_in, float rate_out) {
+  float* output = NULL;
+  if (rate_in == rate_out) {
+    sb_reserve(output, length);
+    for (unsigned int i = 0; i < length; i++)
+      sb_push(output, input[i]);
+    return output;
+  }
+  const double ratio = rate_out / rate_in;
+  const double cutoff = ratio < 1 ? ratio : 1;
+  const int half_width = (int)ceil(16 / cutoff);
+  const unsigned int out_length = (unsigned int)((double)length * ratio);
+  sb_reserve(output, out_length);
+  for (unsigned int n = 0; n < out_length; n++) {
+    const double t = n / ratio;
+    const int center = (int)floor(t);
+    double sum = 0;
+    for (int k = center - half_width + 1; k <= center + half_width; k++) {
+      if (k < 0 || k >= (int)length)
+        continue;
+      const double x = t - k;
+      const double sinc = (x == 0) ? 1 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+      const double w = 0.5 + x / (2 * half_width);
+      const double window = 0.42 - 0.5 * cos(2 * M_PI * w) + 0.08 * cos(4 * M_PI * w);
+      sum += input[k] * cutoff * sinc * window;
+    }
+    sb_push(output, (float)sum);
+  }
+  return output;
+}
+
+// Load a .mns file, with the positions and durations in timesteps.
+// Return a stretchy buffer (NULL if empty).
+static midi_note_data_t* __mns_load(const char* path, float frame_time_step) {
+  FILE* file = fopen(path, "r");
+  if (!file)
+    return NULL;
+  midi_note_data_t* notes = NULL;
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    float number, start, end;
+    if (sscanf(line, " %f : %f : %f", &number, &start, &end) != 3)
+      continue;
+    midi_note_data_t note;
+    memset(&note, 0, sizeof(note));
+    note.note_number = number;
+    note.position = start / frame_time_step;
+    note.duration = (end - start) / frame_time_step;
+    sb_push(notes, note);
+  }
+  fclose(file);
+  return notes;
+}
+
+//
+// Metrics (compute_accuracy of accuracy.py)
+//
+
+struct eval_result {
+  bool done;
+  double audio_seconds;
+  double analysis_seconds;
+  size_t peak_memory;
+  unsigned int nb_notes;
+  unsigned int nb_expected_notes;
+  double midi_number_distance;
+  double segmentation_distance;
+};
+
+// Midi number of the note played at each timestep, 0 for silences
+static int* __notes_to_numbers(const midi_note_data_t* notes, unsigned int nb_notes,
+  unsigned int length) {
+  int* numbers = calloc(length ? length : 1, sizeof(*numbers));
+  for (unsigned int i = 0; numbers && i < nb_notes; i++) {
+    const long first = lroundf(notes[i].position);
+    const long last = lroundf(notes[i].position + notes[i].duration);
+    for (long t = first < 0 ? 0 : first; t < last && t < (long)length; t++)
+      numbers[t] = (int)lroundf(notes[i].note_number);
+  }
+  return numbers;
+}
+
+static unsigned int __notes_length(const midi_note_data_t* notes, unsigned int nb_notes) {
+  float end = 0;
+  for (unsigned int i = 0; i < nb_notes; i++)
+    if (notes[i].position + notes[i].duration > end)
+      end = notes[i].position + notes[i].duration;
+  return (unsigned int)ceilf(end);
+}
+
+// Proportion of the timesteps where a note is played in either list, whose
+// midi numbers differ
+static double __midi_numbers_distance(const midi_note_data_t* a, unsigned int nb_a,
+  const midi_note_data_t* b, unsigned int nb_b) {
+  const unsigned int length_a = __notes_length(a, nb_a);
+  const unsigned int length_b = __notes_length(b, nb_b);
+  const unsigned int length = length_a > length_b ? length_a : length_b;
+  int* numbers_a = __notes_to_numbers(a, nb_a, length);
+  int* numbers_b = __notes_to_numbers(b, nb_b, length);
+  unsigned int nb_voiced = 0, nb_mismatches = 0;
+  for (unsigned int t = 0; numbers_a && numbers_b && t < length; t++) {
+    if (!numbers_a[t] && !numbers_b[t])
+      continue;
+    nb_voiced++;
+    nb_mismatches += numbers_a[t] != numbers_b[t];
+  }
+  free(numbers_a);
+  free(numbers_b);
+  return nb_voiced ? (double)nb_mismatches / nb_voiced : 0;
+}
+
+//
+// Evaluation
+//
+
+static bool __is_set(float value) {
+  return !isnan(value);
+}
+
+// Analyze the audio with a configuration and compare its notes with the
+// ground truth
+static void __evaluate(const struct eval_config* config, const float* audio,
+  unsigned int length, const midi_note_data_t* expected, unsigned int stream_id,
+  struct eval_result* result) {
+  struct counting_allocator counter;
+  __counting_init(&counter);
+  pitch_analyzer_t* s = v2p_new_with_allocator(0, &counter.allocator);
+  s->stream_id = stream_id;
+  s->sampling_rate = config->sampling_rate;
+  if (__is_set(config->octave_cost))
+    s->octave_cost = config->octave_cost;
+  if (__is_set(config->octave_jump_cost))
+    s->octave_jump_cost = config->octave_jump_cost;
+  if (__is_set(config->voiced_unvoiced_cost))
+    s->voiced_unvoiced_cost = config->voiced_unvoiced_cost;
+  if (__is_set(config->silence_threshold))
+    s->silence_threshold = config->silence_threshold;
+  if (__is_set(config->voicing_threshold))
+    s->voicing_threshold = config->voicing_threshold;
+
+  // Same algorithms as the engines of python/v2p/boersma.py
+  algorithm_descriptor_maxfreq_t* adm = config->boersma_only ? NULL : maxfreq_new(config->frame_size);
+  algorithm_descriptor_boersma_unvoiced_t* adu = boersma_unvoiced_new(config->frame_size);
+  algorithm_descriptor_boersma_t* adb = boersma_new(config->frame_size, config->nb_candidates);
+  if (adm)
+    v2p_register_algorithm(s, (algorithm_descriptor_t*)adm);
+  v2p_register_algorithm(s, (algorithm_descriptor_t*)adu);
+  v2p_register_algorithm(s, (algorithm_descriptor_t*)adb);
+  v2p_reset(s);
+
+  const double start = __now();
+  v2p_run(s, (float*)audio, length);
+  float* path = v2p_compute_path(s);
+  const unsigned int path_length = path ? v2p_path_len(s) : 0;
+  result->analysis_seconds = __now() - start;
+  result->audio_seconds = length / config->sampling_rate;
+  result->peak_memory = counter.peak;
+
+  unsigned int nb_notes = 0;
+  midi_note_data_t* notes = NULL;
+  if (path_length) {
+    float* numbers = pitch_to_midi_numbers(path, path_length);
+    float* filtered = median_filter(numbers, path_length, config->median_window);
+    notes = midi_numbers_to_notes(filtered, path_length, &nb_notes);
+    v2p_ptr_free(numbers);
+    v2p_ptr_free(filtered);
+  }
+  const unsigned int nb_expected = sb_count(expected);
+  result->nb_notes = nb_notes;
+  result->nb_expected_notes = nb_expected;
+  result->midi_number_distance = __midi_numbers_distance(notes, nb_notes, expected, nb_expected);
+  const unsigned int nb_max = nb_notes > nb_expected ? nb_notes : nb_expected;
+  result->segmentation_distance = nb_max ?
+    fabs((double)nb_expected - nb_notes) / nb_max : 0;
+  result->done = true;
+
+  v2p_ptr_free(notes);
+  v2p_ptr_free(path);
+  v2p_delete(s);
+  if (adm)
+    maxfreq_delete(adm);
+  boersma_unvoiced_delete(adu);
+  boersma_delete(adb);
+}
+
+struct eval_file {
+  char* wav;
+  char* mns;
+};
+
+struct eval_context {
+  const struct eval_config* configs;
+  unsigned int nb_configs;
+  const struct eval_file* files;
+  unsigned int nb_files;
+  //! results[file * nb_configs + config]
+  struct eval_result* results;
+  unsigned int next_file;
+};
+
+// Protects eval_context::next_file
+static v2p_mutex_t __next_file_lock = V2P_MUTEX_INITIALIZER;
+
+static V2P_THREAD_ROUTINE(__eval_worker, arg) {
+  struct eval_context* context = arg;
+  for (;;) {
+    v2p_mutex_lock(&__next_file_lock);
+    const unsigned int i = context->next_file++;
+    v2p_mutex_unlock(&__next_file_lock);
+    if (i >= context->nb_files)
+      break;
+
+    float rate = 0;
+    float* wav = __wav_load(context->files[i].wav, &rate);
+    if (!wav) {
+      fprintf(stderr, "%s: can't be loaded, skipped\n", context->files[i].wav);
+      continue;
+    }
+    // Timesteps of the default analyzer (10ms)
+    midi_note_data_t* expected = __mns_load(context->files[i].mns, 0.01f);
+    for (unsigned int c = 0; c < context->nb_configs; c++) {
+      const struct eval_config* config = &context->configs[c];
+      float* audio = __resample(wav, sb_count(wav), rate, config->sampling_rate);
+      __evaluate(config, audio, sb_count(audio), expected, i,
+        &context->results[(size_t)i * context->nb_configs + c]);
+      sb_free(audio);
+    }
+    sb_free(expected);
+    sb_free(wav);
+  }
+  return V2P_THREAD_RETURN;
+}
+
+//
+// Corpus
+//
+
+static char* __path_join(const char* directory, const char* name) {
+  char* path = malloc(strlen(directory) + strlen(name) + 2);
+  sprintf(path, "%s/%s", directory, name);
+  return path;
+}
+
+static bool __file_exists(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file)
+    fclose(file);
+  return file != NULL;
+}
+
+// Add the file if it's a .mns with a .wav next to it
+static void __add_file(struct eval_file** files, const char* directory, const char* name) {
+  const size_t length = strlen(name);
+  if (length < 4 || strcmp(name + length - 4, ".mns"))
+    return;
+  struct eval_file file;
+  file.mns = __path_join(directory, name);
+  file.wav = strdup(file.mns);
+  strcpy(file.wav + strlen(file.wav) - 4, ".wav");
+  if (!__file_exists(file.wav)) {
+    fprintf(stderr, "%s: no associated wav source, skipped\n", file.mns);
+    free(file.mns);
+    free(file.wav);
+    return;
+  }
+  sb_push(*files, file);
+}
+
+static void __walk(struct eval_file** files, const char* directory) {
+#if defined _WIN32 || defined _WIN64
+  char* pattern = __path_join(directory, "*");
+  WIN32_FIND_DATAA entry;
+  HANDLE find = FindFirstFileA(pattern, &entry);
+  free(pattern);
+  if (find == INVALID_HANDLE_VALUE)
+    return;
+  do {
+    if (!strcmp(entry.cFileName, ".") || !strcmp(entry.cFileName, ".."))
+      continue;
+    if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+      char* path = __path_join(directory, entry.cFileName);
+      __walk(files, path);
+      free(path);
+    }
+    else
+      __add_file(files, directory, entry.cFileName);
+  } while (FindNextFileA(find, &entry));
+  FindClose(find);
+#else
+  DIR* dir = opendir(directory);
+  if (!dir)
+    return;
+  for (struct dirent* entry = readdir(dir); entry; entry = readdir(dir)) {
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      continue;
+    char* path = __path_join(directory, entry->d_name);
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+      __walk(files, path);
+    else
+      __add_file(files, directory, entry->d_name);
+    free(path);
+  }
+  closedir(dir);
+#endif
+}
+
+static int __cmp_files(const void* a, const void* b) {
+  return strcmp(((const struct eval_file*)a)->mns, ((const struct eval_file*)b)->mns);
+}
+
+//
+// Report
+//
+
+static void __print_summary(const struct eval_context* context, double wall_seconds) {
+  printf("%-16s %6s %10s %10s %7s %9s %11s\n", "config", "files", "pitch acc", "segm acc",
+    "ghosts", "RTF", "peak mem");
+  for (unsigned int c = 0; c < context->nb_configs; c++) {
+    double audio = 0, analysis = 0, pitch = 0, segmentation = 0;
+    size_t peak = 0;
+    unsigned int nb = 0, ghosts = 0;
+    for (unsigned int i = 0; i < context->nb_files; i++) {
+      const struct eval_result* r = &context->results[(size_t)i * context->nb_configs + c];
+      if (!r->done)
+        continue;
+      nb++;
+      audio += r->audio_seconds;
+      analysis += r->analysis_seconds;
+      pitch += r->midi_number_distance;
+      segmentation += r->segmentation_distance;
+      ghosts += r->nb_notes > r->nb_expected_notes ? r->nb_notes - r->nb_expected_notes : 0;
+      if (r->peak_memory > peak)
+        peak = r->peak_memory;
+    }
+    printf("%-16s %6u %9.2f%% %9.2f%% %7u %9.5f %9.2fMB\n", context->configs[c].name, nb,
+      nb ? 100 * (1 - pitch / nb) : 0., nb ? 100 * (1 - segmentation / nb) : 0., ghosts,
+      audio > 0 ? analysis / audio : 0., peak / 1048576.);
+  }
+  printf("\nWall time %.2fs, peak resident memory %.2fMB\n", wall_seconds,
+    __peak_rss() / 1048576.);
+}
+
+static void __print_details(const struct eval_context* context) {
+  printf("\nfile,config,pitch_accuracy,segmentation_accuracy,notes,expected_notes,rtf,peak_memory\n");
+  for (unsigned int i = 0; i < context->nb_files; i++)
+    for (unsigned int c = 0; c < context->nb_configs; c++) {
+      const struct eval_result* r = &context->results[(size_t)i * context->nb_configs + c];
+      if (!r->done)
+        continue;
+      printf("%s,%s,%.4f,%.4f,%u,%u,%.5f,%zu\n", context->files[i].mns, context->configs[c].name,
+        1 - r->midi_number_distance, 1 - r->segmentation_distance, r->nb_notes,
+        r->nb_expected_notes, r->audio_seconds > 0 ? r->analysis_seconds / r->audio_seconds : 0.,
+        r->peak_memory);
+    }
+}
+
+static int __usage(const char* program) {
+  fprintf(stderr, "usage: %s [-j threads] [-v] [-t trace.json] [-c name:key=value,...]... directory\n",
+    program);
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  static struct eval_config configs[EVAL_MAX_CONFIGS];
+  unsigned int nb_configs = 0;
+  unsigned int nb_threads = 0;
+  bool verbose = false;
+  const char* trace_path = NULL;
+  const char* directory = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-j") && i + 1 < argc)
+      nb_threads = (unsigned int)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-v"))
+      verbose = true;
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+      trace_path = argv[++i];
+    else if (!strcmp(argv[i], "-c") && i + 1 < argc && nb_configs < EVAL_MAX_CONFIGS) {
+      if (!__config_parse(&configs[nb_configs++], argv[++i])) {
+        fprintf(stderr, "invalid configuration: %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (argv[i][0] != '-' && !directory)
+      directory = argv[i];
+    else
+      return __usage(argv[0]);
+  }
+  if (!directory)
+    return __usage(argv[0]);
+  if (!nb_configs) {
+    __config_init(&configs[nb_configs++], "maxfreq");
+    __config_init(&configs[nb_configs++], "boersma");
+  }
+
+  struct eval_file* files = NULL;
+  __walk(&files, directory);
+  if (!sb_count(files)) {
+    fprintf(stderr, "%s: no .wav/.mns pair found\n", directory);
+    return 1;
+  }
+  // Same order whatever the file system
+  qsort(files, sb_count(files), sizeof(*files), __cmp_files);
+
+  struct eval_context context;
+  memset(&context, 0, sizeof(context));
+  context.configs = configs;
+  context.nb_configs = nb_configs;
+  context.files = files;
+  context.nb_files = sb_count(files);
+  context.results = calloc((size_t)context.nb_files * nb_configs, sizeof(*context.results));
+  if (!nb_threads)
+    nb_threads = v2p_nb_processors();
+  if (nb_threads > context.nb_files)
+    nb_threads = context.nb_files;
+
+  const double start = __now();
+  v2p_thread_t* threads = malloc(sizeof(*threads) * nb_threads);
+  bool* started = calloc(nb_threads, sizeof(*started));
+  for (unsigned int i = 1; i < nb_threads; i++)
+    started[i] = v2p_thread_create(&threads[i], __eval_worker, &context) == 0;
+  __eval_worker(&context);
+  for (unsigned int i = 1; i < nb_threads; i++)
+    if (started[i])
+      v2p_thread_join(threads[i]);
+  const double wall_seconds = __now() - start;
+
+  __print_summary(&context, wall_seconds);
+  if (verbose)
+    __print_details(&context);
+  if (trace_path && v2p_trace_dump(trace_path) != V2P_OK)
+    fprintf(stderr, "%s: the trace can't be written\n", trace_path);
+
+  for (unsigned int i = 0; i < context.nb_files; i++) {
+    free(files[i].wav);
+    free(files[i].mns);
+  }
+  sb_free(files);
+  free(context.results);
+  free(threads);
+  free(started);
+  return 0;
+}
@@ -0,0 +1,615 @@
+// Performance regression gate: time the hot paths of the library and
+// compare them with a baseline.
+//
+// Usage: v2p-perf [-b baseline.json] [-w baseline.json] [-f filter]
+//
+// Each benchmark is timed several times; the fastest run is kept, divided
+// by the time of a calibration loop of plain float arithmetic run by the
+// same process. This ratio depends much less on the machine than the
+// time itself, so that a baseline can be compared on another computer.
+//
+// -b compares the ratios with the baseline: the benchmarks slower than
+//    their tolerance (after PERF_NB_ATTEMPTS measures) are listed and the
+//    exit status is 1. Faster ones are only reported. A baseline recorded
+//    with another CMAKE_BUILD_TYPE can't be compared: nothing is measured
+//    and the exit status is PERF_SKIPPED (the ctest test is then skipped).
+// -w writes the ratios as a new baseline, keeping the tolerances of the
+//    benchmarks already in the file (the default tolerance otherwise).
+// -f only runs the benchmarks whose name contains filter.
+// Without -b nor -w, the ratios are printed.
+//
+// The baseline is a JSON object, one benchmark per line:
+//   {"build": "Release", "calibration_ns": 812.3, "benchmarks": [
+//     {"name": "fft_1024", "ratio": 14.2, "tolerance": 0.5},
+//     ...
+//   ]}
+// written by -w; a tolerance of 0.5 allows a benchmark 50% slower.
+
+#if !defined _WIN32 && !defined _WIN64
+  #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "v2p.h"
+#include "boersma.h"
+#include "maxfreq.h"
+#include "fft.h"
+#include "viterbi.h"
+#include "spectrum.h"
+#include "tools.h"
+#include "stretchy_buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#if !defined _WIN32 && !defined _WIN64
+  #include <time.h>
+#endif
+
+//! Time of the batches of iterations timed, in seconds
+#define PERF_BATCH_SECONDS 0.05
+//! Number of batches timed per benchmark (the fastest one is kept)
+#define PERF_NB_BATCHES 7
+//! A benchmark slower than its tolerance is measured again, up to this
+//! number of times, and its best ratio is kept: a busy machine slows a run
+//! down, it never speeds it up.
+#define PERF_NB_ATTEMPTS 3
+//! Tolerance of the benchmarks not in the baseline
+#define PERF_DEFAULT_TOLERANCE 0.5
+#define PERF_MAX_BENCHMARKS 32
+//! Exit status when the baseline can't be compared with this build
+//! (SKIP_RETURN_CODE of the ctest test)
+#define PERF_SKIPPED 77
+
+// CMAKE_BUILD_TYPE of the library: the ratios depend on the optimizations
+#ifndef V2P_BUILD_TYPE
+  #define V2P_BUILD_TYPE "None"
+#endif
+
+// Monotonic time in seconds
+static double __now(void) {
+#if defined _WIN32 || defined _WIN64
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (double)counter.QuadPart / frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Deterministic inputs
+static uint32_t __random(uint32_t* state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+static float __uniform(uint32_t* state, float low, float high) {
+  return low + (high - low) * (__random(state) / 16777216.f);
+}
+
+// A sung glide with harmonics
+static void __glide(float* out, unsigned int size, float sampling_rate) {
+  double phase = 0;
+  for (unsigned int i = 0; i < size; i++) {
+    const double t = i / sampling_rate;
+    phase += 2 * M_PI * (180 + 120 * sin(2 * M_PI * 0.2 * t)) / sampling_rate;
+    const bool pause = fmod(t, 2.5) > 2.2;
+    out[i] = pause ? 0.f : (float)(0.6 * sin(phase) + 0.25 * sin(2 * phase) + 0.1 * sin(3 * phase));
+  }
+}
+
+//
+// Benchmarks
+//
+// A benchmark prepares its inputs (setup), runs an iteration of the code
+// timed (run) and frees its inputs (teardown).
+//
+
+struct benchmark {
+  const char* name;
+  void* (*setup)(unsigned int param);
+  void (*run)(void* state);
+  void (*teardown)(void* state);
+  unsigned int param;
+  //! Number of iterations per batch, 0 to run PERF_BATCH_SECONDS
+  unsigned int nb_iterations;
+  //! Number of batches, 0 for PERF_NB_BATCHES
+  unsigned int nb_batches;
+};
+
+// Calibration: a dependent chain of float operations over a small array
+struct calibration_state {
+  float values[256];
+  volatile float sink;
+};
+
+static void* __calibration_setup(unsigned int param) {
+  (void)param;
+  struct calibration_state* state = malloc(sizeof(*state));
+  uint32_t random = 1;
+  for (unsigned int i = 0; i < 256; i++)
+    state->values[i] = __uniform(&random, 0.5f, 1.5f);
+  return state;
+}
+
+static void __calibration_run(void* arg) {
+  struct calibration_state* state = arg;
+  float accumulator = 0;
+  for (unsigned int j = 0; j < 4; j++)
+    for (unsigned int i = 0; i < 256; i++)
+      accumulator = accumulator * 0.999f + state->values[i] * state->values[(i * 7) & 255];
+  state->sink = accumulator;
+}
+
+// FFT: forward and inverse real transform of param floats
+struct fft_state {
+  const fft_plan_t* plan;
+  float* data;
+  float* scratch;
+};
+
+static void* __fft_setup(unsigned int param) {
+  struct fft_state* state = malloc(sizeof(*state));
+  state->plan = fft_plan_acquire(param);
+  state->data = malloc(sizeof(float) * param);
+  state->scratch = malloc(sizeof(float) * (fft_plan_scratch_size(state->plan) + 1));
+  uint32_t random = 2;
+  for (unsigned int i = 0; i < param; i++)
+    state->data[i] = __uniform(&random, -1, 1);
+  return state;
+}
+
+static void __fft_run(void* arg) {
+  struct fft_state* state = arg;
+  fft_plan_realft(state->plan, state->data, state->scratch, FFT_FORWARD);
+  fft_plan_realft(state->plan, state->data, state->scratch, FFT_INVERSE);
+  // Keep the values bounded
+  const float scale = 2.f / fft_plan_size(state->plan);
+  for (unsigned int i = 0; i < fft_plan_size(state->plan); i++)
+    state->data[i] *= scale;
+}
+
+static void __fft_teardown(void* arg) {
+  struct fft_state* state = arg;
+  fft_plan_release(state->plan);
+  free(state->data);
+  free(state->scratch);
+  free(state);
+}
+
+// Boersma: candidates of a frame of param samples
+struct boersma_state {
+  pitch_analyzer_t* s;
+  algorithm_descriptor_boersma_t* ad;
+  float* audio;
+  unsigned int nb_frames;
+  unsigned int frame;
+};
+
+static void* __boersma_setup(unsigned int param) {
+  struct boersma_state* state = calloc(1, sizeof(*state));
+  state->s = v2p_new(0);
+  state->ad = boersma_new(param, 4);
+  v2p_register_algorithm(state->s, (algorithm_descriptor_t*)state->ad);
+  v2p_reset(state->s);
+  const unsigned int size = 48000;
+  state->audio = malloc(sizeof(float) * size);
+  __glide(state->audio, size, 48000);
+  // Sets the global peak
+  v2p_add_samples(state->s, state->audio, size);
+  state->nb_frames = (size - param) / 480;
+  return state;
+}
+
+static void __boersma_run(void* arg) {
+  struct boersma_state* state = arg;
+  float frequency[16], weight[16];
+  struct candidate_slice out = { frequency, weight, NULL, state->ad->parent.nb_candidates_per_step };
+  spectral_context_next_step(state->s->spectrum);
+  emit_boersma_candidates(state->s, state->ad, state->audio + state->frame * 480, &out);
+  state->frame = (state->frame + 1) % state->nb_frames;
+}
+
+static void __boersma_teardown(void* arg) {
+  struct boersma_state* state = arg;
+  v2p_delete(state->s);
+  boersma_delete(state->ad);
+  free(state->audio);
+  free(state);
+}
+
+// Viterbi: a timestep of param candidates
+struct viterbi_state {
+  pitch_analyzer_t* s;
+  float* frequency;
+  float* weight;
+  float* log2_frequency;
+  float* path_costs;
+  float* next_path_costs;
+  float* costs;
+  unsigned int* path_indexes;
+  unsigned int size;
+  unsigned int nb_steps;
+  unsigned int step;
+};
+
+static void* __viterbi_setup(unsigned int param) {
+  struct viterbi_state* state = calloc(1, sizeof(*state));
+  state->s = v2p_new(0);
+  state->size = param;
+  state->nb_steps = 64;
+  const unsigned int size = param * state->nb_steps;
+  state->frequency = malloc(sizeof(float) * size);
+  state->weight = malloc(sizeof(float) * size);
+  state->log2_frequency = malloc(sizeof(float) * size);
+  uint32_t random = 3;
+  for (unsigned int i = 0; i < size; i++) {
+    // A candidate out of 5 is unvoiced
+    state->frequency[i] = i % 5 == 4 ? 0 : __uniform(&random, 80, 800);
+    state->weight[i] = __uniform(&random, 0, 1);
+    state->log2_frequency[i] = state->frequency[i] ? log2f(state->frequency[i]) : 0;
+  }
+  state->path_costs = calloc(param, sizeof(float));
+  state->next_path_costs = calloc(param, sizeof(float));
+  state->costs = malloc(sizeof(float) * param);
+  state->path_indexes = malloc(sizeof(unsigned int) * param);
+  return state;
+}
+
+static void __viterbi_slice(struct viterbi_state* state, unsigned int step,
+  unsigned int size, struct candidate_slice* slice) {
+  slice->frequency = state->frequency + step * size;
+  slice->weight = state->weight + step * size;
+  slice->log2_frequency = state->log2_frequency + step * size;
+  slice->size = size;
+}
+
+static void __viterbi_run(void* arg) {
+  struct viterbi_state* state = arg;
+  struct candidate_slice previous, current;
+  __viterbi_slice(state, state->step, state->size, &previous);
+  state->step = (state->step + 1) % state->nb_steps;
+  __viterbi_slice(state, state->step, state->size, &current);
+  viterbi_step(state->s, state->path_costs, &previous, &current, state->costs,
+    state->next_path_costs, state->path_indexes);
+  symp_swap(state->path_costs, state->next_path_costs);
+}
+
+static void __viterbi_teardown(void* arg) {
+  struct viterbi_state* state = arg;
+  v2p_delete(state->s);
+  free(state->frequency);
+  free(state->weight);
+  free(state->log2_frequency);
+  free(state->path_costs);
+  free(state->next_path_costs);
+  free(state->costs);
+  free(state->path_indexes);
+  free(state);
+}
+
+// Median filter of a path of param values
+struct median_state {
+  float* path;
+  unsigned int length;
+};
+
+static void* __median_setup(unsigned int param) {
+  struct median_state* state = malloc(sizeof(*state));
+  state->length = param;
+  state->path = malloc(sizeof(float) * param);
+  uint32_t random = 4;
+  for (unsigned int i = 0; i < param; i++)
+    state->path[i] = i % 50 < 5 ? 0 : __uniform(&random, 100, 400);
+  return state;
+}
+
+static void __median_run(void* arg) {
+  struct median_state* state = arg;
+  v2p_ptr_free(median_filter(state->path, state->length, 5));
+}
+
+static void __median_teardown(void* arg) {
+  struct median_state* state = arg;
+  free(state->path);
+  free(state);
+}
+
+// End to end: param seconds of audio analyzed with maxfreq, boersma and
+// boersma_unvoiced, and the path computed
+struct pipeline_state {
+  float* audio;
+  unsigned int size;
+};
+
+static void* __pipeline_setup(unsigned int param) {
+  struct pipeline_state* state = malloc(sizeof(*state));
+  state->size = param * 48000;
+  state->audio = malloc(sizeof(float) * state->size);
+  __glide(state->audio, state->size, 48000);
+  return state;
+}
+
+static void __pipeline_run(void* arg) {
+  struct pipeline_state* state = arg;
+  pitch_analyzer_t* s = v2p_new(0);
+  algorithm_descriptor_maxfreq_t* adm = maxfreq_new(2048);
+  algorithm_descriptor_boersma_unvoiced_t* adu = boersma_unvoiced_new(2048);
+  algorithm_descriptor_boersma_t* adb = boersma_new(2048, 0);
+  v2p_register_algorithm(s, (algorithm_descriptor_t*)adm);
+  v2p_register_algorithm(s, (algorithm_descriptor_t*)adu);
+  v2p_register_algorithm(s, (algorithm_descriptor_t*)adb);
+  v2p_reset(s);
+  v2p_run(s, state->audio, state->size);
+  v2p_ptr_free(v2p_compute_path(s));
+  v2p_delete(s);
+  maxfreq_delete(adm);
+  boersma_unvoiced_delete(adu);
+  boersma_delete(adb);
+}
+
+static void __pipeline_teardown(void* arg) {
+  struct pipeline_state* state = arg;
+  free(state->audio);
+  free(state);
+}
+
+static const struct benchmark __calibration = {
+  "calibration", __calibration_setup, __calibration_run, free, 0, 0, 0
+};
+
+static const struct benchmark __benchmarks[] = {
+  { "fft_256", __fft_setup, __fft_run, __fft_teardown, 256, 0, 0 },
+  { "fft_1024", __fft_setup, __fft_run, __fft_teardown, 1024, 0, 0 },
+  { "fft_4096", __fft_setup, __fft_run, __fft_teardown, 4096, 0, 0 },
+  // Mixed radix plan (1500 = 2^2 * 3 * 5^3)
+  { "fft_3000", __fft_setup, __fft_run, __fft_teardown, 3000, 0, 0 },
+  { "boersma_frame_1024", __boersma_setup, __boersma_run, __boersma_teardown, 1024, 0, 0 },
+  { "boersma_frame_2048", __boersma_setup, __boersma_run, __boersma_teardown, 2048, 0, 0 },
+  { "viterbi_step_k5", __viterbi_setup, __viterbi_run, __viterbi_teardown, 5, 0, 0 },
+  { "viterbi_step_k15", __viterbi_setup, __viterbi_run, __viterbi_teardown, 15, 0, 0 },
+  { "median_filter_10000", __median_setup, __median_run, __median_teardown, 10000, 0, 0 },
+  // Real-time factor on 60s of audio: a run per batch
+  { "pipeline_60s", __pipeline_setup, __pipeline_run, __pipeline_teardown, 60, 1, 2 }
+};
+#define PERF_NB_BENCHMARKS (sizeof(__benchmarks) / sizeof(*__benchmarks))
+
+// Time of an iteration in seconds: the fastest of the batches
+static double __measure(const struct benchmark* benchmark) {
+  void* state = benchmark->setup(benchmark->param);
+  // Warm-up, and number of iterations of a batch
+  unsigned int nb_iterations = benchmark->nb_iterations;
+  if (!nb_iterations) {
+    nb_iterations = 1;
+    for (;;) {
+      const double start = __now();
+      for (unsigned int i = 0; i < nb_iterations; i++)
+        benchmark->run(state);
+      const double elapsed = __now() - start;
+      if (elapsed >= PERF_BATCH_SECONDS / 4)
+        break;
+      nb_iterations *= 4;
+    }
+    nb_iterations *= 4;
+  }
+  else
+    benchmark->run(state);
+
+  double best = INFINITY;
+  const unsigned int nb_batches = benchmark->nb_batches ? benchmark->nb_batches : PERF_NB_BATCHES;
+  for (unsigned int batch = 0; batch < nb_batches; batch++) {
+    const double start = __now();
+    for (unsigned int i = 0; i < nb_iterations; i++)
+      benchmark->run(state);
+    const double elapsed = (__now() - start) / nb_iterations;
+    if (elapsed < best)
+      best = elapsed;
+  }
+  benchmark->teardown(state);
+  return best;
+}
+
+//
+// Baseline
+//
+
+struct baseline_entry {
+  char name[64];
+  double ratio;
+  double tolerance;
+};
+
+struct baseline {
+  char build[32];
+  double calibration_ns;
+  struct baseline_entry entries[PERF_MAX_BENCHMARKS];
+  unsigned int nb_entries;
+};
+
+// Number following "key": in text, or NAN
+static double __json_number(const char* text, const char* key) {
+  const char* found = strstr(text, key);
+  if (!found)
+    return NAN;
+  found = strchr(found + strlen(key), ':');
+  return found ? strtod(found + 1, NULL) : NAN;
+}
+
+// Read a baseline written by __baseline_write: an entry per line
+static bool __baseline_read(struct baseline* baseline, const char* path) {
+  memset(baseline, 0, sizeof(*baseline));
+  FILE* file = fopen(path, "r");
+  if (!file)
+    return false;
+  char line[512];
+  while (fgets(line, sizeof(line), file)) {
+    if (strstr(line, "\"calibration_ns\""))
+      baseline->calibration_ns = __json_number(line, "\"calibration_ns\"");
+    const char* build = strstr(line, "\"build\"");
+    if (build)
+      sscanf(build, "\"build\" : \"%31[^\"]\"", baseline->build);
+    const char* name = strstr(line, "\"name\"");
+    if (!name || baseline->nb_entries == PERF_MAX_BENCHMARKS)
+      continue;
+    struct baseline_entry* entry = &baseline->entries[baseline->nb_entries];
+    if (sscanf(name, "\"name\" : \"%63[^\"]\"", entry->name) != 1)
+      continue;
+    entry->ratio = __json_number(line, "\"ratio\"");
+    entry->tolerance = __json_number(line, "\"tolerance\"");
+    if (isnan(entry->tolerance))
+      entry->tolerance = PERF_DEFAULT_TOLERANCE;
+    if (!isnan(entry->ratio))
+      baseline->nb_entries++;
+  }
+  fclose(file);
+  return true;
+}
+
+static const struct baseline_entry* __baseline_find(const struct baseline* baseline,
+  const char* name) {
+  for (unsigned int i = 0; i < baseline->nb_entries; i++)
+    if (!strcmp(baseline->entries[i].name, name))
+      return &baseline->entries[i];
+  return NULL;
+}
+
+static bool __baseline_write(const struct baseline* baseline, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file)
+    return false;
+  fprintf(file, "{\"build\": \"%s\", \"calibration_ns\": %.1f, \"benchmarks\": [\n",
+    baseline->build, baseline->calibration_ns);
+  for (unsigned int i = 0; i < baseline->nb_entries; i++) {
+    const struct baseline_entry* entry = &baseline->entries[i];
+    fprintf(file, "  {\"name\": \"%s\", \"ratio\": %.4g, \"tolerance\": %.2f}%s\n", entry->name,
+      entry->ratio, entry->tolerance, i + 1 < baseline->nb_entries ? "," : "");
+  }
+  fprintf(file, "]}\n");
+  return fclose(file) == 0;
+}
+
+//
+// Main
+//
+
+static int __usage(const char* program) {
+  fprintf(stderr, "usage: %s [-b baseline.json] [-w baseline.json] [-f filter]\n", program);
+  return 2;
+}
+
+// Human readable time
+static void __print_time(double seconds) {
+  if (seconds >= 1)
+    printf("%9.2f s ", seconds);
+  else if (seconds >= 1e-3)
+    printf("%9.2f ms", seconds * 1e3);
+  else
+    printf("%9.2f us", seconds * 1e6);
+}
+
+int main(int argc, char** argv) {
+  const char* baseline_path = NULL;
+  const char* write_path = NULL;
+  const char* filter = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-b") && i + 1 < argc)
+      baseline_path = argv[++i];
+    else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+      write_path = argv[++i];
+    else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+      filter = argv[++i];
+    else
+      return __usage(argv[0]);
+  }
+
+  struct baseline baseline, measured;
+  memset(&measured, 0, sizeof(measured));
+  if (baseline_path && !__baseline_read(&baseline, baseline_path)) {
+    fprintf(stderr, "%s: can't be read\n", baseline_path);
+    return 2;
+  }
+  // The tolerances are kept when the baseline is written again
+  if (!baseline_path && !(write_path && __baseline_read(&baseline, write_path)))
+    memset(&baseline, 0, sizeof(baseline));
+
+  snprintf(measured.build, sizeof(measured.build), "%s", V2P_BUILD_TYPE);
+  // The ratios of another build can't be compared
+  const bool comparable = baseline_path && !strcmp(baseline.build, measured.build);
+  if (baseline_path && !comparable) {
+    printf("%s: recorded with a %s build, this one is a %s build: skipped\n", baseline_path,
+      baseline.build[0] ? baseline.build : "unknown", measured.build);
+    return PERF_SKIPPED;
+  }
+
+  measured.calibration_ns = __measure(&__calibration) * 1e9;
+  printf("calibration: %.1f ns", measured.calibration_ns);
+  if (baseline.calibration_ns > 0)
+    printf(" (baseline %.1f ns: this machine is %.2fx as fast)", baseline.calibration_ns,
+      baseline.calibration_ns / measured.calibration_ns);
+  printf("\n\n%-22s %12s %10s %10s %9s %10s\n", "benchmark", "time", "ratio", "baseline",
+    "change", "tolerance");
+
+  unsigned int nb_slower = 0;
+  for (unsigned int i = 0; i < PERF_NB_BENCHMARKS; i++) {
+    const struct benchmark* benchmark = &__benchmarks[i];
+    if (filter && !strstr(benchmark->name, filter))
+      continue;
+    const struct baseline_entry* expected = __baseline_find(&baseline, benchmark->name);
+    const double tolerance = expected ? expected->tolerance : PERF_DEFAULT_TOLERANCE;
+
+    // The calibration is measured again next to each attempt, so that both
+    // see the same state of the machine
+    double seconds = INFINITY, ratio = INFINITY;
+    for (unsigned int attempt = 0; attempt < PERF_NB_ATTEMPTS; attempt++) {
+      const double attempt_seconds = __measure(benchmark);
+      const double attempt_ratio = attempt_seconds / __measure(&__calibration);
+      if (attempt_ratio < ratio) {
+        seconds = attempt_seconds;
+        ratio = attempt_ratio;
+      }
+      if (!comparable || !expected || ratio / expected->ratio - 1 <= tolerance)
+        break;
+    }
+
+    struct baseline_entry* entry = &measured.entries[measured.nb_entries++];
+    snprintf(entry->name, sizeof(entry->name), "%s", benchmark->name);
+    entry->ratio = ratio;
+    entry->tolerance = tolerance;
+
+    printf("%-22s ", benchmark->name);
+    __print_time(seconds);
+    printf(" %10.4g", ratio);
+    if (!expected) {
+      printf(" %10s\n", "new");
+      continue;
+    }
+    const double change = ratio / expected->ratio - 1;
+    const bool slower = comparable && change > tolerance;
+    nb_slower += slower;
+    printf(" %10.4g %+8.1f%% %9.0f%%%s\n", expected->ratio, change * 100, tolerance * 100,
+      slower ? "  SLOWER" : change > tolerance ? "  slower" : change < -tolerance ? "  faster" : "");
+  }
+  if (baseline_path)
+    for (unsigned int i = 0; i < baseline.nb_entries; i++)
+      if (!filter && !__baseline_find(&measured, baseline.entries[i].name))
+        printf("%-22s %12s\n", baseline.entries[i].name, "missing");
+
+  if (write_path) {
+    if (!__baseline_write(&measured, write_path)) {
+      fprintf(stderr, "%s: can't be written\n", write_path);
+      return 2;
+    }
+    printf("\nbaseline written to %s\n", write_path);
+  }
+  if (nb_slower) {
+    printf("\n%u benchmark%s slower than the baseline beyond the tolerance\n", nb_slower,
+      nb_slower > 1 ? "s" : "");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,349 @@
+// Soak benchmark: stream hours of synthesized singing through an analyzer.
+//
+// Usage: v2p-soak [-d duration] [-i interval] [-b block_size] [-r sampling_rate]
+//                 [-f frame_size] [-k] [-p path_interval] [-o soak.csv]
+//
+// The audio is generated block after block, so that its length isn't
+// limited by the memory: notes of various lengths and loudness, glides
+// between them, vibrato, pauses and a little noise. It's given to
+// v2p_add_samples by blocks of block_size samples, or by blocks of sizes
+// drawn among the usual audio callback sizes (128 to 2048) if block_size is
+// 0. The analyzer runs maxfreq, boersma and boersma_unvoiced, as
+// python/v2p/boersma.py does.
+//
+// Every interval of audio, a row is appended to the CSV time series:
+//   audio_seconds       audio analyzed so far
+//   wall_seconds        time spent so far, generation of the audio excluded
+//   timesteps           timesteps analyzed so far
+//   frames_per_second   timesteps per second of analysis over the interval
+//   latency_p50_us, latency_p90_us, latency_p99_us, latency_max_us
+//                       time spent in v2p_add_samples per block over the interval
+//   path_ms             time of the last v2p_compute_path (with -p)
+//   rss_bytes           resident memory of the process
+//   analyzer_bytes      memory held by the analyzer (v2p_memory_usage)
+//   analyzer_peak_bytes its high-water mark
+// The rows of two versions of the library can be plotted against each other:
+// a throughput which decreases or a memory which grows along the stream
+// points at work or storage proportional to the length of the stream.
+//
+// The durations are in seconds, or suffixed by m (minutes) or h (hours).
+// Defaults: 1h of audio, a row per minute, blocks of random sizes, 48kHz,
+// frames of 2048 samples, the consumed samples are discarded (-k keeps
+// them), the path isn't computed (-p computes it every path_interval).
+
+#if !defined _WIN32 && !defined _WIN64
+  #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "v2p.h"
+#include "boersma.h"
+#include "maxfreq.h"
+#include "tools.h"
+#include "stretchy_buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined _WIN32 || defined _WIN64
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+  #include <time.h>
+  #include <unistd.h>
+#endif
+
+//! Largest block given to v2p_add_samples
+#define SOAK_MAX_BLOCK_SIZE 8192
+
+// Monotonic time in seconds
+static double __now(void) {
+#if defined _WIN32 || defined _WIN64
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (double)counter.QuadPart / frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Resident memory of the process, in bytes. Where the current value isn't
+// available, the peak is returned.
+static size_t __rss(void) {
+#if defined _WIN32 || defined _WIN64
+  PROCESS_MEMORY_COUNTERS counters;
+  GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+  return counters.WorkingSetSize;
+#else
+  #if defined __linux__
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file) {
+      unsigned long size, resident;
+      const int nb_read = fscanf(file, "%lu %lu", &size, &resident);
+      fclose(file);
+      if (nb_read == 2)
+        return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+    }
+  #endif
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  #if defined __APPLE__
+    return (size_t)usage.ru_maxrss;
+  #else
+    return (size_t)usage.ru_maxrss * 1024;
+  #endif
+#endif
+}
+
+//
+// Synthesized audio
+//
+
+// Deterministic generator, so that the runs of two versions analyze the
+// same audio
+static uint32_t __random(uint32_t* state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+// Uniform in [low, high)
+static double __uniform(uint32_t* state, double low, double high) {
+  return low + (high - low) * (__random(state) / 16777216.);
+}
+
+struct singer {
+  uint32_t random;
+  double sampling_rate;
+  double phase;
+  double vibrato_phase;
+  // Current note: pitch (midi), amplitude, and remaining samples
+  double note;
+  double amplitude;
+  unsigned int remaining;
+  // The pitch goes from previous_note to note during the glide
+  double previous_note;
+  unsigned int glide_length;
+  unsigned int position;
+  bool pause;
+};
+
+static void __singer_init(struct singer* singer, double sampling_rate) {
+  memset(singer, 0, sizeof(*singer));
+  singer->random = 0x5eed;
+  singer->sampling_rate = sampling_rate;
+  singer->note = singer->previous_note = 57;
+}
+
+static void __singer_next_note(struct singer* singer) {
+  uint32_t* r = &singer->random;
+  singer->previous_note = singer->note;
+  singer->position = 0;
+  // A pause after one note out of 8
+  singer->pause = !singer->pause && __random(r) % 8 == 0;
+  const double seconds = singer->pause ? __uniform(r, 0.1, 1.5) : __uniform(r, 0.08, 1.6);
+  singer->remaining = (unsigned int)(seconds * singer->sampling_rate);
+  if (singer->pause)
+    return;
+  // Steps of a few semitones around the middle of the voice
+  singer->note = _min(_max(singer->note + (int)(__random(r) % 11) - 5, 40), 79);
+  singer->amplitude = __uniform(r, 0.05, 0.9);
+  singer->glide_length = (unsigned int)(__uniform(r, 0.01, 0.08) * singer->sampling_rate);
+}
+
+static void __singer_generate(struct singer* singer, float* out, unsigned int size) {
+  for (unsigned int i = 0; i < size; i++) {
+    if (!singer->remaining)
+      __singer_next_note(singer);
+    singer->remaining--;
+    const double noise = __uniform(&singer->random, -1e-3, 1e-3);
+    if (singer->pause) {
+      out[i] = (float)noise;
+      continue;
+    }
+    const double glide = singer->position < singer->glide_length ?
+      (double)singer->position / singer->glide_length : 1;
+    singer->position++;
+    singer->vibrato_phase += 2 * M_PI * 5.5 / singer->sampling_rate;
+    const double note = singer->previous_note + (singer->note - singer->previous_note) * glide +
+      0.3 * sin(singer->vibrato_phase);
+    const double frequency = 440 * pow(2, (note - 69) / 12);
+    singer->phase = fmod(singer->phase + 2 * M_PI * frequency / singer->sampling_rate, 2 * M_PI);
+    out[i] = (float)(singer->amplitude * (0.6 * sin(singer->phase) + 0.25 * sin(2 * singer->phase) +
+      0.1 * sin(3 * singer->phase)) + noise);
+  }
+}
+
+//
+// Statistics
+//
+
+static int __cmp_doubles(const void* a, const void* b) {
+  const double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// Percentile of sorted values
+static double __percentile(const double* values, unsigned int nb_values, double percent) {
+  if (!nb_values)
+    return 0;
+  const unsigned int i = (unsigned int)(percent / 100 * (nb_values - 1) + 0.5);
+  return values[i];
+}
+
+// Duration in seconds, minutes (m) or hours (h)
+static double __parse_duration(const char* text) {
+  char* end;
+  const double value = strtod(text, &end);
+  if (*end == 'h')
+    return value * 3600;
+  if (*end == 'm')
+    return value * 60;
+  return *end ? -1 : value;
+}
+
+static int __usage(const char* program) {
+  fprintf(stderr, "usage: %s [-d duration] [-i interval] [-b block_size] [-r sampling_rate]\n"
+    "       [-f frame_size] [-k] [-p path_interval] [-o soak.csv]\n", program);
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  double duration = 3600;
+  double interval = 60;
+  double path_interval = 0;
+  unsigned int block_size = 0;
+  float sampling_rate = 48000;
+  unsigned int frame_size = 2048;
+  bool keep_samples = false;
+  const char* output_path = "soak.csv";
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-d") && i + 1 < argc)
+      duration = __parse_duration(argv[++i]);
+    else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+      interval = __parse_duration(argv[++i]);
+    else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+      path_interval = __parse_duration(argv[++i]);
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+      block_size = (unsigned int)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      sampling_rate = (float)atof(argv[++i]);
+    else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+      frame_size = (unsigned int)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-k"))
+      keep_samples = true;
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+      output_path = argv[++i];
+    else
+      return __usage(argv[0]);
+  }
+  if (duration <= 0 || interval <= 0 || path_interval < 0 || sampling_rate <= 0 ||
+      block_size > SOAK_MAX_BLOCK_SIZE || !frame_size)
+    return __usage(argv[0]);
+
+  FILE* output = fopen(output_path, "w");
+  if (!output) {
+    fprintf(stderr, "%s: can't be written\n", output_path);
+    return 1;
+  }
+  fprintf(output, "audio_seconds,wall_seconds,timesteps,frames_per_second,latency_p50_us,"
+    "latency_p90_us,latency_p99_us,latency_max_us,path_ms,rss_bytes,analyzer_bytes,"
+    "analyzer_peak_bytes\n");
+  fprintf(stderr, "v2p-soak: %.0fs of audio at %.0fHz, frames of %u samples, consumed samples %s\n",
+    duration, sampling_rate, frame_size, keep_samples ? "kept" : "discarded");
+
+  pitch_analyzer_t* s = v2p_new(0);
+  s->sampling_rate = sampling_rate;
+  s->discard_consumed_samples = !keep_samples;
+  algorithm_descriptor_maxfreq_t* adm = maxfreq_new(frame_size);
+  algorithm_descriptor_boersma_unvoiced_t* adu = boersma_unvoiced_new(frame_size);
+  algorithm_descriptor_boersma_t* adb = boersma_new(frame_size, 0);
+  v2p_register_algorithm(s, (algorithm_descriptor_t*)adm);
+  v2p_register_algorithm(s, (algorithm_descriptor_t*)adu);
+  v2p_register_algorithm(s, (algorithm_descriptor_t*)adb);
+  v2p_reset(s);
+
+  struct singer singer;
+  __singer_init(&singer, sampling_rate);
+  uint32_t block_random = 0xb10c;
+  const unsigned int block_sizes[] = { 128, 256, 441, 480, 512, 1024, 2048 };
+  float* block = malloc(sizeof(*block) * SOAK_MAX_BLOCK_SIZE);
+  // Latencies of the blocks of the current interval, in seconds
+  double* latencies = NULL;
+
+  const uint64_t nb_samples = (uint64_t)(duration * sampling_rate);
+  const uint64_t interval_samples = _max((uint64_t)(interval * sampling_rate), 1);
+  const uint64_t path_samples = (uint64_t)(path_interval * sampling_rate);
+  uint64_t position = 0;
+  uint64_t next_row = interval_samples;
+  uint64_t next_path = path_samples ? path_samples : UINT64_MAX;
+  double wall_seconds = 0;
+  double interval_seconds = 0;
+  double path_seconds = 0;
+  unsigned int interval_first_timestep = 0;
+  while (position < nb_samples) {
+    unsigned int size = block_size ? block_size :
+      block_sizes[__random(&block_random) % (sizeof(block_sizes) / sizeof(*block_sizes))];
+    if (size > nb_samples - position)
+      size = (unsigned int)(nb_samples - position);
+    __singer_generate(&singer, block, size);
+
+    const double start = __now();
+    v2p_add_samples(s, block, size);
+    const double latency = __now() - start;
+    sb_push(latencies, latency);
+    interval_seconds += latency;
+    position += size;
+
+    // The path is computed as an application would show it
+    if (position >= next_path) {
+      const double path_start = __now();
+      v2p_ptr_free(v2p_compute_path(s));
+      path_seconds = __now() - path_start;
+      interval_seconds += path_seconds;
+      next_path += path_samples;
+    }
+
+    if (position >= next_row || position == nb_samples) {
+      wall_seconds += interval_seconds;
+      const unsigned int nb_latencies = sb_count(latencies);
+      qsort(latencies, nb_latencies, sizeof(*latencies), __cmp_doubles);
+      struct v2p_memory_report report;
+      v2p_memory_usage(s, &report);
+      const unsigned int nb_timesteps = s->number_of_timesteps - interval_first_timestep;
+      fprintf(output, "%.2f,%.3f,%u,%.1f,%.1f,%.1f,%.1f,%.1f,%.3f,%zu,%zu,%zu\n",
+        position / sampling_rate, wall_seconds, s->number_of_timesteps,
+        interval_seconds > 0 ? nb_timesteps / interval_seconds : 0,
+        __percentile(latencies, nb_latencies, 50) * 1e6,
+        __percentile(latencies, nb_latencies, 90) * 1e6,
+        __percentile(latencies, nb_latencies, 99) * 1e6,
+        nb_latencies ? latencies[nb_latencies - 1] * 1e6 : 0,
+        path_seconds * 1e3, __rss(), report.total.capacity, report.peak);
+      fflush(output);
+      fprintf(stderr, "\r%.0f/%.0fs of audio, %.0f frames/s", position / sampling_rate, duration,
+        interval_seconds > 0 ? nb_timesteps / interval_seconds : 0);
+
+      stb__sbn(latencies) = 0;
+      interval_seconds = 0;
+      interval_first_timestep = s->number_of_timesteps;
+      next_row += interval_samples;
+    }
+  }
+  fprintf(stderr, "\nv2p-soak: %u timesteps in %.1fs (%.0f frames/s), %s written\n",
+    s->number_of_timesteps, wall_seconds,
+    wall_seconds > 0 ? s->number_of_timesteps / wall_seconds : 0, output_path);
+
+  fclose(output);
+  sb_free(latencies);
+  free(block);
+  v2p_delete(s);
+  maxfreq_delete(adm);
+  boersma_unvoiced_delete(adu);
+  boersma_delete(adb);
+  return 0;
+}
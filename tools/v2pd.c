@@ -0,0 +1,551 @@
+// Pitch analysis daemon: analyze the audio streamed by local clients.
+//
+// Usage: v2pd [-s socket] [-n nb_analyzers] [-r sampling_rate] [-f frame_size]
+//             [-l lag] [-m median_window] [-v]
+//
+// The analyzers are created and configured once, at startup: maxfreq,
+// boersma and boersma_unvoiced on frames of frame_size samples, as
+// python/v2p/boersma.py does. A connection takes one of them for its
+// lifetime, and gives it back reset when it's closed; the connections
+// beyond nb_analyzers are refused with V2PD_ERROR. Each connection is
+// served by its own thread, which analyzes the samples as soon as they're
+// received and answers with the pitch of the timesteps settled by them
+// and the notes finalized (see v2pd_protocol.h for the protocol).
+//
+// The notes are built as v2p-eval does: the pitch is converted to MIDI
+// numbers, filtered by a median of median_window timesteps, and segmented
+// by midi_numbers_to_notes. The segmentation runs again on the timesteps
+// settled since the last note sent, so that its cost stays proportional
+// to the length of the current note.
+//
+// Defaults: /tmp/v2pd.sock, 256 analyzers, 48kHz, frames of 2048 samples,
+// a lag of 20 timesteps and a median of 3. -v logs every connection.
+// SIGINT and SIGTERM close the connections and remove the socket.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "v2p.h"
+#include "boersma.h"
+#include "maxfreq.h"
+#include "midi.h"
+#include "tools.h"
+#include "sync.h"
+#include "stretchy_buffer.h"
+#include "v2pd_protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/un.h>
+
+//! Time between two checks of the signals by the accepting loop, in ms
+#define V2PD_POLL_INTERVAL 200
+//! Largest sampling rate accepted by V2PD_OPEN
+#define V2PD_MAX_SAMPLING_RATE 384000
+
+struct daemon_config {
+  const char* socket_path;
+  unsigned int nb_analyzers;
+  float sampling_rate;
+  unsigned int frame_size;
+  unsigned int lag;
+  unsigned int median_window;
+  bool verbose;
+};
+
+enum connection_state {
+  CONNECTION_FREE,
+  CONNECTION_RUNNING,
+  // The thread ended, but wasn't joined yet
+  CONNECTION_FINISHED
+};
+
+// A connection slot, with the analyzer it lends
+struct connection {
+  const struct daemon_config* config;
+  pitch_analyzer_t* s;
+  algorithm_descriptor_maxfreq_t* adm;
+  algorithm_descriptor_boersma_unvoiced_t* adu;
+  algorithm_descriptor_boersma_t* adb;
+
+  // Protected by the mutex of the pool
+  enum connection_state state;
+  int fd;
+  v2p_thread_t thread;
+
+  // Current stream: timesteps whose pitch was sent, and pitch settled
+  // since the end of the last note sent (starting at timestep notes_first)
+  unsigned int nb_frames_sent;
+  unsigned int notes_first;
+  sb_float settled;
+  // Buffers reused from a message to the next one
+  void* payload;
+  size_t payload_capacity;
+  sb_float frames;
+  struct v2pd_note* notes;
+
+  struct v2pd_stats stats;
+  double accepted_at;
+  // Latencies of the last V2PD_LATENCY_WINDOW audio messages, in seconds
+  float latencies[V2PD_LATENCY_WINDOW];
+  unsigned int nb_latencies;
+};
+
+static v2p_mutex_t pool_mutex = V2P_MUTEX_INITIALIZER;
+static unsigned int next_stream_id = 1;
+static volatile sig_atomic_t stopping = 0;
+
+// Monotonic time in seconds
+static double __now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void __on_signal(int signal) {
+  (void)signal;
+  stopping = 1;
+}
+
+//
+// Analyzers
+//
+
+static bool __connection_init(struct connection* c, const struct daemon_config* config) {
+  memset(c, 0, sizeof(*c));
+  c->config = config;
+  c->fd = -1;
+  c->s = v2p_new(0);
+  c->adm = maxfreq_new(config->frame_size);
+  c->adu = boersma_unvoiced_new(config->frame_size);
+  c->adb = boersma_new(config->frame_size, 0);
+  if (!c->s || !c->adm || !c->adu || !c->adb)
+    return false;
+  c->s->sampling_rate = config->sampling_rate;
+  c->s->discard_consumed_samples = 1;
+  v2p_register_algorithm(c->s, (algorithm_descriptor_t*)c->adm);
+  v2p_register_algorithm(c->s, (algorithm_descriptor_t*)c->adu);
+  v2p_register_algorithm(c->s, (algorithm_descriptor_t*)c->adb);
+  v2p_reset(c->s);
+  return true;
+}
+
+static void __connection_clear(struct connection* c) {
+  if (c->s)
+    v2p_delete(c->s);
+  if (c->adm)
+    maxfreq_delete(c->adm);
+  if (c->adu)
+    boersma_unvoiced_delete(c->adu);
+  if (c->adb)
+    boersma_delete(c->adb);
+  sb_free(c->settled);
+  sb_free(c->frames);
+  sb_free(c->notes);
+  free(c->payload);
+}
+
+// Start a new stream on the analyzer of the connection
+static void __open_stream(struct connection* c, float sampling_rate) {
+  c->stats.nb_timesteps += c->s->number_of_timesteps;
+  c->s->sampling_rate = sampling_rate;
+  v2p_mutex_lock(&pool_mutex);
+  c->s->stream_id = next_stream_id++;
+  v2p_mutex_unlock(&pool_mutex);
+  v2p_reset(c->s);
+  c->nb_frames_sent = 0;
+  c->notes_first = 0;
+  if (c->settled)
+    stb__sbn(c->settled) = 0;
+}
+
+//
+// Answers
+//
+
+static int __send_error(struct connection* c, const char* message) {
+  if (c->config->verbose)
+    fprintf(stderr, "v2pd: stream %u: %s\n", c->s->stream_id, message);
+  v2pd_send(c->fd, V2PD_ERROR, message, strlen(message), NULL, 0);
+  return -1;
+}
+
+// Send the notes found in the pitch settled so far. Unless the stream is
+// over, the last note is kept: it may go on with the next samples.
+static int __send_notes(struct connection* c, bool final) {
+  const unsigned int length = sb_count(c->settled);
+  const unsigned int median_window = c->config->median_window;
+  if (!length || (!final && length < median_window))
+    return 0;
+
+  float* numbers = pitch_to_midi_numbers(c->settled, length);
+  float* filtered = length >= median_window ? median_filter(numbers, length, median_window) : NULL;
+  unsigned int nb_notes = 0;
+  midi_note_data_t* notes = midi_numbers_to_notes(filtered ? filtered : numbers, length, &nb_notes);
+  const unsigned int nb_final = final ? nb_notes : nb_notes ? nb_notes - 1 : 0;
+
+  unsigned int end = 0;
+  if (c->notes)
+    stb__sbn(c->notes) = 0;
+  for (unsigned int i = 0; i < nb_final; i++) {
+    const unsigned int first = (unsigned int)lroundf(notes[i].position);
+    const unsigned int note_end = (unsigned int)lroundf(notes[i].position + notes[i].duration);
+    end = _max(end, note_end);
+    // Silences end the notes, but aren't sent
+    if (notes[i].note_number < 1)
+      continue;
+    const struct v2pd_note note = { c->notes_first + first, note_end - first, notes[i].note_number };
+    sb_push(c->notes, note);
+  }
+  v2p_ptr_free(numbers);
+  v2p_ptr_free(filtered);
+  v2p_ptr_free(notes);
+
+  const unsigned int nb_sent = sb_count(c->notes);
+  if (nb_sent && v2pd_send(c->fd, V2PD_NOTES, c->notes, nb_sent * sizeof(*c->notes), NULL, 0))
+    return -1;
+  c->stats.nb_notes_sent += nb_sent;
+
+  // The next notes start after the last one sent
+  if (final || end > length)
+    end = length;
+  memmove(c->settled, c->settled + end, (length - end) * sizeof(*c->settled));
+  stb__sbn(c->settled) = length - end;
+  c->notes_first += end;
+  return 0;
+}
+
+// Send the notes finalized and the pitch of the timesteps settled since
+// the last answer: the timesteps followed by `lag` others, or all of them
+// at the end of the stream.
+static int __send_settled(struct connection* c, bool final) {
+  pitch_analyzer_t* s = c->s;
+  const unsigned int nb_timesteps = v2p_path_len(s);
+  const unsigned int nb_pending = nb_timesteps > c->nb_frames_sent ?
+    nb_timesteps - c->nb_frames_sent : 0;
+  if (c->frames)
+    stb__sbn(c->frames) = 0;
+  float* frames = sb_add(c->frames, nb_pending + 1);
+
+  unsigned int nb_frames = 0;
+  if (!final) {
+    nb_frames = v2p_compute_path_lagged(s, c->nb_frames_sent, c->config->lag, frames);
+  } else if (nb_pending) {
+    float* path = v2p_compute_path(s);
+    if (!path)
+      return __send_error(c, "the path can't be computed");
+    memcpy(frames, path + c->nb_frames_sent, nb_pending * sizeof(*frames));
+    v2p_ptr_free(path);
+    nb_frames = nb_pending;
+  }
+
+  float* settled = sb_add(c->settled, nb_frames);
+  memcpy(settled, frames, nb_frames * sizeof(*frames));
+  if ((nb_frames || final) && __send_notes(c, final))
+    return -1;
+
+  const struct v2pd_pitch pitch = { c->nb_frames_sent, nb_frames };
+  if (v2pd_send(c->fd, V2PD_PITCH, &pitch, sizeof(pitch), frames, nb_frames * sizeof(*frames)))
+    return -1;
+  c->nb_frames_sent += nb_frames;
+  c->stats.nb_frames_sent += nb_frames;
+  return 0;
+}
+
+static int __cmp_floats(const void* a, const void* b) {
+  const float x = *(const float*)a, y = *(const float*)b;
+  return (x > y) - (x < y);
+}
+
+static int __send_stats(struct connection* c) {
+  struct v2pd_stats stats = c->stats;
+  stats.nb_timesteps += c->s->number_of_timesteps;
+  stats.connected_seconds = __now() - c->accepted_at;
+  stats.frames_per_second = stats.busy_seconds > 0 ? stats.nb_timesteps / stats.busy_seconds : 0;
+
+  const unsigned int nb_latencies = _min(c->nb_latencies, V2PD_LATENCY_WINDOW);
+  float sorted[V2PD_LATENCY_WINDOW];
+  memcpy(sorted, c->latencies, nb_latencies * sizeof(*sorted));
+  qsort(sorted, nb_latencies, sizeof(*sorted), __cmp_floats);
+  if (nb_latencies) {
+    stats.latency_p50_us = sorted[(unsigned int)(0.50 * (nb_latencies - 1) + 0.5)] * 1e6;
+    stats.latency_p90_us = sorted[(unsigned int)(0.90 * (nb_latencies - 1) + 0.5)] * 1e6;
+    stats.latency_p99_us = sorted[(unsigned int)(0.99 * (nb_latencies - 1) + 0.5)] * 1e6;
+  }
+
+  struct v2p_memory_report report;
+  v2p_memory_usage(c->s, &report);
+  stats.analyzer_bytes = report.total.capacity;
+  stats.analyzer_peak_bytes = report.peak;
+  return v2pd_send(c->fd, V2PD_STATS, &stats, sizeof(stats), NULL, 0);
+}
+
+//
+// Connections
+//
+
+// Read the payload of a message into the buffer of the connection
+static int __read_payload(struct connection* c, size_t size) {
+  if (size > c->payload_capacity) {
+    void* payload = realloc(c->payload, size);
+    if (!payload)
+      return -1;
+    c->payload = payload;
+    c->payload_capacity = size;
+  }
+  return size ? v2pd_read_all(c->fd, c->payload, size) : 0;
+}
+
+static int __on_audio(struct connection* c, size_t size) {
+  if (size % sizeof(float))
+    return __send_error(c, "the audio isn't made of floats");
+  const double start = __now();
+  const unsigned int nb_samples = (unsigned int)(size / sizeof(float));
+  if (v2p_add_samples(c->s, c->payload, nb_samples) != V2P_OK)
+    return __send_error(c, "the samples can't be analyzed");
+  if (__send_settled(c, false))
+    return -1;
+
+  const double latency = __now() - start;
+  c->latencies[c->nb_latencies++ % V2PD_LATENCY_WINDOW] = (float)latency;
+  c->stats.latency_max_us = _max(c->stats.latency_max_us, latency * 1e6);
+  c->stats.busy_seconds += latency;
+  c->stats.nb_samples += nb_samples;
+  c->stats.nb_audio_messages++;
+  return 0;
+}
+
+static int __on_open(struct connection* c, size_t size) {
+  if (size != sizeof(struct v2pd_open))
+    return __send_error(c, "V2PD_OPEN expects a struct v2pd_open");
+  const struct v2pd_open* open = c->payload;
+  const float sampling_rate = open->sampling_rate ? open->sampling_rate : c->config->sampling_rate;
+  if (!(sampling_rate > 0 && sampling_rate <= V2PD_MAX_SAMPLING_RATE))
+    return __send_error(c, "invalid sampling rate");
+  __open_stream(c, sampling_rate);
+  const struct v2pd_opened opened = {
+    c->s->sampling_rate, c->s->frame_time_step, c->config->lag, c->s->stream_id
+  };
+  return v2pd_send(c->fd, V2PD_OPENED, &opened, sizeof(opened), NULL, 0);
+}
+
+static int __on_flush(struct connection* c) {
+  const double start = __now();
+  if (__send_settled(c, true) || v2pd_send(c->fd, V2PD_DONE, NULL, 0, NULL, 0))
+    return -1;
+  c->stats.busy_seconds += __now() - start;
+  __open_stream(c, c->s->sampling_rate);
+  return 0;
+}
+
+static void __serve(struct connection* c) {
+  __open_stream(c, c->config->sampling_rate);
+  if (c->config->verbose)
+    fprintf(stderr, "v2pd: connection accepted, stream %u\n", c->s->stream_id);
+  for (;;) {
+    struct v2pd_header header;
+    if (v2pd_read_all(c->fd, &header, sizeof(header)))
+      return;
+    if (header.size > V2PD_MAX_PAYLOAD_SIZE) {
+      __send_error(c, "message too large");
+      return;
+    }
+    if (__read_payload(c, header.size))
+      return;
+
+    int status;
+    switch (header.type) {
+    case V2PD_OPEN:
+      status = __on_open(c, header.size);
+      break;
+    case V2PD_AUDIO:
+      status = __on_audio(c, header.size);
+      break;
+    case V2PD_FLUSH:
+      status = __on_flush(c);
+      break;
+    case V2PD_STATS:
+      status = __send_stats(c);
+      break;
+    default:
+      status = __send_error(c, "unknown message");
+      break;
+    }
+    if (status)
+      return;
+  }
+}
+
+static V2P_THREAD_ROUTINE(__connection_routine, arg) {
+  struct connection* c = arg;
+  __serve(c);
+  if (c->config->verbose)
+    fprintf(stderr, "v2pd: connection closed after %.1fs, %llu samples, %llu frames, %llu notes\n",
+      __now() - c->accepted_at, (unsigned long long)c->stats.nb_samples,
+      (unsigned long long)c->stats.nb_frames_sent, (unsigned long long)c->stats.nb_notes_sent);
+  // The analyzer is ready for the next connection
+  __open_stream(c, c->config->sampling_rate);
+  v2p_mutex_lock(&pool_mutex);
+  close(c->fd);
+  c->fd = -1;
+  c->state = CONNECTION_FINISHED;
+  v2p_mutex_unlock(&pool_mutex);
+  return V2P_THREAD_RETURN;
+}
+
+// Take a free connection slot for the socket fd
+static struct connection* __acquire(struct connection* connections, unsigned int nb_connections,
+  int fd) {
+  struct connection* c = NULL;
+  v2p_mutex_lock(&pool_mutex);
+  for (unsigned int i = 0; i < nb_connections; i++) {
+    if (connections[i].state == CONNECTION_FINISHED) {
+      // It's returning
+      v2p_thread_join(connections[i].thread);
+      connections[i].state = CONNECTION_FREE;
+    }
+    if (!c && connections[i].state == CONNECTION_FREE) {
+      c = &connections[i];
+      c->state = CONNECTION_RUNNING;
+      c->fd = fd;
+    }
+  }
+  v2p_mutex_unlock(&pool_mutex);
+  return c;
+}
+
+static int __listen(const char* path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "v2pd: %s: path too long\n", path);
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("v2pd: socket");
+    return -1;
+  }
+  // Socket left by a previous run
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) || listen(fd, SOMAXCONN)) {
+    fprintf(stderr, "v2pd: %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int __usage(const char* program) {
+  fprintf(stderr, "usage: %s [-s socket] [-n nb_analyzers] [-r sampling_rate] [-f frame_size]\n"
+    "       [-l lag] [-m median_window] [-v]\n", program);
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  struct daemon_config config = { V2PD_DEFAULT_SOCKET, 256, 48000, 2048, 20, 3, false };
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc)
+      config.socket_path = argv[++i];
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+      config.nb_analyzers = (unsigned int)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      config.sampling_rate = (float)atof(argv[++i]);
+    else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+      config.frame_size = (unsigned int)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+      config.lag = (unsigned int)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+      config.median_window = (unsigned int)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-v"))
+      config.verbose = true;
+    else
+      return __usage(argv[0]);
+  }
+  if (!config.nb_analyzers || !config.frame_size || !config.median_window ||
+      !(config.sampling_rate > 0 && config.sampling_rate <= V2PD_MAX_SAMPLING_RATE))
+    return __usage(argv[0]);
+
+  struct connection* connections = calloc(config.nb_analyzers, sizeof(*connections));
+  bool ok = connections != NULL;
+  for (unsigned int i = 0; ok && i < config.nb_analyzers; i++)
+    ok = __connection_init(&connections[i], &config);
+  const int listener = ok ? __listen(config.socket_path) : -1;
+  if (listener < 0) {
+    if (!ok)
+      fprintf(stderr, "v2pd: the analyzers can't be created\n");
+    for (unsigned int i = 0; connections && i < config.nb_analyzers; i++)
+      __connection_clear(&connections[i]);
+    free(connections);
+    return 1;
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = __on_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+  fprintf(stderr, "v2pd: listening on %s, %u analyzers at %.0fHz, frames of %u samples\n",
+    config.socket_path, config.nb_analyzers, config.sampling_rate, config.frame_size);
+
+  unsigned long nb_accepted = 0, nb_refused = 0;
+  while (!stopping) {
+    struct pollfd listening = { listener, POLLIN, 0 };
+    if (poll(&listening, 1, V2PD_POLL_INTERVAL) <= 0)
+      continue;
+    const int fd = accept(listener, NULL, NULL);
+    if (fd < 0)
+      continue;
+    struct connection* c = __acquire(connections, config.nb_analyzers, fd);
+    if (!c) {
+      const char* message = "no analyzer available";
+      v2pd_send(fd, V2PD_ERROR, message, strlen(message), NULL, 0);
+      close(fd);
+      nb_refused++;
+      continue;
+    }
+    memset(&c->stats, 0, sizeof(c->stats));
+    c->nb_latencies = 0;
+    c->accepted_at = __now();
+    if (v2p_thread_create(&c->thread, __connection_routine, c)) {
+      fprintf(stderr, "v2pd: the thread of a connection can't be created\n");
+      v2p_mutex_lock(&pool_mutex);
+      close(fd);
+      c->fd = -1;
+      c->state = CONNECTION_FREE;
+      v2p_mutex_unlock(&pool_mutex);
+      nb_refused++;
+      continue;
+    }
+    nb_accepted++;
+  }
+
+  // The reads of the connections fail from now on
+  close(listener);
+  unlink(config.socket_path);
+  v2p_mutex_lock(&pool_mutex);
+  for (unsigned int i = 0; i < config.nb_analyzers; i++)
+    if (connections[i].state == CONNECTION_RUNNING)
+      shutdown(connections[i].fd, SHUT_RDWR);
+  v2p_mutex_unlock(&pool_mutex);
+  for (unsigned int i = 0; i < config.nb_analyzers; i++) {
+    v2p_mutex_lock(&pool_mutex);
+    const bool joinable = connections[i].state != CONNECTION_FREE;
+    v2p_mutex_unlock(&pool_mutex);
+    if (joinable)
+      v2p_thread_join(connections[i].thread);
+    __connection_clear(&connections[i]);
+  }
+  free(connections);
+  fprintf(stderr, "v2pd: %lu connections served, %lu refused\n", nb_accepted, nb_refused);
+  return 0;
+}
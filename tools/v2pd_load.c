@@ -0,0 +1,316 @@
+// Load test of v2pd: stream audio to the daemon on many connections at once.
+//
+// Usage: v2pd-load [-s socket] [-c nb_connections] [-d duration] [-b block_size]
+//                  [-r sampling_rate] [-x speed]
+//
+// Each connection is served by its own thread, which streams duration
+// seconds of a melody (a note per half second, transposed by connection,
+// with a rest every fourth note) by blocks of block_size samples. The
+// blocks are sent at the pace of the audio times speed, or as fast as the
+// answers come with -x 0. The stream is then flushed, and the statistics
+// of the connection are requested.
+//
+// The pitch of every timestep must be received once, in order, and the
+// number of timesteps must match the one reported by the daemon: the
+// connections which don't are counted as failed.
+//
+// Reports the round trip latency of the audio blocks measured by the
+// clients (percentiles over all connections), the latency measured by the
+// daemon (worst p99 of the connections), the throughput and the frames
+// and notes received.
+//
+// Defaults: v2pd's socket, 200 connections, 10s of audio at 48kHz, blocks
+// of 480 samples (10ms), in real time.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "v2p.h"
+#include "tools.h"
+#include "sync.h"
+#include "stretchy_buffer.h"
+#include "v2pd_protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <sys/un.h>
+
+struct load_config {
+  const char* socket_path;
+  unsigned int nb_connections;
+  double duration;
+  unsigned int block_size;
+  float sampling_rate;
+  double speed;
+};
+
+// A connection and what it received
+struct stream {
+  const struct load_config* config;
+  unsigned int index;
+  v2p_thread_t thread;
+  bool ok;
+  char error[128];
+  // Round trip latencies of the audio blocks, in seconds
+  double* latencies;
+  uint64_t nb_frames;
+  uint64_t nb_notes;
+  struct v2pd_stats stats;
+};
+
+// Monotonic time in seconds
+static double __now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void __sleep_until(double deadline) {
+  const double remaining = deadline - __now();
+  if (remaining <= 0)
+    return;
+  struct timespec ts;
+  ts.tv_sec = (time_t)remaining;
+  ts.tv_nsec = (long)((remaining - ts.tv_sec) * 1e9);
+  while (nanosleep(&ts, &ts) && errno == EINTR)
+    ;
+}
+
+static int __fail(struct stream* stream, const char* message) {
+  snprintf(stream->error, sizeof(stream->error), "%s", message);
+  return -1;
+}
+
+static int __connect(const char* path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  if (connect(fd, (struct sockaddr*)&address, sizeof(address))) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Read messages until one of type `until`, whose payload is left in
+// *payload. The pitch and the notes received on the way are checked and
+// counted.
+static int __receive(struct stream* stream, int fd, uint32_t until, char** payload) {
+  for (;;) {
+    struct v2pd_header header;
+    if (v2pd_read_all(fd, &header, sizeof(header)))
+      return __fail(stream, "connection closed by the daemon");
+    if (header.size > V2PD_MAX_PAYLOAD_SIZE)
+      return __fail(stream, "message too large");
+    if (*payload)
+      stb__sbn(*payload) = 0;
+    char* bytes = sb_add(*payload, header.size + 1);
+    if (header.size && v2pd_read_all(fd, bytes, header.size))
+      return __fail(stream, "connection closed by the daemon");
+    bytes[header.size] = 0;
+
+    if (header.type == V2PD_ERROR)
+      return __fail(stream, bytes);
+    if (header.type == V2PD_PITCH) {
+      struct v2pd_pitch pitch;
+      if (header.size < sizeof(pitch))
+        return __fail(stream, "truncated pitch");
+      memcpy(&pitch, bytes, sizeof(pitch));
+      if (header.size != sizeof(pitch) + pitch.nb_timesteps * sizeof(float) ||
+          pitch.first_timestep != stream->nb_frames)
+        return __fail(stream, "pitch out of order");
+      stream->nb_frames += pitch.nb_timesteps;
+    } else if (header.type == V2PD_NOTES) {
+      if (header.size % sizeof(struct v2pd_note))
+        return __fail(stream, "truncated notes");
+      stream->nb_notes += header.size / sizeof(struct v2pd_note);
+    }
+    if (header.type == until)
+      return 0;
+  }
+}
+
+// Melody of the connection: a note per half second, a rest every fourth
+static void __generate(unsigned int index, uint64_t position, float sampling_rate, double* phase,
+  float* out, unsigned int size) {
+  for (unsigned int i = 0; i < size; i++) {
+    const uint64_t note = (position + i) / (uint64_t)(sampling_rate / 2);
+    if (note % 4 == 3) {
+      out[i] = 0;
+      continue;
+    }
+    const double midi_number = 50 + (index + note * 5) % 19;
+    const double frequency = 440 * pow(2, (midi_number - 69) / 12);
+    *phase = fmod(*phase + 2 * M_PI * frequency / sampling_rate, 2 * M_PI);
+    out[i] = (float)(0.5 * sin(*phase) + 0.2 * sin(2 * *phase));
+  }
+}
+
+// Send a message and read the answers until one of type `until`
+static int __request(struct stream* stream, int fd, uint32_t type, const void* data, size_t size,
+  uint32_t until, char** payload) {
+  if (v2pd_send(fd, type, data, size, NULL, 0))
+    return __fail(stream, "connection closed by the daemon");
+  return __receive(stream, fd, until, payload);
+}
+
+static int __run_stream(struct stream* stream, int fd, float* block, char** payload) {
+  const struct load_config* config = stream->config;
+  const struct v2pd_open open = { config->sampling_rate };
+  if (__request(stream, fd, V2PD_OPEN, &open, sizeof(open), V2PD_OPENED, payload))
+    return -1;
+
+  const uint64_t nb_samples = (uint64_t)(config->duration * config->sampling_rate);
+  const double start = __now();
+  double phase = 0;
+  for (uint64_t position = 0; position < nb_samples; position += config->block_size) {
+    unsigned int size = config->block_size;
+    if (size > nb_samples - position)
+      size = (unsigned int)(nb_samples - position);
+    __generate(stream->index, position, config->sampling_rate, &phase, block, size);
+    if (config->speed > 0)
+      __sleep_until(start + position / config->sampling_rate / config->speed);
+
+    const double sent = __now();
+    if (__request(stream, fd, V2PD_AUDIO, block, size * sizeof(*block), V2PD_PITCH, payload))
+      return -1;
+    sb_push(stream->latencies, __now() - sent);
+  }
+
+  if (__request(stream, fd, V2PD_FLUSH, NULL, 0, V2PD_DONE, payload) ||
+      __request(stream, fd, V2PD_STATS, NULL, 0, V2PD_STATS, payload))
+    return -1;
+  if (sb_count(*payload) != sizeof(stream->stats) + 1)
+    return __fail(stream, "truncated statistics");
+  memcpy(&stream->stats, *payload, sizeof(stream->stats));
+  if (stream->stats.nb_timesteps != stream->nb_frames)
+    return __fail(stream, "frames missing");
+  return 0;
+}
+
+static V2P_THREAD_ROUTINE(__stream_routine, arg) {
+  struct stream* stream = arg;
+  const int fd = __connect(stream->config->socket_path);
+  if (fd < 0) {
+    __fail(stream, "can't connect");
+    return V2P_THREAD_RETURN;
+  }
+  float* block = malloc(sizeof(*block) * stream->config->block_size);
+  char* payload = NULL;
+  stream->ok = block && !__run_stream(stream, fd, block, &payload);
+  close(fd);
+  sb_free(payload);
+  free(block);
+  return V2P_THREAD_RETURN;
+}
+
+static int __cmp_doubles(const void* a, const void* b) {
+  const double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// Percentile of sorted values
+static double __percentile(const double* values, unsigned int nb_values, double percent) {
+  if (!nb_values)
+    return 0;
+  return values[(unsigned int)(percent / 100 * (nb_values - 1) + 0.5)];
+}
+
+static int __usage(const char* program) {
+  fprintf(stderr, "usage: %s [-s socket] [-c nb_connections] [-d duration] [-b block_size]\n"
+    "       [-r sampling_rate] [-x speed]\n", program);
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  struct load_config config = { V2PD_DEFAULT_SOCKET, 200, 10, 480, 48000, 1 };
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc)
+      config.socket_path = argv[++i];
+    else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+      config.nb_connections = (unsigned int)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+      config.duration = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+      config.block_size = (unsigned int)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      config.sampling_rate = (float)atof(argv[++i]);
+    else if (!strcmp(argv[i], "-x") && i + 1 < argc)
+      config.speed = atof(argv[++i]);
+    else
+      return __usage(argv[0]);
+  }
+  if (!config.nb_connections || config.duration <= 0 || !config.block_size ||
+      config.block_size * sizeof(float) > V2PD_MAX_PAYLOAD_SIZE || config.sampling_rate <= 0 ||
+      config.speed < 0)
+    return __usage(argv[0]);
+
+  struct stream* streams = calloc(config.nb_connections, sizeof(*streams));
+  if (!streams)
+    return 1;
+  const double start = __now();
+  unsigned int nb_started = 0;
+  for (; nb_started < config.nb_connections; nb_started++) {
+    struct stream* stream = &streams[nb_started];
+    stream->config = &config;
+    stream->index = nb_started;
+    if (v2p_thread_create(&stream->thread, __stream_routine, stream)) {
+      fprintf(stderr, "v2pd-load: only %u threads could be created\n", nb_started);
+      break;
+    }
+  }
+  for (unsigned int i = 0; i < nb_started; i++)
+    v2p_thread_join(streams[i].thread);
+  const double wall_seconds = __now() - start;
+
+  double* latencies = NULL;
+  unsigned int nb_ok = 0;
+  uint64_t nb_frames = 0, nb_notes = 0, nb_samples = 0, peak_bytes = 0;
+  double daemon_p99_us = 0, daemon_max_us = 0;
+  for (unsigned int i = 0; i < nb_started; i++) {
+    const struct stream* stream = &streams[i];
+    if (!stream->ok) {
+      if (i < 10)
+        fprintf(stderr, "v2pd-load: connection %u failed: %s\n", i, stream->error);
+      continue;
+    }
+    nb_ok++;
+    sb_concat(latencies, stream->latencies, sb_count(stream->latencies));
+    nb_frames += stream->nb_frames;
+    nb_notes += stream->nb_notes;
+    nb_samples += stream->stats.nb_samples;
+    daemon_p99_us = _max(daemon_p99_us, stream->stats.latency_p99_us);
+    daemon_max_us = _max(daemon_max_us, stream->stats.latency_max_us);
+    peak_bytes = _max(peak_bytes, stream->stats.analyzer_peak_bytes);
+  }
+  const unsigned int nb_latencies = sb_count(latencies);
+  qsort(latencies, nb_latencies, sizeof(*latencies), __cmp_doubles);
+
+  const double audio_seconds = nb_samples / config.sampling_rate;
+  printf("connections          %u ok, %u failed\n", nb_ok, config.nb_connections - nb_ok);
+  printf("audio                %.1fs in %.1fs (%.1fx real time)\n", audio_seconds, wall_seconds,
+    wall_seconds > 0 ? audio_seconds / wall_seconds : 0);
+  printf("frames received      %llu (%.0f/s)\n", (unsigned long long)nb_frames,
+    wall_seconds > 0 ? nb_frames / wall_seconds : 0);
+  printf("notes received       %llu\n", (unsigned long long)nb_notes);
+  printf("round trip latency   p50 %.0fus, p90 %.0fus, p99 %.0fus, max %.0fus\n",
+    __percentile(latencies, nb_latencies, 50) * 1e6,
+    __percentile(latencies, nb_latencies, 90) * 1e6,
+    __percentile(latencies, nb_latencies, 99) * 1e6,
+    nb_latencies ? latencies[nb_latencies - 1] * 1e6 : 0);
+  printf("daemon latency       worst p99 %.0fus, max %.0fus\n", daemon_p99_us, daemon_max_us);
+  printf("analyzer peak        %llu bytes\n", (unsigned long long)peak_bytes);
+
+  for (unsigned int i = 0; i < config.nb_connections; i++)
+    sb_free(streams[i].latencies);
+  sb_free(latencies);
+  free(streams);
+  return nb_ok == config.nb_connections ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+#ifndef V2PD_PROTOCOL_H_
+#define V2PD_PROTOCOL_H_
+// Protocol between v2pd and its clients over a Unix domain socket.
+//
+// Every message is a struct v2pd_header followed by `size` bytes of
+// payload. Both ends are on the same host: the integers and floats are in
+// the byte order of the host.
+//
+// Client to daemon:
+//   V2PD_OPEN    struct v2pd_open. Start a new stream; answered by V2PD_OPENED.
+//                Optional: a connection starts with a stream at the
+//                sampling rate of the daemon.
+//   V2PD_AUDIO   float samples of the stream. Answered by the notes
+//                finalized by these samples, if any (V2PD_NOTES), then by
+//                the pitch of the timesteps settled by these samples
+//                (V2PD_PITCH, possibly without frame).
+//   V2PD_FLUSH   End of the stream. Answered by the last notes
+//                (V2PD_NOTES, if any), the final pitch of the timesteps
+//                not sent yet (V2PD_PITCH) and V2PD_DONE. The next samples
+//                start a new stream with the same settings.
+//   V2PD_STATS   Answered by V2PD_STATS with struct v2pd_stats.
+//
+// Daemon to client:
+//   V2PD_OPENED  struct v2pd_opened
+//   V2PD_PITCH   struct v2pd_pitch followed by a float frequency (Hz, 0
+//                for silences) per timestep
+//   V2PD_NOTES   struct v2pd_note array
+//   V2PD_DONE    no payload
+//   V2PD_STATS   struct v2pd_stats
+//   V2PD_ERROR   text of the error; the daemon closes the connection after.
+//
+// The pitch of a timestep is sent once, when `lag` timesteps follow it:
+// fixed-lag decoding (see v2p_compute_path_lagged). A note is sent once it's
+// followed by another one in the settled timesteps.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+//! Default path of the socket
+#define V2PD_DEFAULT_SOCKET "/tmp/v2pd.sock"
+//! Largest payload accepted by the daemon
+#define V2PD_MAX_PAYLOAD_SIZE (1u << 20)
+
+enum v2pd_message_type {
+  V2PD_OPEN = 1,
+  V2PD_AUDIO,
+  V2PD_FLUSH,
+  V2PD_STATS,
+  V2PD_OPENED,
+  V2PD_PITCH,
+  V2PD_NOTES,
+  V2PD_DONE,
+  V2PD_ERROR
+};
+
+struct v2pd_header {
+  uint32_t type;
+  //! Bytes of the payload following the header
+  uint32_t size;
+};
+
+struct v2pd_open {
+  //! 0 for the sampling rate of the daemon
+  float sampling_rate;
+};
+
+struct v2pd_opened {
+  float sampling_rate;
+  //! Seconds between two timesteps
+  float frame_time_step;
+  //! Timesteps following a timestep before its pitch is sent
+  uint32_t lag;
+  //! Identifier of the stream in the daemon logs and traces
+  uint32_t stream_id;
+};
+
+struct v2pd_pitch {
+  //! Timestep of the first frequency, from the start of the stream
+  uint32_t first_timestep;
+  uint32_t nb_timesteps;
+};
+
+struct v2pd_note {
+  //! Timestep of the start of the note, from the start of the stream
+  uint32_t first_timestep;
+  uint32_t nb_timesteps;
+  //! Rounded MIDI number: 69 = A4 = 440Hz
+  float midi_number;
+};
+
+//! Statistics of a connection, over all its streams
+struct v2pd_stats {
+  //! Samples received
+  uint64_t nb_samples;
+  //! V2PD_AUDIO messages received
+  uint64_t nb_audio_messages;
+  //! Timesteps analyzed, frames and notes sent
+  uint64_t nb_timesteps;
+  uint64_t nb_frames_sent;
+  uint64_t nb_notes_sent;
+  //! Seconds since the connection was accepted
+  double connected_seconds;
+  //! Seconds spent analyzing (from the reception of a V2PD_AUDIO message
+  //! to the last byte of its answer)
+  double busy_seconds;
+  //! Timesteps analyzed per second spent analyzing
+  double frames_per_second;
+  //! Latency of the V2PD_AUDIO messages, over the last V2PD_LATENCY_WINDOW
+  //! ones, in microseconds (the maximum is over all of them)
+  double latency_p50_us;
+  double latency_p90_us;
+  double latency_p99_us;
+  double latency_max_us;
+  //! Bytes held by the analyzer of the connection and their high-water
+  //! mark (see v2p_memory_usage)
+  uint64_t analyzer_bytes;
+  uint64_t analyzer_peak_bytes;
+};
+
+//! Latencies kept by the daemon for the percentiles of a connection
+#define V2PD_LATENCY_WINDOW 4096
+
+//! Read the whole buffer, retrying after signals.
+//! @return 0 on success, -1 on failure or at the end of the stream.
+static inline int v2pd_read_all(int fd, void* buffer, size_t size) {
+  char* bytes = (char*)buffer;
+  while (size) {
+    const ssize_t nb_read = read(fd, bytes, size);
+    if (nb_read < 0 && errno == EINTR)
+      continue;
+    if (nb_read <= 0)
+      return -1;
+    bytes += nb_read;
+    size -= (size_t)nb_read;
+  }
+  return 0;
+}
+
+//! Send a message made of a header, `first` and `second` (which can be
+//! empty), in a single call when the socket accepts it all.
+//! @return 0 on success, -1 on failure (errno is set).
+static inline int v2pd_send(int fd, uint32_t type, const void* first, size_t first_size,
+  const void* second, size_t second_size) {
+  const struct v2pd_header header = { type, (uint32_t)(first_size + second_size) };
+  struct iovec parts[3] = {
+    { (void*)&header, sizeof(header) }, { (void*)first, first_size }, { (void*)second, second_size }
+  };
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = parts;
+  message.msg_iovlen = 3;
+  while (message.msg_iovlen) {
+#ifdef MSG_NOSIGNAL
+    ssize_t nb_written = sendmsg(fd, &message, MSG_NOSIGNAL);
+#else
+    ssize_t nb_written = sendmsg(fd, &message, 0);
+#endif
+    if (nb_written < 0 && errno == EINTR)
+      continue;
+    if (nb_written < 0)
+      return -1;
+    // Skip what was written
+    while (message.msg_iovlen && (size_t)nb_written >= message.msg_iov->iov_len) {
+      nb_written -= (ssize_t)message.msg_iov->iov_len;
+      message.msg_iov++;
+      message.msg_iovlen--;
+    }
+    if (message.msg_iovlen) {
+      message.msg_iov->iov_base = (char*)message.msg_iov->iov_base + nb_written;
+      message.msg_iov->iov_len -= (size_t)nb_written;
+    }
+  }
+  return 0;
+}
+
+#endif /* !V2PD_PROTOCOL_H_ */